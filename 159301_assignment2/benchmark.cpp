@@ -0,0 +1,1838 @@
+#include <chrono>
+#include <iomanip>
+#include <thread>
+#include <atomic>
+#include <sstream>
+#include <string.h>
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define BENCH_RDTSC
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define BENCH_RDTSC
+#endif
+
+#include "benchmark.h"
+#include "fuzzylogic.h"
+#include "fuzzyops.h"
+#include "fuzzyfit.h"
+#include "fuzzyfixed.h"
+#include "membership.h"
+#include "pendulum.h"
+#include "transform.h"
+#include "display.h"
+#include "recorder.h"
+#include "plot.h"
+#include "surface.h"
+#include "simulation.h"
+#include "disturbance.h"
+#include "replay.h"
+#include "checkpoint.h"
+
+/////////////////////////////////////////////////////////////////
+
+//Time stamp counter on x86, steady_clock nanoseconds elsewhere; in BENCH_TICKS
+static unsigned long long benchTicks() {
+#ifdef BENCH_RDTSC
+	return __rdtsc();
+#else
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+#ifdef BENCH_RDTSC
+static const char *BENCH_TICKS = "cycles";
+#else
+static const char *BENCH_TICKS = "ns";
+#endif
+
+static const int BENCH_GRID_POINTS = 200;
+static const int BENCH_REPEATS = 20;
+
+//Inputs covering every membership function of both Yamakawa inputs
+static void fillBenchmarkInputs(float grid[][2], int n) {
+	for (int row = 0; row < n; row++) {
+		for (int col = 0; col < n; col++) {
+			grid[row * n + col][in_theta_and_theta_dot] = -0.25f + 0.5f * col / float(n - 1);
+			grid[row * n + col][in_x_and_x_dot] = -2.5f + 5.0f * row / float(n - 1);
+		}
+	}
+}
+
+template <class TNorm, class Defuzz>
+static void benchmarkKernel(const char *tnormName, const char *defuzzName, const fuzzy_system_rec &fz, float grid[][2], int count) {
+	int misses = 0;
+	double checksum = 0.0;
+	float out;
+
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		for (int i = 0; i < count; i++) {
+			if (fuzzy_system_kernel<TNorm, Defuzz>(grid[i], fz, out))
+				checksum += fabs(out);
+			else
+				misses++;
+		}
+	}
+	chrono::high_resolution_clock::time_point stop = chrono::high_resolution_clock::now();
+
+	double ns = chrono::duration<double, nano>(stop - start).count() / (double(count) * BENCH_REPEATS);
+	cout << setw(12) << tnormName << setw(18) << defuzzName
+		<< setw(12) << fixed << setprecision(1) << ns
+		<< setw(14) << setprecision(3) << checksum / (double(count) * BENCH_REPEATS)
+		<< setw(10) << misses / BENCH_REPEATS << endl;
+}
+
+template <class TNorm>
+static void benchmarkDefuzzRow(const char *tnormName, const fuzzy_system_rec &fz, float grid[][2], int count) {
+	benchmarkKernel<TNorm, weighted_average_defuzz>(tnormName, "weighted_avg", fz, grid, count);
+	benchmarkKernel<TNorm, centroid_defuzz>(tnormName, "centroid", fz, grid, count);
+	benchmarkKernel<TNorm, bisector_defuzz>(tnormName, "bisector", fz, grid, count);
+	benchmarkKernel<TNorm, mean_of_maximum_defuzz>(tnormName, "mean_of_max", fz, grid, count);
+}
+
+void benchmarkFuzzyOperators() {
+	fuzzy_system_rec fz;
+	const int count = BENCH_GRID_POINTS * BENCH_GRID_POINTS;
+	float(*grid)[2] = new float[count][2];
+
+	initFuzzySystem(&fz);
+	fz.hamacher_gamma = 0.0f;
+	fillBenchmarkInputs(grid, BENCH_GRID_POINTS);
+
+	cout << "Fuzzy operator matrix (" << count << " inputs x " << BENCH_REPEATS << " repeats)" << endl;
+	cout << setw(12) << "t-norm" << setw(18) << "defuzzifier"
+		<< setw(12) << "ns/call" << setw(14) << "mean |F|" << setw(10) << "no fire" << endl;
+
+	benchmarkDefuzzRow<min_tnorm>("min", fz, grid, count);
+	benchmarkDefuzzRow<product_tnorm>("product", fz, grid, count);
+	benchmarkDefuzzRow<lukasiewicz_tnorm>("lukasiewicz", fz, grid, count);
+	benchmarkDefuzzRow<hamacher_tnorm>("hamacher", fz, grid, count);
+
+	//Same combination through the runtime-dispatched entry point, for comparison
+	float out;
+	int misses = 0;
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		for (int i = 0; i < count; i++) {
+			if (!select_fuzzy_kernel(fz)(grid[i], fz, out))
+				misses++;
+		}
+	}
+	chrono::high_resolution_clock::time_point stop = chrono::high_resolution_clock::now();
+	cout << "dispatched min/weighted_avg: " << fixed << setprecision(1)
+		<< chrono::duration<double, nano>(stop - start).count() / (double(count) * BENCH_REPEATS) << " ns/call" << endl << endl;
+
+	delete[] grid;
+	free_fuzzy_rules(&fz);
+}
+
+/////////////////////////////////////////////////////////////////
+
+static const int MAX_RULES_FOR_REFERENCE = 64;
+
+//Reference Mamdani centroid over a sampled output universe (min AND, double precision)
+static bool discretizedMamdani(const float inputs[], const fuzzy_system_rec &fz, int samples, float &out) {
+	float weight[MAX_RULES_FOR_REFERENCE];
+	for (int i = 0; i < fz.no_of_rules; i++) {
+		const rule &r = fz.rules[i];
+		float m_values[MAX_NO_OF_INPUTS];
+		for (int j = 0; j < fz.no_of_inputs; j++)
+			m_values[j] = trapz(inputs[r.inp_index[j]], fz.inp_mem_fns[r.inp_index[j]][r.inp_fuzzy_set[j]]);
+		weight[i] = min_of(m_values, fz.no_of_inputs);
+	}
+
+	double lo = fz.out_mem_fns[0].a, hi = fz.out_mem_fns[0].d;
+	for (int k = 1; k < fz.no_of_outputs; k++) {
+		lo = min(lo, (double)fz.out_mem_fns[k].a);
+		hi = max(hi, (double)fz.out_mem_fns[k].d);
+	}
+
+	double area = 0.0, moment = 0.0, dx = (hi - lo) / (samples - 1);
+	for (int n = 0; n < samples; n++) {
+		double x = lo + n * dx, y = 0.0;
+		for (int i = 0; i < fz.no_of_rules; i++) {
+			double mu = trapz((float)x, fz.out_mem_fns[fz.rules[i].out_fuzzy_set]);
+			double implied = (fz.implication == implication_clip) ? min(mu, (double)weight[i]) : mu * weight[i];
+			if (fz.aggregation == aggregation_sum)
+				y += implied;
+			else
+				y = max(y, implied);
+		}
+		double w = (n == 0 || n == samples - 1) ? 0.5 : 1.0;
+		area += w * y;
+		moment += w * y * x;
+	}
+	if (area < TOO_SMALL)
+		return false;
+	out = (float)(moment / area);
+	return true;
+}
+
+static void benchmarkMamdaniCase(const char *name, fuzzy_system_rec &fz, implication_type implication,
+	aggregation_type aggregation, float grid[][2], int count) {
+	const int samples = 2001;
+	float out, ref;
+	double maxError = 0.0;
+
+	fz.inference = mamdani_consequents;
+	fz.implication = implication;
+	fz.aggregation = aggregation;
+	fuzzy_kernel_fn kernel = select_fuzzy_kernel(fz);
+
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		for (int i = 0; i < count; i++)
+			kernel(grid[i], fz, out);
+	}
+	double ns = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / (double(count) * BENCH_REPEATS);
+
+	start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < count; i++) {
+		bool fired = kernel(grid[i], fz, out);
+		if (discretizedMamdani(grid[i], fz, samples, ref) && fired)
+			maxError = max(maxError, fabs((double)out - ref));
+	}
+	double refNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / count;
+
+	cout << setw(14) << name << setw(14) << fixed << setprecision(1) << ns
+		<< setw(16) << refNs << setw(14) << setprecision(5) << maxError << endl;
+}
+
+void benchmarkMamdani() {
+	fuzzy_system_rec fz;
+	const int count = BENCH_GRID_POINTS * BENCH_GRID_POINTS;
+	float(*grid)[2] = new float[count][2];
+	float out;
+
+	initFuzzySystem(&fz);
+	fillBenchmarkInputs(grid, BENCH_GRID_POINTS);
+
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		for (int i = 0; i < count; i++)
+			fuzzy_system_kernel<min_tnorm, weighted_average_defuzz>(grid[i], fz, out);
+	}
+	double ns = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / (double(count) * BENCH_REPEATS);
+
+	cout << "Mamdani centroid vs. discretized reference (" << count << " inputs)" << endl;
+	cout << setw(14) << "singleton" << setw(14) << fixed << setprecision(1) << ns << " ns/call" << endl;
+	cout << setw(14) << "mamdani" << setw(14) << "ns/call" << setw(16) << "ref ns/call" << setw(14) << "max |error|" << endl;
+	benchmarkMamdaniCase("clip/max", fz, implication_clip, aggregation_max, grid, count);
+	benchmarkMamdaniCase("scale/max", fz, implication_scale, aggregation_max, grid, count);
+	benchmarkMamdaniCase("clip/sum", fz, implication_clip, aggregation_sum, grid, count);
+	benchmarkMamdaniCase("scale/sum", fz, implication_scale, aggregation_sum, grid, count);
+	cout << endl;
+
+	delete[] grid;
+	free_fuzzy_rules(&fz);
+}
+
+/////////////////////////////////////////////////////////////////
+
+static const int BENCH_TSK_RUNS = 16, BENCH_TSK_STEPS = 5000;
+
+//The stock controller's runs from across its stable range, to fit a TSK controller to
+static void recordTeacherRuns(const fuzzy_system_rec &teacher, vector<tsk_sample> &samples) {
+	float initialAngles[BENCH_TSK_RUNS];
+	for (int run = 0; run < BENCH_TSK_RUNS; run++)
+		initialAngles[run] = (-3.0f + 6.0f * run / (BENCH_TSK_RUNS - 1)) * M_PI / 180.0f;  //the teacher's stable range
+	record_tsk_samples(teacher, initialAngles, BENCH_TSK_RUNS, BENCH_TSK_STEPS, 0.002f, defaultPlantParameters(), samples);
+}
+
+//The fitted TSK controller of benchmarkTskFit, which holds the pole where
+//the stock controller lets it fall
+static bool initBalancingController(fuzzy_system_rec *tsk) {
+	fuzzy_system_rec teacher;
+	vector<tsk_sample> samples;
+	initFuzzySystem(&teacher);
+	recordTeacherRuns(teacher, samples);
+	free_fuzzy_rules(&teacher);
+	initTskFuzzySystem(tsk);
+	return fit_tsk_consequents(tsk, samples, 0, 1e-3f);
+}
+
+void benchmarkTskFit() {
+	const int steps = BENCH_TSK_STEPS;
+	const float h = 0.002f;
+	fuzzy_system_rec teacher, tsk;
+	vector<tsk_sample> samples;
+
+	initFuzzySystem(&teacher);
+	recordTeacherRuns(teacher, samples);
+
+	cout << "TSK fit: 9-rule first-order controller vs. 25-rule singleton teacher ("
+		<< samples.size() << " samples)" << endl;
+
+	initTskFuzzySystem(&tsk);
+	cout << "  rms error, zero-order start: " << fixed << setprecision(3) << tsk_rms_error(tsk, samples) << endl;
+
+	int threadCounts[2] = { 1, 0 };
+	for (int t = 0; t < 2; t++) {
+		init_tsk_consequents(&tsk);
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		bool ok = fit_tsk_consequents(&tsk, samples, threadCounts[t], 1e-3f);
+		double ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+		cout << "  fit (" << (threadCounts[t] ? "1 thread" : "all threads") << "): " << setprecision(2) << ms << " ms, "
+			<< (ok ? "rms error " : "singular system, rms error ") << setprecision(3) << tsk_rms_error(tsk, samples) << endl;
+	}
+
+	//closed loop with the fitted controller
+	WorldStateType s;
+	float inputs[MAX_NO_OF_INPUTS], state[MAX_NO_OF_STATE_VARS], out;
+	float peak = 0.0f;
+	int n;
+	s.init();
+	s.angle = 2.5f * M_PI / 180.0f;
+	for (n = 0; n < steps; n++) {
+		getControllerInputs(s, inputs);
+		getStateVector(s, state);
+		if (!fuzzy_system_tsk_kernel<min_tnorm>(inputs, state, tsk, out))
+			break;
+		s.F = out;
+		stepPendulum(s, h, defaultPlantParameters());
+		if (n > steps / 2)
+			peak = max(peak, (float)fabs(s.angle));
+	}
+	cout << "  closed loop from 2.5 deg: " << n * h << " s simulated, late max |angle| = "
+		<< setprecision(2) << peak * 180.0f / M_PI << " deg" << endl;
+
+	//evaluation cost
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	double checksum = 0.0;
+	for (size_t k = 0; k < samples.size(); k++) {
+		if (fuzzy_system_tsk_kernel<min_tnorm>(samples[k].inputs, samples[k].state, tsk, out))
+			checksum += out;
+	}
+	double tskNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / samples.size();
+	start = chrono::high_resolution_clock::now();
+	for (size_t k = 0; k < samples.size(); k++) {
+		if (fuzzy_system_kernel<min_tnorm, weighted_average_defuzz>(samples[k].inputs, teacher, out))
+			checksum += out;
+	}
+	double teacherNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / samples.size();
+	cout << "  eval: tsk " << setprecision(1) << tskNs << " ns/call, teacher " << teacherNs
+		<< " ns/call (checksum " << checksum << ")" << endl << endl;
+
+	free_fuzzy_rules(&tsk);
+	free_fuzzy_rules(&teacher);
+}
+
+/////////////////////////////////////////////////////////////////
+
+static const int BENCH_MF_POINTS = 4096;
+
+//Membership degree evaluated in double precision straight from the shape's definition
+static double referenceMembership(double x, const trapezoid &mf) {
+	switch (mf.tp) {
+	case regular_trapezoid:
+	case triangle:
+		if (x <= mf.a || x >= mf.d)
+			return 0.0;
+		if (x < mf.b)
+			return (x - mf.a) / ((double)mf.b - mf.a);
+		if (x > mf.c)
+			return ((double)mf.d - x) / ((double)mf.d - mf.c);
+		return 1.0;
+	case left_trapezoid:
+		if (x <= mf.a)
+			return 1.0;
+		return (x >= mf.b) ? 0.0 : ((double)mf.b - x) / ((double)mf.b - mf.a);
+	case right_trapezoid:
+		if (x <= mf.a)
+			return 0.0;
+		return (x >= mf.b) ? 1.0 : (x - mf.a) / ((double)mf.b - mf.a);
+	case gaussian:
+		return exp(-(x - mf.a) * (x - mf.a) / (2.0 * mf.b * mf.b));
+	case generalized_bell:
+		return 1.0 / (1.0 + pow(fabs((x - mf.c) / mf.a), 2.0 * mf.b));
+	case sigmoid:
+		return 1.0 / (1.0 + exp(-mf.a * (x - mf.c)));
+	case piecewise_linear:
+		if (x <= mf.px[0])
+			return mf.py[0];
+		for (int i = 1; i < mf.no_of_points; i++) {
+			if (x <= mf.px[i])
+				return mf.py[i - 1] + ((double)mf.py[i] - mf.py[i - 1]) * (x - mf.px[i - 1]) / ((double)mf.px[i] - mf.px[i - 1]);
+		}
+		return mf.py[mf.no_of_points - 1];
+	}
+	return 0.0;
+}
+
+static void benchmarkShape(const char *name, const trapezoid &mf, const float x[], float mu[], int n) {
+	double checksum = 0.0, maxRefError = 0.0, maxScalarDiff = 0.0;
+
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		for (int k = 0; k < n; k++)
+			checksum += trapz(x[k], mf);
+	}
+	double scalarNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / (double(n) * BENCH_REPEATS);
+
+	start = chrono::high_resolution_clock::now();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		membership_many(mf, x, mu, n);
+		checksum += mu[r % n];
+	}
+	double batchNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / (double(n) * BENCH_REPEATS);
+
+	for (int k = 0; k < n; k++) {
+		maxRefError = max(maxRefError, fabs(mu[k] - referenceMembership(x[k], mf)));
+		maxScalarDiff = max(maxScalarDiff, fabs((double)mu[k] - trapz(x[k], mf)));
+	}
+
+	cout << setw(18) << name << setw(12) << fixed << setprecision(2) << scalarNs << setw(12) << batchNs
+		<< setw(14) << scientific << setprecision(2) << maxRefError << setw(14) << maxScalarDiff
+		<< fixed << "   (checksum " << setprecision(1) << checksum << ")" << endl;
+}
+
+void benchmarkMembershipShapes() {
+	const float pwlX[5] = { -0.8f, -0.3f, 0.0f, 0.2f, 0.9f };
+	const float pwlY[5] = { 0.0f, 0.7f, 1.0f, 0.4f, 0.0f };
+	vector<float> x(BENCH_MF_POINTS), mu(BENCH_MF_POINTS);
+
+	for (int k = 0; k < BENCH_MF_POINTS; k++)
+		x[k] = -1.0f + 2.0f * k / float(BENCH_MF_POINTS - 1);
+
+	cout << "Membership shapes (" << BENCH_MF_POINTS << " points x " << BENCH_REPEATS << " repeats)" << endl;
+	cout << setw(18) << "shape" << setw(12) << "trapz ns" << setw(12) << "batch ns"
+		<< setw(14) << "max |ref err|" << setw(14) << "max |trapz|" << endl;
+
+	benchmarkShape("regular_trapezoid", init_trapz(-0.6f, -0.2f, 0.3f, 0.7f, regular_trapezoid), &x[0], &mu[0], BENCH_MF_POINTS);
+	benchmarkShape("left_trapezoid", init_trapz(-0.4f, 0.2f, 0.0f, 0.0f, left_trapezoid), &x[0], &mu[0], BENCH_MF_POINTS);
+	benchmarkShape("right_trapezoid", init_trapz(-0.1f, 0.5f, 0.0f, 0.0f, right_trapezoid), &x[0], &mu[0], BENCH_MF_POINTS);
+	benchmarkShape("triangle", init_triangle(-0.5f, 0.1f, 0.6f), &x[0], &mu[0], BENCH_MF_POINTS);
+	benchmarkShape("gaussian", init_gaussian(0.1f, 0.3f), &x[0], &mu[0], BENCH_MF_POINTS);
+	benchmarkShape("generalized_bell", init_gbell(0.4f, 2.5f, -0.1f), &x[0], &mu[0], BENCH_MF_POINTS);
+	benchmarkShape("sigmoid", init_sigmoid(8.0f, 0.2f), &x[0], &mu[0], BENCH_MF_POINTS);
+	benchmarkShape("piecewise_linear", init_pwl(pwlX, pwlY, 5), &x[0], &mu[0], BENCH_MF_POINTS);
+
+	//Whole-controller fuzzification with a mix of shapes on the angle input
+	fuzzy_system_rec fz;
+	const int count = BENCH_GRID_POINTS * BENCH_GRID_POINTS;
+	float(*grid)[2] = new float[count][2];
+	float degrees[MAX_NO_OF_INPUTS][MAX_NO_OF_INP_REGIONS], batchDegrees[MAX_NO_OF_INPUTS][MAX_NO_OF_INP_REGIONS];
+	membership_batch batch;
+	double checksum = 0.0, maxDiff = 0.0;
+
+	initFuzzySystem(&fz);
+	fz.inp_mem_fns[in_theta_and_theta_dot][in_nm] = init_sigmoid(-60.0f, -0.12f);
+	fz.inp_mem_fns[in_theta_and_theta_dot][in_ns] = init_gaussian(-0.09f, 0.03f);
+	fz.inp_mem_fns[in_theta_and_theta_dot][in_ze] = init_gbell(0.04f, 2.0f, 0.0f);
+	fz.inp_mem_fns[in_theta_and_theta_dot][in_ps] = init_gaussian(0.09f, 0.03f);
+	fz.inp_mem_fns[in_theta_and_theta_dot][in_pm] = init_sigmoid(60.0f, 0.12f);
+	batch.build(fz);
+	fillBenchmarkInputs(grid, BENCH_GRID_POINTS);
+
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		for (int i = 0; i < count; i++) {
+			fuzzify_inputs(grid[i], fz, degrees);
+			checksum += degrees[0][r % MAX_NO_OF_INP_REGIONS];
+		}
+	}
+	double scalarNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / (double(count) * BENCH_REPEATS);
+
+	start = chrono::high_resolution_clock::now();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		for (int i = 0; i < count; i++) {
+			batch.evaluate(grid[i], batchDegrees);
+			checksum += batchDegrees[0][r % MAX_NO_OF_INP_REGIONS];
+		}
+	}
+	double batchNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / (double(count) * BENCH_REPEATS);
+
+	for (int i = 0; i < count; i++) {
+		fuzzify_inputs(grid[i], fz, degrees);
+		batch.evaluate(grid[i], batchDegrees);
+		for (int j = 0; j < fz.no_of_inputs; j++) {
+			for (int k = 0; k < fz.no_of_inp_regions; k++)
+				maxDiff = max(maxDiff, (double)fabs(degrees[j][k] - batchDegrees[j][k]));
+		}
+	}
+
+	cout << "  fuzzify 2x5 mixed shapes: fuzzify_inputs " << setprecision(1) << scalarNs
+		<< " ns/call, membership_batch " << batchNs << " ns/call, max diff "
+		<< scientific << setprecision(2) << maxDiff << fixed << " (checksum " << setprecision(1) << checksum << ")" << endl << endl;
+
+	delete[] grid;
+	free_fuzzy_rules(&fz);
+}
+
+/////////////////////////////////////////////////////////////////
+
+//Same grid as generateControlSurface_Angle_vs_Angle_Dot
+static const int SURFACE_POINTS = 100;
+
+//One fixed-point engine's line against the float engine's outputs
+static void reportFixedError(const char *name, const vector<float> &inputs, const vector<float> &floatOut, const vector<bool> &floatFired,
+	const vector<float> &fixedOut, const vector<bool> &fixedFired) {
+	double maxError = 0.0, sumError = 0.0;
+	int worst = 0, firingMismatches = 0, count = (int)floatOut.size();
+	for (int i = 0; i < count; i++) {
+		if (floatFired[i] != fixedFired[i]) {
+			firingMismatches++;
+			continue;
+		}
+		if (!floatFired[i])
+			continue;
+		double e = fabs((double)floatOut[i] - fixedOut[i]);
+		sumError += e;
+		if (e > maxError) {
+			maxError = e;
+			worst = i;
+		}
+	}
+	cout << "  " << name << " max |F error| " << scientific << setprecision(3) << maxError << " N at inputs (" << fixed << setprecision(4)
+		<< inputs[worst * 2] << ", " << inputs[worst * 2 + 1] << "), mean " << scientific << sumError / count << fixed
+		<< " N, firing mismatches " << firingMismatches << endl;
+}
+
+void benchmarkFixedPoint() {
+	fuzzy_system_rec fz;
+	fuzzy_fixed_rec fx;
+	fuzzy_fixed31_rec fx31;
+	const int count = SURFACE_POINTS * SURFACE_POINTS;
+	vector<float> inputs(count * 2);
+	vector<int32_t> fixedInputs(count * 2), fixed31Inputs(count * 2);
+	vector<float> floatOut(count), fixedOut(count), fixed31Out(count);
+	vector<bool> floatFired(count), fixedFired(count), fixed31Fired(count);
+	float const h = 0.002f;
+
+	initFuzzySystem(&fz);
+	init_fuzzy_fixed(fz, &fx);
+	init_fuzzy_fixed31(fz, &fx31);
+
+	float angle_dot = -0.3f;
+	float angle_dot_increment = (0.3f - -0.3f) / float(SURFACE_POINTS);
+	float minAngle = (-12.0f)* M_PI / 180.0f;
+	float angle_increment = ((12.0f)* M_PI / 180.0f - minAngle) / float(SURFACE_POINTS);
+	for (int row = 0; row < SURFACE_POINTS; row++) {
+		float angle = minAngle;
+		for (int col = 0; col < SURFACE_POINTS; col++) {
+			int i = row * SURFACE_POINTS + col;
+			getSurfaceInputs(angle, angle_dot, h, defaultPlantParameters(), &inputs[i * 2]);
+			for (int j = 0; j < 2; j++) {
+				fixedInputs[i * 2 + j] = fixed_input(inputs[i * 2 + j], fx, j);
+				fixed31Inputs[i * 2 + j] = fixed31_input(inputs[i * 2 + j], fx31, j);
+			}
+			angle = angle + angle_increment;
+		}
+		angle_dot = angle_dot + angle_dot_increment;
+	}
+
+	float out;
+	int32_t fixedY;
+	unsigned long long start = benchTicks();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		for (int i = 0; i < count; i++) {
+			floatFired[i] = fuzzy_system_kernel<min_tnorm, weighted_average_defuzz>(&inputs[i * 2], fz, out);
+			floatOut[i] = out;
+		}
+	}
+	double floatCycles = double(benchTicks() - start) / (double(count) * BENCH_REPEATS);
+
+	start = benchTicks();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		for (int i = 0; i < count; i++) {
+			fixedFired[i] = fuzzy_system_fixed(&fixedInputs[i * 2], fx, fixedY);
+			fixedOut[i] = fixed_output_to_float(fixedY, fx);
+		}
+	}
+	double fixedCycles = double(benchTicks() - start) / (double(count) * BENCH_REPEATS);
+
+	start = benchTicks();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		for (int i = 0; i < count; i++) {
+			fixed31Fired[i] = fuzzy_system_fixed31(&fixed31Inputs[i * 2], fx31, fixedY);
+			fixed31Out[i] = fixed31_output_to_float(fixedY, fx31);
+		}
+	}
+	double fixed31Cycles = double(benchTicks() - start) / (double(count) * BENCH_REPEATS);
+
+	cout << "Fixed-point engines over the " << SURFACE_POINTS << "x" << SURFACE_POINTS << " control surface (Q15: "
+		<< "inputs Q" << 15 - fx.inp_frac_bits[0] << "." << fx.inp_frac_bits[0]
+		<< " / Q" << 15 - fx.inp_frac_bits[1] << "." << fx.inp_frac_bits[1]
+		<< ", output Q" << 15 - fx.out_frac_bits << "." << fx.out_frac_bits << "; Q31: inputs Q"
+		<< 31 - fx31.inp_frac_bits[0] << "." << fx31.inp_frac_bits[0]
+		<< " / Q" << 31 - fx31.inp_frac_bits[1] << "." << fx31.inp_frac_bits[1]
+		<< ", output Q" << 31 - fx31.out_frac_bits << "." << fx31.out_frac_bits << ")" << endl;
+	cout << "  " << BENCH_TICKS << "/call: float " << fixed << setprecision(1) << floatCycles << ", Q15 " << fixedCycles
+		<< ", Q31 " << fixed31Cycles << endl;
+	reportFixedError("Q15", inputs, floatOut, floatFired, fixedOut, fixedFired);
+	reportFixedError("Q31", inputs, floatOut, floatFired, fixed31Out, fixed31Fired);
+	cout << endl;
+
+	free_fuzzy_rules(&fz);
+}
+
+/////////////////////////////////////////////////////////////////
+
+static const int BENCH_VERTICES = 4096;
+
+void benchmarkViewportTransform() {
+	//the boundaries initPendulumWorld sets up in a 1280x1024 window
+	BoundaryType world = { -2.4f, 3.0f, 2.4f, -0.4f };
+	BoundaryType dev = { 1279 / 10, 1023 / 9, 1279 - 1279 / 10, 1023 - 1023 / 9 };
+	ViewportTransform view(world, dev);
+
+	vector<float> points(2 * BENCH_VERTICES);
+	vector<int> legacy(2 * BENCH_VERTICES), scalar(2 * BENCH_VERTICES), batch(2 * BENCH_VERTICES);
+	srand(1);
+	for (int i = 0; i < BENCH_VERTICES; i++) {
+		points[2 * i] = -3.0f + 6.0f * rand() / RAND_MAX;
+		points[2 * i + 1] = -1.0f + 4.5f * rand() / RAND_MAX;
+	}
+
+	unsigned long long start = benchTicks();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		for (int i = 0; i < BENCH_VERTICES; i++) {
+			legacy[2 * i] = xDev(world, dev, points[2 * i]);
+			legacy[2 * i + 1] = yDev(world, dev, points[2 * i + 1]);
+		}
+	}
+	double legacyCycles = double(benchTicks() - start) / (double(BENCH_VERTICES) * BENCH_REPEATS);
+
+	start = benchTicks();
+	for (int r = 0; r < BENCH_REPEATS; r++) {
+		for (int i = 0; i < BENCH_VERTICES; i++) {
+			scalar[2 * i] = view.x(points[2 * i]);
+			scalar[2 * i + 1] = view.y(points[2 * i + 1]);
+		}
+	}
+	double scalarCycles = double(benchTicks() - start) / (double(BENCH_VERTICES) * BENCH_REPEATS);
+
+	start = benchTicks();
+	for (int r = 0; r < BENCH_REPEATS; r++)
+		view.map(&points[0], &batch[0], BENCH_VERTICES);
+	double batchCycles = double(benchTicks() - start) / (double(BENCH_VERTICES) * BENCH_REPEATS);
+
+	int mismatches = 0;
+	for (int i = 0; i < 2 * BENCH_VERTICES; i++) {
+		if (scalar[i] != legacy[i] || batch[i] != legacy[i])
+			mismatches++;
+	}
+
+	cout << "World-to-device transform, " << BENCH_VERTICES << " vertices" << endl;
+	cout << "  " << BENCH_TICKS << "/vertex: xDev+yDev " << fixed << setprecision(1) << legacyCycles << ", ViewportTransform x+y "
+		<< scalarCycles << ", map() " << batchCycles << endl;
+	cout << "  " << mismatches << " coordinates differ from xDev/yDev" << endl << endl;
+}
+
+/////////////////////////////////////////////////////////////////
+
+static const long BENCH_SIM_STEPS = 1500;  //3 s at h = 0.002
+static const int BENCH_STALL_EVERY = 25;
+static const int BENCH_STALL_MS = 40;
+
+//The simulation thread against a display that stalls for 40 ms every 25
+//frames: control ticks late, frames the display saw, and snapshots that do
+//not match a single-threaded run of the same steps
+void benchmarkSimulationThread() {
+	fuzzy_system_rec fz;
+	initFuzzySystem(&fz);
+	WorldStateType s;
+	s.init();
+	s.angle = 8.0f * (M_PI / 180.0f);
+
+	vector<float> x(BENCH_SIM_STEPS + 1), angle(BENCH_SIM_STEPS + 1);
+	WorldStateType reference(s);
+	float inputs[2];
+	x[0] = reference.x;
+	angle[0] = reference.angle;
+	for (long step = 1; step <= BENCH_SIM_STEPS; step++) {
+		getControllerInputs(reference, inputs);
+		reference.F = fuzzy_system(inputs, fz);
+		stepPendulum(reference, 0.002f, defaultPlantParameters());
+		x[step] = reference.x;
+		angle[step] = reference.angle;
+	}
+
+	PendulumSimulation simulation(&fz, 0.002f);
+	long seen = 0, mismatched = 0, backwards = 0, last = -1;
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	simulation.start(s, BENCH_SIM_STEPS);
+	while (simulation.running()) {
+		if (!simulation.update()) {
+			this_thread::sleep_for(chrono::microseconds(200));
+			continue;
+		}
+		const SimulationFrame &f = simulation.latest();
+		mismatched += f.state.x != x[f.step] || f.state.angle != angle[f.step];
+		backwards += f.step <= last;
+		last = f.step;
+		if (++seen % BENCH_STALL_EVERY == 0)
+			this_thread::sleep_for(chrono::milliseconds(BENCH_STALL_MS));
+	}
+	simulation.stop();
+	double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+	cout << "Simulation thread, " << BENCH_SIM_STEPS << " ticks of 2 ms, display stalling " << BENCH_STALL_MS
+		<< " ms every " << BENCH_STALL_EVERY << " frames" << endl;
+	const TickStats &ticks = simulation.tickStats();
+	cout << "  " << fixed << setprecision(2) << seconds << " s wall time for " << BENCH_SIM_STEPS * 0.002 << " s simulated, "
+		<< ticks.misses() << " deadlines missed, worst jitter " << setprecision(3) << ticks.worstUs() / 1e3 << " ms" << endl;
+	cout << "  display saw " << seen << " frames, " << mismatched << " differ from a single-threaded run, "
+		<< backwards << " out of order" << endl << endl;
+	free_fuzzy_rules(&fz);
+}
+
+static const long BENCH_RT_STEPS = 1000;  //2 s at h = 0.002
+
+//One busy thread of synthetic load
+static void burnCpu(const atomic<bool> *stop, volatile double *sink) {
+	double x = 1.0;
+	while (!stop->load(memory_order_relaxed))
+		for (int i = 0; i < 10000; i++)
+			x = x * 1.0000001 + 1e-9;
+	*sink = x;
+}
+
+//PendulumSimulation ticks with and without a busy thread on every CPU, for
+//plain absolute sleeps, a busy-wait tail and a pinned thread
+void benchmarkRealtimeLoop() {
+	struct { const char *name; bool load; RealtimeOptions options; } configs[4] = {
+		{ "idle, sleep", false, { 0.0, -1, false } },
+		{ "loaded, sleep", true, { 0.0, -1, false } },
+		{ "loaded, 200 us spin", true, { 200.0, -1, false } },
+		{ "loaded, spin, CPU 0", true, { 200.0, 0, false } },
+	};
+	fuzzy_system_rec fz;
+	initFuzzySystem(&fz);
+	int cpus = max(1, (int)thread::hardware_concurrency());
+
+	cout << "Real-time control loop, " << BENCH_RT_STEPS << " ticks of 2 ms, load on " << cpus << " CPU(s)" << endl;
+	for (int c = 0; c < 4; c++) {
+		atomic<bool> stop(false);
+		vector<double> sinks(cpus);
+		vector<thread> load;
+		if (configs[c].load)
+			for (int i = 0; i < cpus; i++)
+				load.push_back(thread(burnCpu, &stop, &sinks[i]));
+
+		WorldStateType s;
+		s.init();
+		s.angle = 8.0f * (M_PI / 180.0f);
+		PendulumSimulation simulation(&fz, 0.002f);
+		simulation.setRealtime(configs[c].options);
+		simulation.start(s, BENCH_RT_STEPS);
+		while (simulation.running()) {
+			simulation.update();
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		simulation.stop();
+		stop.store(true);
+		for (size_t i = 0; i < load.size(); i++)
+			load[i].join();
+
+		const TickStats &t = simulation.tickStats();
+		cout << "  " << setw(20) << left << configs[c].name << right << fixed << setprecision(1) << " jitter mean " << setw(7) << t.meanUs()
+			<< " us, 99% under " << setw(7) << t.percentileUs(0.99) << " us, worst " << setw(8) << t.worstUs() << " us, "
+			<< t.misses() << " deadline miss(es)" << endl;
+		if (c == 3)
+			t.print(cout);
+	}
+	cout << endl;
+	free_fuzzy_rules(&fz);
+}
+
+static const long BENCH_TRIAL_STEPS = 5000;  //10 s at h = 0.002
+static const int BENCH_TRIALS = 200;
+
+static bool sameTrial(const MetricSummary &a, const MetricSummary &b) {
+	return a.iseAngle == b.iseAngle && a.effort == b.effort && a.peakAngle == b.peakAngle && a.peakX == b.peakX
+		&& a.failure == b.failure && a.failedAt == b.failedAt && a.cost == b.cost;
+}
+
+//A schedule of every kind of disturbance run as a batch of trials, twice,
+//and once more after saving and loading it.  The controller is the fitted
+//TSK one, since the stock controller falls within 1.5 s from 8 deg and the
+//trials would stop there.
+void benchmarkDisturbanceTrials() {
+	fuzzy_system_rec fz;
+	initBalancingController(&fz);
+	WorldStateType s;
+	s.init();
+	s.angle = 8.0f * (M_PI / 180.0f);
+
+	DisturbanceSchedule schedule;
+	Disturbance entries[4] = {
+		{ impulse_disturbance, 0.5, 0.55, 20.0f, 0.0f, 0 },
+		{ step_disturbance, 1.0, 1.5, 5.0f, 0.0f, 0 },
+		{ sine_disturbance, 0.0, 10.0, 2.0f, 1.5f, 0 },
+		{ noise_disturbance, 0.0, 10.0, 2.0f, 0.0f, 7 },
+	};
+	for (int i = 0; i < 4; i++)
+		schedule.add(entries[i]);
+	schedule.keyForce(0.8, -7.0f);  //as a key press would be recorded
+	schedule.keyForce(0.9, 0.0f);
+
+	vector<MetricSummary> first(BENCH_TRIALS);
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int trial = 0; trial < BENCH_TRIALS; trial++)
+		first[trial] = runDisturbanceTrial(fz, schedule, s, 0.002f, BENCH_TRIAL_STEPS, (unsigned int)trial);
+	double ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	string path = "bench_disturbances.txt";
+	DisturbanceSchedule reloaded;
+	bool saved = schedule.save(path) && reloaded.load(path);
+	remove(path.c_str());
+
+	int repeated = 0, roundTrip = 0, fell = 0;
+	double sumPeak = 0.0, sumFellAt = 0.0, sumCost = 0.0, simulated = 0.0;
+	for (int trial = 0; trial < BENCH_TRIALS; trial++) {
+		repeated += !sameTrial(first[trial], runDisturbanceTrial(fz, schedule, s, 0.002f, BENCH_TRIAL_STEPS, (unsigned int)trial));
+		roundTrip += !saved || !sameTrial(first[trial], runDisturbanceTrial(fz, reloaded, s, 0.002f, BENCH_TRIAL_STEPS, (unsigned int)trial));
+		fell += first[trial].failure != no_failure;
+		sumFellAt += first[trial].failedAt;
+		simulated += first[trial].duration;
+		sumPeak += first[trial].peakAngle * (180.0 / M_PI);
+		sumCost += first[trial].cost;
+	}
+
+	cout << "Disturbance trials, " << BENCH_TRIALS << " x " << BENCH_TRIAL_STEPS << " ticks, " << schedule.size() << " disturbances" << endl;
+	cout << "  " << fixed << setprecision(3) << ms / BENCH_TRIALS << " ms per trial (" << setprecision(0)
+		<< simulated / (ms / 1e3) << "x real time); mean peak angle " << setprecision(2)
+		<< sumPeak / BENCH_TRIALS << " deg, mean cost " << sumCost / BENCH_TRIALS << ", " << fell << " failed";
+	if (fell > 0)
+		cout << " (mean " << sumFellAt / fell << " s)";
+	cout << "; " << setprecision(1) << simulated << " of " << BENCH_TRIALS * BENCH_TRIAL_STEPS * 0.002 << " s simulated" << endl;
+	cout << "  " << repeated << " trials differ when repeated, " << roundTrip << " after a save and load" << endl << endl;
+	free_fuzzy_rules(&fz);
+}
+
+static const int BENCH_RECORDINGS = 3;
+static const int BENCH_REPLAYS = 20;
+
+//Each recording presses a key for a few ms at a different point of the run,
+//the way a person would, and is replayed from its log
+void benchmarkReplay() {
+	fuzzy_system_rec fz, retuned;
+	initFuzzySystem(&fz);
+	initFuzzySystem(&retuned);
+	retuned.output_values[out_ns] -= 0.5f;
+	retuned.output_values[out_ps] += 0.5f;
+
+	WorldStateType s;
+	s.init();
+	s.angle = 8.0f * (M_PI / 180.0f);
+
+	int exact = 0;
+	long diverged = 0;
+	double replayMs = 0.0, simulated = 0.0;
+	cout << "Replay of " << BENCH_RECORDINGS << " threaded runs of " << BENCH_SIM_STEPS << " ticks with key presses" << endl;
+	for (int r = 0; r < BENCH_RECORDINGS; r++) {
+		DisturbanceSchedule schedule;
+		Disturbance sine = { sine_disturbance, 0.0, 3.0, 2.0f, 1.5f, 0 };
+		schedule.add(sine);
+		PendulumSimulation simulation(&fz, 0.002f);
+		simulation.useDisturbances(&schedule);
+		simulation.start(s, BENCH_SIM_STEPS);
+		this_thread::sleep_for(chrono::milliseconds(200 + 300 * r));
+		simulation.setExternalForce(7.0f);
+		this_thread::sleep_for(chrono::milliseconds(30));
+		simulation.setExternalForce(0.0f);
+		while (simulation.running())
+			this_thread::sleep_for(chrono::milliseconds(1));
+		simulation.stop();
+		simulation.update();
+
+		ReplayLog log;
+		log.controller = controllerHash(fz);
+		log.h = 0.002f;
+		log.steps = simulation.latest().step;
+		log.start = s;
+		log.end = replayStep(simulation.latest().state);
+		log.disturbances = schedule;
+
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		for (int i = 0; i < BENCH_REPLAYS; i++) {
+			ReplayLog replayed(log);
+			replayRun(fz, replayed);
+			exact += i == 0 && sameStep(replayed.end, log.end) && replayed.controller == log.controller;
+		}
+		replayMs += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+		simulated += BENCH_REPLAYS * log.steps * 0.002;
+
+		ReplayLog mine(log), theirs(log);
+		replayRun(fz, mine);
+		replayRun(retuned, theirs);
+		diverged += firstDivergence(mine.trace, theirs.trace);
+	}
+
+	cout << "  " << fixed << setprecision(3) << replayMs / (BENCH_RECORDINGS * BENCH_REPLAYS) << " ms per replay, "
+		<< setprecision(0) << simulated / (replayMs / 1e3) << "x real time" << endl;
+	cout << "  " << exact << " of " << BENCH_RECORDINGS << " final states bit-exact; with NS/PS 0.5 N stronger the run first differs at tick "
+		<< diverged / BENCH_RECORDINGS << " on average" << endl << endl;
+	free_fuzzy_rules(&fz);
+	free_fuzzy_rules(&retuned);
+}
+
+static const int BENCH_CHECKPOINT_REPEATS = 200;
+static const long BENCH_CHECKPOINT_EVERY = 50;  //0.1 s at h = 0.002
+
+void benchmarkCheckpoints() {
+	fuzzy_system_rec fz;
+	initFuzzySystem(&fz);
+	WorldStateType s;
+	s.init();
+	s.angle = 8.0f * (M_PI / 180.0f);
+	DisturbanceSchedule schedule;
+	Disturbance noise = { noise_disturbance, 0.0, 10.0, 1.0f, 0.0f, 3 };
+	schedule.add(noise);
+	string path = "bench_checkpoint.bin";
+
+	//uninterrupted reference
+	vector<ReplayStep> reference(BENCH_SIM_STEPS + 1);
+	WorldStateType run(s);
+	float inputs[2];
+	reference[0] = replayStep(run);
+	for (long step = 1; step <= BENCH_SIM_STEPS; step++) {
+		controlStep(fz, run, 0.002f, schedule.force((step - 1) * 0.002, 0.002f), inputs);
+		reference[step] = replayStep(run);
+	}
+
+	Checkpoint c;
+	c.set(BENCH_SIM_STEPS / 2, 0.002f, s, schedule);
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < BENCH_CHECKPOINT_REPEATS; i++)
+		saveCheckpoint(path, c, fz);
+	double saveMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() / BENCH_CHECKPOINT_REPEATS;
+	long bytes = 0;
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file != NULL) {
+		fseek(file, 0, SEEK_END);
+		bytes = ftell(file);
+		fclose(file);
+	}
+	fuzzy_system_rec loaded;
+	loaded.allocated = false;
+	start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < BENCH_CHECKPOINT_REPEATS; i++)
+		loadCheckpoint(path, c, &loaded);
+	double loadMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() / BENCH_CHECKPOINT_REPEATS;
+
+	//resume from a checkpoint at every 100th tick, through the file and a reloaded controller
+	int resumed = 0, exact = 0;
+	for (long at = 0; at < BENCH_SIM_STEPS; at += 100) {
+		WorldStateType from(s);
+		for (long step = 1; step <= at; step++)
+			controlStep(fz, from, 0.002f, schedule.force((step - 1) * 0.002, 0.002f), inputs);
+		Checkpoint saved, back;
+		saved.set(at, 0.002f, from, schedule);
+		if (!saveCheckpoint(path, saved, fz) || !loadCheckpoint(path, back, &loaded))
+			continue;
+		WorldStateType carryOn(back.state);
+		for (long step = back.step + 1; step <= BENCH_SIM_STEPS; step++)
+			controlStep(loaded, carryOn, back.h, back.disturbances.force((step - 1) * (double)back.h, back.h), inputs);
+		resumed++;
+		exact += sameStep(replayStep(carryOn), reference[BENCH_SIM_STEPS]);
+	}
+
+	cout << "Checkpoints, " << bytes << " bytes" << endl;
+	cout << "  " << fixed << setprecision(3) << saveMs << " ms to save (write and rename), " << loadMs << " ms to load" << endl;
+	cout << "  " << exact << " of " << resumed << " runs resumed from a checkpoint end bit-exact" << endl;
+
+	//the control loop with and without checkpoints written in the background,
+	//with a key pressed now and then
+	for (int withWriter = 0; withWriter < 2; withWriter++) {
+		CheckpointWriter writer;
+		PendulumSimulation simulation(&fz, 0.002f);
+		DisturbanceSchedule keyed(schedule);
+		simulation.useDisturbances(&keyed);
+		if (withWriter) {
+			writer.open(path, &fz);
+			simulation.useCheckpoints(&writer, BENCH_CHECKPOINT_EVERY);
+		}
+		simulation.start(s, BENCH_SIM_STEPS);
+		for (int ms = 0; simulation.running(); ms++) {
+			simulation.setExternalForce(ms % 400 < 50 ? 7.0f : 0.0f);
+			this_thread::sleep_for(chrono::milliseconds(1));
+		}
+		simulation.stop();
+		writer.close();
+
+		const TickStats &ticks = simulation.tickStats();
+		cout << "  " << BENCH_SIM_STEPS << " ticks, ";
+		if (withWriter)
+			cout << "checkpointed every " << BENCH_CHECKPOINT_EVERY << " (" << writer.written() << " written, the last at tick " << writer.lastStep() << "): ";
+		else
+			cout << "no checkpoints: ";
+		cout << setprecision(1) << ticks.meanUs() << " us mean jitter, " << ticks.misses() << " deadline miss(es)" << endl;
+
+		//the writer's copy of the schedule, built from the keys alone, against the run's
+		Checkpoint last;
+		if (withWriter && writer.lastStep() == BENCH_SIM_STEPS && loadCheckpoint(path, last, &loaded)) {
+			ostringstream written, run;
+			last.disturbances.write(written);
+			keyed.write(run);
+			cout << "  the last checkpoint's schedule (" << last.disturbances.size() << " entries) "
+				<< (written.str() == run.str() ? "matches" : "differs from") << " the run's" << endl;
+		}
+	}
+	remove(path.c_str());
+	cout << endl;
+	free_fuzzy_rules(&loaded);
+	free_fuzzy_rules(&fz);
+}
+
+static const int BENCH_METRIC_REPEATS = 20;
+
+//Relative difference, for sums taken in another order
+static double relativeError(double a, double b) {
+	return fabs(a - b) / max(1e-12, max(fabs(a), fabs(b)));
+}
+
+//TrajectoryMetrics::add() against the tick it follows, its running values
+//against the same metrics worked out from the whole trace afterwards, and a
+//threaded run's metrics against a headless one
+void benchmarkMetrics() {
+	fuzzy_system_rec fz;
+	initFuzzySystem(&fz);
+	WorldStateType s;
+	s.init();
+	s.angle = 8.0f * (M_PI / 180.0f);
+	const float h = 0.002f;
+
+	//the trace goes on past any failure, for the timing
+	vector<WorldStateType> trace(BENCH_TRIAL_STEPS);
+	WorldStateType run(s);
+	float inputs[2];
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (long step = 1; step <= BENCH_TRIAL_STEPS; step++) {
+		controlStep(fz, run, h, 0.0f, inputs);
+		trace[step - 1] = run;
+	}
+	double tickNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / BENCH_TRIAL_STEPS;
+
+	MetricLimits limits = defaultMetricLimits();
+	limits.angleLimit = 1e30f;  //no failure, so that every tick counts below
+	limits.x1 = -1e30f;
+	limits.x2 = 1e30f;
+	TrajectoryMetrics metrics(limits);
+	start = chrono::high_resolution_clock::now();
+	for (int r = 0; r < BENCH_METRIC_REPEATS; r++) {
+		metrics.reset(s, 0.0, h);
+		for (long step = 1; step <= BENCH_TRIAL_STEPS; step++)
+			metrics.add(trace[step - 1], step * (double)h);
+	}
+	double addNs = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count() / (BENCH_METRIC_REPEATS * BENCH_TRIAL_STEPS);
+
+	//the same from the whole trace
+	double iae = 0.0, ise = 0.0, effort = 0.0, steady = 0.0, settled = -1.0;
+	long window = (long)(limits.window / h + 0.5);
+	for (long i = 0; i < BENCH_TRIAL_STEPS; i++) {
+		double angle = fabs(trace[i].angle);
+		iae += angle * h;
+		ise += angle * angle * h;
+		effort += (double)trace[i].F * trace[i].F * h;
+		if (i >= BENCH_TRIAL_STEPS - window)
+			steady += angle / window;
+		bool inside = angle <= limits.angleBand && fabs(trace[i].x) <= limits.xBand;
+		if (!inside)
+			settled = -1.0;
+		else if (settled < 0.0)
+			settled = (i + 1) * (double)h;
+	}
+	const MetricSummary &m = metrics.summary();
+	double worst = max(max(relativeError(iae, m.iaeAngle), relativeError(ise, m.iseAngle)),
+		max(relativeError(effort, m.effort), relativeError(steady, m.steadyAngle)));
+	bool settling = (settled < 0.0) == (m.settlingTime < 0.0) && (settled < 0.0 || fabs(settled - m.settlingTime) < h / 2);
+
+	//the simulation thread keeps the same metrics as a headless run
+	PendulumSimulation simulation(&fz, h);
+	simulation.setMetricLimits(limits);
+	simulation.start(s, BENCH_SIM_STEPS);
+	while (simulation.running())
+		this_thread::sleep_for(chrono::milliseconds(1));
+	simulation.stop();
+	simulation.update();
+	metrics.reset(s, 0.0, h);
+	for (long step = 1; step <= BENCH_SIM_STEPS; step++)
+		metrics.add(trace[step - 1], step * (double)h);
+	bool threaded = sameTrial(simulation.runMetrics().summary(), metrics.summary())
+		&& sameTrial(simulation.latest().metrics, metrics.summary());
+
+	cout << "Trajectory metrics, " << BENCH_TRIAL_STEPS << " ticks" << endl;
+	cout << "  " << fixed << setprecision(1) << addNs << " ns per add(), against " << tickNs << " ns per control tick ("
+		<< setprecision(1) << 100.0 * addNs / tickNs << "%)" << endl;
+	cout << "  against the whole trace: worst relative error " << scientific << setprecision(2) << worst << fixed
+		<< ", settling time " << (settling ? "the same" : "DIFFERENT") << endl;
+	cout << "  threaded run's metrics " << (threaded ? "match" : "DIFFER FROM") << " a headless run's" << endl << endl;
+	free_fuzzy_rules(&fz);
+}
+
+static const int BENCH_SWEEP_POINTS = 8;
+
+//runPlantSweep over a grid of broom masses and lengths on one thread and on
+//every CPU, and the default plant with the textbook dynamics, friction and
+//actuator limits, all under the fitted TSK controller (see
+//benchmarkDisturbanceTrials)
+void benchmarkPlantSweep() {
+	fuzzy_system_rec fz;
+	initBalancingController(&fz);
+	WorldStateType s;
+	s.init();
+	s.angle = 8.0f * (M_PI / 180.0f);
+	DisturbanceSchedule schedule;
+	Disturbance noise = { noise_disturbance, 0.0, 10.0, 1.0f, 0.0f, 3 };
+	schedule.add(noise);
+	MetricLimits limits = defaultMetricLimits();
+	limits.horizon = BENCH_TRIAL_STEPS * 0.002;
+
+	vector<PlantParameters> plants;
+	for (int i = 0; i < BENCH_SWEEP_POINTS; i++) {
+		for (int j = 0; j < BENCH_SWEEP_POINTS; j++) {
+			PlantParameters p = defaultPlantParameters();
+			p.mb = 0.05f + 0.05f * i;
+			p.m = 1.0f + p.mb;
+			p.l = 0.25f + 0.125f * j;
+			plants.push_back(p);
+		}
+	}
+
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	vector<MetricSummary> serial = runPlantSweep(fz, schedule, s, 0.002f, BENCH_TRIAL_STEPS, plants, limits, 1);
+	double serialMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	start = chrono::high_resolution_clock::now();
+	vector<MetricSummary> parallel = runPlantSweep(fz, schedule, s, 0.002f, BENCH_TRIAL_STEPS, plants, limits);
+	double parallelMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	int differ = 0, failed = 0;
+	double simulated = 0.0, sumCost = 0.0;
+	for (size_t i = 0; i < plants.size(); i++) {
+		differ += !sameTrial(serial[i], parallel[i]);
+		failed += serial[i].failure != no_failure;
+		simulated += serial[i].duration;
+		sumCost += serial[i].cost;
+	}
+
+	struct { const char *name; bool legacy; float cartFriction, poleFriction, maxForce, maxForceRate; } variants[4] = {
+		{ "default plant", true, 0.0f, 0.0f, 0.0f, 0.0f },
+		{ "textbook dynamics", false, 0.0f, 0.0f, 0.0f, 0.0f },
+		{ "with friction", false, 0.5f, 0.01f, 0.0f, 0.0f },
+		{ "20 N, 500 N/s actuator", false, 0.5f, 0.01f, 20.0f, 500.0f },
+	};
+
+	cout << "Plant sweep, " << BENCH_SWEEP_POINTS << " x " << BENCH_SWEEP_POINTS << " broom masses and lengths, up to "
+		<< BENCH_TRIAL_STEPS << " ticks each" << endl;
+	cout << "  " << fixed << setprecision(1) << serialMs << " ms on one thread, " << parallelMs << " ms on "
+		<< max(1, (int)thread::hardware_concurrency()) << " (" << setprecision(2) << serialMs / parallelMs << "x, "
+		<< setprecision(0) << simulated / (parallelMs / 1e3) << "x real time); " << differ << " results differ" << endl;
+	cout << "  mean cost " << setprecision(2) << sumCost / plants.size() << ", " << failed << " of " << plants.size() << " failed; "
+		<< setprecision(1) << simulated << " of " << plants.size() * limits.horizon << " s simulated" << endl;
+	for (int v = 0; v < 4; v++) {
+		PlantParameters p = defaultPlantParameters();
+		p.legacyDynamics = variants[v].legacy;
+		p.cartFriction = variants[v].cartFriction;
+		p.poleFriction = variants[v].poleFriction;
+		p.maxForce = variants[v].maxForce;
+		p.maxForceRate = variants[v].maxForceRate;
+		MetricSummary r = runDisturbanceTrial(fz, schedule, s, 0.002f, BENCH_TRIAL_STEPS, 0, limits, p);
+		cout << "  " << setw(24) << left << variants[v].name << right << setprecision(2) << " cost " << setw(7) << r.cost << ", peak |F| "
+			<< setw(6) << r.peakF << " N, " << failureName(r.failure);
+		if (r.failure != no_failure)
+			cout << " after " << r.failedAt << " s";
+		cout << endl;
+	}
+	cout << endl;
+	free_fuzzy_rules(&fz);
+}
+
+#ifdef BGI_SOFTWARE
+static const int BENCH_FRAMES = 500;
+
+//FNV-1a over a page, to compare frames drawn different ways
+static unsigned int pageHash(int page) {
+	const unsigned int *bits = bgiemu_framebuffer(page);
+	size_t n = (size_t)(getmaxx() + 1) * (getmaxy() + 1);
+	unsigned int h = 2166136261u;
+	for (size_t i = 0; i < n; i++)
+		h = (h ^ bits[i]) * 16777619u;
+	return h;
+}
+
+void benchmarkSoftwareRenderer() {
+	int graphDriver = 0, graphMode = 0;
+	WorldStateType s;
+	fuzzy_system_rec fz;
+	float inputs[2];
+	int page = 0;
+
+	initgraph(&graphDriver, &graphMode, "", 1280, 1024);
+	initPendulumWorld();
+	initFuzzySystem(&fz);
+
+	//same sprites as runInvertedPendulum
+	Cart cart(0.0, worldBoundary.y2 + 0.125f);
+	Rod rod(0.0, worldBoundary.y2 + 0.06f);
+
+	//the same trajectory drawn three ways; frames are compared with the full redraw
+	const char *methodNames[3] = { "cleardevice + full redraw", "layers, full-page blit", "layers, dirty rectangles" };
+	vector<unsigned int> reference(BENCH_FRAMES);
+	cout << "Software rasterizer, runInvertedPendulum frame at " << getmaxx() + 1 << "x" << getmaxy() + 1 << endl;
+
+	for (int method = 0; method < 3; method++) {
+		LayerCompositor compositor(method == 2);
+		double totalNs = 0.0, worstNs = 0.0;
+		int mismatches = 0;
+
+		s.init();
+		s.angle = 8.0f * (M_PI / 180.0f);
+		for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+			getControllerInputs(s, inputs);
+			s.F = fuzzy_system(inputs, fz);
+			stepPendulum(s, 0.002f, defaultPlantParameters());
+
+			chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+			if (method == 0) {
+				setactivepage(page);
+				drawPendulumFrame(s, cart, rod);
+			} else {
+				compositor.drawFrame(s, cart, rod, page);
+			}
+			setvisualpage(page);
+			double ns = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count();
+			totalNs += ns;
+			worstNs = max(worstNs, ns);
+
+			unsigned int h = pageHash(page);
+			if (method == 0)
+				reference[frame] = h;
+			else if (h != reference[frame])
+				mismatches++;
+			page = !page;
+		}
+
+		cout << "  " << setw(26) << left << methodNames[method] << right << fixed << setprecision(3)
+			<< totalNs / BENCH_FRAMES / 1e6 << " ms/frame mean, " << worstNs / 1e6 << " ms worst";
+		if (method > 0)
+			cout << ", " << mismatches << " frames differ";
+		cout << endl;
+		if (method > 0) {
+			for (int layer = 0; layer < LayerCompositor::NO_OF_LAYERS; layer++) {
+				const LayerTimer &t = compositor.layerTimer(layer);
+				if (t.frames == 0)
+					continue;
+				cout << "    " << setw(12) << left << LayerCompositor::layerName(layer) << right
+					<< t.totalNs / max(1L, t.frames) / 1e6 << " ms mean, " << t.worstNs / 1e6 << " ms worst" << endl;
+			}
+			cout << "    background rendered " << compositor.backgroundRenders() << " time(s)" << endl;
+			double lines = (double)BENCH_FRAMES * READOUT_LINES / 100.0;
+			cout << "    readout lines: " << setprecision(1) << compositor.textUnchanged() / lines << "% left on the page, "
+				<< compositor.textFromRuns() / lines << "% from cached runs, " << compositor.textDrawn() / lines << "% outtextxy"
+				<< setprecision(3) << endl;
+		}
+	}
+	if (bgiemu_save_ppm(!page, "pendulum_frame.ppm") == grOk)
+		cout << "  last frame written to pendulum_frame.ppm" << endl;
+	cout << endl;
+
+	closegraph();
+	free_fuzzy_rules(&fz);
+}
+
+static const int BENCH_SPRITE_DRAWS = 20000;
+
+void benchmarkSprites() {
+	int graphDriver = 0, graphMode = 0;
+	initgraph(&graphDriver, &graphMode, "", 1280, 1024);
+	initPendulumWorld();
+
+	Cart cart(0.0, worldBoundary.y2 + 0.125f);
+	Rod rod(0.0, worldBoundary.y2 + 0.06f);
+	int poly[8];
+	int sink = 0;
+
+	//angles and positions sweep so nothing is reused between calls
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < BENCH_SPRITE_DRAWS; i++) {
+		float x = -1.0f + 2.0f * i / BENCH_SPRITE_DRAWS;
+		rod.setX(x);
+		rod.setAngle(-0.5f + 1.0f * i / BENCH_SPRITE_DRAWS);
+		cart.setX(x);
+		rod.devicePolygon(poly);
+		sink += poly[0];
+		cart.devicePolygon(poly);
+		sink += poly[0] + rod.bounds().x1 + cart.bounds().x1;
+	}
+	double geometryS = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+	start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < BENCH_SPRITE_DRAWS; i++) {
+		float x = -1.0f + 2.0f * i / BENCH_SPRITE_DRAWS;
+		rod.setX(x);
+		rod.setAngle(-0.5f + 1.0f * i / BENCH_SPRITE_DRAWS);
+		cart.setX(x);
+		rod.draw();
+		cart.draw();
+	}
+	double drawS = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+	cout << "Sprites (Rod + Cart), " << BENCH_SPRITE_DRAWS << " poses" << endl;
+	cout << "  geometry (devicePolygon + bounds): " << fixed << setprecision(0) << BENCH_SPRITE_DRAWS / geometryS
+		<< " poses/s" << (sink == 42 ? " " : "") << endl;
+	cout << "  draw(): " << BENCH_SPRITE_DRAWS / drawS << " poses/s" << endl << endl;
+
+	closegraph();
+}
+
+static const float BENCH_TRIAL_SECONDS = 60.0f;
+static const int BENCH_TRIAL_FPS = 30;
+
+void benchmarkFrameRecorder() {
+	int graphDriver = 0, graphMode = 0;
+	WorldStateType s;
+	fuzzy_system_rec fz;
+	FrameRecorder recorder;
+	float inputs[2];
+	float const h = 0.002f;
+	int page = 0;
+
+	initgraph(&graphDriver, &graphMode, "", 640, 480);
+	initPendulumWorld();
+	initFuzzySystem(&fz);
+	s.init();
+	s.angle = 2.0f * (M_PI / 180.0f);
+
+	Cart cart(0.0, worldBoundary.y2 + 0.125f);
+	Rod rod(0.0, worldBoundary.y2 + 0.06f);
+
+	if (!recorder.open("pendulum_trial.y4m", frames_y4m, BENCH_TRIAL_FPS)) {
+		closegraph();
+		free_fuzzy_rules(&fz);
+		return;
+	}
+
+	int steps = (int)(BENCH_TRIAL_SECONDS / h + 0.5f);
+	double captureNs = 0.0;
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int frame = 0; frame < steps; frame++) {
+		getControllerInputs(s, inputs);
+		s.F = fuzzy_system(inputs, fz);
+		stepPendulum(s, h, defaultPlantParameters());
+
+		double t = (frame + 1) * h;
+		if (recorder.due(t)) {
+			setactivepage(page);
+			drawPendulumFrame(s, cart, rod);
+			chrono::high_resolution_clock::time_point c = chrono::high_resolution_clock::now();
+			recorder.frame(t, page);
+			captureNs += chrono::duration<double, nano>(chrono::high_resolution_clock::now() - c).count();
+			setvisualpage(page);
+			page = !page;
+		}
+	}
+	recorder.close();
+	double wallMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+
+	cout << "Frame recorder, " << setprecision(0) << BENCH_TRIAL_SECONDS << " s trial at " << getmaxx() + 1 << "x" << getmaxy() + 1
+		<< ", " << BENCH_TRIAL_FPS << " fps Y4M" << endl;
+	cout << "  " << recorder.framesWritten() << " frames in " << fixed << setprecision(0) << wallMs << " ms ("
+		<< setprecision(1) << BENCH_TRIAL_SECONDS * 1000.0 / wallMs << "x real time), capture "
+		<< setprecision(3) << captureNs / max(1, recorder.framesWritten()) / 1e6 << " ms/frame on the simulation thread" << endl;
+	cout << endl;
+	remove("pendulum_trial.y4m");
+
+	closegraph();
+	free_fuzzy_rules(&fz);
+}
+#else
+static const int BENCH_FRAMES = 500;
+
+//FNV-1a over getimage() of the active page
+static unsigned int pageHash(vector<char> &image) {
+	int w = getmaxx() + 1, h = getmaxy() + 1;
+	image.resize(imagesize(0, 0, w - 1, h - 1));
+	getimage(0, 0, w - 1, h - 1, &image[0]);
+	unsigned int hash = 2166136261u;
+	for (size_t i = 0; i < image.size(); i++)
+		hash = (hash ^ (unsigned char)image[i]) * 16777619u;
+	return hash;
+}
+
+//The GDI benchmarks share one window, closed by runBenchmarks()
+static void openBenchmarkWindow() {
+	static bool open = false;
+	if (!open) {
+		int graphDriver = 0, graphMode = 0;
+		initgraph(&graphDriver, &graphMode, "", 1280, 1024);
+		initPendulumWorld();
+		open = true;
+	}
+}
+
+//Draws the runInvertedPendulum trajectory with the dirty-rectangle compositor
+//and presents every frame: flipping between pages 0 and 1 as runInvertedPendulum
+//does, or drawing page 0 while it is on screen.  Keeps a hash of each page.
+static void timeGdiFrames(bool flip, vector<unsigned int> &hashes, double &meanMs, double &worstMs) {
+	WorldStateType s;
+	fuzzy_system_rec fz;
+	float inputs[2];
+	int page = 0;
+	vector<char> image;
+	LayerCompositor compositor;
+	double totalNs = 0.0, worstNs = 0.0;
+
+	initFuzzySystem(&fz);
+	Cart cart(0.0, worldBoundary.y2 + 0.125f);
+	Rod rod(0.0, worldBoundary.y2 + 0.06f);
+
+	hashes.resize(BENCH_FRAMES);
+	s.init();
+	s.angle = 8.0f * (M_PI / 180.0f);
+	for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+		getControllerInputs(s, inputs);
+		s.F = fuzzy_system(inputs, fz);
+		stepPendulum(s, 0.002f, defaultPlantParameters());
+
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		compositor.drawFrame(s, cart, rod, page);
+		setvisualpage(page);
+		GdiFlush();
+		double ns = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count();
+		totalNs += ns;
+		worstNs = max(worstNs, ns);
+
+		hashes[frame] = pageHash(image);
+		if (flip)
+			page = !page;
+	}
+	meanMs = totalNs / BENCH_FRAMES / 1e6;
+	worstMs = worstNs / 1e6;
+	free_fuzzy_rules(&fz);
+}
+
+static int countMismatches(const vector<unsigned int> &a, const vector<unsigned int> &b) {
+	int n = 0;
+	for (size_t i = 0; i < a.size(); i++)
+		n += a[i] != b[i];
+	return n;
+}
+
+void benchmarkBatchedDrawing() {
+	openBenchmarkWindow();
+
+	//the same trajectory drawn immediately and through the command buffer
+	const char *methodNames[2] = { "immediate GDI calls", "batched (bgiemu_batch_draw)" };
+	vector<unsigned int> reference, hashes;
+	cout << "WinBGI command buffer, runInvertedPendulum frame at " << getmaxx() + 1 << "x" << getmaxy() + 1 << endl;
+
+	for (int method = 0; method < 2; method++) {
+		batchstatstype stats;
+		double meanMs, worstMs;
+
+		bgiemu_batch_draw = method;
+		bgiemu_batch_stats(&stats);
+		timeGdiFrames(true, method == 0 ? reference : hashes, meanMs, worstMs);
+		bgiemu_batch_stats(&stats);
+
+		cout << "  " << setw(28) << left << methodNames[method] << right << fixed << setprecision(3)
+			<< meanMs << " ms/frame mean, " << worstMs << " ms worst";
+		if (method > 0) {
+			cout << ", " << countMismatches(reference, hashes) << " frames differ" << endl;
+			cout << "    " << setprecision(1) << (double)stats.commands / BENCH_FRAMES << " commands/frame, "
+				<< (double)stats.state_changes / BENCH_FRAMES << " pen/brush/font switches/frame ("
+				<< (double)stats.unsorted_state_changes / BENCH_FRAMES << " in call order)";
+		}
+		cout << endl;
+	}
+	bgiemu_batch_draw = 0;
+	cout << endl;
+}
+
+void benchmarkWindowPresent() {
+	openBenchmarkWindow();
+
+	const char *strategyNames[2] = { "page bitmap + window", "bitmap, damage blit" };
+	const char *pageNames[2] = { "drawn on screen", "page flipping" };
+	cout << "WinBGI redraw strategies (bgiemu_present_damage), runInvertedPendulum frame" << endl;
+
+	for (int flip = 1; flip >= 0; flip--) {
+		vector<unsigned int> reference, hashes;
+		for (int strategy = 0; strategy < 2; strategy++) {
+			double meanMs, worstMs;
+			bgiemu_present_damage = strategy;
+			timeGdiFrames(flip != 0, strategy == 0 ? reference : hashes, meanMs, worstMs);
+
+			cout << "  " << setw(16) << left << pageNames[flip] << setw(22) << strategyNames[strategy] << right
+				<< fixed << setprecision(3) << meanMs << " ms/frame mean, " << worstMs << " ms worst";
+			if (strategy > 0)
+				cout << ", " << countMismatches(reference, hashes) << " pages differ";
+			cout << endl;
+		}
+	}
+	bgiemu_present_damage = 0;
+	cout << endl;
+}
+#endif
+
+static const int BENCH_IMAGE_COPIES = 200;
+
+//Hash of page 0 after copying the n blocks
+static unsigned int timeImageCopies(bool persistent, int w, int h, double &meanUs) {
+	int maxX = getmaxx() + 1 - w, maxY = getmaxy() + 1 - h;
+	vector<char> buffer(imagesize(0, 0, w - 1, h - 1));
+	bgiemu_image *image = bgiemu_newimage(w, h);
+
+	setactivepage(0);
+	cleardevice();
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	for (int i = 0; i < BENCH_IMAGE_COPIES; i++) {
+		int x = (i * 37) % (maxX + 1), y = (i * 53) % (maxY + 1);
+		setactivepage(BACKGROUND_PAGE);
+		if (persistent) {
+			bgiemu_getimage(x, y, image);
+			setactivepage(0);
+			bgiemu_putimage(maxX - x, maxY - y, image, 0, 0, w, h, COPY_PUT);
+		} else {
+			getimage(x, y, x + w - 1, y + h - 1, &buffer[0]);
+			setactivepage(0);
+			putimage(maxX - x, maxY - y, &buffer[0], COPY_PUT);
+		}
+	}
+#ifndef BGI_SOFTWARE
+	GdiFlush();
+#endif
+	meanUs = chrono::duration<double, micro>(chrono::high_resolution_clock::now() - start).count() / BENCH_IMAGE_COPIES;
+	bgiemu_freeimage(image);
+
+#ifdef BGI_SOFTWARE
+	return pageHash(0);
+#else
+	return pageHash(buffer);
+#endif
+}
+
+void benchmarkImageCopies() {
+#ifdef BGI_SOFTWARE
+	int graphDriver = 0, graphMode = 0;
+	initgraph(&graphDriver, &graphMode, "", 1280, 1024);
+	initPendulumWorld();
+#else
+	openBenchmarkWindow();
+#endif
+	setactivepage(BACKGROUND_PAGE);
+	cleardevice();
+	drawInvertedPendulumWorld();
+
+	const int sizes[2][2] = { { 96, 96 }, { getmaxx() + 1, getmaxy() + 1 } };
+	cout << "Page to page copies: getimage + putimage against a persistent bgiemu_image" << endl;
+	for (int size = 0; size < 2; size++) {
+		double getputUs, persistentUs;
+		unsigned int reference = timeImageCopies(false, sizes[size][0], sizes[size][1], getputUs);
+		unsigned int hash = timeImageCopies(true, sizes[size][0], sizes[size][1], persistentUs);
+		cout << "  " << setw(4) << sizes[size][0] << "x" << setw(4) << left << sizes[size][1] << right << fixed << setprecision(1)
+			<< "  getimage/putimage " << getputUs << " us, bgiemu_image " << persistentUs << " us"
+			<< (hash == reference ? ", same page" : ", pages differ") << endl;
+	}
+	cout << endl;
+#ifdef BGI_SOFTWARE
+	closegraph();
+#endif
+}
+
+//Vector sprites against the SpriteAtlas on the runInvertedPendulum trajectory.
+//Both compositors blit the whole background, so each frame can be drawn both
+//ways on the same page and the two compared pixel by pixel.
+void benchmarkSpriteAtlas() {
+#ifdef BGI_SOFTWARE
+	int graphDriver = 0, graphMode = 0;
+	initgraph(&graphDriver, &graphMode, "", 1280, 1024);
+	initPendulumWorld();
+#else
+	openBenchmarkWindow();
+#endif
+	WorldStateType s;
+	fuzzy_system_rec fz;
+	float inputs[2];
+	int page = 0;
+	int w = getmaxx() + 1, h = getmaxy() + 1;
+
+	initFuzzySystem(&fz);
+	Cart cart(0.0, worldBoundary.y2 + 0.125f);
+	Rod rod(0.0, worldBoundary.y2 + 0.06f);
+
+	SpriteAtlas atlas;
+	LayerCompositor vectors(false), sprites(false);
+	sprites.useSpriteAtlas(&atlas);
+	bool built = atlas.build(cart, rod, SPRITE_PAGE);
+
+	cout << "Sprite atlas at " << w << "x" << h << ": ";
+	if (built)
+		cout << atlas.poses() << " poses in " << fixed << setprecision(1) << atlas.pixels() * 4.0 / (1024 * 1024)
+			<< " MB, built in " << atlas.buildMs() << " ms" << endl;
+	else
+		cout << "too big at this scale, vector drawing" << endl;
+
+	bgiemu_image *reference = bgiemu_newimage(w, h), *frame = bgiemu_newimage(w, h);
+	double totalDiffering = 0.0;
+	long worstDiffering = 0;
+	s.init();
+	s.angle = 8.0f * (M_PI / 180.0f);
+	for (int i = 0; i < BENCH_FRAMES; i++) {
+		getControllerInputs(s, inputs);
+		s.F = fuzzy_system(inputs, fz);
+		stepPendulum(s, 0.002f, defaultPlantParameters());
+
+		vectors.drawFrame(s, cart, rod, page);
+		bgiemu_getimage(0, 0, reference);
+		sprites.drawFrame(s, cart, rod, page);
+		bgiemu_getimage(0, 0, frame);
+
+		const unsigned int *a = bgiemu_imagebits(reference), *b = bgiemu_imagebits(frame);
+		long differing = 0;
+		for (size_t p = 0; p < (size_t)w * h; p++)
+			differing += a[p] != b[p];
+		totalDiffering += differing;
+		worstDiffering = max(worstDiffering, differing);
+		setvisualpage(page);
+		page = !page;
+	}
+
+	const char *names[2] = { "vector sprites", "atlas sprites" };
+	for (int method = 0; method < 2; method++) {
+		const LayerTimer &t = (method == 0 ? vectors : sprites).layerTimer(LayerCompositor::SPRITE_LAYER);
+		cout << "  " << setw(16) << left << names[method] << right << fixed << setprecision(3)
+			<< t.totalNs / max(1L, t.frames) / 1e6 << " ms/frame mean, " << t.worstNs / 1e6 << " ms worst (sprite layer)" << endl;
+	}
+	cout << "  pixels differing from the vector frame: " << setprecision(1) << totalDiffering / BENCH_FRAMES
+		<< " mean, " << worstDiffering << " worst" << endl << endl;
+
+	bgiemu_freeimage(reference);
+	bgiemu_freeimage(frame);
+	free_fuzzy_rules(&fz);
+#ifdef BGI_SOFTWARE
+	closegraph();
+#endif
+}
+
+static const int BENCH_RING_SAMPLES = 1000000;
+static const int BENCH_PLOT_FRAMES = 200;
+static const int BENCH_PLOT_RATE = 500;  //samples per simulated second, as runInvertedPendulum
+
+//Synthetic trajectory for the plot benchmarks: sample i at BENCH_PLOT_RATE
+static PlotSample benchSample(long i) {
+	float t = (float)i / BENCH_PLOT_RATE;
+	PlotSample s = { t, 0.14f * sinf(7.0f * t) * cosf(0.3f * t), 2.0f * sinf(0.5f * t), 50.0f * sinf(11.0f * t) };
+	return s;
+}
+
+//Drawn without decimation: a line from every sample to the next, at the
+//chart's scales (the ranges in plot.cpp)
+static void drawEverySample(const StripChart &chart, const vector<PlotSample> &history) {
+	static const float lo[3] = { -15.0f, -2.4f, -60.0f }, hi[3] = { 15.0f, 2.4f, 60.0f };
+	static const int colours[3] = { YELLOW, LIGHTCYAN, LIGHTRED };
+	for (int trace = 0; trace < StripChart::NO_OF_TRACES; trace++) {
+		DeviceRectType r = chart.traceArea(trace);
+		double newest = history.back().t;
+		double pixelsPerSecond = (r.x2 - r.x1 + 1) / chart.seconds();
+		setcolor(colours[trace]);
+		int px = 0, py = 0;
+		for (size_t i = 0; i < history.size(); i++) {
+			float v = trace == 0 ? history[i].angle * 180.0f / 3.14159265f : trace == 1 ? history[i].x : history[i].F;
+			float f = (v - lo[trace]) / (hi[trace] - lo[trace]);
+			f = f < 0.0f ? 0.0f : f > 1.0f ? 1.0f : f;
+			int x = r.x2 - (int)((newest - history[i].t) * pixelsPerSecond), y = r.y2 - (int)(f * (r.y2 - r.y1) + 0.5f);
+			if (i > 0 && x >= r.x1)
+				line(px, py, x, y);
+			px = x;
+			py = y;
+		}
+	}
+}
+
+//SampleRing between two threads, and StripChart drawing against a
+//polyline through every sample for windows of 1 to 60 simulated seconds
+void benchmarkStripChart() {
+	SampleRing ring;
+	long outOfOrder = 0, received = 0;
+	vector<PlotSample> out(256);
+
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	thread producer([&ring]() {
+		for (long i = 0; i < BENCH_RING_SAMPLES; i++) {
+			PlotSample s = { (float)i, 0.0f, 0.0f, 0.0f };
+			while (!ring.push(s))
+				this_thread::yield();
+		}
+	});
+	while (received < BENCH_RING_SAMPLES) {
+		int n = ring.pop(&out[0], (int)out.size());
+		for (int i = 0; i < n; i++)
+			outOfOrder += out[i].t != (float)(received + i);
+		received += n;
+		if (n == 0)
+			this_thread::yield();
+	}
+	producer.join();
+	double ns = chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count();
+	cout << "Strip chart" << endl << "  SampleRing, 2 threads: " << fixed << setprecision(1) << ns / BENCH_RING_SAMPLES
+		<< " ns/sample, " << outOfOrder << " out of order, ring full " << ring.dropped() << " time(s)" << endl;
+
+#ifdef BGI_SOFTWARE
+	int graphDriver = 0, graphMode = 0;
+	initgraph(&graphDriver, &graphMode, "", 1280, 1024);
+	initPendulumWorld();
+#else
+	openBenchmarkWindow();
+#endif
+	const double windows[3] = { 1.0, 10.0, 60.0 };
+	DeviceRectType panel = { fieldX1, fieldY2 + 12, fieldX2, getmaxy() - 12 };
+	setactivepage(0);
+	for (int w = 0; w < 3; w++) {
+		StripChart chart(windows[w]);
+		chart.place(panel);
+		vector<PlotSample> history;
+		long next = 0;
+		long windowSamples = (long)(windows[w] * BENCH_PLOT_RATE);
+		double chartNs = 0.0, everyNs = 0.0;
+
+		for (int frame = 0; frame < BENCH_PLOT_FRAMES; frame++) {
+			//the first frame brings a whole window, then 60 frames per second
+			long until = frame == 0 ? windowSamples : next + BENCH_PLOT_RATE / 60;
+			for (; next < until; next++) {
+				chart.ring().push(benchSample(next));
+				history.push_back(benchSample(next));
+				if ((next & 1023) == 1023)
+					chart.update();  //a window is more than the ring holds
+			}
+			if ((long)history.size() > windowSamples)
+				history.erase(history.begin(), history.end() - windowSamples);
+
+			cleardevice();
+			start = chrono::high_resolution_clock::now();
+			chart.update();
+			chart.draw();
+#ifndef BGI_SOFTWARE
+			GdiFlush();
+#endif
+			if (frame > 0)
+				chartNs += chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count();
+
+			cleardevice();
+			start = chrono::high_resolution_clock::now();
+			drawEverySample(chart, history);
+#ifndef BGI_SOFTWARE
+			GdiFlush();
+#endif
+			if (frame > 0)
+				everyNs += chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count();
+		}
+		cout << "  " << setw(3) << (int)windows[w] << " s window (" << setw(5) << windowSamples << " samples): min/max columns "
+			<< setprecision(3) << chartNs / (BENCH_PLOT_FRAMES - 1) / 1e6 << " ms/frame, every sample "
+			<< everyNs / (BENCH_PLOT_FRAMES - 1) / 1e6 << " ms/frame" << endl;
+	}
+	cout << endl;
+#ifdef BGI_SOFTWARE
+	closegraph();
+#endif
+}
+
+static const int BENCH_SURFACE_POINTS = 2000;
+static const int BENCH_SURFACE_VIEWS = 20;
+
+//A 2000x2000 surface: pyramid build, heatmap and mesh draw times with the
+//level of detail, and the mesh at full resolution for comparison
+void benchmarkSurfaceViewer() {
+#ifdef BGI_SOFTWARE
+	int graphDriver = 0, graphMode = 0;
+	initgraph(&graphDriver, &graphMode, "", 1280, 1024);
+#else
+	openBenchmarkWindow();
+#endif
+	int n = BENCH_SURFACE_POINTS;
+	vector<float> x(n), y(n);
+	vector<vector<float> > z(n, vector<float>(n));
+	for (int i = 0; i < n; i++) {
+		x[i] = -0.2f + 0.4f * i / (n - 1);
+		y[i] = -0.3f + 0.6f * i / (n - 1);
+	}
+	for (int row = 0; row < n; row++)
+		for (int col = 0; col < n; col++)
+			z[row][col] = 60.0f * tanhf(8.0f * x[col] + 3.0f * y[row]) + 5.0f * sinf(40.0f * x[col]) * cosf(30.0f * y[row]);
+
+	SurfaceViewer viewer, fullMesh(n);
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	viewer.setGrid(x, y, z);
+	double buildMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	fullMesh.setGrid(x, y, z);
+	for (int i = 0; i < 1000; i++)
+		viewer.addState(0.1f * sinf(i * 0.05f), 0.2f * cosf(i * 0.03f), 0.0f);
+
+	DeviceRectType heat = { 20, 100, 619, 699 }, mesh = { 660, 100, 1259, 699 };
+	cout << "Surface viewer, " << n << "x" << n << " grid, " << viewer.noOfLevels() << " levels built in "
+		<< fixed << setprecision(1) << buildMs << " ms" << endl;
+
+	setactivepage(0);
+	double heatMs[2] = { 0.0, 0.0 }, meshMs = 0.0, trajectoryMs = 0.0;
+	for (int i = 0; i < BENCH_SURFACE_VIEWS; i++) {
+		cleardevice();
+		viewer.setView(0.1f * i, 0.5f);
+		start = chrono::high_resolution_clock::now();
+		viewer.drawHeatmap(heat);
+		heatMs[i > 0] += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+		start = chrono::high_resolution_clock::now();
+		viewer.drawMesh(mesh);
+		meshMs += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+		start = chrono::high_resolution_clock::now();
+		viewer.drawTrajectory(heat, mesh);
+#ifndef BGI_SOFTWARE
+		GdiFlush();
+#endif
+		trajectoryMs += chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	}
+	cout << "  heatmap 600x600 from level " << viewer.heatmapLevel() << " (" << viewer.columns(viewer.heatmapLevel()) << "x"
+		<< viewer.rows(viewer.heatmapLevel()) << "): " << setprecision(2) << heatMs[0] << " ms rasterized, "
+		<< heatMs[1] / (BENCH_SURFACE_VIEWS - 1) << " ms put again" << endl;
+	cout << "  mesh from level " << viewer.meshLevel() << " (" << viewer.columns(viewer.meshLevel()) << "x"
+		<< viewer.rows(viewer.meshLevel()) << "): " << meshMs / BENCH_SURFACE_VIEWS << " ms/view, trajectory "
+		<< trajectoryMs / BENCH_SURFACE_VIEWS << " ms" << endl;
+
+	cleardevice();
+	start = chrono::high_resolution_clock::now();
+	fullMesh.drawMesh(mesh);
+#ifndef BGI_SOFTWARE
+	GdiFlush();
+#endif
+	cout << "  mesh at full resolution: " << chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count()
+		<< " ms/view" << endl << endl;
+#ifdef BGI_SOFTWARE
+	closegraph();
+#endif
+}
+
+/////////////////////////////////////////////////////////////////
+
+void runBenchmarks() {
+	benchmarkFuzzyOperators();
+	benchmarkMamdani();
+	benchmarkTskFit();
+	benchmarkMembershipShapes();
+	benchmarkFixedPoint();
+	benchmarkViewportTransform();
+	benchmarkSimulationThread();
+	benchmarkRealtimeLoop();
+	benchmarkDisturbanceTrials();
+	benchmarkReplay();
+	benchmarkCheckpoints();
+	benchmarkMetrics();
+	benchmarkPlantSweep();
+#ifdef BGI_SOFTWARE
+	benchmarkSoftwareRenderer();
+	benchmarkSprites();
+	benchmarkFrameRecorder();
+	benchmarkImageCopies();
+	benchmarkSpriteAtlas();
+	benchmarkStripChart();
+	benchmarkSurfaceViewer();
+#else
+	benchmarkBatchedDrawing();
+	benchmarkWindowPresent();
+	benchmarkImageCopies();
+	benchmarkSpriteAtlas();
+	benchmarkStripChart();
+	benchmarkSurfaceViewer();
+	closegraph();
+#endif
+}
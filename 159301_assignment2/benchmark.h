@@ -0,0 +1,99 @@
+#ifndef __BENCHMARK_H__
+#define __BENCHMARK_H__
+
+#include <string>
+#include <iostream>
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//Console benchmarks (run with: 159301_assignment2.exe -bench)
+
+//Times every T-norm x defuzzifier kernel over a grid of controller inputs
+void benchmarkFuzzyOperators();
+
+//Mamdani analytic centroid: latency and accuracy against a sampled output universe
+void benchmarkMamdani();
+
+//Fits a 9-rule TSK controller to trajectories of the 25-rule controller
+void benchmarkTskFit();
+
+//Every membership shape: scalar trapz() against the batch kernels, and the
+//error of both against a double precision evaluation of the definition
+void benchmarkMembershipShapes();
+
+//Q15 and Q31 fixed-point engines against the float engine on the control
+//surface grid: cycles per call (rdtsc where there is one) and the largest
+//output error
+void benchmarkFixedPoint();
+
+//ViewportTransform against xDev/yDev: cycles per vertex and exact agreement
+void benchmarkViewportTransform();
+
+//PendulumSimulation ticking while the display stalls: late ticks, and
+//frames that differ from a single-threaded run
+void benchmarkSimulationThread();
+
+//Control loop tick jitter and deadline misses under synthetic CPU load,
+//with the RealtimeOptions
+void benchmarkRealtimeLoop();
+
+//Headless disturbance trials: time per trial, and identical responses on
+//repeated runs and after a save/load round trip of the schedule
+void benchmarkDisturbanceTrials();
+
+//Threaded runs with key presses at wall-clock times, replayed headless:
+//replay speed, bit-exact final states, and where a retuned controller diverges
+void benchmarkReplay();
+
+//Checkpoint save and load time and size, a threaded run writing checkpoints
+//every 0.1 s, and runs resumed from a checkpoint against uninterrupted ones
+void benchmarkCheckpoints();
+
+//TrajectoryMetrics::add() cost per tick, and its metrics against ones worked
+//out from the whole trace and against a threaded run's
+void benchmarkMetrics();
+
+//Headless trials over a grid of plants, on one thread and on every CPU, and
+//the default plant with the textbook dynamics, friction and actuator limits
+void benchmarkPlantSweep();
+
+#ifdef BGI_SOFTWARE
+//Renders runInvertedPendulum frames at 1280x1024 into the software framebuffer
+void benchmarkSoftwareRenderer();
+
+//Rod and Cart geometry and draw() calls per second over a sweep of poses
+void benchmarkSprites();
+
+//Records a simulated trial to Y4M the way "-record" does: simulation-side
+//cost of capture, and wall time against the simulated duration
+void benchmarkFrameRecorder();
+#else
+//Immediate GDI drawing against the bgiemu_batch_draw command buffer:
+//frame time, identical pages, and pen/brush/font switches per frame
+void benchmarkBatchedDrawing();
+
+//Both redraw strategies (bgiemu_present_damage), page flipping and drawing
+//the visible page: frame time and identical pages
+void benchmarkWindowPresent();
+#endif
+
+//getimage()/putimage() against bgiemu_getimage()/bgiemu_putimage() for a
+//sprite-sized block and the whole page: time per copy and identical pages
+void benchmarkImageCopies();
+
+//SpriteAtlas against vector drawing of the cart and rod: build time and
+//size, sprite layer time per frame, and pixels that differ
+void benchmarkSpriteAtlas();
+
+//SampleRing throughput between two threads, and StripChart draw time per
+//frame against drawing every sample, as the window grows
+void benchmarkStripChart();
+
+//SurfaceViewer on a 2000x2000 grid: level of detail against the full mesh
+void benchmarkSurfaceViewer();
+
+void runBenchmarks();
+
+
+#endif
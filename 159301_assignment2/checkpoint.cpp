@@ -0,0 +1,432 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sstream>
+
+#include "checkpoint.h"
+#include "replay.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+static const char CHECKPOINT_MAGIC[8] = { 'P', 'N', 'D', 'C', 'K', 'P', 'T', '2' };
+
+//Little-endian fields one after another, as the machine stores them
+class CheckpointBytes{
+
+public:
+	CheckpointBytes() : at(0), failed(false) {}
+	CheckpointBytes(const vector<unsigned char>& from) : bytes(from), at(0), failed(false) {}
+
+	template <class T> void put(const T& value) { putBytes(&value, sizeof(T)); }
+	void putBytes(const void* p, size_t n){
+		const unsigned char* b = (const unsigned char*)p;
+		bytes.insert(bytes.end(), b, b + n);
+	}
+
+	template <class T> T get() { T value = T(); getBytes(&value, sizeof(T)); return value; }
+	void getBytes(void* p, size_t n){
+		if (failed || at + n > bytes.size()) {
+			failed = true;
+			memset(p, 0, n);
+			return;
+		}
+		memcpy(p, &bytes[at], n);
+		at += n;
+	}
+
+	vector<unsigned char> bytes;
+	size_t at;
+	bool failed;  //read past the end
+};
+
+static unsigned int checksum(const unsigned char* p, size_t n){
+	unsigned int h = 2166136261u;
+	for (size_t i = 0; i < n; i++)
+		h = (h ^ p[i]) * 16777619u;
+	return h;
+}
+
+static void putTrapezoid(CheckpointBytes& out, const trapezoid& t){
+	out.put((int)t.tp);
+	float shape[6] = { t.a, t.b, t.c, t.d, t.l_slope, t.r_slope };
+	out.putBytes(shape, sizeof(shape));
+	out.put(t.no_of_points);
+	out.putBytes(t.px, sizeof(t.px));
+	out.putBytes(t.py, sizeof(t.py));
+}
+
+static trapezoid getTrapezoid(CheckpointBytes& in){
+	trapezoid t;
+	t.tp = (trapz_type)in.get<int>();
+	float shape[6];
+	in.getBytes(shape, sizeof(shape));
+	t.a = shape[0];
+	t.b = shape[1];
+	t.c = shape[2];
+	t.d = shape[3];
+	t.l_slope = shape[4];
+	t.r_slope = shape[5];
+	t.no_of_points = in.get<short>();
+	in.getBytes(t.px, sizeof(t.px));
+	in.getBytes(t.py, sizeof(t.py));
+	return t;
+}
+
+//Whether a trapezoid read back can be evaluated without going out of bounds
+static bool validTrapezoid(const trapezoid& t){
+	if (t.tp < regular_trapezoid || t.tp >= NO_OF_MF_SHAPES)
+		return false;
+	return t.tp != piecewise_linear || (t.no_of_points >= 2 && t.no_of_points <= MAX_NO_OF_PWL_POINTS);
+}
+
+static void putState(CheckpointBytes& out, const WorldStateType& s){
+	float values[10] = { s.x, s.x_dot, s.x_double_dot, s.angle, s.angle_dot, s.angle_double_dot,
+		s.F, s.in_theta_and_theta_dot, s.in_x_and_x_dot, s.F_actuator };
+	out.putBytes(values, sizeof(values));
+}
+
+static void getState(CheckpointBytes& in, WorldStateType& s){
+	float values[10];
+	in.getBytes(values, sizeof(values));
+	s.x = values[0];
+	s.x_dot = values[1];
+	s.x_double_dot = values[2];
+	s.angle = values[3];
+	s.angle_dot = values[4];
+	s.angle_double_dot = values[5];
+	s.F = values[6];
+	s.in_theta_and_theta_dot = values[7];
+	s.in_x_and_x_dot = values[8];
+	s.F_actuator = values[9];
+}
+
+static void putPlant(CheckpointBytes& out, const PlantParameters& p){
+	float values[8] = { p.mb, p.g, p.m, p.l, p.cartFriction, p.poleFriction, p.maxForce, p.maxForceRate };
+	out.put((int)p.legacyDynamics);
+	out.putBytes(values, sizeof(values));
+}
+
+static void getPlant(CheckpointBytes& in, PlantParameters& p){
+	float values[8];
+	p.legacyDynamics = in.get<int>() != 0;
+	in.getBytes(values, sizeof(values));
+	p.mb = values[0];
+	p.g = values[1];
+	p.m = values[2];
+	p.l = values[3];
+	p.cartFriction = values[4];
+	p.poleFriction = values[5];
+	p.maxForce = values[6];
+	p.maxForceRate = values[7];
+}
+
+static void putController(CheckpointBytes& out, const fuzzy_system_rec& fz){
+	out.put(fz.no_of_inputs);
+	out.put(fz.no_of_inp_regions);
+	out.put(fz.no_of_rules);
+	out.put(fz.no_of_outputs);
+	out.put(fz.no_of_state_vars);
+	for (int i = 0; i < MAX_NO_OF_INPUTS; i++)
+		for (int j = 0; j < MAX_NO_OF_INP_REGIONS; j++)
+			putTrapezoid(out, fz.inp_mem_fns[i][j]);
+	for (int r = 0; r < fz.no_of_rules; r++) {
+		out.putBytes(fz.rules[r].inp_index, sizeof(fz.rules[r].inp_index));
+		out.putBytes(fz.rules[r].inp_fuzzy_set, sizeof(fz.rules[r].inp_fuzzy_set));
+		out.put(fz.rules[r].out_fuzzy_set);
+	}
+	out.putBytes(fz.output_values, sizeof(fz.output_values));
+	for (int i = 0; i < MAX_NO_OF_OUTPUT_VALUES; i++)
+		putTrapezoid(out, fz.out_mem_fns[i]);
+	out.putBytes(fz.tsk_coeffs, fz.no_of_rules * TSK_ROW_SIZE * sizeof(float));
+
+	int operators[5] = { (int)fz.tnorm, (int)fz.defuzz, (int)fz.inference, (int)fz.implication, (int)fz.aggregation };
+	out.putBytes(operators, sizeof(operators));
+	out.put(fz.hamacher_gamma);
+	float gains[4] = { A, B, C, D };
+	out.putBytes(gains, sizeof(gains));
+}
+
+static bool getController(CheckpointBytes& in, fuzzy_system_rec* fz){
+	int sizes[5];
+	in.getBytes(sizes, sizeof(sizes));
+	if (in.failed || sizes[0] < 1 || sizes[0] > MAX_NO_OF_INPUTS || sizes[1] < 1 || sizes[1] > MAX_NO_OF_INP_REGIONS
+		|| sizes[2] < 1 || sizes[2] > 10000 || sizes[3] < 1 || sizes[3] > MAX_NO_OF_OUTPUT_VALUES
+		|| sizes[4] < 0 || sizes[4] > MAX_NO_OF_STATE_VARS)
+		return false;
+
+	//allocated the way initFuzzySystem does it
+	free_fuzzy_rules(fz);
+	fz->no_of_inputs = sizes[0];
+	fz->no_of_inp_regions = sizes[1];
+	fz->no_of_rules = sizes[2];
+	fz->no_of_outputs = sizes[3];
+	fz->no_of_state_vars = sizes[4];
+	fz->rules = (rule *)malloc((size_t)(fz->no_of_rules*sizeof(rule)));
+	fz->tsk_coeffs = (float *)malloc((size_t)(fz->no_of_rules*TSK_ROW_SIZE*sizeof(float)));
+	fz->allocated = true;
+
+	//every index and enum is checked, since they pick array entries and
+	//switch cases: a damaged checkpoint is refused rather than run
+	bool valid = true;
+	for (int i = 0; i < MAX_NO_OF_INPUTS; i++)
+		for (int j = 0; j < MAX_NO_OF_INP_REGIONS; j++) {
+			fz->inp_mem_fns[i][j] = getTrapezoid(in);
+			if (i < fz->no_of_inputs && j < fz->no_of_inp_regions)
+				valid = valid && validTrapezoid(fz->inp_mem_fns[i][j]);
+		}
+	for (int r = 0; r < fz->no_of_rules; r++) {
+		rule& rl = fz->rules[r];
+		in.getBytes(rl.inp_index, sizeof(rl.inp_index));
+		in.getBytes(rl.inp_fuzzy_set, sizeof(rl.inp_fuzzy_set));
+		rl.out_fuzzy_set = in.get<short>();
+		for (int i = 0; i < fz->no_of_inputs; i++)
+			valid = valid && rl.inp_index[i] >= 0 && rl.inp_index[i] < fz->no_of_inputs
+				&& rl.inp_fuzzy_set[i] >= 0 && rl.inp_fuzzy_set[i] < fz->no_of_inp_regions;
+		valid = valid && rl.out_fuzzy_set >= 0 && rl.out_fuzzy_set < fz->no_of_outputs;
+	}
+	in.getBytes(fz->output_values, sizeof(fz->output_values));
+	for (int i = 0; i < MAX_NO_OF_OUTPUT_VALUES; i++) {
+		fz->out_mem_fns[i] = getTrapezoid(in);
+		if (i < fz->no_of_outputs)
+			valid = valid && validTrapezoid(fz->out_mem_fns[i]);
+	}
+	in.getBytes(fz->tsk_coeffs, fz->no_of_rules * TSK_ROW_SIZE * sizeof(float));
+
+	int operators[5];
+	in.getBytes(operators, sizeof(operators));
+	valid = valid && operators[0] >= tnorm_min && operators[0] <= tnorm_hamacher
+		&& operators[1] >= defuzz_weighted_average && operators[1] <= defuzz_mean_of_maximum
+		&& operators[2] >= singleton_consequents && operators[2] <= tsk_consequents
+		&& operators[3] >= implication_clip && operators[3] <= implication_scale
+		&& operators[4] >= aggregation_max && operators[4] <= aggregation_sum;
+	fz->tnorm = (tnorm_type)operators[0];
+	fz->defuzz = (defuzz_type)operators[1];
+	fz->inference = (inference_type)operators[2];
+	fz->implication = (implication_type)operators[3];
+	fz->aggregation = (aggregation_type)operators[4];
+	fz->hamacher_gamma = in.get<float>();
+	float gains[4];
+	in.getBytes(gains, sizeof(gains));
+	A = gains[0];
+	B = gains[1];
+	C = gains[2];
+	D = gains[3];
+	return valid && !in.failed;
+}
+
+//Replaces to with from, even where a plain rename will not (Windows)
+static bool replaceFile(const string& from, const string& to){
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+Checkpoint::Checkpoint(){
+	step = 0;
+	h = 0.0f;
+	plant = defaultPlantParameters();
+	state.init();
+}
+
+void Checkpoint::set(long step_, float h_, const WorldStateType& s, const DisturbanceSchedule& d){
+	step = step_;
+	h = h_;
+	state = s;
+	disturbances = d;
+	disturbances.keyForce(step * (double)h, 0.0f);
+}
+
+bool saveCheckpoint(const string& path, const Checkpoint& c, const fuzzy_system_rec& fz){
+	CheckpointBytes out;
+	out.putBytes(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+	out.put((long long)c.step);
+	out.put(c.h);
+	putPlant(out, c.plant);
+	putState(out, c.state);
+	out.put(controllerHash(fz));
+	putController(out, fz);
+	ostringstream schedule;
+	c.disturbances.write(schedule);
+	string text = schedule.str();
+	out.put((unsigned int)text.size());
+	out.putBytes(text.data(), text.size());
+	out.put(checksum(&out.bytes[0], out.bytes.size()));
+
+	string tmp = path + ".tmp";
+	FILE* file = fopen(tmp.c_str(), "wb");
+	if (file == NULL) {
+		cout << "Cannot write checkpoint " << tmp << endl;
+		return false;
+	}
+	bool ok = fwrite(&out.bytes[0], 1, out.bytes.size(), file) == out.bytes.size();
+	ok = fclose(file) == 0 && ok;
+	if (!ok || !replaceFile(tmp, path)) {
+		cout << "Cannot write checkpoint " << path << endl;
+		remove(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool loadCheckpoint(const string& path, Checkpoint& c, fuzzy_system_rec* fz){
+	FILE* file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		cout << "Cannot open checkpoint " << path << endl;
+		return false;
+	}
+	vector<unsigned char> bytes;
+	unsigned char block[4096];
+	size_t n;
+	while ((n = fread(block, 1, sizeof(block), file)) > 0)
+		bytes.insert(bytes.end(), block, block + n);
+	fclose(file);
+
+	unsigned int sum = 0;
+	if (bytes.size() > sizeof(CHECKPOINT_MAGIC) + sizeof(sum))
+		memcpy(&sum, &bytes[bytes.size() - sizeof(sum)], sizeof(sum));
+	if (bytes.size() <= sizeof(CHECKPOINT_MAGIC) + sizeof(sum) || memcmp(&bytes[0], CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC)) != 0
+		|| checksum(&bytes[0], bytes.size() - sizeof(sum)) != sum) {
+		cout << path << " is not a checkpoint of this version, or is damaged" << endl;
+		return false;
+	}
+
+	CheckpointBytes in(bytes);
+	in.at = sizeof(CHECKPOINT_MAGIC);
+	c.step = (long)in.get<long long>();
+	c.h = in.get<float>();
+	getPlant(in, c.plant);
+	getState(in, c.state);
+	unsigned int hash = in.get<unsigned int>();
+	if (!getController(in, fz) || controllerHash(*fz) != hash) {
+		cout << path << ": the controller cannot be read" << endl;
+		return false;
+	}
+	string text(in.get<unsigned int>(), ' ');
+	if (!text.empty())
+		in.getBytes(&text[0], text.size());
+	istringstream schedule(text);
+	c.disturbances.clear();
+	if (in.failed || !c.disturbances.read(schedule, path))
+		return false;
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CheckpointWriter::CheckpointWriter(){
+	fz = NULL;
+	waiting = stopping = false;
+	count = 0;
+	latest = -1;
+}
+
+CheckpointWriter::~CheckpointWriter(){
+	close();
+}
+
+bool CheckpointWriter::open(const string& path_, const fuzzy_system_rec* fz_, const PlantParameters& plant){
+	close();
+	path = path_;
+	fz = fz_;
+	pending.plant = saving.plant = plant;
+	string tmp = path + ".tmp";
+	FILE* file = fopen(tmp.c_str(), "wb");
+	if (file == NULL) {
+		cout << "Cannot write checkpoint " << tmp << endl;
+		return false;
+	}
+	fclose(file);
+	remove(tmp.c_str());
+
+	waiting = stopping = false;
+	count = 0;
+	latest = -1;
+	worker = thread(&CheckpointWriter::writer, this);
+	return true;
+}
+
+void CheckpointWriter::begin(const DisturbanceSchedule& d){
+	unique_lock<mutex> guard(lock);
+	while (waiting)
+		changed.wait(guard);
+	schedule = d;
+	keys.clear();
+}
+
+void CheckpointWriter::keyForce(double t, float F){
+	KeyChange k = { t, F };
+	keys.push_back(k);
+}
+
+bool CheckpointWriter::offer(long step, float h, const WorldStateType& s){
+	unique_lock<mutex> guard(lock, try_to_lock);
+	if (!guard.owns_lock() || waiting)
+		return false;
+	pending.step = step;
+	pending.h = h;
+	pending.state = s;
+	pendingKeys.swap(keys);  //keys gets the writer's emptied vector back
+	waiting = true;
+	guard.unlock();
+	changed.notify_all();
+	return true;
+}
+
+void CheckpointWriter::close(){
+	if (!worker.joinable())
+		return;
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	worker.join();
+}
+
+long CheckpointWriter::written() const{
+	lock_guard<mutex> guard(lock);
+	return count;
+}
+
+long CheckpointWriter::lastStep() const{
+	lock_guard<mutex> guard(lock);
+	return latest;
+}
+
+void CheckpointWriter::writer(){
+	for (;;) {
+		{
+			unique_lock<mutex> guard(lock);
+			while (!waiting && !stopping)
+				changed.wait(guard);
+			if (!waiting)
+				return;  //stopping, and everything has been written
+			saving.step = pending.step;
+			saving.h = pending.h;
+			saving.state = pending.state;
+			for (size_t i = 0; i < pendingKeys.size(); i++)
+				schedule.keyForce(pendingKeys[i].t, pendingKeys[i].F);
+			pendingKeys.clear();
+			saving.disturbances = schedule;
+		}
+		saving.disturbances.keyForce(saving.step * (double)saving.h, 0.0f);  //as Checkpoint::set
+
+		bool ok = saveCheckpoint(path, saving, *fz);
+
+		{
+			lock_guard<mutex> guard(lock);
+			waiting = false;
+			if (ok) {
+				count++;
+				latest = saving.step;
+			}
+		}
+		changed.notify_all();  //for begin()
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "fuzzylogic.h"
+#include "pendulum.h"
+#include "disturbance.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//Snapshots of a long run, to carry on from after a restart
+
+//A run between two ticks: carrying on from here with the same controller
+//gives the same ticks as the run would have
+class Checkpoint{
+
+public:
+	Checkpoint();
+
+	//The run after tick step.  An open key step is closed there: after a
+	//restart the key is no longer held.
+	void set(long step, float h, const WorldStateType& s, const DisturbanceSchedule& d);
+
+	long step;        //ticks done
+	float h;
+	PlantParameters plant;
+	WorldStateType state;
+	DisturbanceSchedule disturbances;  //the noise is a function of its seeds and t, so this is all of the randomness
+};
+
+//Binary file of the checkpoint, its plant and the whole controller (rules,
+//membership functions, operators, TSK consequents and the Yamakawa gains),
+//with a checksum.  Saving writes <path>.tmp and renames it over path, so a crash
+//mid-write leaves the previous checkpoint.
+bool saveCheckpoint(const string& path, const Checkpoint& c, const fuzzy_system_rec& fz);
+
+//fz is (re)allocated to the saved controller; false, with a message, if the
+//file is missing, damaged or from another version
+bool loadCheckpoint(const string& path, Checkpoint& c, fuzzy_system_rec* fz);
+
+//A key force as DisturbanceSchedule::keyForce takes it
+typedef struct {
+	double t;
+	float F;
+} KeyChange;
+
+//Writes checkpoints on a thread of its own.  offer() is for the control
+//loop: it copies the snapshot only if the writer is idle, and never waits.
+//The writer keeps its own copy of the schedule, taken by begin(), and the
+//control loop hands over only the key forces since, so that a tick never
+//copies a schedule that grows with every key press.
+class CheckpointWriter{
+
+public:
+	CheckpointWriter();
+	~CheckpointWriter();
+
+	//fz must not change while open; false if path cannot be written
+	bool open(const string& path, const fuzzy_system_rec* fz, const PlantParameters& plant = defaultPlantParameters());
+
+	//The schedule a run starts with; call before the run's first tick.
+	//Waits for a checkpoint still being written.
+	void begin(const DisturbanceSchedule& d);
+
+	//The control loop's side.  keyForce() follows each keyForce() on the
+	//run's schedule.  offer() is false if the last checkpoint is still
+	//being written: offer again on a later tick.  Open key steps are
+	//closed in the checkpoint (see Checkpoint::set).
+	void keyForce(double t, float F);
+	bool offer(long step, float h, const WorldStateType& s);
+
+	//Writes the pending checkpoint, if any, and stops the thread
+	void close();
+
+	bool isOpen() const { return worker.joinable(); }
+	long written() const;
+	long lastStep() const;
+
+private:
+	void writer();
+
+	string path;
+	const fuzzy_system_rec* fz;
+
+	Checkpoint pending, saving;
+	DisturbanceSchedule schedule;   //the run's, up to the keys handed over; writer side
+	vector<KeyChange> keys;         //since the last offer; control loop side
+	vector<KeyChange> pendingKeys;  //handed over with pending
+	bool waiting, stopping;
+	long count, latest;
+	mutable mutex lock;
+	condition_variable changed;
+	thread worker;
+};
+
+
+#endif
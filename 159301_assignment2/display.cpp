@@ -0,0 +1,456 @@
+#include <stdio.h>
+#include <chrono>
+
+#include "display.h"
+
+/// Global Variables ///////////////////////////////////////////////////////////////////////
+
+float WORLD_MAXX, WORLD_MAXY;
+int fieldX1, fieldY1, fieldX2, fieldY2; //playing field boundaries
+BoundaryType worldBoundary, deviceBoundary;
+ViewportTransform worldView;  //worldBoundary to deviceBoundary
+char keyPressed[5];
+
+////////////////////////////////////////////////////////////////////////////////
+
+void initPendulumWorld(){
+
+	//widescreen
+	fieldX1 = getmaxx() / 10;
+	fieldX2 = getmaxx() - (getmaxx() / 10);
+	fieldY1 = getmaxy() / 9;
+	fieldY2 = getmaxy() - (getmaxy() / 9);
+
+
+	worldBoundary.x1 = -2.4f;
+	//worldBoundary.y1 = 1.2;
+	worldBoundary.y1 = 3.0f;
+	worldBoundary.x2 = 2.4f;
+	worldBoundary.y2 = -0.4f;
+
+	deviceBoundary.x1 = (float)fieldX1;
+	deviceBoundary.y1 = (float)fieldY1;
+	deviceBoundary.x2 = (float)fieldX2;
+	deviceBoundary.y2 = (float)fieldY2;
+
+	WORLD_MAXX = worldBoundary.x2 - worldBoundary.x1;
+	WORLD_MAXY = worldBoundary.y2 - worldBoundary.y1;
+
+	worldView.set(worldBoundary, deviceBoundary);
+
+}
+
+void drawInvertedPendulumWorld(){
+
+	setcolor(WHITE);
+	rectangle(worldView.x(worldBoundary.x1), worldView.y(worldBoundary.y1),
+		worldView.x(worldBoundary.x2), worldView.y(worldBoundary.y2));
+	//~ setcolor(YELLOW);
+	//~ rectangle(xDev(worldBoundary,deviceBoundary,worldBoundary.x1),yDev(worldBoundary,deviceBoundary,worldBoundary.y2+0.07),
+	//~ xDev(worldBoundary,deviceBoundary,worldBoundary.x2),yDev(worldBoundary,deviceBoundary,worldBoundary.y2));
+	settextstyle(TRIPLEX_FONT, HORIZ_DIR, 2);
+	settextjustify(CENTER_TEXT, CENTER_TEXT);
+
+	setcolor(WHITE);
+	settextstyle(TRIPLEX_FONT, HORIZ_DIR, 1);
+	outtextxy((deviceBoundary.x1 + deviceBoundary.x2) / 2, deviceBoundary.y1 - 2 * textheight("H"), "INVERTED PENDULUM");
+	settextstyle(TRIPLEX_FONT, HORIZ_DIR, 1);
+	outtextxy((deviceBoundary.x1 + deviceBoundary.x2) / 2, deviceBoundary.y1 - textheight("H"), "FUZZY LOGIC CONTROLLER");
+
+}
+
+//Text of one line of the state readout; the metrics lines are blank
+//without metrics
+static void readoutText(const WorldStateType& s, const MetricSummary* metrics, int line, char str[]){
+	float a = ((s.angle * 180.0f / 3.14f));
+
+	if (a > 360.0f){
+		a = a / 360.0f;
+	}
+
+	switch (line) {
+	case 0:
+		sprintf(str, "x = %4.2f", s.x);
+		break;
+	case 1:
+		sprintf(str, "angle = %4.2f", a);
+		break;
+	case 2:
+		sprintf(str, "F = %4.2f", s.F);
+		break;
+	default:
+		if (metrics == NULL)
+			str[0] = '\0';
+		else if (line == 3)
+			sprintf(str, "IAE = %4.2f deg s", metrics->iaeAngle * 180.0 / M_PI);
+		else if (line == 4)
+			sprintf(str, "overshoot = %4.2f deg", metrics->overshoot * 180.0 / M_PI);
+		else if (line == 5 && metrics->settlingTime >= 0.0)
+			sprintf(str, "settled at %4.2f s", metrics->settlingTime);
+		else if (line == 5)
+			sprintf(str, "not settled");
+		else if (metrics->failure != no_failure)
+			sprintf(str, "FAILED at %4.2f s", metrics->failedAt);
+		else
+			sprintf(str, "effort = %4.1f N^2 s", metrics->effort);
+		break;
+	}
+}
+
+//Position of one line of the state readout, in the current font
+static void readoutPosition(int line, int& x, int& y){
+	x = (int)(deviceBoundary.x2 - textwidth("n.h.reyes@massey.ac.nz"));
+	y = (int)(deviceBoundary.y2 - ((7 - line) * textheight("H")));
+}
+
+void displayInfo(const WorldStateType& s){
+	setcolor(WHITE);
+	outtextxy((deviceBoundary.x1 + deviceBoundary.x2) / 2, deviceBoundary.y1 - 2 * textheight("H"), "INVERTED PENDULUM");
+	settextstyle(TRIPLEX_FONT, HORIZ_DIR, 1);
+	outtextxy((deviceBoundary.x1 + deviceBoundary.x2) / 2, deviceBoundary.y1 - textheight("H"), "FUZZY LOGIC CONTROLLER");
+	settextstyle(SMALL_FONT, HORIZ_DIR, 6);
+
+	char str[120];
+	int x, y;
+	for (int line = 0; line < READOUT_LINES; line++) {
+		readoutText(s, NULL, line, str);
+		readoutPosition(line, x, y);
+		outtextxy(x, y, str);
+	}
+
+}
+
+void drawPendulumFrame(const WorldStateType& s, Cart& cart, Rod& rod){
+	cleardevice();
+	drawInvertedPendulumWorld();
+
+	cart.setX(s.x);
+	rod.setX(s.x);
+	rod.setAngle(s.angle);
+	cart.draw();
+	rod.draw();
+
+	displayInfo(s);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+//Slack around item bounds for outlines and rounding in the backends
+static const int DIRTY_MARGIN = 2;
+
+//Space between the field, the plot panel and the bottom of the window
+static const int PLOT_MARGIN = 12;
+
+//Space around the surface heatmap and mesh, and how far past them the
+//trajectory's marker circles reach
+static const int SURFACE_MARGIN = 10;
+static const int SURFACE_MARKER = 3;
+
+static DeviceRectType grow(DeviceRectType r, int margin){
+	r.x1 -= margin;
+	r.y1 -= margin;
+	r.x2 += margin;
+	r.y2 += margin;
+	return r;
+}
+
+static double elapsedNs(chrono::high_resolution_clock::time_point start){
+	return chrono::duration<double, nano>(chrono::high_resolution_clock::now() - start).count();
+}
+
+static void addTime(LayerTimer& t, double ns){
+	t.totalNs += ns;
+	t.worstNs = max(t.worstNs, ns);
+	t.frames++;
+}
+
+LayerCompositor::LayerCompositor(bool dirtyRects_){
+	dirtyRects = dirtyRects_;
+	backgroundReady = false;
+	backgroundWidth = backgroundHeight = 0;
+	background = NULL;
+	renders = 0;
+	sprites = NULL;
+	plot = NULL;
+	surface = NULL;
+	metrics = NULL;
+	pageReady[0] = pageReady[1] = false;
+	layoutReady = false;
+	runClock = 0;
+	resetTimers();
+}
+
+LayerCompositor::~LayerCompositor(){
+	bgiemu_freeimage(background);
+	freeRuns();
+}
+
+void LayerCompositor::invalidate(){
+	backgroundReady = false;
+}
+
+const char* LayerCompositor::layerName(int layer){
+	static const char* names[NO_OF_LAYERS] = { "background", "sprites", "text", "plot", "surface" };
+	return names[layer];
+}
+
+void LayerCompositor::resetTimers(){
+	for (int i = 0; i < NO_OF_LAYERS; i++) {
+		timers[i].totalNs = timers[i].worstNs = 0.0;
+		timers[i].frames = 0;
+	}
+	renders = 0;
+	unchanged = fromRuns = textOut = 0;
+}
+
+LayerCompositor::TextRun* LayerCompositor::findRun(int line, const char* str){
+	for (size_t i = 0; i < runs[line].size(); i++) {
+		if (strcmp(runs[line][i].str, str) == 0) {
+			runs[line][i].used = ++runClock;
+			return &runs[line][i];
+		}
+	}
+	return NULL;
+}
+
+void LayerCompositor::addRun(int line, const char* str, DeviceRectType r){
+	r.x1 = max(r.x1, 0);
+	r.y1 = max(r.y1, 0);
+	r.x2 = min(r.x2, getmaxx());
+	r.y2 = min(r.y2, getmaxy());
+	if (r.x1 > r.x2 || r.y1 > r.y2 || strlen(str) >= READOUT_CHARS)
+		return;
+
+	//a full cache gives up its least recently used run
+	vector<TextRun>& cache = runs[line];
+	TextRun* run;
+	if (cache.size() < TEXT_RUNS) {
+		cache.push_back(TextRun());
+		run = &cache.back();
+	} else {
+		run = &cache[0];
+		for (size_t i = 1; i < cache.size(); i++)
+			if (cache[i].used < run->used)
+				run = &cache[i];
+		bgiemu_freeimage(run->image);
+	}
+	strcpy(run->str, str);
+	run->rect = r;
+	run->image = bgiemu_newimage(r.x2 - r.x1 + 1, r.y2 - r.y1 + 1);
+	run->used = ++runClock;
+	bgiemu_getimage(r.x1, r.y1, run->image);
+}
+
+void LayerCompositor::freeRuns(){
+	for (int line = 0; line < READOUT_LINES; line++) {
+		for (size_t i = 0; i < runs[line].size(); i++)
+			bgiemu_freeimage(runs[line][i].image);
+		runs[line].clear();
+	}
+}
+
+void LayerCompositor::renderBackground(){
+	//the world is fitted to the window, so a new size moves everything
+	if (getmaxx() + 1 != backgroundWidth || getmaxy() + 1 != backgroundHeight) {
+		backgroundWidth = getmaxx() + 1;
+		backgroundHeight = getmaxy() + 1;
+		initPendulumWorld();
+		bgiemu_freeimage(background);
+		background = NULL;
+	}
+
+	setactivepage(BACKGROUND_PAGE);
+	cleardevice();
+	drawInvertedPendulumWorld();
+	if (plot != NULL) {
+		DeviceRectType r = { fieldX1, fieldY2 + PLOT_MARGIN, fieldX2, getmaxy() - PLOT_MARGIN };
+		plot->place(r);
+		plot->drawPanel();
+	}
+	if (surface != NULL) {
+		int size = (fieldY2 - fieldY1) / 4;
+		DeviceRectType heat = { fieldX1 + SURFACE_MARGIN, fieldY1 + SURFACE_MARGIN,
+			fieldX1 + SURFACE_MARGIN + size - 1, fieldY1 + SURFACE_MARGIN + size - 1 };
+		DeviceRectType mesh = { heat.x2 + 1 + SURFACE_MARGIN, heat.y1, heat.x2 + SURFACE_MARGIN + size, heat.y2 };
+		heatmapRect = heat;
+		meshRect = mesh;
+		surface->drawHeatmap(heatmapRect);
+		surface->drawMesh(meshRect);
+		setcolor(DARKGRAY);
+		rectangle(meshRect.x1, meshRect.y1, meshRect.x2, meshRect.y2);
+	}
+
+	if (background == NULL)
+		background = bgiemu_newimage(backgroundWidth, backgroundHeight);
+	bgiemu_getimage(0, 0, background);
+
+	//runs hold the old background, and the readout may have moved
+	freeRuns();
+	layoutReady = false;
+
+	backgroundReady = true;
+	pageReady[0] = pageReady[1] = false;
+	renders++;
+}
+
+void LayerCompositor::restore(DeviceRectType r){
+	r.x1 = max(r.x1, 0);
+	r.y1 = max(r.y1, 0);
+	r.x2 = min(r.x2, getmaxx());
+	r.y2 = min(r.y2, getmaxy());
+	if (r.x1 > r.x2 || r.y1 > r.y2)
+		return;
+
+	bgiemu_putimage(r.x1, r.y1, background, r.x1, r.y1, r.x2 - r.x1 + 1, r.y2 - r.y1 + 1, COPY_PUT);
+}
+
+void LayerCompositor::drawFrame(const WorldStateType& s, Cart& cart, Rod& rod, int page){
+	DeviceRectType now[NO_OF_ITEMS];
+	char str[READOUT_LINES][READOUT_CHARS];
+	TextRun* run[READOUT_LINES];
+	enum { LEAVE, PUT_RUN, OUTTEXT } text[READOUT_LINES];
+	chrono::high_resolution_clock::time_point start;
+	double backgroundNs = 0.0, spriteNs, textNs;
+
+	if (!backgroundReady || getmaxx() + 1 != backgroundWidth || getmaxy() + 1 != backgroundHeight) {
+		start = chrono::high_resolution_clock::now();
+		renderBackground();
+		backgroundNs = elapsedNs(start);
+	}
+
+	//the bounds of this frame's items come first, so the background can go under them
+	start = chrono::high_resolution_clock::now();
+	if (sprites != NULL && !sprites->current())
+		sprites->build(cart, rod, SPRITE_PAGE);
+	cart.setX(s.x);
+	rod.setX(s.x);
+	rod.setAngle(s.angle);
+	if (sprites != NULL) {
+		now[CART_ITEM] = grow(sprites->cartBounds(cart), DIRTY_MARGIN);
+		now[ROD_ITEM] = grow(sprites->rodBounds(rod), DIRTY_MARGIN);
+	} else {
+		now[CART_ITEM] = grow(cart.bounds(), DIRTY_MARGIN);
+		now[ROD_ITEM] = grow(rod.bounds(), DIRTY_MARGIN);
+	}
+	spriteNs = elapsedNs(start);
+
+	//the font is only asked about strings that have no run
+	start = chrono::high_resolution_clock::now();
+	settextstyle(SMALL_FONT, HORIZ_DIR, 6);
+	settextjustify(CENTER_TEXT, CENTER_TEXT);
+	if (!layoutReady) {
+		//the lines are one text height apart, so each gets the rows half way
+		//to its neighbours and can be restored without touching them
+		int h = textheight("H");
+		for (int line = 0; line < READOUT_LINES; line++)
+			readoutPosition(line, readoutX[line], readoutY[line]);
+		for (int line = 0; line < READOUT_LINES; line++) {
+			readoutTop[line] = line == 0 ? readoutY[line] - h / 2 - DIRTY_MARGIN
+				: (readoutY[line - 1] + readoutY[line] + 1) / 2;
+			readoutBottom[line] = line == READOUT_LINES - 1 ? readoutY[line] + h / 2 + DIRTY_MARGIN
+				: (readoutY[line] + readoutY[line + 1] + 1) / 2 - 1;
+		}
+		layoutReady = true;
+	}
+	for (int line = 0; line < READOUT_LINES; line++) {
+		readoutText(s, metrics, line, str[line]);
+		run[line] = findRun(line, str[line]);
+		if (run[line] != NULL) {
+			now[READOUT_ITEM + line] = run[line]->rect;
+		} else {
+			int w = textwidth(str[line]);
+			DeviceRectType r = { readoutX[line] - w / 2 - DIRTY_MARGIN, readoutTop[line],
+				readoutX[line] + w / 2 + DIRTY_MARGIN, readoutBottom[line] };
+			now[READOUT_ITEM + line] = r;
+		}
+	}
+	textNs = elapsedNs(start);
+
+	//background layer
+	start = chrono::high_resolution_clock::now();
+	bool fullBlit = !dirtyRects || !pageReady[page];
+	setactivepage(page);
+	if (fullBlit) {
+		bgiemu_putimage(0, 0, background, 0, 0, backgroundWidth, backgroundHeight, COPY_PUT);
+		pageReady[page] = true;
+	} else {
+		for (int i = 0; i < READOUT_ITEM; i++)
+			restore(unionRect(drawn[page][i], now[i]));
+		if (plot != NULL)
+			for (int i = 0; i < StripChart::NO_OF_TRACES; i++)
+				restore(plot->traceArea(i));
+		if (surface != NULL) {
+			restore(grow(heatmapRect, SURFACE_MARKER));
+			restore(grow(meshRect, SURFACE_MARKER));
+		}
+	}
+	for (int line = 0; line < READOUT_LINES; line++) {
+		int item = READOUT_ITEM + line;
+		DeviceRectType r = fullBlit ? now[item] : unionRect(drawn[page][item], now[item]);
+
+		//a sprite drawn or erased over the line spoils both shortcuts
+		bool covered = false;
+		for (int i = 0; i < READOUT_ITEM; i++)
+			covered = covered || rectsOverlap(r, fullBlit ? now[i] : unionRect(drawn[page][i], now[i]));
+
+		if (!fullBlit && !covered && strcmp(shown[page][line], str[line]) == 0) {
+			text[line] = LEAVE;
+			unchanged++;
+			continue;
+		}
+		if (!fullBlit)
+			restore(r);
+		text[line] = (run[line] != NULL && !covered) ? PUT_RUN : OUTTEXT;
+	}
+	for (int i = 0; i < NO_OF_ITEMS; i++)
+		drawn[page][i] = now[i];
+	addTime(timers[BACKGROUND_LAYER], backgroundNs + elapsedNs(start));
+
+	//surface layer, under the sprites
+	if (surface != NULL) {
+		start = chrono::high_resolution_clock::now();
+		surface->addState(s.angle, s.angle_dot, s.F);
+		surface->drawTrajectory(heatmapRect, meshRect);
+		addTime(timers[SURFACE_LAYER], elapsedNs(start));
+	}
+
+	//sprite layer
+	start = chrono::high_resolution_clock::now();
+	if (sprites != NULL) {
+		sprites->drawCart(cart);
+		sprites->drawRod(rod);
+	} else {
+		cart.draw();
+		rod.draw();
+	}
+	addTime(timers[SPRITE_LAYER], spriteNs + elapsedNs(start));
+
+	//text layer; a line drawn clear of the sprites becomes a run
+	start = chrono::high_resolution_clock::now();
+	setcolor(WHITE);
+	for (int line = 0; line < READOUT_LINES; line++) {
+		DeviceRectType r = now[READOUT_ITEM + line];
+		if (text[line] == PUT_RUN) {
+			bgiemu_putimage(r.x1, r.y1, run[line]->image, 0, 0, r.x2 - r.x1 + 1, r.y2 - r.y1 + 1, COPY_PUT);
+			fromRuns++;
+		} else if (text[line] == OUTTEXT) {
+			outtextxy(readoutX[line], readoutY[line], str[line]);
+			textOut++;
+			bool clear = true;
+			for (int i = 0; i < READOUT_ITEM; i++)
+				clear = clear && !rectsOverlap(r, now[i]);
+			if (clear && run[line] == NULL)
+				addRun(line, str[line], r);
+		}
+		strcpy(shown[page][line], str[line]);
+	}
+	addTime(timers[TEXT_LAYER], textNs + elapsedNs(start));
+
+	//plot layer
+	if (plot != NULL) {
+		start = chrono::high_resolution_clock::now();
+		plot->update();
+		plot->draw();
+		addTime(timers[PLOT_LAYER], elapsedNs(start));
+	}
+}
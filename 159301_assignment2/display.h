@@ -0,0 +1,158 @@
+#ifndef __DISPLAY_H__
+#define __DISPLAY_H__
+
+#include "graphics.h"
+#include "transform.h"
+#include "sprites.h"
+#include "pendulum.h"
+#include "plot.h"
+#include "surface.h"
+#include "metrics.h"
+
+#include <vector>
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//Drawing of the pendulum world on the active page
+
+extern float WORLD_MAXX, WORLD_MAXY;
+extern int fieldX1, fieldY1, fieldX2, fieldY2; //playing field boundaries
+extern BoundaryType worldBoundary, deviceBoundary;
+extern ViewportTransform worldView;  //worldBoundary to deviceBoundary, set by initPendulumWorld
+
+//Fits the world to the current graphics window
+void initPendulumWorld();
+
+void drawInvertedPendulumWorld();
+void displayInfo(const WorldStateType& s);
+
+//One animation frame of runInvertedPendulum: clears the active page and
+//draws the world, the cart and rod at state s, and the state readout
+void drawPendulumFrame(const WorldStateType& s, Cart& cart, Rod& rod);
+
+//Page that holds the static background layer of LayerCompositor
+#define BACKGROUND_PAGE 2
+
+//Page the SpriteAtlas poses are drawn on
+#define SPRITE_PAGE 3
+
+//Lines in the state readout (x, angle, F), then the metrics readout (IAE,
+//overshoot, settling, effort or failure), blank unless it is shown
+#define READOUT_LINES 7
+
+//Accumulated cost of one compositor layer
+typedef struct {
+	double totalNs, worstNs;
+	long frames;
+} LayerTimer;
+
+//Replacement for drawPendulumFrame on flipped pages 0 and 1, built from
+//five layers:
+//  background  border and titles, drawn once into BACKGROUND_PAGE (and
+//              again only when the window size changes)
+//  sprites     the cart and the rod, as vectors or from a SpriteAtlas
+//  text        the state readout, and the metrics readout if shown
+//  plot        the traces of a StripChart, if one is used, in a panel
+//              below the field (its frames and labels are background)
+//  surface     the state trajectory over a SurfaceViewer's heatmap and
+//              mesh, if one is used, in the top left of the field (the
+//              heatmap and mesh themselves are background)
+//Each frame the background is put back on the page from a persistent
+//image (bgiemu_newimage), then the sprites and text are drawn over it.
+//With dirtyRects the background is copied only under the sprites and text
+//(where they are now, and where they were when the same page was last
+//drawn); otherwise it is a single full-page blit.
+//
+//A readout line that a sprite does not reach is left alone if the page
+//already shows the same string.  When it changes, it is put back from a
+//run: the line's rectangle as it was last drawn with that string, kept in
+//a small cache per line.  Only strings not in the cache go to outtextxy.
+class LayerCompositor{
+
+public:
+	enum { BACKGROUND_LAYER, SPRITE_LAYER, TEXT_LAYER, PLOT_LAYER, SURFACE_LAYER, NO_OF_LAYERS };
+
+	LayerCompositor(bool dirtyRects = true);
+	~LayerCompositor();
+
+	//Redraws the background on the next frame; call if the world
+	//boundaries or the palette change
+	void invalidate();
+
+	//Draws the cart and rod from atlas (built on SPRITE_PAGE when needed)
+	//instead of as vectors; NULL for vectors.  Experimental: slower than the
+	//vectors where it has been measured (-bench, software renderer), and
+	//within a pixel of them rather than identical
+	void useSpriteAtlas(SpriteAtlas* atlas) { sprites = atlas; }
+
+	//Shows chart under the field, taking its samples each frame; NULL for none
+	void usePlot(StripChart* chart) { plot = chart; backgroundReady = false; }
+
+	//Shows viewer's surface with the trajectory of the frames drawn
+	//(angle, angle_dot, F); NULL for none
+	void useSurface(SurfaceViewer* viewer) { surface = viewer; backgroundReady = false; }
+
+	//Shows the metrics readout from summary on the frames drawn from now
+	//on; NULL for none.  Meant to be called each frame with the frame's
+	//metrics.
+	void setMetrics(const MetricSummary* summary) { metrics = summary; }
+
+	//Leaves page active with the frame for state s drawn on it
+	void drawFrame(const WorldStateType& s, Cart& cart, Rod& rod, int page);
+
+	const LayerTimer& layerTimer(int layer) const { return timers[layer]; }
+	static const char* layerName(int layer);
+	int backgroundRenders() const { return renders; }
+	void resetTimers();
+
+	//Readout lines since resetTimers(): left as they were on the page, put
+	//back from a cached run, and drawn with outtextxy
+	long textUnchanged() const { return unchanged; }
+	long textFromRuns() const { return fromRuns; }
+	long textDrawn() const { return textOut; }
+
+private:
+	enum { CART_ITEM, ROD_ITEM, READOUT_ITEM, NO_OF_ITEMS = READOUT_ITEM + READOUT_LINES };
+	enum { READOUT_CHARS = 64, TEXT_RUNS = 32 };
+
+	//A readout line over the background, for putting back with COPY_PUT
+	struct TextRun {
+		char str[READOUT_CHARS];
+		DeviceRectType rect;
+		bgiemu_image* image;
+		long used;  //for least recently used replacement
+	};
+
+	void renderBackground();
+	void restore(DeviceRectType r);
+	TextRun* findRun(int line, const char* str);
+	void addRun(int line, const char* str, DeviceRectType r);
+	void freeRuns();
+
+	bool dirtyRects;
+	bool backgroundReady;
+	int backgroundWidth, backgroundHeight;
+	bgiemu_image* background;  //the whole background page
+	int renders;
+	SpriteAtlas* sprites;
+	StripChart* plot;
+	SurfaceViewer* surface;
+	const MetricSummary* metrics;
+	DeviceRectType heatmapRect, meshRect;
+
+	bool pageReady[2];
+	DeviceRectType drawn[2][NO_OF_ITEMS];
+	char shown[2][READOUT_LINES][READOUT_CHARS];  //readout on each page
+
+	bool layoutReady;
+	int readoutX[READOUT_LINES], readoutY[READOUT_LINES];
+	int readoutTop[READOUT_LINES], readoutBottom[READOUT_LINES];  //rows of each line, not shared
+	vector<TextRun> runs[READOUT_LINES];
+	long runClock;
+	long unchanged, fromRuns, textOut;
+
+	LayerTimer timers[NO_OF_LAYERS];
+};
+
+#endif
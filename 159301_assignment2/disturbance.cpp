@@ -0,0 +1,261 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+
+#include "disturbance.h"
+#include "simulation.h"
+
+//Times closer than this are the same tick (h is far bigger)
+static const double TICK_EPSILON = 1e-7;
+
+//Open-ended steps end here
+static const double NEVER = 1e30;
+
+//splitmix64's finalizer: a bijection with mix64(0) = 0
+static unsigned long long mix64(unsigned long long z){
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+	return z ^ (z >> 31);
+}
+
+//Uniform in (0, 1) from a seed, a trial and a time, the same on every run.
+//The trial goes in through a hash of its own rather than added to the
+//seed, so that seeds k apart do not repeat each other k trials apart;
+//trial 0 is as it always was.
+static double hashUnit(unsigned int seed, unsigned int trial, double t, unsigned int stream){
+	unsigned long long z = ((unsigned long long)seed << 32) ^ (unsigned long long)floor(t * 1e5 + 0.5) ^ ((unsigned long long)stream << 61);
+	z ^= mix64(trial);
+	z = mix64(z + 0x9E3779B97F4A7C15ull);
+	return ((z >> 11) + 0.5) / 9007199254740992.0;  //53 bits
+}
+
+//Shortest decimal that reads back as exactly v, so that a saved schedule
+//gives the same forces bit for bit
+static string exact(double v){
+	char text[32];
+	for (int digits = 6; digits < 17; digits++) {
+		sprintf(text, "%.*g", digits, v);
+		if (strtod(text, NULL) == v)
+			return text;
+	}
+	sprintf(text, "%.17g", v);
+	return text;
+}
+
+static string exact(float v){
+	char text[32];
+	for (int digits = 6; digits < 9; digits++) {
+		sprintf(text, "%.*g", digits, v);
+		if ((float)strtod(text, NULL) == v)
+			return text;
+	}
+	sprintf(text, "%.9g", v);
+	return text;
+}
+
+//Shortest duration that takes start to exactly end
+static string exactDuration(double start, double end){
+	char text[32];
+	for (int digits = 6; digits < 17; digits++) {
+		sprintf(text, "%.*g", digits, end - start);
+		if (start + strtod(text, NULL) == end)
+			return text;
+	}
+	return exact(end - start);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+DisturbanceSchedule::DisturbanceSchedule(){
+	keyEntry = -1;
+}
+
+int DisturbanceSchedule::insert(const Disturbance& d){
+	vector<Disturbance>::iterator at = entries.begin();
+	while (at != entries.end() && at->start <= d.start)
+		++at;
+	int index = (int)(at - entries.begin());
+	entries.insert(at, d);
+	if (keyEntry >= index)
+		keyEntry++;
+	return index;
+}
+
+void DisturbanceSchedule::keyForce(double t, float F){
+	if (keyEntry >= 0) {
+		entries[keyEntry].end = t;
+		keyEntry = -1;
+	}
+	if (F != 0.0f) {
+		Disturbance d = { step_disturbance, t, NEVER, F, 0.0f, 0 };
+		keyEntry = insert(d);
+	}
+}
+
+float DisturbanceSchedule::force(double t, float h, unsigned int trial) const{
+	double now = t + TICK_EPSILON;
+	float F = 0.0f;
+	for (size_t i = 0; i < entries.size() && entries[i].start <= now; i++) {
+		const Disturbance& d = entries[i];
+		//An impulse shorter than a tick may fall between two ticks' samples,
+		//so it goes whole into the first tick from its start, spread over h
+		//to keep its impulse (force x duration)
+		if (d.kind == impulse_disturbance && d.end - d.start < h) {
+			if (now - h < d.start)
+				F += d.force * (float)((d.end - d.start) / h);
+			continue;
+		}
+		if (now >= d.end)
+			continue;
+		switch (d.kind) {
+		case impulse_disturbance:
+		case step_disturbance:
+			F += d.force;
+			break;
+		case sine_disturbance:
+			F += d.force * (float)sin(2.0 * M_PI * d.hz * (t - d.start));
+			break;
+		case noise_disturbance: {
+			//Box-Muller
+			double u = hashUnit(d.seed, trial, t, 0), v = hashUnit(d.seed, trial, t, 1);
+			F += d.force * (float)(sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v));
+			break;
+		}
+		}
+	}
+	return F;
+}
+
+bool DisturbanceSchedule::load(const string& path){
+	ifstream in(path.c_str());
+	if (!in) {
+		cout << "Cannot open disturbance schedule " << path << endl;
+		return false;
+	}
+	return read(in, path);
+}
+
+bool DisturbanceSchedule::read(istream& in, const string& name, int lineNo){
+	string text;
+	for (; getline(in, text); lineNo++) {
+		size_t hash = text.find('#');
+		if (hash != string::npos)
+			text.erase(hash);
+		istringstream line(text);
+		string kind;
+		if (!(line >> kind))
+			continue;
+		if (kind == "end")
+			break;
+
+		Disturbance d = { step_disturbance, 0.0, NEVER, 0.0f, 0.0f, 0 };
+		double duration = 0.0;
+		bool ok = false;
+		if (kind == "impulse") {
+			d.kind = impulse_disturbance;
+			ok = !(line >> d.start >> d.force >> duration).fail() && duration > 0.0;
+		} else if (kind == "step") {
+			d.kind = step_disturbance;
+			ok = !(line >> d.start >> d.force).fail();
+			double end;
+			if (ok && (line >> end))
+				d.end = end;
+			ok = ok && d.end > d.start;
+		} else if (kind == "sine") {
+			d.kind = sine_disturbance;
+			ok = !(line >> d.start >> d.force >> d.hz >> duration).fail() && duration > 0.0;
+		} else if (kind == "noise") {
+			d.kind = noise_disturbance;
+			ok = !(line >> d.start >> d.force >> duration).fail() && duration > 0.0;
+			if (ok && !(line >> d.seed))
+				d.seed = (unsigned int)lineNo;
+		}
+		if (!ok) {
+			cout << name << ":" << lineNo << ": cannot read \"" << text << "\"" << endl;
+			return false;
+		}
+		if (duration > 0.0)
+			d.end = d.start + duration;
+		insert(d);
+	}
+	return true;
+}
+
+bool DisturbanceSchedule::save(const string& path) const{
+	ofstream out(path.c_str());
+	if (!out) {
+		cout << "Cannot write disturbance schedule " << path << endl;
+		return false;
+	}
+	out << "# kind start force ... (seconds, newtons)" << endl;
+	write(out);
+	return true;
+}
+
+void DisturbanceSchedule::write(ostream& out) const{
+	for (size_t i = 0; i < entries.size(); i++) {
+		const Disturbance& d = entries[i];
+		switch (d.kind) {
+		case impulse_disturbance:
+			out << "impulse " << exact(d.start) << " " << exact(d.force) << " " << exactDuration(d.start, d.end) << endl;
+			break;
+		case step_disturbance:
+			out << "step " << exact(d.start) << " " << exact(d.force);
+			if (d.end < NEVER)
+				out << " " << exact(d.end);
+			out << endl;
+			break;
+		case sine_disturbance:
+			out << "sine " << exact(d.start) << " " << exact(d.force) << " " << exact(d.hz) << " " << exactDuration(d.start, d.end) << endl;
+			break;
+		case noise_disturbance:
+			out << "noise " << exact(d.start) << " " << exact(d.force) << " " << exactDuration(d.start, d.end) << " " << d.seed << endl;
+			break;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+MetricSummary runDisturbanceTrial(const fuzzy_system_rec& fz, const DisturbanceSchedule& schedule,
+	WorldStateType s, float h, long steps, unsigned int trial, const MetricLimits& limits, const PlantParameters& plant){
+	TrajectoryMetrics metrics(limits);
+	float inputs[2];
+
+	metrics.reset(s, 0.0, h);
+	for (long step = 1; step <= steps && !metrics.failed(); step++) {
+		controlStep(fz, s, h, schedule.force((step - 1) * (double)h, h, trial), inputs, plant);
+		metrics.add(s, step * (double)h);
+	}
+	return metrics.summary();
+}
+
+//Takes plants off a shared counter until there are none left
+static void sweepWorker(const fuzzy_system_rec* fz, const DisturbanceSchedule* schedule, const WorldStateType* s,
+	float h, long steps, const vector<PlantParameters>* plants, const MetricLimits* limits,
+	atomic<int>* next, vector<MetricSummary>* results){
+	for (int i = next->fetch_add(1); i < (int)plants->size(); i = next->fetch_add(1))
+		(*results)[i] = runDisturbanceTrial(*fz, *schedule, *s, h, steps, 0, *limits, (*plants)[i]);
+}
+
+vector<MetricSummary> runPlantSweep(const fuzzy_system_rec& fz, const DisturbanceSchedule& schedule,
+	const WorldStateType& s, float h, long steps, const vector<PlantParameters>& plants,
+	const MetricLimits& limits, int threads){
+	vector<MetricSummary> results(plants.size());
+	atomic<int> next(0);
+	if (threads <= 0)
+		threads = max(1, (int)thread::hardware_concurrency());
+	threads = min(threads, (int)plants.size());
+
+	vector<thread> workers;
+	for (int i = 1; i < threads; i++)
+		workers.push_back(thread(sweepWorker, &fz, &schedule, &s, h, steps, &plants, &limits, &next, &results));
+	sweepWorker(&fz, &schedule, &s, h, steps, &plants, &limits, &next, &results);
+	for (size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	return results;
+}
@@ -0,0 +1,88 @@
+#ifndef __DISTURBANCE_H__
+#define __DISTURBANCE_H__
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "fuzzylogic.h"
+#include "pendulum.h"
+#include "metrics.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//External forces on the cart, by simulated time
+
+typedef enum { impulse_disturbance, step_disturbance, sine_disturbance, noise_disturbance } disturbance_kind;
+
+//One source of force, added to the controller's force while
+//start <= t < end
+typedef struct {
+	disturbance_kind kind;
+	double start, end;  //simulated seconds
+	float force;        //N: the level, the sine's amplitude, or the noise's standard deviation
+	float hz;           //sine only
+	unsigned int seed;  //noise only
+} Disturbance;
+
+//A list of disturbances, summed at every control tick.  Everything is a
+//function of simulated time alone (noise comes from a hash of the seed and
+//t), so a schedule gives the same forces on every run, headless or not, at
+//any speed.
+//
+//A schedule file has one disturbance per line; # starts a comment:
+//  impulse <start> <force> <duration>
+//  step    <start> <force> [<end>]
+//  sine    <start> <amplitude> <hz> <duration>
+//  noise   <start> <sigma> <duration> [<seed>]
+//and a line "end", if there is one, finishes the schedule.  An impulse
+//shorter than a tick acts for one tick, scaled to the same impulse.
+class DisturbanceSchedule{
+
+public:
+	DisturbanceSchedule();
+
+	//Adds the file's disturbances; false (with the line at fault) if it cannot be read
+	bool load(const string& path);
+	bool save(const string& path) const;
+
+	//The same, for a schedule inside another file; name and lineNo are for messages
+	bool read(istream& in, const string& name, int lineNo = 1);
+	void write(ostream& out) const;
+
+	void add(const Disturbance& d) { insert(d); }
+	void clear() { entries.clear(); keyEntry = -1; }
+
+	//A keyboard force from simulated time t until the next call (0 = none):
+	//the key becomes a step in the schedule, so a saved schedule replays it
+	void keyForce(double t, float F);
+
+	//Sum of the forces on the tick of length h from t; each trial draws
+	//its own noise
+	float force(double t, float h, unsigned int trial = 0) const;
+
+	int size() const { return (int)entries.size(); }
+
+private:
+	int insert(const Disturbance& d);  //after any with the same start; returns its index
+
+	vector<Disturbance> entries;  //by start time
+	int keyEntry;  //the open keyboard step, or -1
+};
+
+//Runs the controller and stepPendulum from s for steps ticks of h, as fast
+//as they compute, with the schedule's forces for the given trial; stops
+//early if the run fails (see MetricLimits)
+MetricSummary runDisturbanceTrial(const fuzzy_system_rec& fz, const DisturbanceSchedule& schedule,
+	WorldStateType s, float h, long steps, unsigned int trial = 0,
+	const MetricLimits& limits = defaultMetricLimits(), const PlantParameters& plant = defaultPlantParameters());
+
+//runDisturbanceTrial (trial 0) on each of plants, on threads of their own
+//(0 = one per CPU); the results are those of running them one by one
+vector<MetricSummary> runPlantSweep(const fuzzy_system_rec& fz, const DisturbanceSchedule& schedule,
+	const WorldStateType& s, float h, long steps, const vector<PlantParameters>& plants,
+	const MetricLimits& limits = defaultMetricLimits(), int threads = 0);
+
+
+#endif
@@ -0,0 +1,212 @@
+#include <thread>
+
+#include "fuzzyfit.h"
+#include "fuzzyops.h"
+#include "pendulum.h"
+
+/////////////////////////////////////////////////////////////////
+
+void record_tsk_samples(const fuzzy_system_rec &teacher, const float initial_angles[], int no_of_runs,
+	int steps, float h, const PlantParameters &plant, vector<tsk_sample> &samples) {
+	WorldStateType s;
+	tsk_sample sample;
+
+	for (int run = 0; run < no_of_runs; run++) {
+		s.init();
+		s.angle = initial_angles[run];
+
+		for (int n = 0; n < steps; n++) {
+			if (fabs(s.angle) > 0.5f || fabs(s.x) > 2.4f)
+				break;
+			getControllerInputs(s, sample.inputs);
+			getStateVector(s, sample.state);
+			s.F = fuzzy_system(sample.inputs, teacher);
+			sample.target = s.F;
+			samples.push_back(sample);
+			stepPendulum(s, h, plant);
+		}
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+template <class TNorm>
+static float rule_strengths(const float inputs[], const fuzzy_system_rec &fz, float w[]) {
+	TNorm tnorm(fz);
+	float sum = 0.0f;
+	float degrees[MAX_NO_OF_INPUTS][MAX_NO_OF_INP_REGIONS];
+
+	fuzzify_inputs(inputs, fz, degrees);
+	for (int i = 0; i < fz.no_of_rules; i++) {
+		const rule &r = fz.rules[i];
+		float weight = degrees[r.inp_index[0]][r.inp_fuzzy_set[0]];
+		for (int j = 1; j < fz.no_of_inputs; j++)
+			weight = tnorm(weight, degrees[r.inp_index[j]][r.inp_fuzzy_set[j]]);
+		w[i] = weight;
+		sum += weight;
+	}
+	return sum;
+}
+
+static float firing_strengths(const float inputs[], const fuzzy_system_rec &fz, float w[]) {
+	switch (fz.tnorm) {
+	case tnorm_product:
+		return rule_strengths<product_tnorm>(inputs, fz, w);
+	case tnorm_lukasiewicz:
+		return rule_strengths<lukasiewicz_tnorm>(inputs, fz, w);
+	case tnorm_hamacher:
+		return rule_strengths<hamacher_tnorm>(inputs, fz, w);
+	case tnorm_min:
+	default:
+		return rule_strengths<min_tnorm>(inputs, fz, w);
+	}
+}
+
+//Partial normal equations A'A (upper triangle) and A'y over samples [first, last).
+//Each sample only touches the blocks of the rules it fires.
+static void accumulate_normal_equations(const fuzzy_system_rec *fz, const vector<tsk_sample> *samples,
+	size_t first, size_t last, vector<double> *ata, vector<double> *aty) {
+	const int row = fz->no_of_state_vars + 1;
+	const int n = fz->no_of_rules * row;
+	vector<float> w(fz->no_of_rules);
+	vector<int> active(fz->no_of_rules);
+	double z[TSK_ROW_SIZE];
+
+	for (size_t k = first; k < last; k++) {
+		const tsk_sample &sample = (*samples)[k];
+		float sum = firing_strengths(sample.inputs, *fz, &w[0]);
+		if (sum < TOO_SMALL)
+			continue;
+
+		int no_of_active = 0;
+		for (int i = 0; i < fz->no_of_rules; i++) {
+			if (w[i] > 0.0f)
+				active[no_of_active++] = i;
+		}
+
+		z[0] = 1.0;
+		for (int v = 0; v < fz->no_of_state_vars; v++)
+			z[v + 1] = sample.state[v];
+
+		for (int a = 0; a < no_of_active; a++) {
+			int i = active[a];
+			double wi = w[i] / sum;
+			for (int p = 0; p < row; p++) {
+				int r = i * row + p;
+				(*aty)[r] += wi * z[p] * sample.target;
+				for (int b = a; b < no_of_active; b++) {
+					int j = active[b];
+					double wij = wi * w[j] / sum;
+					for (int q = (b == a) ? p : 0; q < row; q++)
+						(*ata)[(size_t)r * n + j * row + q] += wij * z[p] * z[q];
+				}
+			}
+		}
+	}
+}
+
+//Solves the symmetric positive definite system M x = b in place (Cholesky)
+static bool cholesky_solve(vector<double> &M, vector<double> &b, int n) {
+	for (int j = 0; j < n; j++) {
+		double d = M[(size_t)j * n + j];
+		for (int k = 0; k < j; k++)
+			d -= M[(size_t)j * n + k] * M[(size_t)j * n + k];
+		if (d <= 0.0)
+			return false;
+		d = sqrt(d);
+		M[(size_t)j * n + j] = d;
+		for (int i = j + 1; i < n; i++) {
+			double s = M[(size_t)i * n + j];
+			for (int k = 0; k < j; k++)
+				s -= M[(size_t)i * n + k] * M[(size_t)j * n + k];
+			M[(size_t)i * n + j] = s / d;
+		}
+	}
+	for (int i = 0; i < n; i++) {
+		double s = b[i];
+		for (int k = 0; k < i; k++)
+			s -= M[(size_t)i * n + k] * b[k];
+		b[i] = s / M[(size_t)i * n + i];
+	}
+	for (int i = n - 1; i >= 0; i--) {
+		double s = b[i];
+		for (int k = i + 1; k < n; k++)
+			s -= M[(size_t)k * n + i] * b[k];
+		b[i] = s / M[(size_t)i * n + i];
+	}
+	return true;
+}
+
+bool fit_tsk_consequents(fuzzy_system_rec *fz, const vector<tsk_sample> &samples, int no_of_threads, float ridge) {
+	const int row = fz->no_of_state_vars + 1;
+	const int n = fz->no_of_rules * row;
+
+	if (no_of_threads <= 0)
+		no_of_threads = max(1, (int)thread::hardware_concurrency());
+	if ((size_t)no_of_threads > samples.size())
+		no_of_threads = max(1, (int)samples.size());
+
+	vector<vector<double> > ata(no_of_threads, vector<double>((size_t)n * n, 0.0));
+	vector<vector<double> > aty(no_of_threads, vector<double>(n, 0.0));
+	vector<thread> workers;
+
+	size_t chunk = (samples.size() + no_of_threads - 1) / no_of_threads;
+	for (int t = 1; t < no_of_threads; t++) {
+		size_t first = min(samples.size(), t * chunk), last = min(samples.size(), first + chunk);
+		workers.push_back(thread(accumulate_normal_equations, fz, &samples, first, last, &ata[t], &aty[t]));
+	}
+	accumulate_normal_equations(fz, &samples, 0, min(samples.size(), chunk), &ata[0], &aty[0]);
+	for (size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+
+	vector<double> &M = ata[0], &b = aty[0];
+	for (int t = 1; t < no_of_threads; t++) {
+		for (size_t k = 0; k < M.size(); k++)
+			M[k] += ata[t][k];
+		for (int k = 0; k < n; k++)
+			b[k] += aty[t][k];
+	}
+
+	//mirror the upper triangle, then (A'A + ridge I) x = A'y + ridge x0
+	for (int r = 0; r < n; r++) {
+		for (int c = 0; c < r; c++)
+			M[(size_t)r * n + c] = M[(size_t)c * n + r];
+	}
+	for (int i = 0; i < fz->no_of_rules; i++) {
+		for (int p = 0; p < row; p++) {
+			int r = i * row + p;
+			M[(size_t)r * n + r] += ridge;
+			b[r] += ridge * fz->tsk_coeffs[i * TSK_ROW_SIZE + p];
+		}
+	}
+
+	if (!cholesky_solve(M, b, n))
+		return false;
+
+	for (int i = 0; i < fz->no_of_rules; i++) {
+		for (int p = 0; p < row; p++)
+			fz->tsk_coeffs[i * TSK_ROW_SIZE + p] = (float)b[i * row + p];
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+float tsk_rms_error(const fuzzy_system_rec &fz, const vector<tsk_sample> &samples) {
+	vector<float> w(fz.no_of_rules);
+	double sum = 0.0;
+
+	for (size_t k = 0; k < samples.size(); k++) {
+		const tsk_sample &sample = samples[k];
+		float total = firing_strengths(sample.inputs, fz, &w[0]);
+		double out = 0.0;
+		for (int i = 0; total >= TOO_SMALL && i < fz.no_of_rules; i++) {
+			const float *c = fz.tsk_coeffs + i * TSK_ROW_SIZE;
+			double y = c[0];
+			for (int v = 0; v < fz.no_of_state_vars; v++)
+				y += c[v + 1] * sample.state[v];
+			out += w[i] / total * y;
+		}
+		sum += (out - sample.target) * (out - sample.target);
+	}
+	return samples.empty() ? 0.0f : (float)sqrt(sum / samples.size());
+}
@@ -0,0 +1,35 @@
+#ifndef __FUZZYFIT_H__
+#define __FUZZYFIT_H__
+
+#include <vector>
+
+#include "fuzzylogic.h"
+#include "pendulum.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//Least-squares fitting of first-order TSK consequents
+
+typedef struct {
+	float inputs[MAX_NO_OF_INPUTS];
+	float state[MAX_NO_OF_STATE_VARS];
+	float target;
+} tsk_sample;
+
+//Runs the teacher controller in closed loop on plant from each initial angle and
+//records (inputs, state, force) once per step until the pole falls.
+void record_tsk_samples(const fuzzy_system_rec &teacher, const float initial_angles[], int no_of_runs,
+	int steps, float h, const PlantParameters &plant, vector<tsk_sample> &samples);
+
+//Solves for fz->tsk_coeffs minimising the squared output error over the
+//samples.  The normal equations are accumulated in parallel over
+//no_of_threads slices of the data (0 = one per hardware thread).  ridge
+//pulls every coefficient towards its current value, which keeps rules
+//that the data never fires unchanged.  Returns false if the system is singular.
+bool fit_tsk_consequents(fuzzy_system_rec *fz, const vector<tsk_sample> &samples, int no_of_threads, float ridge);
+
+float tsk_rms_error(const fuzzy_system_rec &fz, const vector<tsk_sample> &samples);
+
+
+#endif
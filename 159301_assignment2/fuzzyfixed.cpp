@@ -0,0 +1,373 @@
+#include "fuzzyfixed.h"
+
+/////////////////////////////////////////////////////////////////
+
+//Largest number of fraction bits that keeps +-max_abs inside 16 bits
+static int choose_frac_bits(float max_abs) {
+	int bits = 15;
+	while (bits > -15 && max_abs * ldexp(1.0f, bits) >= 32767.0f)
+		bits--;
+	return bits;
+}
+
+static int32_t quantise(float x, int frac_bits) {
+	float q = floor(x * ldexp(1.0f, frac_bits) + 0.5f);
+	if (q > 32767.0f)
+		return 32767;
+	if (q < -32768.0f)
+		return -32768;
+	return (int32_t)q;
+}
+
+//Degree per input step for a ramp over [from, to], with FIXED_SLOPE_SHIFT fraction bits
+static int32_t fixed_slope(int32_t from, int32_t to) {
+	int64_t run = (int64_t)to - from;
+	if (run == 0)
+		return 0;  //empty ramp, never evaluated
+	int64_t slope = ((int64_t)FIXED_ONE << FIXED_SLOPE_SHIFT) / run;
+	if (slope > INT32_MAX)
+		return INT32_MAX;
+	if (slope < -INT32_MAX)
+		return -INT32_MAX;
+	return (int32_t)slope;
+}
+
+static float max_breakpoint(const trapezoid &trz) {
+	switch (trz.tp) {
+	case left_trapezoid:
+	case right_trapezoid:
+		return max(fabs(trz.a), fabs(trz.b));
+	default:
+		return max(max(fabs(trz.a), fabs(trz.b)), max(fabs(trz.c), fabs(trz.d)));
+	}
+}
+
+//The controllers both engines can be generated from; anything else is fatal
+static void check_fixed_controller(const fuzzy_system_rec &fz, const char *name) {
+	if (fz.tnorm != tnorm_min || fz.defuzz != defuzz_weighted_average || fz.inference != singleton_consequents) {
+		cout << name << ": only min / weighted average / singleton controllers are supported" << endl;
+		exit(1);
+	}
+	if (fz.no_of_rules > FIXED_MAX_NO_OF_RULES) {
+		cout << name << ": too many rules (" << fz.no_of_rules << ")" << endl;
+		exit(1);
+	}
+	for (int j = 0; j < fz.no_of_inputs; j++) {
+		for (int k = 0; k < fz.no_of_inp_regions; k++) {
+			trapz_type tp = fz.inp_mem_fns[j][k].tp;
+			if (tp != regular_trapezoid && tp != left_trapezoid && tp != right_trapezoid && tp != triangle) {
+				cout << name << ": input " << j << " region " << k << " is not trapezoidal" << endl;
+				exit(1);
+			}
+		}
+	}
+}
+
+void init_fuzzy_fixed(const fuzzy_system_rec &fz, fuzzy_fixed_rec *fx) {
+	check_fixed_controller(fz, "init_fuzzy_fixed");
+
+	fx->no_of_inputs = fz.no_of_inputs;
+	fx->no_of_inp_regions = fz.no_of_inp_regions;
+	fx->no_of_rules = fz.no_of_rules;
+	fx->no_of_outputs = fz.no_of_outputs;
+
+	for (int j = 0; j < fz.no_of_inputs; j++) {
+		float range = 0.0f;
+		for (int k = 0; k < fz.no_of_inp_regions; k++)
+			range = max(range, max_breakpoint(fz.inp_mem_fns[j][k]));
+		fx->inp_frac_bits[j] = choose_frac_bits(range);
+
+		for (int k = 0; k < fz.no_of_inp_regions; k++) {
+			const trapezoid &trz = fz.inp_mem_fns[j][k];
+			fixed_trapezoid &q = fx->inp_mem_fns[j][k];
+			q.tp = trz.tp;
+			q.a = quantise(trz.a, fx->inp_frac_bits[j]);
+			q.b = quantise(trz.b, fx->inp_frac_bits[j]);
+			q.c = quantise(trz.c, fx->inp_frac_bits[j]);
+			q.d = quantise(trz.d, fx->inp_frac_bits[j]);
+			q.l_slope = 0;
+			q.r_slope = 0;
+
+			//slopes from the quantised breakpoints, so every ramp ends exactly on FIXED_ONE
+			switch (trz.tp) {
+			case left_trapezoid:
+				q.r_slope = fixed_slope(q.b, q.a);
+				break;
+			case right_trapezoid:
+				q.l_slope = fixed_slope(q.a, q.b);
+				break;
+			default:
+				q.l_slope = fixed_slope(q.a, q.b);
+				q.r_slope = fixed_slope(q.d, q.c);
+				break;
+			}
+		}
+	}
+
+	float out_range = 0.0f;
+	for (int k = 0; k < fz.no_of_outputs; k++)
+		out_range = max(out_range, (float)fabs(fz.output_values[k]));
+	fx->out_frac_bits = choose_frac_bits(out_range);
+	for (int k = 0; k < fz.no_of_outputs; k++)
+		fx->output_values[k] = quantise(fz.output_values[k], fx->out_frac_bits);
+
+	for (int i = 0; i < fz.no_of_rules; i++) {
+		for (int j = 0; j < fz.no_of_inputs; j++) {
+			fx->rules[i].inp_index[j] = (unsigned char)fz.rules[i].inp_index[j];
+			fx->rules[i].inp_fuzzy_set[j] = (unsigned char)fz.rules[i].inp_fuzzy_set[j];
+		}
+		fx->rules[i].out_fuzzy_set = (unsigned char)fz.rules[i].out_fuzzy_set;
+	}
+}
+
+int32_t fixed_input(float x, const fuzzy_fixed_rec &fx, int input) {
+	return quantise(x, fx.inp_frac_bits[input]);
+}
+
+float fixed_output_to_float(int32_t y, const fuzzy_fixed_rec &fx) {
+	return ldexp((float)y, -fx.out_frac_bits);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static int32_t ramp(int32_t x, int32_t from, int32_t slope) {
+	int32_t mu = (int32_t)(((int64_t)(x - from) * slope) >> FIXED_SLOPE_SHIFT);
+	return (mu > FIXED_ONE) ? FIXED_ONE : mu;
+}
+
+int32_t fixed_trapz(int32_t x, const fixed_trapezoid &trz) {
+	switch (trz.tp) {
+
+	case left_trapezoid:
+		if (x <= trz.a)
+			return FIXED_ONE;
+		if (x >= trz.b)
+			return 0;
+		return ramp(x, trz.b, trz.r_slope);
+
+	case right_trapezoid:
+		if (x <= trz.a)
+			return 0;
+		if (x >= trz.b)
+			return FIXED_ONE;
+		return ramp(x, trz.a, trz.l_slope);
+
+	case regular_trapezoid:
+	case triangle:
+		if ((x <= trz.a) || (x >= trz.d))
+			return 0;
+		if (x < trz.b)
+			return ramp(x, trz.a, trz.l_slope);
+		if (x > trz.c)
+			return ramp(x, trz.d, trz.r_slope);
+		return FIXED_ONE;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool fuzzy_system_fixed(const int32_t inputs[], const fuzzy_fixed_rec &fx, int32_t &output) {
+	int32_t degrees[MAX_NO_OF_INPUTS][MAX_NO_OF_INP_REGIONS];
+	int64_t sum1 = 0;
+	int32_t sum2 = 0;
+
+	for (int j = 0; j < fx.no_of_inputs; j++) {
+		for (int k = 0; k < fx.no_of_inp_regions; k++)
+			degrees[j][k] = fixed_trapz(inputs[j], fx.inp_mem_fns[j][k]);
+	}
+
+	for (int i = 0; i < fx.no_of_rules; i++) {
+		const fixed_rule &r = fx.rules[i];
+		int32_t weight = degrees[r.inp_index[0]][r.inp_fuzzy_set[0]];
+		for (int j = 1; j < fx.no_of_inputs; j++) {
+			int32_t mu = degrees[r.inp_index[j]][r.inp_fuzzy_set[j]];
+			weight = (mu < weight) ? mu : weight;
+		}
+		sum1 += (int64_t)weight * fx.output_values[r.out_fuzzy_set];
+		sum2 += weight;
+	}
+
+	if (sum2 == 0)
+		return false;
+
+	//round to nearest, away from zero on ties
+	int64_t half = sum2 / 2;
+	output = (int32_t)((sum1 >= 0 ? sum1 + half : sum1 - half) / sum2);
+	return true;
+}
+
+/////////////////////////////////////////////////////////////////
+//Q31
+
+//Largest number of fraction bits that keeps +-max_abs inside 32 bits
+static int choose_frac_bits31(float max_abs) {
+	int bits = 31;
+	while (bits > -31 && max_abs * ldexp(1.0, bits) >= 2147483647.0)
+		bits--;
+	return bits;
+}
+
+static int32_t quantise31(float x, int frac_bits) {
+	double q = floor(x * ldexp(1.0, frac_bits) + 0.5);
+	if (q > 2147483647.0)
+		return INT32_MAX;
+	if (q < -2147483648.0)
+		return INT32_MIN;
+	return (int32_t)q;
+}
+
+//As fixed_slope, with FIXED31_SLOPE_SHIFT fraction bits; |slope * run| < 2^62
+static int64_t fixed31_slope(int32_t from, int32_t to) {
+	int64_t run = (int64_t)to - from;
+	if (run == 0)
+		return 0;
+	return ((int64_t)FIXED31_ONE << FIXED31_SLOPE_SHIFT) / run;
+}
+
+void init_fuzzy_fixed31(const fuzzy_system_rec &fz, fuzzy_fixed31_rec *fx) {
+	check_fixed_controller(fz, "init_fuzzy_fixed31");
+
+	fx->no_of_inputs = fz.no_of_inputs;
+	fx->no_of_inp_regions = fz.no_of_inp_regions;
+	fx->no_of_rules = fz.no_of_rules;
+	fx->no_of_outputs = fz.no_of_outputs;
+
+	for (int j = 0; j < fz.no_of_inputs; j++) {
+		float range = 0.0f;
+		for (int k = 0; k < fz.no_of_inp_regions; k++)
+			range = max(range, max_breakpoint(fz.inp_mem_fns[j][k]));
+		fx->inp_frac_bits[j] = choose_frac_bits31(range);
+
+		for (int k = 0; k < fz.no_of_inp_regions; k++) {
+			const trapezoid &trz = fz.inp_mem_fns[j][k];
+			fixed31_trapezoid &q = fx->inp_mem_fns[j][k];
+			q.tp = trz.tp;
+			q.a = quantise31(trz.a, fx->inp_frac_bits[j]);
+			q.b = quantise31(trz.b, fx->inp_frac_bits[j]);
+			q.c = quantise31(trz.c, fx->inp_frac_bits[j]);
+			q.d = quantise31(trz.d, fx->inp_frac_bits[j]);
+			q.l_slope = 0;
+			q.r_slope = 0;
+
+			switch (trz.tp) {
+			case left_trapezoid:
+				q.r_slope = fixed31_slope(q.b, q.a);
+				break;
+			case right_trapezoid:
+				q.l_slope = fixed31_slope(q.a, q.b);
+				break;
+			default:
+				q.l_slope = fixed31_slope(q.a, q.b);
+				q.r_slope = fixed31_slope(q.d, q.c);
+				break;
+			}
+		}
+	}
+
+	float out_range = 0.0f;
+	for (int k = 0; k < fz.no_of_outputs; k++)
+		out_range = max(out_range, (float)fabs(fz.output_values[k]));
+	fx->out_frac_bits = choose_frac_bits31(out_range);
+	for (int k = 0; k < fz.no_of_outputs; k++)
+		fx->output_values[k] = quantise31(fz.output_values[k], fx->out_frac_bits);
+
+	for (int i = 0; i < fz.no_of_rules; i++) {
+		for (int j = 0; j < fz.no_of_inputs; j++) {
+			fx->rules[i].inp_index[j] = (unsigned char)fz.rules[i].inp_index[j];
+			fx->rules[i].inp_fuzzy_set[j] = (unsigned char)fz.rules[i].inp_fuzzy_set[j];
+		}
+		fx->rules[i].out_fuzzy_set = (unsigned char)fz.rules[i].out_fuzzy_set;
+	}
+}
+
+int32_t fixed31_input(float x, const fuzzy_fixed31_rec &fx, int input) {
+	return quantise31(x, fx.inp_frac_bits[input]);
+}
+
+float fixed31_output_to_float(int32_t y, const fuzzy_fixed31_rec &fx) {
+	return (float)ldexp((double)y, -fx.out_frac_bits);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//x is strictly inside the ramp, so |x - from| < |run| and the product stays under 2^62
+static int32_t ramp31(int32_t x, int32_t from, int64_t slope) {
+	int64_t mu = (((int64_t)x - from) * slope) >> FIXED31_SLOPE_SHIFT;
+	return (mu > FIXED31_ONE) ? FIXED31_ONE : (int32_t)mu;
+}
+
+int32_t fixed31_trapz(int32_t x, const fixed31_trapezoid &trz) {
+	switch (trz.tp) {
+
+	case left_trapezoid:
+		if (x <= trz.a)
+			return FIXED31_ONE;
+		if (x >= trz.b)
+			return 0;
+		return ramp31(x, trz.b, trz.r_slope);
+
+	case right_trapezoid:
+		if (x <= trz.a)
+			return 0;
+		if (x >= trz.b)
+			return FIXED31_ONE;
+		return ramp31(x, trz.a, trz.l_slope);
+
+	case regular_trapezoid:
+	case triangle:
+		if ((x <= trz.a) || (x >= trz.d))
+			return 0;
+		if (x < trz.b)
+			return ramp31(x, trz.a, trz.l_slope);
+		if (x > trz.c)
+			return ramp31(x, trz.d, trz.r_slope);
+		return FIXED31_ONE;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+bool fuzzy_system_fixed31(const int32_t inputs[], const fuzzy_fixed31_rec &fx, int32_t &output) {
+	int32_t degrees[MAX_NO_OF_INPUTS][MAX_NO_OF_INP_REGIONS];
+	int32_t weights[FIXED_MAX_NO_OF_RULES];
+	int32_t heaviest = 0;
+	int64_t sum1 = 0, sum2 = 0;
+
+	for (int j = 0; j < fx.no_of_inputs; j++) {
+		for (int k = 0; k < fx.no_of_inp_regions; k++)
+			degrees[j][k] = fixed31_trapz(inputs[j], fx.inp_mem_fns[j][k]);
+	}
+
+	for (int i = 0; i < fx.no_of_rules; i++) {
+		const fixed_rule &r = fx.rules[i];
+		int32_t weight = degrees[r.inp_index[0]][r.inp_fuzzy_set[0]];
+		for (int j = 1; j < fx.no_of_inputs; j++) {
+			int32_t mu = degrees[r.inp_index[j]][r.inp_fuzzy_set[j]];
+			weight = (mu < weight) ? mu : weight;
+		}
+		weights[i] = weight;
+		heaviest = (weight > heaviest) ? weight : heaviest;
+	}
+
+	if (heaviest == 0)
+		return false;
+
+	//Q31 x Q31 is up to 2^62 a rule; Q23 degrees leave room for 256 rules
+	int shift = (heaviest >> FIXED31_WEIGHT_SHIFT) != 0 ? FIXED31_WEIGHT_SHIFT : 0;
+	for (int i = 0; i < fx.no_of_rules; i++) {
+		int64_t weight = weights[i] >> shift;
+		sum1 += weight * fx.output_values[fx.rules[i].out_fuzzy_set];
+		sum2 += weight;
+	}
+
+	//round to nearest, away from zero on ties
+	int64_t half = sum2 / 2;
+	output = (int32_t)((sum1 >= 0 ? sum1 + half : sum1 - half) / sum2);
+	return true;
+}
@@ -0,0 +1,104 @@
+#ifndef __FUZZYFIXED_H__
+#define __FUZZYFIXED_H__
+
+#include <stdint.h>
+
+#include "fuzzylogic.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//Fixed-point inference engines for targets without an FPU.
+//
+//Generated from a float controller (min / weighted average / singleton
+//consequents, trapezoidal and triangular membership functions only) and
+//evaluated with integer arithmetic:
+//  inputs, breakpoints  Q15 with a per-input number of fraction bits chosen
+//                       so the largest breakpoint fits in 16 bits
+//  membership degrees   Q15, FIXED_ONE = 1.0
+//  slopes               degree per input step with FIXED_SLOPE_SHIFT extra
+//                       fraction bits; applied with one 32x32->64 multiply
+//  output values        Q15 with out_frac_bits fraction bits
+//  defuzzification      64-bit sums and a single integer division
+
+#define FIXED_ONE (1 << 15)
+#define FIXED_SLOPE_SHIFT 16
+
+//Enough for a complete rule table over MAX_NO_OF_INPUTS = 2 inputs
+#define FIXED_MAX_NO_OF_RULES (MAX_NO_OF_INP_REGIONS * MAX_NO_OF_INP_REGIONS)
+
+typedef struct {
+	trapz_type tp;  //regular_trapezoid, left_trapezoid, right_trapezoid or triangle
+	int32_t a, b, c, d, l_slope, r_slope;
+} fixed_trapezoid;
+
+typedef struct {
+	unsigned char inp_index[MAX_NO_OF_INPUTS],
+		inp_fuzzy_set[MAX_NO_OF_INPUTS],
+		out_fuzzy_set;
+} fixed_rule;
+
+typedef struct {
+	int no_of_inputs, no_of_inp_regions, no_of_rules, no_of_outputs;
+	int inp_frac_bits[MAX_NO_OF_INPUTS];
+	int out_frac_bits;
+	fixed_trapezoid inp_mem_fns[MAX_NO_OF_INPUTS][MAX_NO_OF_INP_REGIONS];
+	fixed_rule rules[FIXED_MAX_NO_OF_RULES];
+	int32_t output_values[MAX_NO_OF_OUTPUT_VALUES];
+} fuzzy_fixed_rec;
+
+//---------------------------------------------------------------------------
+
+//Quantises a float controller.  Unsupported operators or shapes are fatal.
+void init_fuzzy_fixed(const fuzzy_system_rec &fz, fuzzy_fixed_rec *fx);
+
+//Saturating conversions between real units and the engine's Q formats
+int32_t fixed_input(float x, const fuzzy_fixed_rec &fx, int input);
+float fixed_output_to_float(int32_t y, const fuzzy_fixed_rec &fx);
+
+int32_t fixed_trapz(int32_t x, const fixed_trapezoid &trz);
+
+//Output in out_frac_bits format; false if no rule fires
+bool fuzzy_system_fixed(const int32_t inputs[], const fuzzy_fixed_rec &fx, int32_t &output);
+
+/////////////////////////////////////////////////////
+//The same engine in Q31, for 32-bit targets that need more than Q15's
+//resolution.  Same controllers as above:
+//  inputs, breakpoints  Q31 with per-input fraction bits, as above
+//  membership degrees   Q31, FIXED31_ONE = 1.0 - 2^-31
+//  slopes               FIXED31_SLOPE_SHIFT extra fraction bits, in 64 bits
+//  output values        Q31 with out_frac_bits fraction bits
+//  defuzzification      64-bit sums and a single integer division; degrees
+//                       lose FIXED31_WEIGHT_SHIFT bits there, once any is
+//                       that large, so that every rule's product still fits
+
+#define FIXED31_ONE INT32_MAX
+#define FIXED31_SLOPE_SHIFT 31
+#define FIXED31_WEIGHT_SHIFT 8
+
+typedef struct {
+	trapz_type tp;
+	int32_t a, b, c, d;
+	int64_t l_slope, r_slope;
+} fixed31_trapezoid;
+
+typedef struct {
+	int no_of_inputs, no_of_inp_regions, no_of_rules, no_of_outputs;
+	int inp_frac_bits[MAX_NO_OF_INPUTS];
+	int out_frac_bits;
+	fixed31_trapezoid inp_mem_fns[MAX_NO_OF_INPUTS][MAX_NO_OF_INP_REGIONS];
+	fixed_rule rules[FIXED_MAX_NO_OF_RULES];
+	int32_t output_values[MAX_NO_OF_OUTPUT_VALUES];
+} fuzzy_fixed31_rec;
+
+void init_fuzzy_fixed31(const fuzzy_system_rec &fz, fuzzy_fixed31_rec *fx);
+
+int32_t fixed31_input(float x, const fuzzy_fixed31_rec &fx, int input);
+float fixed31_output_to_float(int32_t y, const fuzzy_fixed31_rec &fx);
+
+int32_t fixed31_trapz(int32_t x, const fixed31_trapezoid &trz);
+
+bool fuzzy_system_fixed31(const int32_t inputs[], const fuzzy_fixed31_rec &fx, int32_t &output);
+
+
+#endif
@@ -1,5 +1,6 @@
 #include <algorithm>
 #include "fuzzylogic.h"
+#include "fuzzyops.h"
 
 /////////////////////////////////////////////////////////////////
 
@@ -148,6 +149,15 @@ void initMembershipFunctions(fuzzy_system_rec *fl) {
 	fl->inp_mem_fns[in_theta_and_theta_dot][in_pm] = init_trapz(0.12, 0.18, 0.0, 0.0, right_trapezoid);
 }
 
+void initOutputMembershipFunctions(fuzzy_system_rec *fl) {
+
+	/* Triangles centred on the singleton output values, overlapping their neighbours */
+	for (int k = 0; k < fl->no_of_outputs; k++) {
+		fl->out_mem_fns[k] = init_trapz(fl->output_values[k] - 15.0f, fl->output_values[k],
+			fl->output_values[k], fl->output_values[k] + 15.0f, regular_trapezoid);
+	}
+}
+
 void initFuzzySystem(fuzzy_system_rec *fl) {
 	//Note: The settings of these parameters will depend upon your fuzzy system design
 	fl->no_of_inputs = 2;  /* Inputs are handled 2 at a time only */
@@ -166,9 +176,69 @@ void initFuzzySystem(fuzzy_system_rec *fl) {
 	fl->output_values[out_pl] = 45.0;
 	fl->output_values[out_pvl] = 60.0;
 
+	fl->tnorm = tnorm_min;
+	fl->defuzz = defuzz_weighted_average;
+	fl->hamacher_gamma = 0.0f;
+	fl->inference = singleton_consequents;
+	fl->implication = implication_clip;
+	fl->aggregation = aggregation_max;
+
 	fl->rules = (rule *)malloc((size_t)(fl->no_of_rules*sizeof(rule)));
+	fl->tsk_coeffs = (float *)malloc((size_t)(fl->no_of_rules*TSK_ROW_SIZE*sizeof(float)));
+	fl->no_of_state_vars = MAX_NO_OF_STATE_VARS;
+	fl->allocated = true;
 	initFuzzyRules(fl);
 	initMembershipFunctions(fl);
+	initOutputMembershipFunctions(fl);
+	init_tsk_consequents(fl);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//3 x 3 first-order TSK controller over the same Yamakawa inputs.
+//Only the nm/ze/pm regions are used; the consequents are meant to be fitted
+//(see fit_tsk_consequents) and start from a coarse zero-order rule table.
+void initTskFuzzySystem(fuzzy_system_rec *fl) {
+	const short regions[3] = { in_nm, in_ze, in_pm };
+	const short famm[3][3] = {
+		out_ns, out_ps, out_pvl,
+		out_nm, out_ze, out_pm,
+		out_nvl, out_ns, out_ps
+	};
+
+	initFuzzySystem(fl);
+	fl->no_of_rules = 9;
+	fl->inference = tsk_consequents;
+
+	for (int i = 0; i < 3; i++) {
+		for (int j = 0; j < 3; j++) {
+			rule &r = fl->rules[i * 3 + j];
+			r.inp_index[0] = in_theta_and_theta_dot;
+			r.inp_index[1] = in_x_and_x_dot;
+			r.inp_fuzzy_set[0] = regions[i];
+			r.inp_fuzzy_set[1] = regions[2 - j];
+			r.out_fuzzy_set = famm[j][i];
+		}
+	}
+
+	fl->inp_mem_fns[in_theta_and_theta_dot][in_nm] = init_trapz(-0.12f, 0.0f, 0.0f, 0.0f, left_trapezoid);
+	fl->inp_mem_fns[in_theta_and_theta_dot][in_ze] = init_trapz(-0.12f, 0.0f, 0.0f, 0.12f, regular_trapezoid);
+	fl->inp_mem_fns[in_theta_and_theta_dot][in_pm] = init_trapz(0.0f, 0.12f, 0.0f, 0.0f, right_trapezoid);
+	fl->inp_mem_fns[in_x_and_x_dot][in_nm] = init_trapz(-1.8f, 0.0f, 0.0f, 0.0f, left_trapezoid);
+	fl->inp_mem_fns[in_x_and_x_dot][in_ze] = init_trapz(-1.8f, 0.0f, 0.0f, 1.8f, regular_trapezoid);
+	fl->inp_mem_fns[in_x_and_x_dot][in_pm] = init_trapz(0.0f, 1.8f, 0.0f, 0.0f, right_trapezoid);
+
+	init_tsk_consequents(fl);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+//Zero-order start: every TSK consequent is its rule's singleton output value
+void init_tsk_consequents(fuzzy_system_rec *fz) {
+	for (int i = 0; i < fz->no_of_rules; i++) {
+		float *c = fz->tsk_coeffs + i * TSK_ROW_SIZE;
+		c[0] = fz->output_values[fz->rules[i].out_fuzzy_set];
+		for (int v = 1; v < TSK_ROW_SIZE; v++)
+			c[v] = 0.0f;
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -181,9 +251,11 @@ trapezoid init_trapz(float x1, float x2, float x3, float x4, trapz_type typ) {
 	trz.c = x3;
 	trz.d = x4;
 	trz.tp = typ;
+	trz.no_of_points = 0;
 	switch (trz.tp) {
 
 	case regular_trapezoid:
+	case triangle:
 		trz.l_slope = 1.0 / (trz.b - trz.a);
 		trz.r_slope = 1.0 / (trz.c - trz.d);
 		break;
@@ -197,16 +269,63 @@ trapezoid init_trapz(float x1, float x2, float x3, float x4, trapz_type typ) {
 		trz.l_slope = 1.0 / (trz.b - trz.a);
 		trz.r_slope = 0.0;
 		break;
+
+	default:
+		trz.l_slope = 0.0;
+		trz.r_slope = 0.0;
+		break;
 	}  /* end switch  */
 
 	return trz;
 }  /* end function */
 
+//////////////////////////////////////////////////////////////////////////////
+//Other shapes keep their parameters in the trapezoid record:
+//  triangle          a = left foot, b = c = peak, d = right foot
+//  gaussian          a = centre, b = sigma, l_slope = -1 / (2 sigma^2)
+//  generalized_bell  a = width, b = slope, c = centre, l_slope = 1 / width
+//  sigmoid           a = slope, c = centre
+//  piecewise_linear  px/py breakpoints
+
+trapezoid init_triangle(float left, float peak, float right) {
+	return init_trapz(left, peak, peak, right, triangle);
+}
+
+trapezoid init_gaussian(float centre, float sigma) {
+	trapezoid trz = init_trapz(centre, sigma, 0.0, 0.0, gaussian);
+	trz.l_slope = -1.0f / (2.0f * sigma * sigma);
+	return trz;
+}
+
+trapezoid init_gbell(float width, float slope, float centre) {
+	trapezoid trz = init_trapz(width, slope, centre, 0.0, generalized_bell);
+	trz.l_slope = 1.0f / width;
+	return trz;
+}
+
+trapezoid init_sigmoid(float slope, float centre) {
+	return init_trapz(slope, 0.0, centre, 0.0, sigmoid);
+}
+
+trapezoid init_pwl(const float xs[], const float ys[], int no_of_points) {
+	if (no_of_points < 2 || no_of_points > MAX_NO_OF_PWL_POINTS) {
+		cout << "init_pwl: " << no_of_points << " points, not 2 to " << MAX_NO_OF_PWL_POINTS << endl;
+		exit(1);
+	}
+	trapezoid trz = init_trapz(xs[0], xs[no_of_points - 1], 0.0, 0.0, piecewise_linear);
+	trz.no_of_points = no_of_points;
+	for (int i = 0; i < no_of_points; i++) {
+		trz.px[i] = xs[i];
+		trz.py[i] = ys[i];
+	}
+	return trz;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 
 //////////////////////////////////////////////////////////////////////////////
-float trapz(float x, trapezoid trz) {
+float trapz(float x, const trapezoid &trz) {
 	switch (trz.tp) {
 
 	case left_trapezoid:
@@ -235,12 +354,47 @@ float trapz(float x, trapezoid trz) {
 			return trz.l_slope * (x - trz.a);
 		if ((x >= trz.c) && (x <= trz.d))
 			return  trz.r_slope * (x - trz.d);
+		break;
+
+	case triangle:
+		if ((x <= trz.a) || (x >= trz.d))
+			return 0.0;
+		if (x <= trz.b)
+			return trz.l_slope * (x - trz.a);
+		return trz.r_slope * (x - trz.d);
+
+	case gaussian:
+		return exp(trz.l_slope * (x - trz.a) * (x - trz.a));
+
+	case generalized_bell:
+		return 1.0f / (1.0f + pow(fabs((x - trz.c) * trz.l_slope), 2.0f * trz.b));
+
+	case sigmoid:
+		return 1.0f / (1.0f + exp(-trz.a * (x - trz.c)));
+
+	case piecewise_linear:
+		if (x <= trz.px[0])
+			return trz.py[0];
+		for (int i = 1; i < trz.no_of_points; i++) {
+			if (x <= trz.px[i])
+				return trz.py[i - 1] + (trz.py[i] - trz.py[i - 1]) * (x - trz.px[i - 1]) / (trz.px[i] - trz.px[i - 1]);
+		}
+		return trz.py[trz.no_of_points - 1];
 
 	}  /* End switch  */
 
 	return 0.0;  /* should not get to this point */
 }  /* End function */
 
+//////////////////////////////////////////////////////////////////////////////
+//Degree of every (input, region) pair, so rules sharing a fuzzy set share the evaluation
+void fuzzify_inputs(const float inputs[], const fuzzy_system_rec &fz, float degrees[][MAX_NO_OF_INP_REGIONS]) {
+	for (int j = 0; j < fz.no_of_inputs; j++) {
+		for (int k = 0; k < fz.no_of_inp_regions; k++)
+			degrees[j][k] = trapz(inputs[j], fz.inp_mem_fns[j][k]);
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////////
 float min_of(float values[], int no_of_inps) {
 	int i;
@@ -254,38 +408,97 @@ float min_of(float values[], int no_of_inps) {
 }
 
 //////////////////////////////////////////////////////////////////////////////
-float fuzzy_system(float inputs[], fuzzy_system_rec fz) {
-	int i, j;
-	short variable_index, fuzzy_set;
-	float sum1 = 0.0, sum2 = 0.0, weight;
-	float m_values[MAX_NO_OF_INPUTS];
-
-	for (i = 0; i < fz.no_of_rules; i++) {
-		for (j = 0; j < fz.no_of_inputs; j++) {
-			variable_index = fz.rules[i].inp_index[j];
-			fuzzy_set = fz.rules[i].inp_fuzzy_set[j];
-			m_values[j] = trapz(inputs[variable_index],
-				fz.inp_mem_fns[variable_index][fuzzy_set]);
-		} /* end j  */
-		weight = min_of(m_values, fz.no_of_inputs);
-		sum1 += weight * fz.output_values[fz.rules[i].out_fuzzy_set];
-		sum2 += weight;
-	} /* end i  */
-
-	if (fabs(sum2) < TOO_SMALL) {
-		cout << "\r\nFLPRCS Error: Sum2 in fuzzy_system is 0.  Press key: " << endl;
-		//~ getch();
-		exit(1);
-		return 0.0;
+template <class TNorm>
+static fuzzy_kernel_fn select_defuzz_kernel(const fuzzy_system_rec &fz) {
+	switch (fz.defuzz) {
+	case defuzz_centroid:
+		return fuzzy_system_kernel<TNorm, centroid_defuzz>;
+	case defuzz_bisector:
+		return fuzzy_system_kernel<TNorm, bisector_defuzz>;
+	case defuzz_mean_of_maximum:
+		return fuzzy_system_kernel<TNorm, mean_of_maximum_defuzz>;
+	case defuzz_weighted_average:
+	default:
+		return fuzzy_system_kernel<TNorm, weighted_average_defuzz>;
+	}
+}
+
+template <class TNorm>
+static fuzzy_kernel_fn select_mamdani_kernel(const fuzzy_system_rec &fz) {
+	if (fz.aggregation == aggregation_sum) {
+		if (fz.implication == implication_scale)
+			return fuzzy_system_kernel<TNorm, mamdani_sum_defuzz<scale_implication> >;
+		return fuzzy_system_kernel<TNorm, mamdani_sum_defuzz<clip_implication> >;
+	}
+	if (fz.implication == implication_scale)
+		return fuzzy_system_kernel<TNorm, mamdani_max_defuzz<scale_implication> >;
+	return fuzzy_system_kernel<TNorm, mamdani_max_defuzz<clip_implication> >;
+}
+
+template <class TNorm>
+static fuzzy_kernel_fn select_consequent_kernel(const fuzzy_system_rec &fz) {
+	if (fz.inference == mamdani_consequents)
+		return select_mamdani_kernel<TNorm>(fz);
+	return select_defuzz_kernel<TNorm>(fz);
+}
+
+fuzzy_kernel_fn select_fuzzy_kernel(const fuzzy_system_rec &fz) {
+	switch (fz.tnorm) {
+	case tnorm_product:
+		return select_consequent_kernel<product_tnorm>(fz);
+	case tnorm_lukasiewicz:
+		return select_consequent_kernel<lukasiewicz_tnorm>(fz);
+	case tnorm_hamacher:
+		return select_consequent_kernel<hamacher_tnorm>(fz);
+	case tnorm_min:
+	default:
+		return select_consequent_kernel<min_tnorm>(fz);
 	}
+}
 
-	return (sum1 / sum2);
+//////////////////////////////////////////////////////////////////////////////
+float fuzzy_system(float inputs[], const fuzzy_system_rec &fz) {
+	float output = 0.0;
+
+	//no rule fired (the Lukasiewicz T-norm can leave gaps between sets): no force
+	if (!select_fuzzy_kernel(fz)(inputs, fz, output))
+		return 0.0;
+
+	return output;
 }  /* end fuzzy_system  */
 
+//////////////////////////////////////////////////////////////////////////////
+float fuzzy_system_tsk(float inputs[], const float state[], const fuzzy_system_rec &fz) {
+	float output = 0.0;
+	bool fired;
+
+	switch (fz.tnorm) {
+	case tnorm_product:
+		fired = fuzzy_system_tsk_kernel<product_tnorm>(inputs, state, fz, output);
+		break;
+	case tnorm_lukasiewicz:
+		fired = fuzzy_system_tsk_kernel<lukasiewicz_tnorm>(inputs, state, fz, output);
+		break;
+	case tnorm_hamacher:
+		fired = fuzzy_system_tsk_kernel<hamacher_tnorm>(inputs, state, fz, output);
+		break;
+	case tnorm_min:
+	default:
+		fired = fuzzy_system_tsk_kernel<min_tnorm>(inputs, state, fz, output);
+		break;
+	}
+
+	if (!fired)
+		return 0.0;  //as in fuzzy_system
+
+	return output;
+}  /* end fuzzy_system_tsk  */
+
 //////////////////////////////////////////////////////////////////////////////
 void free_fuzzy_rules(fuzzy_system_rec *fz) {
 	if (fz->allocated){
 		free(fz->rules);
+		free(fz->tsk_coeffs);
 	}
 	fz->allocated = false;
 }
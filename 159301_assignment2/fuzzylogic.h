@@ -20,12 +20,38 @@ using namespace std;
 //~ #define MAX_NO_OF_INPUTS 5
 #define MAX_NO_OF_INPUTS 2
 #define MAX_NO_OF_INP_REGIONS 5
-#define MAX_NO_OF_OUTPUT_VALUES 8
+#define MAX_NO_OF_OUTPUT_VALUES 9
+
+//TSK consequents: y = c0 + c1*s1 + ... over the raw plant state
+#define MAX_NO_OF_STATE_VARS 4
+#define TSK_ROW_SIZE (MAX_NO_OF_STATE_VARS + 1)
+
+#define MAX_NO_OF_PWL_POINTS 8
 
 #define TOO_SMALL 1e-6
 
-//Trapezoidal membership function types
-typedef enum { regular_trapezoid, left_trapezoid, right_trapezoid } trapz_type;
+//Membership function types.  The trapezoidal shapes come first; the others
+//reuse the trapezoid record (see the init_* functions for the parameters).
+typedef enum { regular_trapezoid, left_trapezoid, right_trapezoid,
+	triangle, gaussian, generalized_bell, sigmoid, piecewise_linear } trapz_type;
+
+#define NO_OF_MF_SHAPES 8
+
+//T-norm used for the fuzzy AND of a rule's antecedents
+typedef enum { tnorm_min, tnorm_product, tnorm_lukasiewicz, tnorm_hamacher } tnorm_type;
+
+//Defuzzification methods
+typedef enum { defuzz_weighted_average, defuzz_centroid, defuzz_bisector, defuzz_mean_of_maximum } defuzz_type;
+
+//Rule consequents: singleton output_values, Mamdani output sets (out_mem_fns),
+//or first-order Takagi-Sugeno linear functions of the state (tsk_coeffs)
+typedef enum { singleton_consequents, mamdani_consequents, tsk_consequents } inference_type;
+
+//Mamdani implication: clip the output set at the firing strength, or scale it
+typedef enum { implication_clip, implication_scale } implication_type;
+
+//Mamdani aggregation of the implied output sets
+typedef enum { aggregation_max, aggregation_sum } aggregation_type;
 
 //Input parameters
 //enum {in_theta,in_theta_dot,in_x,in_x_dot};
@@ -48,6 +74,9 @@ typedef struct {
 	trapz_type tp;
 	float a, b, c, d, l_slope, r_slope;
 
+	//piecewise_linear only: breakpoints in increasing x
+	short no_of_points;
+	float px[MAX_NO_OF_PWL_POINTS], py[MAX_NO_OF_PWL_POINTS];
 }trapezoid;
 
 typedef struct {
@@ -62,6 +91,17 @@ typedef struct {
 	rule *rules;
 	int no_of_inputs, no_of_inp_regions, no_of_rules, no_of_outputs;
 	float output_values[MAX_NO_OF_OUTPUT_VALUES];
+	trapezoid out_mem_fns[MAX_NO_OF_OUTPUT_VALUES]; //regular trapezoids only
+	float *tsk_coeffs; //no_of_rules rows of TSK_ROW_SIZE, allocated with the rules
+	int no_of_state_vars;
+
+	//Operators, selected per controller (defaults: min / weighted average)
+	tnorm_type tnorm;
+	defuzz_type defuzz;
+	float hamacher_gamma;
+	inference_type inference;  //Mamdani consequents are always defuzzified by centroid
+	implication_type implication;
+	aggregation_type aggregation;
 } fuzzy_system_rec;
 
 extern fuzzy_system_rec g_fuzzy_system;
@@ -69,18 +109,29 @@ extern fuzzy_system_rec g_fuzzy_system;
 //---------------------------------------------------------------------------
 
 trapezoid init_trapz(float x1, float x2, float x3, float x4, trapz_type typ);
-float fuzzy_system(float inputs[], fuzzy_system_rec fl);
+float fuzzy_system(float inputs[], const fuzzy_system_rec &fl);
 void free_fuzzy_rules(fuzzy_system_rec *fz);
 
 //-------------------------------------------------------------------------
 void initFuzzyRules(fuzzy_system_rec *fl);
 void initMembershipFunctions(fuzzy_system_rec *fl);
+void initOutputMembershipFunctions(fuzzy_system_rec *fl);
 void initFuzzySystem(fuzzy_system_rec *fl);
+void initTskFuzzySystem(fuzzy_system_rec *fl);
 
 trapezoid init_trapz(float x1, float x2, float x3, float x4, trapz_type typ);
-float trapz(float x, trapezoid trz);
+trapezoid init_triangle(float left, float peak, float right);
+trapezoid init_gaussian(float centre, float sigma);
+trapezoid init_gbell(float width, float slope, float centre);
+trapezoid init_sigmoid(float slope, float centre);
+trapezoid init_pwl(const float xs[], const float ys[], int no_of_points);
+float trapz(float x, const trapezoid &trz);
+void fuzzify_inputs(const float inputs[], const fuzzy_system_rec &fz, float degrees[][MAX_NO_OF_INP_REGIONS]);
 float min_of(float values[], int no_of_inps);
-float fuzzy_system(float inputs[], fuzzy_system_rec fz);
+//Both give 0 when no rule fires
+float fuzzy_system(float inputs[], const fuzzy_system_rec &fz);
+float fuzzy_system_tsk(float inputs[], const float state[], const fuzzy_system_rec &fz);
+void init_tsk_consequents(fuzzy_system_rec *fz);
 void free_fuzzy_rules(fuzzy_system_rec *fz);
 
 
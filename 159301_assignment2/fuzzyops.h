@@ -0,0 +1,358 @@
+#ifndef __FUZZYOPS_H__
+#define __FUZZYOPS_H__
+
+#include "fuzzylogic.h"
+
+/////////////////////////////////////////////////////
+//Operator kernels for the fuzzy engine.
+//
+//Every T-norm and defuzzifier is a small functor that the compiler inlines
+//into fuzzy_system_kernel<>.  One kernel is instantiated per combination, so
+//the rule loop never goes through a function pointer or virtual call; the
+//choice is made once per call in fuzzy_system() (see fuzzylogic.cpp).
+
+//---------------------------------------------------------------------------
+// T-norms (fuzzy AND)
+
+struct min_tnorm {
+	min_tnorm(const fuzzy_system_rec &) {}
+	float operator()(float a, float b) const { return (b < a) ? b : a; }
+};
+
+struct product_tnorm {
+	product_tnorm(const fuzzy_system_rec &) {}
+	float operator()(float a, float b) const { return a * b; }
+};
+
+struct lukasiewicz_tnorm {
+	lukasiewicz_tnorm(const fuzzy_system_rec &) {}
+	float operator()(float a, float b) const {
+		float t = a + b - 1.0f;
+		return (t > 0.0f) ? t : 0.0f;
+	}
+};
+
+//Hamacher family: ab / (gamma + (1 - gamma)(a + b - ab)), gamma >= 0.
+//gamma = 0 is the Hamacher product, gamma = 1 the algebraic product.
+struct hamacher_tnorm {
+	float gamma;
+	hamacher_tnorm(const fuzzy_system_rec &fz) : gamma(fz.hamacher_gamma) {}
+	float operator()(float a, float b) const {
+		float ab = a * b;
+		float den = gamma + (1.0f - gamma) * (a + b - ab);
+		return (den > TOO_SMALL) ? ab / den : 0.0f;
+	}
+};
+
+//---------------------------------------------------------------------------
+// Defuzzifiers
+//
+// accumulate() is called once per rule with the rule firing strength.
+// result() returns false when no rule fired.
+//
+// The aggregated defuzzifiers (centroid, bisector, mean of maximum) combine
+// rules that share an output term with max, then work on the singleton
+// output_values.  Terms are assumed to be ordered along the output universe
+// in the same order as the out_* enum.
+
+struct weighted_average_defuzz {
+	const float *values;
+	float sum1, sum2;
+	weighted_average_defuzz(const fuzzy_system_rec &fz) : values(fz.output_values), sum1(0.0f), sum2(0.0f) {}
+	void accumulate(float weight, short out_fuzzy_set) {
+		sum1 += weight * values[out_fuzzy_set];
+		sum2 += weight;
+	}
+	bool result(float &out) const {
+		if (fabs(sum2) < TOO_SMALL)
+			return false;
+		out = sum1 / sum2;
+		return true;
+	}
+};
+
+struct aggregated_defuzz_base {
+	const float *values;
+	int no_of_outputs;
+	float strength[MAX_NO_OF_OUTPUT_VALUES];
+	aggregated_defuzz_base(const fuzzy_system_rec &fz) : values(fz.output_values), no_of_outputs(fz.no_of_outputs) {
+		for (int k = 0; k < MAX_NO_OF_OUTPUT_VALUES; k++)
+			strength[k] = 0.0f;
+	}
+	void accumulate(float weight, short out_fuzzy_set) {
+		if (weight > strength[out_fuzzy_set])
+			strength[out_fuzzy_set] = weight;
+	}
+};
+
+struct centroid_defuzz : aggregated_defuzz_base {
+	centroid_defuzz(const fuzzy_system_rec &fz) : aggregated_defuzz_base(fz) {}
+	bool result(float &out) const {
+		float sum1 = 0.0f, sum2 = 0.0f;
+		for (int k = 0; k < no_of_outputs; k++) {
+			sum1 += strength[k] * values[k];
+			sum2 += strength[k];
+		}
+		if (sum2 < TOO_SMALL)
+			return false;
+		out = sum1 / sum2;
+		return true;
+	}
+};
+
+struct bisector_defuzz : aggregated_defuzz_base {
+	bisector_defuzz(const fuzzy_system_rec &fz) : aggregated_defuzz_base(fz) {}
+	bool result(float &out) const {
+		float total = 0.0f;
+		for (int k = 0; k < no_of_outputs; k++)
+			total += strength[k];
+		if (total < TOO_SMALL)
+			return false;
+
+		//first singleton at which the cumulative strength reaches half the total
+		float half = 0.5f * total, running = 0.0f;
+		for (int k = 0; k < no_of_outputs; k++) {
+			running += strength[k];
+			if (running >= half) {
+				out = values[k];
+				return true;
+			}
+		}
+		out = values[no_of_outputs - 1];
+		return true;
+	}
+};
+
+struct mean_of_maximum_defuzz : aggregated_defuzz_base {
+	mean_of_maximum_defuzz(const fuzzy_system_rec &fz) : aggregated_defuzz_base(fz) {}
+	bool result(float &out) const {
+		float peak = 0.0f;
+		for (int k = 0; k < no_of_outputs; k++) {
+			if (strength[k] > peak)
+				peak = strength[k];
+		}
+		if (peak < TOO_SMALL)
+			return false;
+
+		float sum = 0.0f;
+		int count = 0;
+		for (int k = 0; k < no_of_outputs; k++) {
+			if (strength[k] >= peak - TOO_SMALL) {
+				sum += values[k];
+				count++;
+			}
+		}
+		out = sum / count;
+		return true;
+	}
+};
+
+//---------------------------------------------------------------------------
+// Mamdani consequents
+//
+// An implied output set is the polyline (a,0) (b',h) (c',h) (d,0) of a regular
+// trapezoid at firing strength h.  Its area and first moment are exact sums
+// over the three linear segments, so centroid needs no sampled universe.
+
+struct clip_implication {
+	static void apply(const trapezoid &t, float h, float px[4], float py[4]) {
+		px[0] = t.a; px[1] = t.a + h * (t.b - t.a); px[2] = t.d - h * (t.d - t.c); px[3] = t.d;
+		py[0] = 0.0f; py[1] = h; py[2] = h; py[3] = 0.0f;
+	}
+};
+
+struct scale_implication {
+	static void apply(const trapezoid &t, float h, float px[4], float py[4]) {
+		px[0] = t.a; px[1] = t.b; px[2] = t.c; px[3] = t.d;
+		py[0] = 0.0f; py[1] = h; py[2] = h; py[3] = 0.0f;
+	}
+};
+
+//Area and first moment of the line from (x0,y0) to (x1,y1) above the axis
+inline void segment_moments(float x0, float y0, float x1, float y1, float &area, float &moment) {
+	float w = x1 - x0;
+	area += 0.5f * w * (y0 + y1);
+	moment += w * (y0 * (2.0f * x0 + x1) + y1 * (x0 + 2.0f * x1)) * (1.0f / 6.0f);
+}
+
+//Additive aggregation: the centroid of a sum is the area-weighted mean of the
+//individual centroids, so every rule is folded in as it fires.
+template <class Implication>
+struct mamdani_sum_defuzz {
+	const trapezoid *sets;
+	float area, moment;
+	mamdani_sum_defuzz(const fuzzy_system_rec &fz) : sets(fz.out_mem_fns), area(0.0f), moment(0.0f) {}
+	void accumulate(float weight, short out_fuzzy_set) {
+		if (weight <= 0.0f)
+			return;
+		float px[4], py[4];
+		Implication::apply(sets[out_fuzzy_set], weight, px, py);
+		for (int s = 0; s < 3; s++)
+			segment_moments(px[s], py[s], px[s + 1], py[s + 1], area, moment);
+	}
+	bool result(float &out) const {
+		if (area < TOO_SMALL)
+			return false;
+		out = moment / area;
+		return true;
+	}
+};
+
+//Max aggregation: the upper envelope of the implied sets is piecewise linear
+//with kinks only at the set vertices and where two set edges cross.  Between
+//consecutive kinks a single set is on top, so the envelope integrates exactly.
+template <class Implication>
+struct mamdani_max_defuzz : aggregated_defuzz_base {
+	const trapezoid *sets;
+	mamdani_max_defuzz(const fuzzy_system_rec &fz) : aggregated_defuzz_base(fz), sets(fz.out_mem_fns) {}
+
+	bool result(float &out) const {
+		float px[MAX_NO_OF_OUTPUT_VALUES][4], py[MAX_NO_OF_OUTPUT_VALUES][4];
+		float kinks[MAX_NO_OF_OUTPUT_VALUES * 4 + MAX_NO_OF_OUTPUT_VALUES * MAX_NO_OF_OUTPUT_VALUES * 9];
+		int active = 0, no_of_kinks = 0;
+
+		for (int k = 0; k < no_of_outputs; k++) {
+			if (strength[k] <= 0.0f)
+				continue;
+			Implication::apply(sets[k], strength[k], px[active], py[active]);
+			for (int v = 0; v < 4; v++)
+				kinks[no_of_kinks++] = px[active][v];
+			active++;
+		}
+		if (active == 0)
+			return false;
+
+		//edge crossings between every pair of implied sets
+		for (int i = 0; i < active; i++) {
+			for (int j = i + 1; j < active; j++) {
+				if (px[j][0] >= px[i][3] || px[i][0] >= px[j][3])
+					continue;
+				for (int s = 0; s < 3; s++) {
+					float wi = px[i][s + 1] - px[i][s];
+					if (wi <= 0.0f)
+						continue;
+					float mi = (py[i][s + 1] - py[i][s]) / wi;
+					for (int t = 0; t < 3; t++) {
+						float wj = px[j][t + 1] - px[j][t];
+						if (wj <= 0.0f)
+							continue;
+						float mj = (py[j][t + 1] - py[j][t]) / wj;
+						if (mi == mj)
+							continue;
+						float x = (py[j][t] - mj * px[j][t] - py[i][s] + mi * px[i][s]) / (mi - mj);
+						if (x > px[i][s] && x < px[i][s + 1] && x > px[j][t] && x < px[j][t + 1])
+							kinks[no_of_kinks++] = x;
+					}
+				}
+			}
+		}
+
+		//insertion sort; there are only a few dozen kinks
+		for (int i = 1; i < no_of_kinks; i++) {
+			float key = kinks[i];
+			int j = i - 1;
+			while (j >= 0 && kinks[j] > key) {
+				kinks[j + 1] = kinks[j];
+				j--;
+			}
+			kinks[j + 1] = key;
+		}
+
+		float area = 0.0f, moment = 0.0f;
+		for (int n = 0; n + 1 < no_of_kinks; n++) {
+			float x0 = kinks[n], x1 = kinks[n + 1];
+			if (x1 <= x0)
+				continue;
+			//the set on top at the midpoint is on top over the whole interval
+			float mid = 0.5f * (x0 + x1), best = 0.0f, y0 = 0.0f, y1 = 0.0f;
+			for (int i = 0; i < active; i++) {
+				if (mid <= px[i][0] || mid >= px[i][3])
+					continue;
+				int s = (mid < px[i][1]) ? 0 : ((mid < px[i][2]) ? 1 : 2);
+				float m = (py[i][s + 1] - py[i][s]) / (px[i][s + 1] - px[i][s]);
+				float y = py[i][s] + m * (mid - px[i][s]);
+				if (y > best) {
+					best = y;
+					y0 = py[i][s] + m * (x0 - px[i][s]);
+					y1 = py[i][s] + m * (x1 - px[i][s]);
+				}
+			}
+			if (best > 0.0f)
+				segment_moments(x0, y0, x1, y1, area, moment);
+		}
+
+		if (area < TOO_SMALL)
+			return false;
+		out = moment / area;
+		return true;
+	}
+};
+
+//---------------------------------------------------------------------------
+// Inference kernel
+
+template <class TNorm, class Defuzz>
+bool fuzzy_system_kernel(const float inputs[], const fuzzy_system_rec &fz, float &out) {
+	TNorm tnorm(fz);
+	Defuzz defuzz(fz);
+	float degrees[MAX_NO_OF_INPUTS][MAX_NO_OF_INP_REGIONS];
+
+	fuzzify_inputs(inputs, fz, degrees);
+	for (int i = 0; i < fz.no_of_rules; i++) {
+		const rule &r = fz.rules[i];
+		float weight = degrees[r.inp_index[0]][r.inp_fuzzy_set[0]];
+		for (int j = 1; j < fz.no_of_inputs; j++) {
+			weight = tnorm(weight, degrees[r.inp_index[j]][r.inp_fuzzy_set[j]]);
+		} /* end j  */
+		defuzz.accumulate(weight, r.out_fuzzy_set);
+	} /* end i  */
+
+	return defuzz.result(out);
+}
+
+//First-order TSK: every rule contributes weight * (c0 + c . state).  The
+//coefficient rows are contiguous, so the consequent is a straight run of
+//multiply-adds over one cache line per rule.
+#if defined(__FMA__) || defined(__AVX2__)
+#define FUZZY_FMA(a, b, c) fmaf((a), (b), (c))
+#else
+#define FUZZY_FMA(a, b, c) ((a) * (b) + (c))  //fmaf is emulated in software without FMA hardware
+#endif
+
+template <class TNorm>
+bool fuzzy_system_tsk_kernel(const float inputs[], const float state[], const fuzzy_system_rec &fz, float &out) {
+	TNorm tnorm(fz);
+	const float *c = fz.tsk_coeffs;
+	float sum1 = 0.0f, sum2 = 0.0f;
+	float degrees[MAX_NO_OF_INPUTS][MAX_NO_OF_INP_REGIONS];
+
+	fuzzify_inputs(inputs, fz, degrees);
+	for (int i = 0; i < fz.no_of_rules; i++, c += TSK_ROW_SIZE) {
+		const rule &r = fz.rules[i];
+		float weight = degrees[r.inp_index[0]][r.inp_fuzzy_set[0]];
+		for (int j = 1; j < fz.no_of_inputs; j++) {
+			weight = tnorm(weight, degrees[r.inp_index[j]][r.inp_fuzzy_set[j]]);
+		}
+		if (weight <= 0.0f)
+			continue;
+
+		float y = c[0];
+		for (int v = 0; v < fz.no_of_state_vars; v++)
+			y = FUZZY_FMA(c[v + 1], state[v], y);
+		sum1 = FUZZY_FMA(weight, y, sum1);
+		sum2 += weight;
+	}
+
+	if (sum2 < TOO_SMALL)
+		return false;
+	out = sum1 / sum2;
+	return true;
+}
+
+typedef bool(*fuzzy_kernel_fn)(const float inputs[], const fuzzy_system_rec &fz, float &out);
+
+//Resolves the kernel instantiation for the controller's operators.
+//Callers that evaluate the same controller many times can hoist this out of their loop.
+fuzzy_kernel_fn select_fuzzy_kernel(const fuzzy_system_rec &fz);
+
+#endif
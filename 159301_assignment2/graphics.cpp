@@ -11,11 +11,16 @@
 ////////////////////////////////////////////////////////////////////////
 
 
+#ifndef BGI_SOFTWARE
+
 #include "graphics.h"
+#include <vector>
 
 ///////////////////////////////////////////////////////////////////////
 int bgiemu_handle_redraw = TRUE;
 int bgiemu_default_mode = VGAHI; //VGAMAX;
+int bgiemu_batch_draw = FALSE;
+int bgiemu_present_damage = FALSE;
 ///////////////////////////////////////////////////////////////////////
 
 class char_queue { 
@@ -257,6 +262,24 @@ class font_cache : public l2list {
 
 static font_cache fcache;
 
+static void flush_commands();
+
+//
+// Drawing goes to the page bitmap (hdc[1]) and, when the active page is
+// on screen, to the window (hdc[0]) as well -- unless bgiemu_present_damage
+// leaves the window to present_damage().
+//
+inline bool draw_to_page()
+{
+    return bgiemu_handle_redraw || visual_page != active_page;
+}
+
+inline bool draw_to_window()
+{
+    return visual_page == active_page 
+	&& !(bgiemu_present_damage && bgiemu_handle_redraw);
+}
+
 
 #define FLAGS         PC_NOCOLLAPSE
 #define PALETTE_SIZE  256
@@ -372,6 +395,7 @@ void setcolor(int c)
 {
     c &= MAXCOLORS;
     color = c;
+    text_color = c; // keep select_fill_color() in step with the DCs
     SetTextColor(hdc[0], PALETTEINDEX(c+BG));
     SetTextColor(hdc[1], PALETTEINDEX(c+BG));
 }
@@ -397,14 +421,14 @@ char* getmodename(int mode)
 int getx()
 {
     POINT pos;
-    GetCurrentPositionEx(hdc[active_page == visual_page ? 0 : 1], &pos);
+    GetCurrentPositionEx(hdc[draw_to_page() ? 1 : 0], &pos);
     return pos.x;
 }
 
 int gety()
 {
     POINT pos;
-    GetCurrentPositionEx(hdc[active_page == visual_page ? 0 : 1], &pos);
+    GetCurrentPositionEx(hdc[draw_to_page() ? 1 : 0], &pos);
     return pos.y;
 }
 
@@ -448,6 +472,7 @@ void setwritemode(int mode)
 
 void setpalette(int index, int color)
 {
+    flush_commands();
     color &= MAXCOLORS;
     BGIpalette[index] = BGIcolor[color];
     current_palette.colors[index] = color;
@@ -460,6 +485,7 @@ void setpalette(int index, int color)
 
 void setrgbpalette(int index, int red, int green, int blue)
 {
+    flush_commands();
     BGIpalette[index].peRed = red & 0xFC;
     BGIpalette[index].peGreen = green & 0xFC;
     BGIpalette[index].peBlue = blue & 0xFC;
@@ -472,6 +498,7 @@ void setrgbpalette(int index, int red, int green, int blue)
 
 void setallpalette(palettetype* pal)
 {
+    flush_commands();
     for (int i = 0; i < pal->size; i++) { 
 	current_palette.colors[i] = pal->colors[i] & MAXCOLORS;
 	BGIpalette[i] = BGIcolor[pal->colors[i] & MAXCOLORS];
@@ -498,6 +525,12 @@ void getpalette(palettetype* pal)
     *pal = current_palette;
 }
 
+unsigned int bgiemu_color_rgba(int color)
+{
+    PALETTEENTRY const& e = BGIpalette[color & MAXCOLORS];
+    return e.peRed | (e.peGreen << 8) | (e.peBlue << 16) | 0xFF000000u;
+}
+
 int getpalettesize() 
 {
     return MAXCOLORS+1;
@@ -505,6 +538,7 @@ int getpalettesize()
 
 void setbkcolor(int color)
 {
+    flush_commands();
     color &= MAXCOLORS;
     BGIpalette[0] = BGIcolor[color];
     SetPaletteEntries(hPalette, BG, 1, &BGIpalette[0]);
@@ -537,6 +571,7 @@ void setfillpattern(char const* upattern, int color)
 {
     static HBITMAP hFillBitmap;
     static short bitmap_data[8];
+    flush_commands();
     for (int i = 0; i < 8; i++) { 
 	bitmap_data[i] = (unsigned char)~upattern[i];
 	userfillpattern[i] = upattern[i];
@@ -581,10 +616,10 @@ void setusercharsize(int multx, int divx, int multy, int divy)
 
 void moveto(int x, int y)
 {
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    if (draw_to_page()) { 
 	MoveToEx(hdc[1], x, y, NULL);
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	MoveToEx(hdc[0], x, y, NULL);
     } 
 }
@@ -613,23 +648,511 @@ static void select_font()
     }
 }
 
+// Box covered by str output at (x, y) with the current text settings
+static RECT text_bounds(int x, int y, const char* str)
+{
+    SIZE ss;
+    RECT r;
+    select_font();
+    GetTextExtentPoint32(hdc[1], str, strlen(str), &ss);
+    int w = ss.cx, h = ss.cy;
+    if (text_settings.direction == HORIZ_DIR) { 
+	r.left = text_settings.horiz == LEFT_TEXT ? x 
+	    : text_settings.horiz == CENTER_TEXT ? x - w/2 : x - w;
+	r.right = r.left + w;
+    } else { 
+	r.left = x - w;
+	r.right = x + w;
+	h = w > h ? w : h;
+    }
+    r.top = y - h;
+    r.bottom = y + h;
+    return r;
+}
+
+
+//
+// Damage tracking for bgiemu_present_damage.  Each page keeps the window
+// rectangles that may differ from it: what was drawn on it since it was
+// last presented, plus what changed on the window meanwhile.
+//
+#define DAMAGE_RECTS 16
+
+class damage_list { 
+    RECT rect[DAMAGE_RECTS]; // window coordinates, right and bottom exclusive
+    int  n;
+    bool all;
+
+    static bool touch(RECT const& a, RECT const& b) { 
+	return a.left <= b.right && b.left <= a.right 
+	    && a.top <= b.bottom && b.top <= a.bottom;
+    }
+    static void merge(RECT& a, RECT const& b) { 
+	if (b.left < a.left) a.left = b.left;
+	if (b.top < a.top) a.top = b.top;
+	if (b.right > a.right) a.right = b.right;
+	if (b.bottom > a.bottom) a.bottom = b.bottom;
+    }
+
+  public: 
+    damage_list() { clear(); }
+
+    void clear() { 
+	n = 0;
+	all = false;
+    }
+    bool empty() const { 
+	return n == 0 && !all;
+    }
+    void add_all() { 
+	n = 0;
+	all = true;
+    }
+    void add(RECT r) { 
+	if (all || r.left >= r.right || r.top >= r.bottom) { 
+	    return;
+	}
+	// absorb every rectangle r touches, then fall back to one box
+	for (int i = 0; i < n; i++) { 
+	    if (touch(rect[i], r)) { 
+		merge(r, rect[i]);
+		rect[i--] = rect[--n];
+	    }
+	}
+	if (n == DAMAGE_RECTS) { 
+	    for (int i = 0; i < n; i++) { 
+		merge(r, rect[i]);
+	    }
+	    n = 0;
+	}
+	rect[n++] = r;
+    }
+    void add(damage_list const& d) { 
+	if (d.all) { 
+	    add_all();
+	}
+	for (int i = 0; i < d.n; i++) { 
+	    add(d.rect[i]);
+	}
+    }
+    // Copies the damaged part of src (a page) to dst (the window)
+    void blit(HDC dst, HDC src) const { 
+	int dx = -view_settings.left, dy = -view_settings.top;
+	if (all) { 
+	    BitBlt(dst, dx, dy, window_width, window_height, 
+		   src, dx, dy, SRCCOPY);
+	    return;
+	}
+	for (int i = 0; i < n; i++) { 
+	    RECT const& r = rect[i];
+	    BitBlt(dst, r.left+dx, r.top+dy, r.right-r.left, r.bottom-r.top, 
+		   src, r.left+dx, r.top+dy, SRCCOPY);
+	}
+    }
+};
+
+static damage_list page_damage[MAX_PAGES];
+
+// Marks left..right, top..bottom (viewport coordinates, inclusive, grown
+// by the pen width) as drawn on the active page
+static void damage(int left, int top, int right, int bottom)
+{
+    if (!bgiemu_present_damage || !bgiemu_handle_redraw) { 
+	return;
+    }
+    int pen = line_settings.thickness/2 + 1;
+    RECT r;
+    r.left = left - pen + view_settings.left;
+    r.top = top - pen + view_settings.top;
+    r.right = right + pen + 1 + view_settings.left;
+    r.bottom = bottom + pen + 1 + view_settings.top;
+    if (r.left < 0) r.left = 0;
+    if (r.top < 0) r.top = 0;
+    if (r.right > window_width) r.right = window_width;
+    if (r.bottom > window_height) r.bottom = window_height;
+    page_damage[active_page].add(r);
+}
+
+static void damage_points(int n_points, int* points)
+{
+    int left = points[0], right = points[0];
+    int top = points[1], bottom = points[1];
+    for (int i = 1; i < n_points; i++) { 
+	int x = points[2*i], y = points[2*i+1];
+	if (x < left) left = x;
+	if (x > right) right = x;
+	if (y < top) top = y;
+	if (y > bottom) bottom = y;
+    }
+    damage(left, top, right, bottom);
+}
+
+static void damage_viewport()
+{
+    damage(0, 0, view_settings.right-view_settings.left, 
+	   view_settings.bottom-view_settings.top);
+}
+
 static void text_output(int x, int y, const char* str)
 { 
+    // the text extent is only needed for damage tracking
+    if (bgiemu_present_damage && bgiemu_handle_redraw) { 
+	POINT pos = { x, y };
+	if (text_align_mode == UPDATE_CP) { 
+	    GetCurrentPositionEx(hdc[1], &pos);
+	}
+	RECT r = text_bounds(pos.x, pos.y, str);
+	damage(r.left, r.top, r.right, r.bottom);
+    }
     select_font();
     if (text_color != color) { 
 	text_color = color;
 	SetTextColor(hdc[0], PALETTEINDEX(text_color+BG));
 	SetTextColor(hdc[1], PALETTEINDEX(text_color+BG));
     }
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    if (draw_to_page()) { 
         TextOut(hdc[1], x, y, str, strlen(str));
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
         TextOut(hdc[0], x, y, str, strlen(str));
     } 
 }
 
 
+//
+// Retained-mode command buffer (bgiemu_batch_draw).  The common primitives
+// are recorded with a snapshot of the state they draw with and submitted
+// to the page bitmap (hdc[1]) in one pass.  A command is moved up to join
+// an earlier one with the same pen, brush or font only if its bounding box
+// misses every command it jumps over, so the result is the same as drawing
+// in call order.
+//
+class command_buffer { 
+    enum { PEN = 1, BRUSH = 2, FONT = 4 };
+    enum { FILLPOLY, FILLELLIPSE, BAR, DRAWPOLY, CIRCLE, TEXT };
+    enum { LOOKAHEAD = 64 }; // commands searched for a batch partner
+
+    struct draw_state { 
+	int color;
+	int write_mode;
+	linesettingstype line;
+	fillsettingstype fill;
+	textsettingstype text;
+	int mul_x, div_x, mul_y, div_y;
+    };
+    struct command { 
+	int  kind;
+	int  state;    // index into states
+	RECT bounds;   // viewport coordinates, pen width included
+	int  arg[4];
+	int  data;     // first point or character
+    };
+
+    std::vector<command>    cmds;
+    std::vector<draw_state> states;
+    std::vector<int>        coords;
+    std::vector<char>       chars;
+    std::vector<int>        order;
+    std::vector<char>       done;
+    bool replaying;
+    batchstatstype stats;
+
+    static int state_mask(int kind) { 
+	switch (kind) { 
+	  case FILLPOLY: 
+	  case FILLELLIPSE: return PEN|BRUSH;
+	  case BAR:         return BRUSH;
+	  case TEXT:        return FONT;
+	  default:          return PEN;
+	}
+    }
+    static draw_state current_state() { 
+	draw_state s;
+	s.color = color;
+	s.write_mode = write_mode;
+	s.line = line_settings;
+	s.fill = fill_settings;
+	s.text = text_settings;
+	s.mul_x = font_mul_x; s.div_x = font_div_x;
+	s.mul_y = font_mul_y; s.div_y = font_div_y;
+	return s;
+    }
+    static void set_state(draw_state const& s) { 
+	color = s.color;
+	write_mode = s.write_mode;
+	line_settings = s.line;
+	fill_settings = s.fill;
+	text_settings = s.text;
+	font_mul_x = s.mul_x; font_div_x = s.div_x;
+	font_mul_y = s.mul_y; font_div_y = s.div_y;
+    }
+    // Bits of mask in which a and b differ
+    static int changed(draw_state const& a, draw_state const& b, int mask) { 
+	int diff = 0;
+	if ((mask & PEN) && (a.color != b.color || a.write_mode != b.write_mode
+			     || a.line.linestyle != b.line.linestyle
+			     || a.line.thickness != b.line.thickness
+			     || a.line.upattern != b.line.upattern)) {
+	    diff |= PEN;
+	}
+	if ((mask & BRUSH) && (a.fill.pattern != b.fill.pattern 
+			       || a.fill.color != b.fill.color)) {
+	    diff |= BRUSH;
+	}
+	if ((mask & FONT) && (a.color != b.color
+			      || a.text.font != b.text.font
+			      || a.text.direction != b.text.direction
+			      || a.text.charsize != b.text.charsize
+			      || a.text.horiz != b.text.horiz
+			      || a.text.vert != b.text.vert
+			      || a.mul_x != b.mul_x || a.div_x != b.div_x
+			      || a.mul_y != b.mul_y || a.div_y != b.div_y)) {
+	    diff |= FONT;
+	}
+	return diff;
+    }
+    bool same_batch(command const& a, command const& b) const { 
+	int mask = state_mask(a.kind);
+	return mask == state_mask(b.kind) 
+	    && changed(states[a.state], states[b.state], mask) == 0;
+    }
+    static bool overlap(RECT const& a, RECT const& b) { 
+	return a.left <= b.right && b.left <= a.right 
+	    && a.top <= b.bottom && b.top <= a.bottom;
+    }
+
+    bool recording() { 
+	if (bgiemu_batch_draw && !replaying 
+	    && draw_to_page()) 
+	{ 
+	    return true;
+	}
+	flush();
+	return false;
+    }
+    command& add(int kind, int left, int top, int right, int bottom) { 
+	draw_state s = current_state();
+	if (states.empty() || changed(states.back(), s, PEN|BRUSH|FONT)) { 
+	    states.push_back(s);
+	}
+	int pen = (state_mask(kind) & PEN) ? line_settings.thickness/2 + 1 : 1;
+	command c;
+	c.kind = kind;
+	c.state = (int)states.size() - 1;
+	c.bounds.left = left - pen;
+	c.bounds.top = top - pen;
+	c.bounds.right = right + pen;
+	c.bounds.bottom = bottom + pen;
+	c.data = 0;
+	cmds.push_back(c);
+	stats.commands += 1;
+	return cmds.back();
+    }
+
+    // Call order, with each command followed by the later ones of the same
+    // state that can be moved up to it
+    void sort() { 
+	int n = cmds.size();
+	order.clear();
+	done.assign(n, 0);
+	for (int i = 0; i < n; i++) { 
+	    if (done[i]) { 
+		continue;
+	    }
+	    order.push_back(i);
+	    done[i] = 1;
+	    for (int j = i+1; j < n && j <= i + LOOKAHEAD; j++) { 
+		if (done[j] || !same_batch(cmds[i], cmds[j])) { 
+		    continue;
+		}
+		int k;
+		for (k = i+1; k < j; k++) { 
+		    if (!done[k] && overlap(cmds[k].bounds, cmds[j].bounds)) { 
+			break;
+		    }
+		}
+		if (k == j) { 
+		    order.push_back(j);
+		    done[j] = 1;
+		}
+	    }
+	}
+    }
+    // Pen, brush and font switches needed to draw the commands sorted or
+    // in call order
+    long state_changes(bool sorted) const { 
+	long n = 0;
+	int valid = 0;
+	draw_state const* last = NULL;
+	for (size_t i = 0; i < cmds.size(); i++) { 
+	    command const& c = cmds[sorted ? order[i] : i];
+	    int mask = state_mask(c.kind);
+	    int diff = last ? changed(*last, states[c.state], mask) : 0;
+	    diff |= mask & ~valid;
+	    n += ((diff & PEN) != 0) + ((diff & BRUSH) != 0) + ((diff & FONT) != 0);
+	    valid |= mask;
+	    last = &states[c.state];
+	}
+	return n;
+    }
+
+  public: 
+    command_buffer() { 
+	replaying = false;
+	memset(&stats, 0, sizeof stats);
+    }
+
+    bool record_poly(int kind, int n_points, int* points) { 
+	if (!recording()) { 
+	    return false;
+	}
+	int left = points[0], right = points[0];
+	int top = points[1], bottom = points[1];
+	for (int i = 1; i < n_points; i++) { 
+	    int x = points[2*i], y = points[2*i+1];
+	    if (x < left) left = x;
+	    if (x > right) right = x;
+	    if (y < top) top = y;
+	    if (y > bottom) bottom = y;
+	}
+	command& c = add(kind, left, top, right, bottom);
+	c.arg[0] = n_points;
+	c.data = (int)coords.size();
+	coords.insert(coords.end(), points, points + 2*n_points);
+	return true;
+    }
+    bool record_fillpoly(int n_points, int* points) { 
+	return record_poly(FILLPOLY, n_points, points);
+    }
+    bool record_drawpoly(int n_points, int* points) { 
+	return record_poly(DRAWPOLY, n_points, points);
+    }
+    bool record_fillellipse(int x, int y, int rx, int ry) { 
+	if (!recording()) { 
+	    return false;
+	}
+	command& c = add(FILLELLIPSE, x-rx, y-ry, x+rx, y+ry);
+	c.arg[0] = x; c.arg[1] = y; c.arg[2] = rx; c.arg[3] = ry;
+	return true;
+    }
+    bool record_circle(int x, int y, int radius) { 
+	if (!recording()) { 
+	    return false;
+	}
+	int ry = (unsigned)radius*aspect_ratio_x/aspect_ratio_y;
+	command& c = add(CIRCLE, x-radius, y-ry, x+radius, y+ry);
+	c.arg[0] = x; c.arg[1] = y; c.arg[2] = radius;
+	return true;
+    }
+    bool record_bar(int left, int top, int right, int bottom) { 
+	if (!recording()) { 
+	    return false;
+	}
+	command& c = add(BAR, left < right ? left : right, 
+			 top < bottom ? top : bottom,
+			 left < right ? right : left, 
+			 top < bottom ? bottom : top);
+	c.arg[0] = left; c.arg[1] = top; c.arg[2] = right; c.arg[3] = bottom;
+	return true;
+    }
+    bool record_text(int x, int y, const char* str) { 
+	if (!recording()) { 
+	    return false;
+	}
+	RECT r = text_bounds(x, y, str);
+	command& c = add(TEXT, r.left, r.top, r.right, r.bottom);
+	c.arg[0] = x; c.arg[1] = y;
+	c.data = (int)chars.size();
+	chars.insert(chars.end(), str, str + strlen(str) + 1);
+	return true;
+    }
+
+    // Draws the recorded commands on the active page and empties the buffer
+    void flush() { 
+	if (replaying || cmds.empty()) { 
+	    return;
+	}
+	sort();
+	stats.flushes += 1;
+	stats.state_changes += state_changes(true);
+	stats.unsorted_state_changes += state_changes(false);
+
+	draw_state live = current_state();
+	int live_visual_page = visual_page;
+	int selected_pattern = -1;
+	draw_state const* last_text = NULL;
+	replaying = true;
+	visual_page = -1; // not the active page: draw to hdc[1] only
+	for (size_t i = 0; i < order.size(); i++) { 
+	    command const& c = cmds[order[i]];
+	    draw_state const& s = states[c.state];
+	    set_state(s);
+	    if ((state_mask(c.kind) & BRUSH) && s.fill.pattern != selected_pattern) { 
+		selected_pattern = s.fill.pattern;
+		SelectObject(hdc[1], hBrush[selected_pattern]);
+	    }
+	    if (c.kind == TEXT) { 
+		if (last_text == NULL || changed(*last_text, s, FONT)) { 
+		    text_align_mode = ALIGN_NOT_SET;
+		}
+		last_text = &s;
+	    }
+	    switch (c.kind) { 
+	      case FILLPOLY: 
+		fillpoly(c.arg[0], &coords[c.data]);
+		break;
+	      case DRAWPOLY: 
+		drawpoly(c.arg[0], &coords[c.data]);
+		break;
+	      case FILLELLIPSE: 
+		fillellipse(c.arg[0], c.arg[1], c.arg[2], c.arg[3]);
+		break;
+	      case CIRCLE: 
+		circle(c.arg[0], c.arg[1], c.arg[2]);
+		break;
+	      case BAR: 
+		bar(c.arg[0], c.arg[1], c.arg[2], c.arg[3]);
+		break;
+	      case TEXT: 
+		outtextxy(c.arg[0], c.arg[1], &chars[c.data]);
+		break;
+	    }
+	}
+	visual_page = live_visual_page;
+	replaying = false;
+
+	set_state(live);
+	SelectObject(hdc[0], hBrush[fill_settings.pattern]);
+	SelectObject(hdc[1], hBrush[fill_settings.pattern]);
+	text_align_mode = ALIGN_NOT_SET;
+	discard();
+    }
+    // Drops the recorded commands (the page is about to be overwritten)
+    void discard() { 
+	cmds.clear();
+	states.clear();
+	coords.clear();
+	chars.clear();
+    }
+    void get_stats(batchstatstype* s) { 
+	*s = stats;
+	memset(&stats, 0, sizeof stats);
+    }
+};
+
+static command_buffer commands;
+
+static void flush_commands()
+{
+    commands.flush();
+}
+
+void bgiemu_batch_stats(batchstatstype* stats)
+{
+    commands.get_stats(stats);
+}
+
+
 void settextstyle(int font, int direction, int char_size)
 {
     if (char_size > 10) { 
@@ -672,6 +1195,7 @@ int textwidth(const char* str)
 
 void outtext(const char* str)
 {
+    flush_commands();
     if (text_align_mode != UPDATE_CP) {
 	text_align_mode = UPDATE_CP;
 	int align = (text_settings.direction == HORIZ_DIR)
@@ -689,6 +1213,9 @@ void outtext(const char* str)
 
 void outtextxy(int x, int y, const char* str)
 {
+    if (commands.record_text(x, y, str)) { 
+	return;
+    }
     if (text_align_mode != NOT_UPDATE_CP) {
 	text_align_mode = NOT_UPDATE_CP;
 	int align = (text_settings.direction == HORIZ_DIR)
@@ -706,6 +1233,7 @@ void outtextxy(int x, int y, const char* str)
 
 void setviewport(int x1, int y1, int x2, int y2, int clip)
 {
+    flush_commands();
     view_settings.left = x1;
     view_settings.top = y1;
     view_settings.right = x2;
@@ -756,6 +1284,7 @@ inline void arc_coords(double angle, double rx, double ry, int& x, int& y)
 void ellipse(int x, int y, int start_angle, int end_angle, 
 		       int rx, int ry)
 {
+    flush_commands();
     ac.x = x;
     ac.y = y;
     arc_coords(start_angle, rx, ry, ac.xstart, ac.ystart);
@@ -764,11 +1293,12 @@ void ellipse(int x, int y, int start_angle, int end_angle,
     ac.xend += x; ac.yend += y;
 
     pcache.select(color+BG); 
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage(x-rx, y-ry, x+rx, y+ry);
+    if (draw_to_page()) { 
         Arc(hdc[1], x-rx, y-ry, x+rx, y+ry, 
 	    ac.xstart, ac.ystart, ac.xend, ac.yend); 
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	Arc(hdc[0], x-rx, y-ry, x+rx, y+ry, 
 	    ac.xstart, ac.ystart, ac.xend, ac.yend); 
     }
@@ -776,12 +1306,16 @@ void ellipse(int x, int y, int start_angle, int end_angle,
 
 void fillellipse(int x, int y, int rx, int ry)
 {
+    if (commands.record_fillellipse(x, y, rx, ry)) { 
+	return;
+    }
     pcache.select(color+BG); 
     select_fill_color();
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage(x-rx, y-ry, x+rx, y+ry);
+    if (draw_to_page()) { 
 	Ellipse(hdc[1], x-rx, y-ry, x+rx, y+ry); 
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	Ellipse(hdc[0], x-rx, y-ry, x+rx, y+ry); 
     }
 }
@@ -802,6 +1336,7 @@ static void allocate_new_graphic_page(int page)
 
 void setactivepage(int page)
 {
+    flush_commands();
     if (hBitmap[page] == NULL) { 
 	allocate_new_graphic_page(page);
     } else { 
@@ -816,12 +1351,45 @@ void setactivepage(int page)
 }
 
 
+// Brings the window up to date with page by blitting only its damage
+static void present_damage(int page)
+{
+    damage_list& d = page_damage[page];
+    if (d.empty() || hdc[0] == NULL) { 
+	return;
+    }
+    if (hBitmap[page] == NULL) { 
+	allocate_new_graphic_page(page);
+    }
+    SelectObject(hdc[1], hBitmap[page]);	    
+    SelectClipRgn(hdc[0], NULL);
+    SelectClipRgn(hdc[1], NULL);
+    d.blit(hdc[0], hdc[1]);
+    SelectClipRgn(hdc[0], hRgn);
+    SelectClipRgn(hdc[1], hRgn);
+    SelectObject(hdc[1], hBitmap[active_page]);	    
+
+    // the window now shows page where d was: other pages may differ there
+    for (int i = 0; i < MAX_PAGES; i++) { 
+	if (i != page) { 
+	    page_damage[i].add(d);
+	}
+    }
+    d.clear();
+}
+
 void setvisualpage(int page)
 {
     POINT pos;
+    flush_commands();
     if (hdc[page] == NULL) { 
 	allocate_new_graphic_page(page);
     }
+    if (bgiemu_present_damage && bgiemu_handle_redraw) { 
+	present_damage(page);
+	visual_page = page;
+	return;
+    }
     if (!bgiemu_handle_redraw && active_page == visual_page) { 
 	SelectObject(hdc[1], hBitmap[visual_page]);	    
 	SelectClipRgn(hdc[1], NULL);
@@ -855,6 +1423,7 @@ void setvisualpage(int page)
 
 void setaspectratio(int ax, int ay)
 {
+    flush_commands();
     aspect_ratio_x = ax;
     aspect_ratio_y = ay;
 }
@@ -867,19 +1436,24 @@ void getaspectratio(int* ax, int* ay)
 
 void circle(int x, int y, int radius)
 {
+    if (commands.record_circle(x, y, radius)) { 
+	return;
+    }
     pcache.select(color+BG); 
     int ry = (unsigned)radius*aspect_ratio_x/aspect_ratio_y;
     int rx = radius;
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage(x-rx, y-ry, x+rx, y+ry);
+    if (draw_to_page()) { 
 	Arc(hdc[1], x-rx, y-ry, x+rx, y+ry, x+rx, y, x+rx, y);
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
         Arc(hdc[0], x-rx, y-ry, x+rx, y+ry, x+rx, y, x+rx, y);
     }    
 }
 
 void arc(int x, int y, int start_angle, int end_angle, int radius)
 {
+    flush_commands();
     ac.x = x;
     ac.y = y;
     ac.xstart = x + int(radius*cos(start_angle*pi/180.0));
@@ -887,11 +1461,12 @@ void arc(int x, int y, int start_angle, int end_angle, int radius)
     ac.xend = x + int(radius*cos(end_angle*pi/180.0));
     ac.yend = y - int(radius*sin(end_angle*pi/180.0));
 
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage(x-radius, y-radius, x+radius, y+radius);
+    if (draw_to_page()) { 
         Arc(hdc[1], x-radius, y-radius, x+radius, y+radius, 
 	ac.xstart, ac.ystart, ac.xend, ac.yend);
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	Arc(hdc[0], x-radius, y-radius, x+radius, y+radius, 
 	    ac.xstart, ac.ystart, ac.xend, ac.yend);
     }
@@ -905,6 +1480,7 @@ void getarccoords(arccoordstype *arccoords)
 void pieslice(int x, int y, int start_angle, int end_angle, 
 	      int radius)
 {
+    flush_commands();
     pcache.select(color+BG); 
     select_fill_color();
     ac.x = x;
@@ -914,11 +1490,12 @@ void pieslice(int x, int y, int start_angle, int end_angle,
     ac.xend = x + int(radius*cos(end_angle*pi/180.0));
     ac.yend = y - int(radius*sin(end_angle*pi/180.0));
 
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage(x-radius, y-radius, x+radius, y+radius);
+    if (draw_to_page()) { 
 	Pie(hdc[1], x-radius, y-radius, x+radius, y+radius, 
 	    ac.xstart, ac.ystart, ac.xend, ac.yend); 
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	Pie(hdc[0], x-radius, y-radius, x+radius, y+radius, 
     	    ac.xstart, ac.ystart, ac.xend, ac.yend); 
     }
@@ -928,6 +1505,7 @@ void pieslice(int x, int y, int start_angle, int end_angle,
 void sector(int x, int y, int start_angle, int end_angle, 
 		      int rx, int ry)
 {
+    flush_commands();
     ac.x = x;
     ac.y = y;
     arc_coords(start_angle, rx, ry, ac.xstart, ac.ystart);
@@ -936,11 +1514,12 @@ void sector(int x, int y, int start_angle, int end_angle,
     ac.xend += x; ac.yend += y;
 
     pcache.select(color+BG); 
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage(x-rx, y-ry, x+rx, y+ry);
+    if (draw_to_page()) { 
         Pie(hdc[1], x-rx, y-ry, x+rx, y+ry, 
 	    ac.xstart, ac.ystart, ac.xend, ac.yend); 
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	Pie(hdc[0], x-rx, y-ry, x+rx, y+ry, 
     	    ac.xstart, ac.ystart, ac.xend, ac.yend); 
     }
@@ -949,6 +1528,9 @@ void sector(int x, int y, int start_angle, int end_angle,
 void bar(int left, int top, int right, int bottom)
 {
     RECT r;
+    if (commands.record_bar(left, top, right, bottom)) { 
+	return;
+    }
     if (left > right) {	/* Turbo C corrects for badly ordered corners */   
 	r.left = right;
 	r.right = left;
@@ -964,10 +1546,11 @@ void bar(int left, int top, int right, int bottom)
 	r.bottom = bottom;
     }
     select_fill_color();
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage(r.left, r.top, r.right, r.bottom);
+    if (draw_to_page()) { 
 	FillRect(hdc[1], &r, hBrush[fill_settings.pattern]);
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	FillRect(hdc[0], &r, hBrush[fill_settings.pattern]);
     }
 }
@@ -987,8 +1570,10 @@ void bar3d(int left, int top, int right, int bottom, int depth, int topflag)
 	bottom = top;
 	top = temp;
     }
+    flush_commands();
     bar(left+line_settings.thickness, top+line_settings.thickness, 
 	right-line_settings.thickness+1, bottom-line_settings.thickness+1);
+    flush_commands();
 
     if (write_mode != COPY_PUT) { 
 	SetROP2(hdc[0], write_mode_cnv[write_mode]);
@@ -1011,10 +1596,11 @@ void bar3d(int left, int top, int right, int bottom, int depth, int topflag)
 	p[9].x = left+depth, p[9].y = top-dy;
 	p[10].x = left, p[10].y = top;	
     }
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage(left, top-dy, right+depth, bottom);
+    if (draw_to_page()) { 
 	Polyline(hdc[1], p, topflag ? 11 : 8);
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	Polyline(hdc[0], p, topflag ? 11 : 8);
     }
     if (write_mode != COPY_PUT) { 
@@ -1025,15 +1611,20 @@ void bar3d(int left, int top, int right, int bottom, int depth, int topflag)
 
 void lineto(int x, int y)
 {
+    flush_commands();
     if (write_mode != COPY_PUT) { 
 	SetROP2(hdc[0], write_mode_cnv[write_mode]);
 	SetROP2(hdc[1], write_mode_cnv[write_mode]);
     } 
     pcache.select(ADJUSTED_MODE(write_mode) ? color : color + BG);
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    POINT pos;
+    GetCurrentPositionEx(hdc[1], &pos);
+    damage(pos.x < x ? pos.x : x, pos.y < y ? pos.y : y, 
+	   pos.x < x ? x : pos.x, pos.y < y ? y : pos.y);
+    if (draw_to_page()) { 
 	LineTo(hdc[1], x, y);
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	LineTo(hdc[0], x, y);
     }
     if (write_mode != COPY_PUT) { 
@@ -1051,16 +1642,20 @@ void linerel(int dx, int dy)
 
 void drawpoly(int n_points, int* points) 
 { 
+    if (commands.record_drawpoly(n_points, points)) { 
+	return;
+    }
     if (write_mode != COPY_PUT) { 
 	SetROP2(hdc[0], write_mode_cnv[write_mode]);
 	SetROP2(hdc[1], write_mode_cnv[write_mode]);
     } 
     pcache.select(ADJUSTED_MODE(write_mode) ? color : color + BG);
 
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage_points(n_points, points);
+    if (draw_to_page()) { 
 	Polyline(hdc[1], (POINT*)points, n_points);
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	Polyline(hdc[0], (POINT*)points, n_points);
     }
 
@@ -1093,23 +1688,29 @@ void rectangle(int left, int top, int right, int bottom)
     
 void fillpoly(int n_points, int* points)
 {
+    if (commands.record_fillpoly(n_points, points)) { 
+	return;
+    }
     pcache.select(color+BG);
     select_fill_color();
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage_points(n_points, points);
+    if (draw_to_page()) { 
         Polygon(hdc[1], (POINT*)points, n_points);
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	Polygon(hdc[0], (POINT*)points, n_points);
     }
 }
 
 void floodfill(int x, int y, int border)
 {
+    flush_commands();
     select_fill_color();
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage_viewport();
+    if (draw_to_page()) { 
 	FloodFill(hdc[1], x, y, PALETTEINDEX(border+BG));
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	FloodFill(hdc[0], x, y, PALETTEINDEX(border+BG));
     } 
 }
@@ -1119,6 +1720,9 @@ void floodfill(int x, int y, int border)
 static bool handle_input(bool wait = 0)
 {
     MSG lpMsg;
+    if (bgiemu_present_damage && bgiemu_handle_redraw) { 
+	present_damage(visual_page);
+    }
     if (wait ? GetMessage(&lpMsg, NULL, 0, 0) 
 	     : PeekMessage(&lpMsg, NULL, 0, 0, PM_REMOVE)) 
     {
@@ -1195,12 +1799,16 @@ int getch()
 void cleardevice()
 {	    
     RECT scr;
+    commands.discard(); // painted over
     scr.left = -view_settings.left;
     scr.top = -view_settings.top; 
     scr.right = screen_width-view_settings.left-1;
     scr.bottom = screen_height-view_settings.top-1;
 
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    if (bgiemu_present_damage && bgiemu_handle_redraw) { 
+	page_damage[active_page].add_all();
+    }
+    if (draw_to_page()) { 
 	if (hRgn != NULL) { 
 	    SelectClipRgn(hdc[1], NULL);
 	}
@@ -1209,7 +1817,7 @@ void cleardevice()
 	    SelectClipRgn(hdc[1], hRgn);
 	}
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	if (hRgn != NULL) { 
 	    SelectClipRgn(hdc[0], NULL);
 	}
@@ -1223,15 +1831,17 @@ void cleardevice()
 
 void clearviewport()
 {
+    flush_commands();
     RECT scr;
     scr.left = 0;
     scr.top = 0; 
     scr.right = view_settings.right-view_settings.left;
     scr.bottom = view_settings.bottom-view_settings.top;
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage_viewport();
+    if (draw_to_page()) { 
         FillRect(hdc[1], &scr, hBackgroundBrush);
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	FillRect(hdc[0], &scr, hBackgroundBrush);
     }
     moveto(0,0);
@@ -1250,10 +1860,28 @@ int getgraphmode()
 
 void setgraphmode(int) {}
 
+//
+// The 4 bit DIB colour table of bminfo: putimage() indexes the logical
+// palette directly for XOR_PUT and NOT_PUT (mask 0) and through the BG
+// offset otherwise.  Rebuilt only when the mask changes.
+//
+static int bminfo_mask = -1;
+
+static void set_bminfo_colors(int mask)
+{
+    if (bminfo_mask != mask) { 
+	for (int i = 0; i <= MAXCOLORS; i++) { 
+	    bminfo.color_table[i] = i + mask;
+	}
+	bminfo_mask = mask;
+    }
+}
+
 void putimage(int x, int y, void* image, int bitblt)
 {
     BGIimage* bi = (BGIimage*)image;
     static int putimage_width, putimage_height;
+    flush_commands();
 
     if (hPutimageBitmap == NULL ||
 	putimage_width < bi->width || putimage_height < bi->height)
@@ -1272,19 +1900,17 @@ void putimage(int x, int y, void* image, int bitblt)
 	}
 	hPutimageBitmap = h;
     }
-    int mask = ADJUSTED_MODE(bitblt) ? 0 : BG;
-    for (int i = 0; i <= MAXCOLORS; i++) { 
-	bminfo.color_table[i] = i + mask;
-    }
+    set_bminfo_colors(ADJUSTED_MODE(bitblt) ? 0 : BG);
     bminfo.hdr.biHeight = bi->height; 
     bminfo.hdr.biWidth = bi->width; 
     SetDIBits(hdc[2], hPutimageBitmap, 0, bi->height, bi->bits, 
 	      (BITMAPINFO*)&bminfo, DIB_PAL_COLORS);
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage(x, y, x+bi->width-1, y+bi->height-1);
+    if (draw_to_page()) { 
 	BitBlt(hdc[1], x, y, bi->width, bi->height, hdc[2], 0, 0, 
 	       bitblt_mode_cnv[bitblt]);
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
         BitBlt(hdc[0], x, y, bi->width, bi->height, hdc[2], 0, 0, 
 	       bitblt_mode_cnv[bitblt]);
     }
@@ -1295,31 +1921,145 @@ unsigned int imagesize(int x1, int y1, int x2, int y2)
     return 8 + (((x2-x1+8) & ~7) >> 1)*(y2-y1+1); 
 }
 
+//
+// getimage() scratch: a bottom-up 4 bit DIB section kept selected into
+// hdc[3], grown on demand.  Its width is a multiple of 8 pixels, so a row
+// is exactly (width/2) bytes, as in a BGIimage.
+//
+static HBITMAP hGetimageBitmap;
+static unsigned char* getimage_bits;
+static int getimage_width, getimage_height;
+
+static void free_getimage_bitmap()
+{
+    if (hGetimageBitmap) { 
+	DeleteObject(hGetimageBitmap);
+	hGetimageBitmap = NULL;
+	getimage_width = getimage_height = 0;
+    }
+}
+
 void getimage(int x1, int y1, int x2, int y2, void* image)
 {
     BGIimage* bi = (BGIimage*)image;
-    int* image_bits; 
+    flush_commands();
     bi->width = x2-x1+1;
     bi->height = y2-y1+1;
-    bminfo.hdr.biHeight = bi->height; 
-    bminfo.hdr.biWidth = bi->width; 
-    for (int i = 0; i <= MAXCOLORS; i++) { 
-	bminfo.color_table[i] = i + BG;
+    if (hGetimageBitmap == NULL ||
+	getimage_width < bi->width || getimage_height < bi->height)
+    {
+	if (getimage_width < bi->width) { 
+	    getimage_width = (bi->width+7) & ~7;
+	}
+	if (getimage_height < bi->height) { 
+	    getimage_height = bi->height;
+	}
+	set_bminfo_colors(BG);
+	bminfo.hdr.biHeight = getimage_height; 
+	bminfo.hdr.biWidth = getimage_width; 
+	HBITMAP hb = CreateDIBSection(hdc[3], (BITMAPINFO*)&bminfo, 
+	    DIB_PAL_COLORS, (void**)&getimage_bits, 0, 0); 
+	SelectObject(hdc[3], hb);
+	if (hGetimageBitmap) { 
+	    DeleteObject(hGetimageBitmap);
+	}
+	hGetimageBitmap = hb;
+    } else { 
+	// the colour table was taken from the palette when the DIB was made
+	RGBQUAD rgb[MAXCOLORS+1];
+	for (int i = 0; i <= MAXCOLORS; i++) { 
+	    rgb[i].rgbRed = BGIpalette[i].peRed;
+	    rgb[i].rgbGreen = BGIpalette[i].peGreen;
+	    rgb[i].rgbBlue = BGIpalette[i].peBlue;
+	    rgb[i].rgbReserved = 0;
+	}
+	SetDIBColorTable(hdc[3], 0, MAXCOLORS+1, rgb);
     }
-    HBITMAP hb = CreateDIBSection(hdc[3], (BITMAPINFO*)&bminfo, 
-	DIB_PAL_COLORS, (void**)&image_bits, 0, 0); 
-    HBITMAP hdb = (HBITMAP__*) SelectObject(hdc[3], hb);
     BitBlt(hdc[3], 0, 0, bi->width, bi->height, 
-	   hdc[visual_page != active_page || bgiemu_handle_redraw ? 1 : 0], 
-	   x1, y1, SRCCOPY);
+	   hdc[draw_to_page() ? 1 : 0], x1, y1, SRCCOPY);
+    GdiFlush();
+    // the image is the bottom bi->height rows of the scratch DIB
+    int stride = getimage_width >> 1;
+    int row_bytes = ((bi->width+7) & ~7) >> 1;
+    unsigned char* src = getimage_bits + (getimage_height - bi->height)*stride;
+    if (row_bytes == stride) { 
+	memcpy(bi->bits, src, row_bytes*bi->height);
+    } else { 
+	for (int y = 0; y < bi->height; y++) { 
+	    memcpy(bi->bits + y*row_bytes, src + y*stride, row_bytes);
+	}
+    }
+}
+
+struct bgiemu_image { 
+    int width;
+    int height;
+    HDC dc;
+    HBITMAP bitmap;
+    HBITMAP old_bitmap;
+    unsigned int* bits;
+};
+
+bgiemu_image* bgiemu_newimage(int width, int height)
+{
+    BITMAPINFO bmi;
+    memset(&bmi, 0, sizeof bmi);
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height; // top row first
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    bgiemu_image* img = new bgiemu_image;
+    img->width = width;
+    img->height = height;
+    img->dc = CreateCompatibleDC(hdc[0]);
+    img->bitmap = CreateDIBSection(img->dc, &bmi, DIB_RGB_COLORS, 
+				   (void**)&img->bits, 0, 0);
+    img->old_bitmap = (HBITMAP__*) SelectObject(img->dc, img->bitmap);
+    return img;
+}
+
+void bgiemu_freeimage(bgiemu_image* img)
+{
+    if (img != NULL) { 
+	SelectObject(img->dc, img->old_bitmap);
+	DeleteObject(img->bitmap);
+	DeleteDC(img->dc);
+	delete img;
+    }
+}
+
+void bgiemu_getimage(int x, int y, bgiemu_image* img)
+{
+    flush_commands();
+    BitBlt(img->dc, 0, 0, img->width, img->height, 
+	   hdc[draw_to_page() ? 1 : 0], x, y, SRCCOPY);
+}
+
+void bgiemu_putimage(int x, int y, bgiemu_image* img, 
+		     int sx, int sy, int w, int h, int op)
+{
+    flush_commands();
+    damage(x, y, x+w-1, y+h-1);
+    if (draw_to_page()) { 
+	BitBlt(hdc[1], x, y, w, h, img->dc, sx, sy, bitblt_mode_cnv[op]);
+    }
+    if (draw_to_window()) { 
+	BitBlt(hdc[0], x, y, w, h, img->dc, sx, sy, bitblt_mode_cnv[op]);
+    }
+}
+
+unsigned int* bgiemu_imagebits(bgiemu_image* img)
+{
     GdiFlush();
-    memcpy(bi->bits, image_bits, (((bi->width+7) & ~7) >> 1)*bi->height);
-    SelectObject(hdc[3], hdb);
-    DeleteObject(hb);
+    return img->bits;
 }
 
 int getpixel(int x, int y)
 { 
+    flush_commands();
     int color;
     COLORREF rgb = GetPixel(hdc[visual_page != active_page 
 			       || bgiemu_handle_redraw ? 1 : 0], x, y);
@@ -1343,11 +2083,13 @@ int getpixel(int x, int y)
     	    
 void putpixel(int x, int y, int c)
 {
+    flush_commands();
     c &= MAXCOLORS;
-    if (bgiemu_handle_redraw || visual_page != active_page) { 
+    damage(x, y, x, y);
+    if (draw_to_page()) { 
 	SetPixel(hdc[1], x, y, PALETTEINDEX(c+BG));
     }
-    if (visual_page == active_page) { 
+    if (draw_to_window()) { 
 	SetPixel(hdc[0], x, y, PALETTEINDEX(c+BG));
     }
 }
@@ -1409,6 +2151,14 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT messg,
 	if (visual_page != active_page) { 
 	    SelectObject(hdc[1], hBitmap[active_page]); 
 	} 
+	// the window is whole again, and shows nothing but the visual page
+	for (i = 0; i < MAX_PAGES; i++) { 
+	    if (i == visual_page) { 
+		page_damage[i].clear();
+	    } else { 
+		page_damage[i].add_all();
+	    }
+	}
 	ValidateRect(hWnd, NULL);
 	break;
       case WM_SETFOCUS:
@@ -1439,6 +2189,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT messg,
 	    DeleteObject(hPutimageBitmap);
 	    hPutimageBitmap = NULL;
 	}
+	free_getimage_bitmap();
 	for (i = 0; i < MAX_PAGES; i++) { 
 	    if (hBitmap[i] != NULL) {
 		DeleteObject(hBitmap[i]);
@@ -1499,6 +2250,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT messg,
 
 void closegraph()
 {
+    commands.discard();
     DestroyWindow(hWnd);
     while(handle_input(true));
 }
@@ -1801,3 +2553,5 @@ void restorecrtmode() {}
 
 
 /////////////////////////////////////////////////////////////////////////////////////////////
+
+#endif // BGI_SOFTWARE
@@ -17,7 +17,9 @@
 #define __GRAPHICS_H__
 
 
+#ifndef BGI_SOFTWARE
 #include <windows.h>
+#endif
 #include <stddef.h>
 #include <stdio.h>
 #include <math.h>
@@ -203,6 +205,10 @@ typedef struct viewporttype {
 
 
 //////////////////////////////////////////////////////////////////////////////
+// WinBGI (GDI) backend state.  Building with BGI_SOFTWARE defined selects the
+// headless framebuffer backend in softgraphics.cpp instead of graphics.cpp.
+#ifndef BGI_SOFTWARE
+
 #define MAX_PAGES 16
 
 static HDC hdc[4];
@@ -376,6 +382,8 @@ static int active_page;
 
 static arccoordstype ac;
 
+#endif // BGI_SOFTWARE
+
 
 
 
@@ -491,6 +499,70 @@ int kbhit PROTO((void));
 void delay PROTO((unsigned msec));
 void restorecrtmode PROTO((void));
 
+//
+// The current colour of a palette entry, packed as 0xAABBGGRR.
+//
+unsigned int bgiemu_color_rgba PROTO((int color));
+
+//
+// Persistent images: a block of page pixels that is kept between calls and
+// copied to and from pages as it is, with no colour conversion and no
+// allocation (under WinBGI a 32-bit DIB section with its own memory DC).
+// bgiemu_getimage() fills the whole image from the active page at (x, y);
+// bgiemu_putimage() puts the w x h part at (sx, sy) of the image on the
+// active page at (x, y), with a putimage() op.  bgiemu_imagebits() is the
+// image's pixels, width per row, top row first, which may also be written:
+// 0xAABBGGRR in the software backend, 0x00RRGGBB under WinBGI.
+//
+struct bgiemu_image;
+struct bgiemu_image* bgiemu_newimage PROTO((int width, int height));
+void bgiemu_freeimage PROTO((struct bgiemu_image* img));
+void bgiemu_getimage PROTO((int x, int y, struct bgiemu_image* img));
+void bgiemu_putimage PROTO((int x, int y, struct bgiemu_image* img,
+			    int sx, int sy, int w, int h, int op));
+unsigned int* bgiemu_imagebits PROTO((struct bgiemu_image* img));
+
+#ifndef BGI_SOFTWARE
+//
+// WinBGI only, with bgiemu_handle_redraw: when nonzero, primitives draw to
+// the page bitmap only, never straight to the window, and the rectangles
+// they touched are copied to the window at present time -- setvisualpage(),
+// or any input poll (kbhit(), getch(), delay(), mouse queries).  WM_PAINT
+// still repaints from the page bitmap.  Default 0: pages on screen are
+// drawn twice, to the bitmap and to the window.
+//
+extern int bgiemu_present_damage;
+
+//
+// WinBGI only: when nonzero, bar(), fillpoly(), fillellipse(), drawpoly(),
+// line(), rectangle(), circle() and outtextxy() are recorded rather than
+// drawn, and submitted to the page bitmap in one pass grouped by pen, brush
+// and font at the next setvisualpage() (or before anything that reads
+// pixels, or changes the page, viewport or palette).  Nothing reaches the
+// window until setvisualpage().  Default 0.
+//
+extern int bgiemu_batch_draw;
+
+struct batchstatstype { 
+    long commands;                // draw calls recorded
+    long flushes;                 // one-pass submissions
+    long state_changes;           // pen, brush and font switches made
+    long unsorted_state_changes;  // switches the same calls needed in call order
+};
+// Counts since the previous call
+void bgiemu_batch_stats PROTO((struct batchstatstype *stats));
+#endif
+
+#ifdef BGI_SOFTWARE
+//
+// Software backend only: the 32-bit RGBA pixels of a page (getmaxx()+1 per
+// row, read only), and a binary PPM dump of it.  Pages are allocated on
+// first use.
+//
+unsigned int const* bgiemu_framebuffer PROTO((int page));
+int bgiemu_save_ppm PROTO((int page, char const* file_name));
+#endif
+
 bool mouseup();
 bool mousedown();
 void clearmouse();
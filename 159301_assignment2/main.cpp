@@ -7,7 +7,9 @@
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#ifndef BGI_SOFTWARE
 #include <windows.h>
+#endif
 #include <stddef.h>
 #include <stdio.h>
 #include <math.h>
@@ -16,6 +18,8 @@
 #include <string.h>
 #include <iostream>
 #include <fstream>
+#include <iomanip>
+#include <chrono>
 #include <deque>
 #include <set>
 #include <vector>
@@ -27,62 +31,21 @@
 #include "transform.h"
 #include "algorithm.h"
 #include "fuzzylogic.h"
+#include "pendulum.h"
+#include "display.h"
+#include "surface.h"
+#include "simulation.h"
+#include "replay.h"
+#include "recorder.h"
+#include "benchmark.h"
 
 using namespace std;
 
 
 /// Global Variables ///////////////////////////////////////////////////////////////////////
 
-float WORLD_MAXX, WORLD_MAXY;
-int fieldX1, fieldY1, fieldX2, fieldY2; //playing field boundaries
-BoundaryType worldBoundary, deviceBoundary;
-char keyPressed[5];
 fuzzy_system_rec g_fuzzy_system;
 
-//Yamakawa
-float A = 100.0;
-float B = 1.0;
-float C = 10.0;
-float D = 0.5;
-
-struct WorldStateType{
-
-	void init(){
-		x = 0.0;
-		x_dot = 0.0;
-		x_double_dot = 0.0;
-		angle = 0.0;
-		angle_dot = 0.0;
-		angle_double_dot = 0.0;
-		F = 0.0;
-
-		//Yamakawa
-		in_theta_and_theta_dot = 0.0;
-		in_x_and_x_dot = 0.0;
-
-	}
-
-	float x;
-	float x_dot;
-	float x_double_dot;
-	float angle;
-	float angle_dot;
-	float angle_double_dot;
-
-	float const mb = 0.1f;
-	float const g = 9.8f;
-	float const m = 1.1f; // mass of cart & broom
-	float const l = 0.5f;
-
-	float F;
-
-	//Yamakawa
-	float	in_theta_and_theta_dot;
-	float	in_x_and_x_dot;
-
-};
-
-
 struct DataSetType{
 	vector<float> x;
 	vector<float> y;
@@ -93,6 +56,87 @@ DataSetType dataSet;
 
 int NUM_OF_DATA_POINTS;
 
+//Stop runInvertedPendulum after this many frames (0 = run until ESC).  The
+//headless build has no keyboard, so there 0 means HEADLESS_FRAMES more
+//frames (10 s of simulated time at h = 0.002), after which the data are saved.
+int maxFrames = 0;
+#define HEADLESS_FRAMES 5000
+
+//The frame to stop at for a run starting at frame from; 0 = none
+static long frameLimit(long from){
+#ifdef BGI_SOFTWARE
+	if (maxFrames == 0)
+		return from + HEADLESS_FRAMES;
+#endif
+	return maxFrames;
+}
+
+//-record <file.y4m|file.ppm|file.rgb> [-fps N]: export runInvertedPendulum
+string recordPath;
+int recordFps = 30;
+FrameRecorder recorder;
+
+//-atlas 1: draw the cart and rod from a SpriteAtlas.  Experimental: on the
+//software renderer it is 2-3x slower than the vectors (-bench), it costs
+//an 18.5 MB atlas, and it is not yet timed on GDI
+int useSpriteAtlas = 0;
+
+//-plot <seconds>: strip charts of angle, x and F over that window (0 = none)
+double plotSeconds = 0.0;
+
+//-surface 1: the control surface is generated first, shown with the live
+//trajectory during the run, and then in a viewer (arrow keys turn the mesh)
+int showSurface = 0;
+SurfaceViewer surfaceViewer;
+bool surfaceGenerated = false;
+
+//-grid N: control surface samples along each axis
+int surfaceGridPoints = 100;
+
+//-rt 1: print the control loop's tick jitter histogram at exit; -spin <us>,
+//-cpu <n> and -mlock 1 tune the ticks (see RealtimeOptions)
+int realtimeReport = 0;
+RealtimeOptions realtimeOptions = { 0.0, -1, false };
+
+//-disturb <file>: forces on the cart by simulated time (see DisturbanceSchedule);
+//-keys 0 ignores the arrow keys; -savedisturb <file> writes the schedule at
+//exit, with the key presses of the run as steps
+DisturbanceSchedule disturbances;
+string disturbPath, saveDisturbPath;
+int useKeys = 1;
+
+//-trials N: instead of the animation, run the schedule N times headless
+//(-frames ticks each, default 5000; noise reseeded per trial) and print
+//the response
+int disturbanceTrials = 0;
+
+//-savereplay <file>: write a replay log of the run.  -replay <file>: run a
+//log again headless, as fast as it computes (-savereplay then writes the
+//new run with its trace); -diff <file> reports the first tick at which it
+//differs from that log's trace, e.g. one saved by another build
+string saveReplayPath, replayPath, diffPath;
+
+//-checkpoint <file>: snapshots of the run every -every simulated seconds
+//(default 10), written on a thread of their own, and at exit; -resume <file>
+//carries on from one, with its controller and disturbances
+string checkpointPath, resumePath;
+double checkpointSeconds = 10.0;
+
+//-mb <kg>, -mass <kg> (cart and broom), -length <m>, -gravity <m/s^2>: the
+//plant (see PlantParameters); -legacy 0 for the textbook equations in place
+//of the original ones; -friction <N s/m> on the cart and -pivot <N m s> at
+//the pole; -fmax <N> and -frate <N/s> limit the actuator
+PlantParameters plant = defaultPlantParameters();
+
+//-sweep N: instead of the animation, run the schedule headless on an N x N
+//grid of plants, -mb and -length each from half to twice their value, in
+//parallel, and print each one's cost and failure
+int sweepPoints = 0;
+
+//-metrics 1: the run's metrics (see TrajectoryMetrics) under the state
+//readout, and printed at exit.  -trials always prints them.
+int showMetrics = 0;
+
 // Function Prototypes ////////////////////////////////////////////////////////////////////
 
 
@@ -101,6 +145,7 @@ float getKey() {
 
 	float F = 0.0;
 
+#ifndef BGI_SOFTWARE
 	if (GetAsyncKeyState(VK_LEFT) < 0) {
 		//"LEFT ARROW";
 		F = -7.0;
@@ -114,121 +159,47 @@ float getKey() {
 		//F = 350.0;
 		//"RIGHT ARROW"
 	}
+#endif
 
 	return F;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-
-
-
-void initPendulumWorld(){
-
-	//widescreen
-	fieldX1 = getmaxx() / 10;
-	fieldX2 = getmaxx() - (getmaxx() / 10);
-	fieldY1 = getmaxy() / 9;
-	fieldY2 = getmaxy() - (getmaxy() / 9);
-
-
-	worldBoundary.x1 = -2.4f;
-	//worldBoundary.y1 = 1.2;
-	worldBoundary.y1 = 3.0f;
-	worldBoundary.x2 = 2.4f;
-	worldBoundary.y2 = -0.4f;
-
-	deviceBoundary.x1 = (float)fieldX1;
-	deviceBoundary.y1 = (float)fieldY1;
-	deviceBoundary.x2 = (float)fieldX2;
-	deviceBoundary.y2 = (float)fieldY2;
-
-	WORLD_MAXX = worldBoundary.x2 - worldBoundary.x1;
-	WORLD_MAXY = worldBoundary.y2 - worldBoundary.y1;
-
-}
-
-void drawInvertedPendulumWorld(){
-
-	setcolor(WHITE);
-	rectangle(xDev(worldBoundary, deviceBoundary, worldBoundary.x1), yDev(worldBoundary, deviceBoundary, worldBoundary.y1),
-		xDev(worldBoundary, deviceBoundary, worldBoundary.x2), yDev(worldBoundary, deviceBoundary, worldBoundary.y2));
-	//~ setcolor(YELLOW);
-	//~ rectangle(xDev(worldBoundary,deviceBoundary,worldBoundary.x1),yDev(worldBoundary,deviceBoundary,worldBoundary.y2+0.07),
-	//~ xDev(worldBoundary,deviceBoundary,worldBoundary.x2),yDev(worldBoundary,deviceBoundary,worldBoundary.y2));
-	settextstyle(TRIPLEX_FONT, HORIZ_DIR, 2);
-	settextjustify(CENTER_TEXT, CENTER_TEXT);
-
-	setcolor(WHITE);
-	settextstyle(TRIPLEX_FONT, HORIZ_DIR, 1);
-	outtextxy((deviceBoundary.x1 + deviceBoundary.x2) / 2, deviceBoundary.y1 - 2 * textheight("H"), "INVERTED PENDULUM");
-	settextstyle(TRIPLEX_FONT, HORIZ_DIR, 1);
-	outtextxy((deviceBoundary.x1 + deviceBoundary.x2) / 2, deviceBoundary.y1 - textheight("H"), "FUZZY LOGIC CONTROLLER");
-
-}
-
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// BEGIN - DYNAMICS OF THE SYSTEM
-float calc_angular_acceleration(const WorldStateType& s){
-	float a_double_dot = 0.0;
-
-	a_double_dot = (s.m * s.g * sin(s.angle) - (cos(s.angle) * (s.F + ((s.mb) * s.l * s.angle_dot * s.angle_dot * sin(s.angle)))))
-		/ (((4 / 3)*s.m * s.l) - (s.mb * s.l * cos(s.angle) * cos(s.angle)));
-	return a_double_dot;
-}
-
-float calc_horizontal_acceleration(const WorldStateType& s){
-	float x_double_dot = 0.0;
-
-	x_double_dot = (s.F + s.mb * s.l * (s.angle_dot * s.angle_dot)* sin(s.angle) - s.angle_double_dot * cos(s.angle)) / s.m;
-	return x_double_dot;
+bool escapePressed() {
+#ifdef BGI_SOFTWARE
+	return kbhit() && getch() == 0x1b;  //headless: no keyboard
+#else
+	return GetAsyncKeyState(VK_ESCAPE) != 0;
+#endif
 }
-// END - DYNAMICS OF THE SYSTEM
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-
-void displayInfo(const WorldStateType& s){
-	setcolor(WHITE);
-	outtextxy((deviceBoundary.x1 + deviceBoundary.x2) / 2, deviceBoundary.y1 - 2 * textheight("H"), "INVERTED PENDULUM");
-	settextstyle(TRIPLEX_FONT, HORIZ_DIR, 1);
-	outtextxy((deviceBoundary.x1 + deviceBoundary.x2) / 2, deviceBoundary.y1 - textheight("H"), "FUZZY LOGIC CONTROLLER");
-	settextstyle(SMALL_FONT, HORIZ_DIR, 6);
-
-	char angleStr[120];
-	char xStr[120];
-
-	float a = ((s.angle * 180.0f / 3.14f));
-
-	if (a > 360.0f){
-		a = a / 360.0f;
-	}
-
-	sprintf(xStr, "x = %4.2f", s.x);
-	outtextxy((deviceBoundary.x2 - textwidth("n.h.reyes@massey.ac.nz")), deviceBoundary.y2 - (7 * textheight("H")), xStr);
-
-	sprintf(angleStr, "angle = %4.2f", a);
-	outtextxy((deviceBoundary.x2 - textwidth("n.h.reyes@massey.ac.nz")), deviceBoundary.y2 - (6 * textheight("H")), angleStr);
 
-	sprintf(angleStr, "F = %4.2f", s.F);
-	outtextxy((deviceBoundary.x2 - textwidth("n.h.reyes@massey.ac.nz")), deviceBoundary.y2 - (5 * textheight("H")), angleStr);
+////////////////////////////////////////////////////////////////////////////////
 
-}
 
 
 void runInvertedPendulum(){
 
-	float inputs[4];
-
-	WorldStateType prevState, newState;
+	WorldStateType prevState;
 	srand((unsigned int)time(NULL));  // Seed the random number generator
 
 	initPendulumWorld();
 
-	static BOOL page;
+	static int page;
+	LayerCompositor renderer;
+	SpriteAtlas atlas;
+	if (useSpriteAtlas) {
+		cout << "-atlas is experimental and slower than drawing vectors on the software renderer" << endl;
+		renderer.useSpriteAtlas(&atlas);
+	}
+	StripChart chart(plotSeconds);
+	if (plotSeconds > 0.0)
+		renderer.usePlot(&chart);
+	if (showSurface && surfaceViewer.ready())
+		renderer.useSurface(&surfaceViewer);
 
 	float const h = 0.002f;
 	float externalForce = 0.0f;
 
 	prevState.init();
-	newState.init();
 
 
 	//-------------------------------------------------
@@ -251,74 +222,127 @@ void runInvertedPendulum(){
 
 	initFuzzySystem(&g_fuzzy_system);
 
+	long firstStep = 0;
+	if (!resumePath.empty()) {
+		Checkpoint resumed;
+		if (!loadCheckpoint(resumePath, resumed, &g_fuzzy_system))
+			exit(1);
+		if (resumed.h != h) {
+			cout << resumePath << " was made with h = " << resumed.h << ", not " << h << endl;
+			exit(1);
+		}
+		prevState = resumed.state;
+		disturbances = resumed.disturbances;
+		firstStep = resumed.step;
+		plant = resumed.plant;
+		cout << "Resuming " << resumePath << " from tick " << firstStep << " (t = " << firstStep * h << " s)" << endl;
+	}
+	CheckpointWriter checkpoints;
+	if (!checkpointPath.empty() && !checkpoints.open(checkpointPath, &g_fuzzy_system, plant))
+		exit(1);
+
+	if (!recordPath.empty()) {
+		frame_format format;
+		if (!frameFormatFromPath(recordPath, format)) {
+			cout << "Unknown recording format: " << recordPath << " (use .y4m, .ppm or .rgb)" << endl;
+			exit(1);
+		}
+		if (!recorder.open(recordPath, format, recordFps))
+			exit(1);
+	}
+
 	//~ display_All_MF (g_fuzzy_system);
 	//~ getch();
 
-	while ((GetAsyncKeyState(VK_ESCAPE)) == 0) {
-
-		setactivepage(page);
-		cleardevice();
-		drawInvertedPendulumWorld();
+	//1) Enable this only after your fuzzy system has been completed already.
+	//Remember, you need to define the rules, membership function parameters and rule outputs.
+	//The controller and the dynamics run on the simulation thread (simulation.cpp),
+	//ticking every h seconds; this thread draws the newest state it has published.
+	PendulumSimulation simulation(&g_fuzzy_system, h);
+	if (plotSeconds > 0.0)
+		simulation.usePlot(&chart.ring());
+	simulation.useDisturbances(&disturbances);
+	if (checkpoints.isOpen())
+		simulation.useCheckpoints(&checkpoints, (long)(checkpointSeconds / h + 0.5));
+	simulation.setPlant(plant);
+	simulation.setRealtime(realtimeOptions);
+	MetricLimits limits = defaultMetricLimits();
+	limits.x1 = worldBoundary.x1;
+	limits.x2 = worldBoundary.x2;
+	long lastStep = frameLimit(firstStep);
+	limits.horizon = lastStep > 0 ? (lastStep - firstStep) * (double)h : 0.0;
+	simulation.setMetricLimits(limits);
+	simulation.start(prevState, lastStep, firstStep);
+
+	while (!escapePressed() && simulation.running()) {
+		if (useKeys) {
+			externalForce = getKey(); //manual operation, added to the schedule as a step
+			simulation.setExternalForce(externalForce);
+		}
 
-		//retrieve inputs
-		//~ inputs[in_theta] = prevState.angle;
-		//~ inputs[in_theta_dot] = prevState.angle_dot;
-		//~ inputs[in_x] = prevState.x;
-		//~ inputs[in_x_dot] = prevState.x_dot;
+		if (!simulation.update()) {
+			delay(1);  //nothing new since the last frame
+			continue;
+		}
+		const SimulationFrame& f = simulation.latest();
 
 		//yamakawa
-		inputs[in_theta_and_theta_dot] = (A * prevState.angle) + (B * prevState.angle_dot);
-		inputs[in_x_and_x_dot] = (C * prevState.x) + (D * prevState.x_dot);
-
-		//cout << "prevState.angle = " << prevState.angle << ". prevState.angle_dot = " << prevState.angle_dot << " ";
-		//cout << "prevState.x = " << prevState.x << " prevState.x_dot = " << prevState.x_dot << " ";
-		cout << "theta_and_theta_dot = " << inputs[in_theta_and_theta_dot] << ". x_and_x_dot = " << inputs[in_x_and_x_dot];
-		//cout << "in_x_and_x_dot = " << inputs[in_x_and_x_dot] << " ";
-
-		//1) Enable this only after your fuzzy system has been completed already.
-		//Remember, you need to define the rules, membership function parameters and rule outputs.
-		prevState.F = fuzzy_system(inputs, g_fuzzy_system); //call the fuzzy controller
-
-		externalForce = 0.0;
-		externalForce = getKey(); //manual operation
-
-		if (externalForce != 0.0)
-			prevState.F = externalForce;
-		//-------------
-		cout << "F = " << prevState.F << endl; //for debugging purposes only
-
-		//---------------------------------------------------------------------------
-		// **************************************************************************
-		// BEGIN - DYNAMICS OF THE SYSTEM
-
-		//Calculate the new state of the world
-		newState.angle_double_dot = calc_angular_acceleration(prevState);
-		newState.angle_dot = prevState.angle_dot + (h * newState.angle_double_dot);
-		newState.angle = prevState.angle + (h * newState.angle_dot);
-		newState.F = prevState.F;
-		newState.x_double_dot = calc_horizontal_acceleration(prevState);
-		newState.x_dot = prevState.x_dot + (h * newState.x_double_dot);
-		newState.x = prevState.x + (h * newState.x_dot);
-
-		prevState.x = newState.x;
-		prevState.angle = newState.angle;
-		prevState.x_dot = newState.x_dot;
-		prevState.angle_dot = newState.angle_dot;
-		prevState.angle_double_dot = newState.angle_double_dot;
-		prevState.x_double_dot = newState.x_double_dot;
-		//--------------------------	 		 
-		cart.setX(newState.x);
-		rod.setX(newState.x);
-		rod.setAngle(newState.angle);
-		cart.draw();
-		rod.draw();
-		// END - DYNAMICS OF THE SYSTEM
-		// **************************************************************************
-		//---------------------------------------------------------------------------
-		displayInfo(newState);
-
-		setvisualpage(page);
-		page = !page;  //switch to another page
+		cout << "theta_and_theta_dot = " << f.inputs[in_theta_and_theta_dot] << ". x_and_x_dot = " << f.inputs[in_x_and_x_dot];
+		cout << "F = " << f.state.F;
+		if (f.disturbance != 0.0f)
+			cout << " (disturbance " << f.disturbance << ")";
+		cout << endl; //for debugging purposes only
+
+		bool draw = true;
+#ifdef BGI_SOFTWARE
+		draw = !recorder.isOpen() || recorder.due(f.t);  //headless: only recorded frames are seen
+#endif
+		if (draw) {
+			setactivepage(page);
+			renderer.setMetrics(showMetrics ? &f.metrics : NULL);
+			renderer.drawFrame(f.state, cart, rod, page);
+			recorder.frame(f.t, page);
+
+			setvisualpage(page);
+			page = !page;  //switch to another page
+		}
+	}
+	simulation.stop();
+	simulation.update();  //the last tick, if the display had not taken it
+	const SimulationFrame& last = simulation.latest();
+	if (realtimeReport)
+		simulation.tickStats().print(cout);
+	else if (simulation.tickStats().misses() > 0)
+		cout << simulation.tickStats().misses() << " control tick deadline(s) missed" << endl;
+	if (showMetrics)
+		simulation.runMetrics().print(cout);
+
+	if (recorder.isOpen()) {
+		recorder.close();
+		cout << recorder.framesWritten() << " frames written to " << recordPath << endl;
+	}
+	if (!saveDisturbPath.empty() && disturbances.save(saveDisturbPath))
+		cout << disturbances.size() << " disturbance(s) written to " << saveDisturbPath << endl;
+	if (checkpoints.isOpen()) {
+		checkpoints.close();
+		Checkpoint atExit;
+		atExit.set(last.step, h, last.state, disturbances);
+		atExit.plant = plant;
+		if (saveCheckpoint(checkpointPath, atExit, g_fuzzy_system))
+			cout << checkpoints.written() + 1 << " checkpoint(s) written to " << checkpointPath << ", the last at tick " << last.step << endl;
+	}
+	if (!saveReplayPath.empty()) {
+		ReplayLog log;
+		log.controller = controllerHash(g_fuzzy_system);
+		log.plant = plant;
+		log.h = h;
+		log.first = firstStep;
+		log.steps = last.step - firstStep;
+		log.start = prevState;
+		log.end = replayStep(last.state);
+		log.disturbances = disturbances;
+		if (log.save(saveReplayPath))
+			cout << "Replay log of " << log.steps << " ticks written to " << saveReplayPath << endl;
 	}
 
 	//2) Enable this only after your fuzzy system has been completed already.
@@ -326,6 +350,186 @@ void runInvertedPendulum(){
 }
 
 
+//-trials: the same start as runInvertedPendulum, no window and no waiting
+void runDisturbanceTrials(){
+	float const h = 0.002f;
+	long steps = maxFrames > 0 ? maxFrames : 5000;
+
+	WorldStateType start;
+	start.init();
+	start.angle = 8.0f * (M_PI / 180.0f);
+
+	initFuzzySystem(&g_fuzzy_system);
+
+	MetricLimits limits = defaultMetricLimits();
+	limits.horizon = steps * (double)h;
+
+	cout << "Running " << disturbanceTrials << " trial(s) of " << steps << " steps with " << disturbances.size() << " disturbance(s)..." << endl;
+	MetricSummary mean = MetricSummary(), worst = MetricSummary();
+	int settled = 0, failures[3] = { 0, 0, 0 };
+	for (int trial = 0; trial < disturbanceTrials; trial++) {
+		MetricSummary r = runDisturbanceTrial(g_fuzzy_system, disturbances, start, h, steps, (unsigned int)trial, limits, plant);
+		mean.duration += r.duration;
+		mean.iaeAngle += r.iaeAngle;
+		mean.iseAngle += r.iseAngle;
+		mean.iaeX += r.iaeX;
+		mean.effort += r.effort;
+		mean.overshoot += r.overshoot;
+		mean.cost += r.cost;
+		worst.peakAngle = max(worst.peakAngle, r.peakAngle);
+		worst.peakX = max(worst.peakX, r.peakX);
+		worst.cost = max(worst.cost, r.cost);
+		if (r.settlingTime >= 0.0) {
+			mean.settlingTime += r.settlingTime;
+			settled++;
+		}
+		failures[r.failure]++;
+		if (r.failure != no_failure)
+			mean.failedAt += r.failedAt;
+	}
+	double n = disturbanceTrials, degrees = 180.0 / M_PI;
+	int failed = failures[angle_failure] + failures[x_failure];
+	cout << "Mean over the trials (up to any failure): " << mean.duration / n << " s run, IAE " << mean.iaeAngle / n * degrees
+		<< " deg s, ISE " << mean.iseAngle / n << " rad^2 s, IAE(x) " << mean.iaeX / n << " m s, effort " << mean.effort / n
+		<< " N^2 s, overshoot " << mean.overshoot / n * degrees << " deg" << endl;
+	cout << "Worst: peak angle " << worst.peakAngle * degrees << " deg, peak |x| " << worst.peakX << " m" << endl;
+	cout << settled << " settled";
+	if (settled > 0)
+		cout << ", after " << mean.settlingTime / settled << " s on average";
+	cout << "; " << failures[angle_failure] << " fell and " << failures[x_failure] << " left the track";
+	if (failed > 0)
+		cout << ", after " << mean.failedAt / failed << " s on average";
+	cout << endl;
+	cout << "Cost: mean " << mean.cost / n << ", worst " << worst.cost << endl;
+
+	free_fuzzy_rules(&g_fuzzy_system);
+}
+
+
+//-sweep: runDisturbanceTrials' start, on a grid of plants around plant
+void runSweep(){
+	float const h = 0.002f;
+	long steps = maxFrames > 0 ? maxFrames : 5000;
+	float cart = plant.m - plant.mb;  //the cart keeps its mass as the broom's changes
+
+	WorldStateType start;
+	start.init();
+	start.angle = 8.0f * (M_PI / 180.0f);
+
+	initFuzzySystem(&g_fuzzy_system);
+
+	MetricLimits limits = defaultMetricLimits();
+	limits.horizon = steps * (double)h;
+
+	vector<PlantParameters> plants;
+	vector<float> scale(sweepPoints);
+	for (int i = 0; i < sweepPoints; i++)
+		scale[i] = sweepPoints > 1 ? 0.5f * pow(4.0f, i / (float)(sweepPoints - 1)) : 1.0f;
+	for (int i = 0; i < sweepPoints; i++) {
+		for (int j = 0; j < sweepPoints; j++) {
+			PlantParameters p = plant;
+			p.mb = plant.mb * scale[i];
+			p.m = cart + p.mb;
+			p.l = plant.l * scale[j];
+			plants.push_back(p);
+		}
+	}
+
+	cout << "Running " << plants.size() << " plants for " << steps << " steps with " << disturbances.size() << " disturbance(s)..." << endl;
+	chrono::high_resolution_clock::time_point begin = chrono::high_resolution_clock::now();
+	vector<MetricSummary> results = runPlantSweep(g_fuzzy_system, disturbances, start, h, steps, plants, limits);
+	double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - begin).count();
+
+	//a row per broom mass, a column per length: the cost, and when it failed
+	char cell[32];
+	cout << "  mb \\ l ";
+	for (int j = 0; j < sweepPoints; j++) {
+		sprintf(cell, "%14.3f", plants[j].l);
+		cout << cell;
+	}
+	cout << endl;
+	int failed = 0;
+	for (int i = 0; i < sweepPoints; i++) {
+		sprintf(cell, "%8.3f ", plants[i * sweepPoints].mb);
+		cout << cell;
+		for (int j = 0; j < sweepPoints; j++) {
+			const MetricSummary& r = results[i * sweepPoints + j];
+			if (r.failure != no_failure) {
+				sprintf(cell, "%8.2f %c%4.2f", r.cost, r.failure == angle_failure ? 'a' : 'x', r.failedAt);
+				failed++;
+			} else {
+				sprintf(cell, "%8.2f      ", r.cost);
+			}
+			cout << cell;
+		}
+		cout << endl;
+	}
+	cout << "Cost of each plant, with a<s> or x<s> when the pole fell or the cart left the track; " << failed << " of "
+		<< plants.size() << " failed.  " << seconds << " s for the sweep." << endl;
+
+	free_fuzzy_rules(&g_fuzzy_system);
+}
+
+
+static void printReplayStep(const char* label, const ReplayStep& s){
+	streamsize precision = cout.precision();
+	cout << label << setprecision(9) << "x " << s.x << ", x_dot " << s.x_dot << ", angle " << s.angle
+		<< ", angle_dot " << s.angle_dot << ", F " << s.F << endl;
+	cout.precision(precision);
+}
+
+//-replay: the log's run again with this build's controller
+void runReplay(){
+	ReplayLog log;
+	if (!log.load(replayPath))
+		exit(1);
+	initFuzzySystem(&g_fuzzy_system);
+
+	ReplayLog replayed(log);
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	replayRun(g_fuzzy_system, replayed);
+	double seconds = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+
+	double simulated = log.steps * (double)log.h;
+	cout << "Replayed " << log.steps << " ticks (" << simulated << " s) in " << seconds * 1e3 << " ms, "
+		<< simulated / max(seconds, 1e-9) << "x real time" << endl;
+	if (replayed.controller != log.controller)
+		cout << "The controller is not the one recorded (" << hex << replayed.controller << ", not "
+			<< log.controller << dec << "), so the run may differ" << endl;
+	if (sameStep(replayed.end, log.end)) {
+		cout << "The final state matches the recording bit for bit" << endl;
+	} else {
+		cout << "The final state differs from the recording" << endl;
+		printReplayStep("  recorded: ", log.end);
+		printReplayStep("  replayed: ", replayed.end);
+	}
+
+	if (!diffPath.empty()) {
+		ReplayLog other;
+		if (!other.load(diffPath))
+			exit(1);
+		if (other.trace.empty()) {
+			cout << diffPath << " has no trace (save one with -replay <log> -savereplay <file>)" << endl;
+		} else {
+			long at = firstDivergence(replayed.trace, other.trace);
+			long common = (long)min(replayed.trace.size(), other.trace.size());
+			if (at == 0) {
+				cout << "The runs agree for all " << common << " ticks they share" << endl;
+			} else {
+				long tick = log.first + at;
+				cout << "The runs first differ at tick " << tick << " (t = " << tick * (double)log.h << " s) of " << log.first + common << endl;
+				printReplayStep("  this build: ", replayed.trace[at - 1]);
+				printReplayStep(("  " + diffPath + ": ").c_str(), other.trace[at - 1]);
+			}
+		}
+	}
+
+	if (!saveReplayPath.empty() && replayed.save(saveReplayPath))
+		cout << "Replay log with its trace written to " << saveReplayPath << endl;
+	free_fuzzy_rules(&g_fuzzy_system);
+}
+
+
 void generateControlSurface_Angle_vs_Angle_Dot(){
 	//float inputs[4];
 
@@ -333,17 +537,14 @@ void generateControlSurface_Angle_vs_Angle_Dot(){
 	float inputs[2];
 
 	cout << "Generating control surface (Angle vs. Angle_Dot)..." << endl;
-	WorldStateType prevState, newState;
+	WorldStateType prevState;
 	srand((unsigned int)time(NULL));  // Seed the random number generator
 
 	initPendulumWorld();
 
-	static BOOL page;
-
 	float const h = 0.002f;
 
 	prevState.init();
-	newState.init();
 
 	//-------------------------------------------------
 	//~ Cart cart(-1.0, worldBoundary.y2 + 0.125);
@@ -363,7 +564,7 @@ void generateControlSurface_Angle_vs_Angle_Dot(){
 	float minAngleDot = 0;
 	float maxAngleDot = 0;
 
-	NUM_OF_DATA_POINTS = 100;
+	NUM_OF_DATA_POINTS = surfaceGridPoints;
 
 	//---------------------------------
 	dataSet.x.resize(NUM_OF_DATA_POINTS);
@@ -390,64 +591,10 @@ void generateControlSurface_Angle_vs_Angle_Dot(){
 		angle = minAngle;
 
 		for (int col = 0; col < NUM_OF_DATA_POINTS; col++){
-			prevState.x = 0.0f;
-			prevState.x_dot = 0.0f;
-			prevState.x_double_dot = 0.0f;
-			prevState.angle = angle;
-			prevState.angle_dot = angle_dot;
-			prevState.angle_double_dot = 0.0f;
-			prevState.F = 0.0f;
-
-
 			dataSet.x[col] = angle;
-			prevState.angle = angle;
-
-
-			//~ inputs[in_theta] = prevState.angle;
-			//~ inputs[in_theta_dot] = prevState.angle_dot;
-			//~ inputs[in_x] = prevState.x;
-			//~ inputs[in_x_dot] = prevState.x_dot;
-
-			//yamakawa
-			inputs[in_theta_and_theta_dot] = (A * prevState.angle) + (B * prevState.angle_dot);
-			inputs[in_x_and_x_dot] = (C * prevState.angle) + (D * prevState.angle_dot);
-
-
-			prevState.F = 0.0;  //nothing is done.//fuzzy_system(inputs, g_fuzzy_system);
-
 
-			//---------------------------------------------------------------------------
-			//Calculate the new state of the world
-			//Updating angle
-
-			newState.angle_double_dot = calc_angular_acceleration(prevState);
-			newState.angle_dot = prevState.angle_dot + (h * newState.angle_double_dot);
-			newState.angle = prevState.angle + (h * newState.angle_dot);
-			newState.F = prevState.F;
-
-			//Updating x
-
-			newState.x_double_dot = calc_horizontal_acceleration(prevState);
-			newState.x_dot = prevState.x_dot + (h * newState.x_double_dot);
-			newState.x = prevState.x + (h * newState.x_dot);
-
-			//Update previous state
-			prevState.x = newState.x;
-			prevState.angle = newState.angle;
-			prevState.x_dot = newState.x_dot;
-			prevState.angle_dot = newState.angle_dot;
-			prevState.angle_double_dot = newState.angle_double_dot;
-			prevState.x_double_dot = newState.x_double_dot;
-
-			//--------------------------
-			//inputs[in_theta] = prevState.angle;
-			//inputs[in_theta_dot] = prevState.angle_dot;
-			//inputs[in_x] = prevState.x;
-			//inputs[in_x_dot] = prevState.x_dot;
-
-			//Yamakawa
-			inputs[in_theta_and_theta_dot] = (A * prevState.angle) + (B * prevState.angle_dot);
-			inputs[in_x_and_x_dot] = (C * prevState.angle) + (D * prevState.angle_dot);
+			//Yamakawa: one unforced step from (angle, angle_dot), see getSurfaceInputs
+			getSurfaceInputs(angle, angle_dot, h, plant, inputs);
 
 			prevState.F = fuzzy_system(inputs, g_fuzzy_system);
 			dataSet.z[row][col] = prevState.F; //record Force calculated
@@ -459,6 +606,7 @@ void generateControlSurface_Angle_vs_Angle_Dot(){
 	}
 
 	free_fuzzy_rules(&g_fuzzy_system);
+	surfaceGenerated = true;
 	cout << "done collecting data." << endl;
 
 }
@@ -466,6 +614,45 @@ void generateControlSurface_Angle_vs_Angle_Dot(){
 
 
 
+//Heatmap and mesh of dataSet side by side, with the trajectory of the last
+//run; the arrow keys turn the mesh until ESC
+void viewControlSurface(){
+	cout << "Control surface viewer: arrow keys turn the mesh, ESC to leave" << endl;
+	while (escapePressed())  //the ESC that ended the run
+		delay(10);
+
+	int size = min(getmaxx() / 2, getmaxy()) - 40;
+	DeviceRectType heat = { getmaxx() / 4 - size / 2, (getmaxy() - size) / 2, getmaxx() / 4 - size / 2 + size - 1, (getmaxy() + size) / 2 - 1 };
+	DeviceRectType mesh = { heat.x1 + getmaxx() / 2, heat.y1, heat.x2 + getmaxx() / 2, heat.y2 };
+	int page = 0;
+	long frames = frameLimit(0);
+
+	for (long frame = 0; !escapePressed() && (frames == 0 || frame < frames); frame++) {
+		float yaw = surfaceViewer.yaw(), pitch = surfaceViewer.pitch();
+#ifndef BGI_SOFTWARE
+		if (GetAsyncKeyState(VK_LEFT) < 0) yaw -= 0.03f;
+		if (GetAsyncKeyState(VK_RIGHT) < 0) yaw += 0.03f;
+		if (GetAsyncKeyState(VK_UP) < 0 && pitch < 1.55f) pitch += 0.02f;
+		if (GetAsyncKeyState(VK_DOWN) < 0 && pitch > 0.0f) pitch -= 0.02f;
+#endif
+		surfaceViewer.setView(yaw, pitch);
+
+		setactivepage(page);
+		cleardevice();
+		setcolor(WHITE);
+		settextstyle(TRIPLEX_FONT, HORIZ_DIR, 1);
+		settextjustify(CENTER_TEXT, CENTER_TEXT);
+		outtextxy((heat.x1 + heat.x2) / 2, heat.y1 - 20, "F(angle, angle_dot)");
+		outtextxy((mesh.x1 + mesh.x2) / 2, mesh.y1 - 20, "mesh");
+		surfaceViewer.drawHeatmap(heat);
+		surfaceViewer.drawMesh(mesh);
+		surfaceViewer.drawTrajectory(heat, mesh);
+		setvisualpage(page);
+		page = !page;
+	}
+}
+
+
 void saveDataToFile(string fileName){
 	cout << "Saving control surface to file: " << fileName << "..." << endl;
 	ofstream myfile;
@@ -524,17 +711,122 @@ void clearDataSet(){
 
 ////////////////////////////////////////////////////////////////////////////////////
 
-int main(void) {
+int main(int argc, char *argv[]) {
 
 	int graphDriver = 0, graphMode = 0;
 
+	if (argc > 1 && strcmp(argv[1], "-bench") == 0) {
+		runBenchmarks();
+		return 0;
+	}
+	for (int i = 1; i + 1 < argc; i += 2) {
+		if (strcmp(argv[i], "-frames") == 0)
+			maxFrames = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-record") == 0)
+			recordPath = argv[i + 1];
+		else if (strcmp(argv[i], "-fps") == 0)
+			recordFps = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-atlas") == 0)
+			useSpriteAtlas = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-plot") == 0)
+			plotSeconds = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-surface") == 0)
+			showSurface = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-grid") == 0)
+			surfaceGridPoints = max(2, atoi(argv[i + 1]));
+		else if (strcmp(argv[i], "-rt") == 0)
+			realtimeReport = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-spin") == 0)
+			realtimeOptions.spinUs = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-cpu") == 0)
+			realtimeOptions.cpu = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-mlock") == 0)
+			realtimeOptions.lockMemory = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "-disturb") == 0)
+			disturbPath = argv[i + 1];
+		else if (strcmp(argv[i], "-savedisturb") == 0)
+			saveDisturbPath = argv[i + 1];
+		else if (strcmp(argv[i], "-keys") == 0)
+			useKeys = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-trials") == 0)
+			disturbanceTrials = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-savereplay") == 0)
+			saveReplayPath = argv[i + 1];
+		else if (strcmp(argv[i], "-replay") == 0)
+			replayPath = argv[i + 1];
+		else if (strcmp(argv[i], "-diff") == 0)
+			diffPath = argv[i + 1];
+		else if (strcmp(argv[i], "-checkpoint") == 0)
+			checkpointPath = argv[i + 1];
+		else if (strcmp(argv[i], "-every") == 0)
+			checkpointSeconds = atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-resume") == 0)
+			resumePath = argv[i + 1];
+		else if (strcmp(argv[i], "-metrics") == 0)
+			showMetrics = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-sweep") == 0)
+			sweepPoints = atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "-mb") == 0)
+			plant.mb = (float)atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-mass") == 0)
+			plant.m = (float)atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-length") == 0)
+			plant.l = (float)atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-gravity") == 0)
+			plant.g = (float)atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-legacy") == 0)
+			plant.legacyDynamics = atoi(argv[i + 1]) != 0;
+		else if (strcmp(argv[i], "-friction") == 0)
+			plant.cartFriction = (float)atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-pivot") == 0)
+			plant.poleFriction = (float)atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-fmax") == 0)
+			plant.maxForce = (float)atof(argv[i + 1]);
+		else if (strcmp(argv[i], "-frate") == 0)
+			plant.maxForceRate = (float)atof(argv[i + 1]);
+#ifndef BGI_SOFTWARE
+		else if (strcmp(argv[i], "-batch") == 0)
+			bgiemu_batch_draw = atoi(argv[i + 1]);  //1: record and submit at setvisualpage
+		else if (strcmp(argv[i], "-damage") == 0)
+			bgiemu_present_damage = atoi(argv[i + 1]);  //1: draw to the page bitmap, blit what changed
+#endif
+	}
+
+	if (plant.mb <= 0.0f || plant.l <= 0.0f || plant.m <= plant.mb) {
+		cout << "The plant needs -mb and -length above 0, and -mass (cart and broom) above -mb" << endl;
+		exit(1);
+	}
+	if (!disturbPath.empty() && !disturbances.load(disturbPath))
+		exit(1);
+	if (disturbanceTrials > 0) {
+		runDisturbanceTrials();
+		return 0;
+	}
+	if (sweepPoints > 0) {
+		runSweep();
+		return 0;
+	}
+	if (!replayPath.empty()) {
+		runReplay();
+		return 0;
+	}
+
 	initgraph(&graphDriver, &graphMode, "", 1280, 1024); // Start Window
 	clearDataSet();
 	try{
+		if (showSurface) {
+			generateControlSurface_Angle_vs_Angle_Dot();
+			surfaceViewer.setGrid(dataSet.x, dataSet.y, dataSet.z);
+		}
+
 		runInvertedPendulum();
 
+		if (showSurface)
+			viewControlSurface();
+
 		//3) Enable this only after your fuzzy system has been completed already.
-		generateControlSurface_Angle_vs_Angle_Dot();
+		if (!surfaceGenerated)
+			generateControlSurface_Angle_vs_Angle_Dot();
 
 		//4) Enable this only after your fuzzy system has been completed already.
 		saveDataToFile("data_angle_vs_angle_dot.txt");
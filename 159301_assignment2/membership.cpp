@@ -0,0 +1,168 @@
+#include "membership.h"
+
+/////////////////////////////////////////////////////////////////
+//Branch-free shape kernels.  Comparisons become selects, so a loop over
+//these vectorises; the values match trapz() exactly.
+
+static inline float regular_mu(float x, float a, float d, float l_slope, float r_slope) {
+	float t = (x - a) * l_slope;
+	float r = (x - d) * r_slope;
+	t = (r < t) ? r : t;
+	t = (t < 1.0f) ? t : 1.0f;
+	return (x > a && x < d) ? t : 0.0f;
+}
+
+static inline float left_mu(float x, float a, float b, float r_slope) {
+	float t = r_slope * (x - b);
+	t = (x >= b) ? 0.0f : t;
+	return (x <= a) ? 1.0f : t;
+}
+
+static inline float right_mu(float x, float a, float b, float l_slope) {
+	float t = l_slope * (x - a);
+	t = (x >= b) ? 1.0f : t;
+	return (x <= a) ? 0.0f : t;
+}
+
+static inline float gaussian_mu(float x, float centre, float k) {
+	return expf(k * (x - centre) * (x - centre));
+}
+
+static inline float gbell_mu(float x, float slope, float centre, float inv_width) {
+	return 1.0f / (1.0f + powf(fabsf((x - centre) * inv_width), 2.0f * slope));
+}
+
+static inline float sigmoid_mu(float x, float slope, float centre) {
+	return 1.0f / (1.0f + expf(-slope * (x - centre)));
+}
+
+//Shared by every point of a piecewise linear function; each segment is a select
+static inline float pwl_mu(float x, const trapezoid &mf) {
+	float mu = mf.py[0];
+	for (int i = 1; i < mf.no_of_points; i++) {
+		float t = mf.py[i - 1] + (mf.py[i] - mf.py[i - 1]) * (x - mf.px[i - 1]) / (mf.px[i] - mf.px[i - 1]);
+		mu = (x > mf.px[i - 1]) ? t : mu;
+	}
+	return (x > mf.px[mf.no_of_points - 1]) ? mf.py[mf.no_of_points - 1] : mu;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void membership_many(const trapezoid &mf, const float x[], float mu[], int n) {
+	const float a = mf.a, b = mf.b, c = mf.c, d = mf.d, ls = mf.l_slope, rs = mf.r_slope;
+	int k;
+
+	switch (mf.tp) {
+	case regular_trapezoid:
+	case triangle:
+		for (k = 0; k < n; k++)
+			mu[k] = regular_mu(x[k], a, d, ls, rs);
+		break;
+	case left_trapezoid:
+		for (k = 0; k < n; k++)
+			mu[k] = left_mu(x[k], a, b, rs);
+		break;
+	case right_trapezoid:
+		for (k = 0; k < n; k++)
+			mu[k] = right_mu(x[k], a, b, ls);
+		break;
+	case gaussian:
+		for (k = 0; k < n; k++)
+			mu[k] = gaussian_mu(x[k], a, ls);
+		break;
+	case generalized_bell:
+		for (k = 0; k < n; k++)
+			mu[k] = gbell_mu(x[k], b, c, ls);
+		break;
+	case sigmoid:
+		for (k = 0; k < n; k++)
+			mu[k] = sigmoid_mu(x[k], a, c);
+		break;
+	case piecewise_linear:
+		for (k = 0; k < n; k++)
+			mu[k] = pwl_mu(x[k], mf);
+		break;
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+void membership_batch::build(const fuzzy_system_rec &fz) {
+	for (int s = 0; s < NO_OF_MF_SHAPES; s++)
+		shapes[s] = shape_batch();
+
+	for (int j = 0; j < fz.no_of_inputs; j++) {
+		for (int k = 0; k < fz.no_of_inp_regions; k++) {
+			const trapezoid &mf = fz.inp_mem_fns[j][k];
+			shape_batch &batch = shapes[mf.tp];
+			batch.a.push_back(mf.a);
+			batch.b.push_back(mf.b);
+			batch.c.push_back(mf.c);
+			batch.d.push_back(mf.d);
+			batch.l_slope.push_back(mf.l_slope);
+			batch.r_slope.push_back(mf.r_slope);
+			batch.input.push_back((short)j);
+			batch.region.push_back((short)k);
+			if (mf.tp == piecewise_linear)
+				batch.mfs.push_back(mf);
+		}
+	}
+
+	for (int s = 0; s < NO_OF_MF_SHAPES; s++) {
+		shapes[s].x.resize(shapes[s].a.size());
+		shapes[s].mu.resize(shapes[s].a.size());
+	}
+}
+
+void membership_batch::evaluate(const float inputs[], float degrees[][MAX_NO_OF_INP_REGIONS]) {
+	for (int s = 0; s < NO_OF_MF_SHAPES; s++) {
+		shape_batch &batch = shapes[s];
+		const int n = (int)batch.a.size();
+		if (n == 0)
+			continue;
+
+		//gather, run the uniform kernel, scatter
+		float *x = &batch.x[0], *mu = &batch.mu[0];
+		const float *a = &batch.a[0], *b = &batch.b[0], *c = &batch.c[0], *d = &batch.d[0];
+		const float *ls = &batch.l_slope[0], *rs = &batch.r_slope[0];
+		int k;
+
+		for (k = 0; k < n; k++)
+			x[k] = inputs[batch.input[k]];
+
+		switch (s) {
+		case regular_trapezoid:
+		case triangle:
+			for (k = 0; k < n; k++)
+				mu[k] = regular_mu(x[k], a[k], d[k], ls[k], rs[k]);
+			break;
+		case left_trapezoid:
+			for (k = 0; k < n; k++)
+				mu[k] = left_mu(x[k], a[k], b[k], rs[k]);
+			break;
+		case right_trapezoid:
+			for (k = 0; k < n; k++)
+				mu[k] = right_mu(x[k], a[k], b[k], ls[k]);
+			break;
+		case gaussian:
+			for (k = 0; k < n; k++)
+				mu[k] = gaussian_mu(x[k], a[k], ls[k]);
+			break;
+		case generalized_bell:
+			for (k = 0; k < n; k++)
+				mu[k] = gbell_mu(x[k], b[k], c[k], ls[k]);
+			break;
+		case sigmoid:
+			for (k = 0; k < n; k++)
+				mu[k] = sigmoid_mu(x[k], a[k], c[k]);
+			break;
+		case piecewise_linear:
+			for (k = 0; k < n; k++)
+				mu[k] = pwl_mu(x[k], batch.mfs[k]);
+			break;
+		}
+
+		for (k = 0; k < n; k++)
+			degrees[batch.input[k]][batch.region[k]] = mu[k];
+	}
+}
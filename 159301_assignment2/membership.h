@@ -0,0 +1,41 @@
+#ifndef __MEMBERSHIP_H__
+#define __MEMBERSHIP_H__
+
+#include <vector>
+
+#include "fuzzylogic.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//Batch membership evaluation.
+//
+//The membership functions of a controller are grouped by shape into
+//structure-of-arrays batches.  Each shape has one branch-free kernel, so a
+//batch runs through the same instructions in every SIMD lane and the
+//compiler can vectorise it.
+
+//Evaluates one membership function at n points with its shape's kernel
+void membership_many(const trapezoid &mf, const float x[], float mu[], int n);
+
+class membership_batch {
+public:
+	//Groups the input membership functions of fz by shape.
+	//Rebuild after changing fz.inp_mem_fns.
+	void build(const fuzzy_system_rec &fz);
+
+	//Same result as fuzzify_inputs()
+	void evaluate(const float inputs[], float degrees[][MAX_NO_OF_INP_REGIONS]);
+
+private:
+	struct shape_batch {
+		vector<float> a, b, c, d, l_slope, r_slope;
+		vector<short> input, region;
+		vector<float> x, mu;
+		vector<trapezoid> mfs;  //piecewise_linear only
+	};
+	shape_batch shapes[NO_OF_MF_SHAPES];
+};
+
+
+#endif
@@ -0,0 +1,129 @@
+#include <math.h>
+#include <iomanip>
+
+#include "metrics.h"
+
+static const float DEGREES = (float)(180.0 / M_PI);
+
+MetricLimits defaultMetricLimits(){
+	MetricLimits limits = { 1.0f / DEGREES, 0.05f, 90.0f / DEGREES, -2.4f, 2.4f, 1.0,
+		0.1f, 1e-4f, 100.0f, 0.0 };
+	return limits;
+}
+
+const char* failureName(failure_type f){
+	switch (f) {
+	case angle_failure:
+		return "the pole fell";
+	case x_failure:
+		return "the cart left the track";
+	default:
+		return "none";
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+TrajectoryMetrics::TrajectoryMetrics(const MetricLimits& limits_){
+	limits = limits_;
+	WorldStateType s;
+	s.init();
+	reset(s, 0.0, 0.002f);
+}
+
+void TrajectoryMetrics::reset(const WorldStateType& s, double t, float h){
+	MetricSummary zero = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, -1.0, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, no_failure, 0.0, 0.0 };
+	m = zero;
+	start = last = t;
+	insideSince = -1.0;
+	side = fabs(s.angle) > limits.angleBand ? (s.angle > 0.0f ? 1.0f : -1.0f) : 0.0f;
+
+	int n = max(1, (int)(limits.window / h + 0.5));
+	windowAngle.assign(n, 0.0f);
+	windowX.assign(n, 0.0f);
+	next = filled = 0;
+	sumAngle = sumX = 0.0;
+}
+
+void TrajectoryMetrics::add(const WorldStateType& s, double t){
+	double dt = t - last;
+	last = t;
+	m.duration = t - start;
+
+	float angle = fabs(s.angle), x = fabs(s.x);
+	m.iaeAngle += angle * dt;
+	m.iseAngle += (double)angle * angle * dt;
+	m.iaeX += x * dt;
+	m.iseX += (double)x * x * dt;
+	m.effort += (double)s.F * s.F * dt;
+	m.peakAngle = max(m.peakAngle, angle);
+	m.peakX = max(m.peakX, x);
+	m.peakF = max(m.peakF, (float)fabs(s.F));
+
+	//overshoot is measured from the first deflection out of the band
+	if (side == 0.0f && angle > limits.angleBand)
+		side = s.angle > 0.0f ? 1.0f : -1.0f;
+	if (side != 0.0f)
+		m.overshoot = max(m.overshoot, -side * s.angle);
+
+	if (angle <= limits.angleBand && x <= limits.xBand) {
+		if (insideSince < 0.0)
+			insideSince = t;
+	} else {
+		insideSince = -1.0;
+	}
+	m.settlingTime = insideSince < 0.0 ? -1.0 : insideSince - start;
+
+	//running sums over the ring, summed afresh once a lap against drift
+	sumAngle += angle - windowAngle[next];
+	sumX += x - windowX[next];
+	windowAngle[next] = angle;
+	windowX[next] = x;
+	next = (next + 1) % (int)windowAngle.size();
+	filled = min(filled + 1, (int)windowAngle.size());
+	if (next == 0) {
+		sumAngle = sumX = 0.0;
+		for (size_t i = 0; i < windowAngle.size(); i++) {
+			sumAngle += windowAngle[i];
+			sumX += windowX[i];
+		}
+	}
+	m.steadyAngle = (float)(sumAngle / filled);
+	m.steadyX = (float)(sumX / filled);
+
+	if (m.failure == no_failure) {
+		if (angle > limits.angleLimit)
+			m.failure = angle_failure;
+		else if (s.x < limits.x1 || s.x > limits.x2)
+			m.failure = x_failure;
+		if (m.failure != no_failure)
+			m.failedAt = m.duration;
+	}
+
+	m.cost = m.iseAngle + limits.xWeight * m.iseX + limits.effortWeight * m.effort;
+	if (m.failure != no_failure)
+		m.cost += limits.failurePenalty * (limits.horizon > 0.0 ? max(0.0, 1.0 - m.failedAt / limits.horizon) : 1.0);
+}
+
+void TrajectoryMetrics::print(ostream& out) const{
+	//the caller's format is put back at the end
+	ios::fmtflags flags = out.flags();
+	streamsize precision = out.precision();
+	out << fixed << setprecision(3) << "Over " << m.duration << " s: ";
+	if (m.settlingTime >= 0.0)
+		out << "settled after " << m.settlingTime << " s";
+	else
+		out << "not settled";
+	out << ", overshoot " << m.overshoot * DEGREES << " deg, peak angle " << m.peakAngle * DEGREES << " deg, peak |x| "
+		<< m.peakX << " m, peak |F| " << m.peakF << " N" << endl;
+	out << "  IAE " << m.iaeAngle * DEGREES << " deg s, ISE " << m.iseAngle << " rad^2 s (angle); IAE " << m.iaeX
+		<< " m s, ISE " << m.iseX << " m^2 s (x); effort " << m.effort << " N^2 s" << endl;
+	out << "  steady-state error over the last " << limits.window << " s: " << m.steadyAngle * DEGREES << " deg, "
+		<< m.steadyX << " m" << endl;
+	out << "  failure: " << failureName(m.failure);
+	if (m.failure != no_failure)
+		out << " after " << m.failedAt << " s";
+	out << "; cost " << m.cost << endl;
+	out.flags(flags);
+	out.precision(precision);
+}
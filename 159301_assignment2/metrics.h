@@ -0,0 +1,87 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <vector>
+#include <iostream>
+
+#include "pendulum.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//Figures of merit of a controller, from its trajectory
+
+typedef enum { no_failure, angle_failure, x_failure } failure_type;
+
+//What the metrics are judged against
+typedef struct {
+	float angleBand, xBand;  //settled once |angle| (rad) and |x| (m) stay inside these
+	float angleLimit;        //failure past this |angle| (rad)
+	float x1, x2;            //failure off this track (worldBoundary's x range)
+	double window;           //s: steady-state error is the mean over the last window
+
+	//cost = iseAngle + xWeight * iseX + effortWeight * effort, plus
+	//failurePenalty scaled by the part of horizon (s; 0 = all of it) lost
+	float xWeight, effortWeight, failurePenalty;
+	double horizon;
+} MetricLimits;
+
+//1 degree and 5 cm bands, failure past 90 degrees or off the 4.8 m track,
+//a 1 s window
+MetricLimits defaultMetricLimits();
+
+//The metrics so far, in SI units (angles in radians)
+typedef struct {
+	double duration;      //s since reset()
+	double iaeAngle, iseAngle;
+	double iaeX, iseX;
+	double effort;        //integral of F^2
+	double settlingTime;  //from reset() to entering both bands for good; < 0 while outside them
+	float overshoot;      //furthest past upright, on the side away from the first deflection
+	float peakAngle, peakX, peakF;
+	float steadyAngle, steadyX;  //mean |angle| and |x| over the last window
+	failure_type failure;
+	double failedAt;      //s since reset(), if failed
+	double cost;
+} MetricSummary;
+
+//Accumulates MetricSummary one tick at a time, in constant time per tick,
+//so that the simulation thread can keep it up to date as it runs.  The
+//steady-state window is a ring allocated by reset().
+class TrajectoryMetrics{
+
+public:
+	TrajectoryMetrics(const MetricLimits& limits = defaultMetricLimits());
+
+	void setLimits(const MetricLimits& limits) { this->limits = limits; }
+	const MetricLimits& getLimits() const { return limits; }
+
+	//Starts again from s at simulated time t, ticks of h apart
+	void reset(const WorldStateType& s, double t, float h);
+
+	//State after the tick that ended at t
+	void add(const WorldStateType& s, double t);
+
+	const MetricSummary& summary() const { return m; }
+	bool failed() const { return m.failure != no_failure; }
+
+	void print(ostream& out) const;
+
+private:
+	MetricLimits limits;
+	MetricSummary m;
+
+	double start, last;
+	double insideSince;  //< 0 while outside the bands
+	float side;          //sign of the first deflection, 0 until there is one
+
+	vector<float> windowAngle, windowX;  //ring of |angle| and |x|
+	int next, filled;
+	double sumAngle, sumX;
+};
+
+//Name of a failure type, for messages
+const char* failureName(failure_type f);
+
+
+#endif
@@ -0,0 +1,92 @@
+#include "pendulum.h"
+#include "fuzzylogic.h"
+
+//Yamakawa
+float A = 100.0;
+float B = 1.0;
+float C = 10.0;
+float D = 0.5;
+
+PlantParameters defaultPlantParameters(){
+	PlantParameters plant = { 0.1f, 9.8f, 1.1f, 0.5f, true, 0.0f, 0.0f, 0.0f, 0.0f };
+	return plant;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// BEGIN - DYNAMICS OF THE SYSTEM
+float calc_angular_acceleration(const WorldStateType& s, const PlantParameters& p){
+	float a_double_dot = 0.0;
+
+	//friction is subtracted as exact zeros when there is none, so the
+	//default plant steps bit for bit as it always has
+	float F = s.F - p.cartFriction * s.x_dot;
+	float pivot = p.m * p.poleFriction * s.angle_dot / (p.mb * p.l);
+	float inertia = p.legacyDynamics ? (float)(4 / 3) : 4.0f / 3.0f;
+
+	a_double_dot = (p.m * p.g * sin(s.angle) - (cos(s.angle) * (F + ((p.mb) * p.l * s.angle_dot * s.angle_dot * sin(s.angle)))) - pivot)
+		/ ((inertia*p.m * p.l) - (p.mb * p.l * cos(s.angle) * cos(s.angle)));
+	return a_double_dot;
+}
+
+float calc_horizontal_acceleration(const WorldStateType& s, const PlantParameters& p){
+	float x_double_dot = 0.0;
+	float F = s.F - p.cartFriction * s.x_dot;
+
+	if (p.legacyDynamics)
+		x_double_dot = (F + p.mb * p.l * (s.angle_dot * s.angle_dot)* sin(s.angle) - s.angle_double_dot * cos(s.angle)) / p.m;
+	else
+		x_double_dot = (F + p.mb * p.l * ((s.angle_dot * s.angle_dot) * sin(s.angle) - s.angle_double_dot * cos(s.angle))) / p.m;
+	return x_double_dot;
+}
+// END - DYNAMICS OF THE SYSTEM
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+float actuatorForce(float F, float previous, float h, const PlantParameters& plant){
+	if (plant.maxForceRate > 0.0f) {
+		float step = plant.maxForceRate * h;
+		F = min(max(F, previous - step), previous + step);
+	}
+	if (plant.maxForce > 0.0f)
+		F = min(max(F, -plant.maxForce), plant.maxForce);
+	return F;
+}
+
+void stepPendulum(WorldStateType& s, float h, const PlantParameters& plant){
+	//the textbook x'' couples to this step's theta''; the legacy plant keeps
+	//the previous step's, as the controller was tuned against it
+	float angle_double_dot = calc_angular_acceleration(s, plant);
+	if (!plant.legacyDynamics)
+		s.angle_double_dot = angle_double_dot;
+	float x_double_dot = calc_horizontal_acceleration(s, plant);
+
+	s.angle_dot = s.angle_dot + (h * angle_double_dot);
+	s.angle = s.angle + (h * s.angle_dot);
+	s.x_dot = s.x_dot + (h * x_double_dot);
+	s.x = s.x + (h * s.x_dot);
+	s.angle_double_dot = angle_double_dot;
+	s.x_double_dot = x_double_dot;
+}
+
+void getControllerInputs(const WorldStateType& s, float inputs[]){
+	inputs[in_theta_and_theta_dot] = (A * s.angle) + (B * s.angle_dot);
+	inputs[in_x_and_x_dot] = (C * s.x) + (D * s.x_dot);
+}
+
+void getSurfaceInputs(float angle, float angle_dot, float h, const PlantParameters& plant, float inputs[]){
+	WorldStateType s;
+	s.init();
+	s.angle = angle;
+	s.angle_dot = angle_dot;
+	stepPendulum(s, h, plant);
+
+	//both composite inputs are formed from the pole state on the control surface
+	inputs[in_theta_and_theta_dot] = (A * s.angle) + (B * s.angle_dot);
+	inputs[in_x_and_x_dot] = (C * s.angle) + (D * s.angle_dot);
+}
+
+void getStateVector(const WorldStateType& s, float state[]){
+	state[st_angle] = s.angle;
+	state[st_angle_dot] = s.angle_dot;
+	state[st_x] = s.x;
+	state[st_x_dot] = s.x_dot;
+}
@@ -0,0 +1,97 @@
+#ifndef __PENDULUM_H__
+#define __PENDULUM_H__
+
+#include <math.h>
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//Cart and pole plant model
+
+//Raw state variables, in the order used by TSK consequents
+enum { st_angle, st_angle_dot, st_x, st_x_dot };
+
+struct WorldStateType{
+
+	void init(){
+		x = 0.0;
+		x_dot = 0.0;
+		x_double_dot = 0.0;
+		angle = 0.0;
+		angle_dot = 0.0;
+		angle_double_dot = 0.0;
+		F = 0.0;
+		F_actuator = 0.0;
+
+		//Yamakawa
+		in_theta_and_theta_dot = 0.0;
+		in_x_and_x_dot = 0.0;
+
+	}
+
+	float x;
+	float x_dot;
+	float x_double_dot;
+	float angle;
+	float angle_dot;
+	float angle_double_dot;
+
+	float F;
+	float F_actuator;  //of F, the controller's force as the actuator delivered it
+
+	//Yamakawa
+	float	in_theta_and_theta_dot;
+	float	in_x_and_x_dot;
+
+};
+
+//The cart and pole themselves, and the actuator that pushes the cart
+typedef struct {
+	float mb;  //mass of the broom (kg)
+	float g;
+	float m;   //mass of cart & broom (kg)
+	float l;   //m
+
+	//The equations as they always were: (4 / 3) in integer arithmetic, which
+	//is 1, and angle_double_dot in x_double_dot without its mb * l.  Off,
+	//they are the textbook cart and pole.
+	bool legacyDynamics;
+
+	float cartFriction;  //N per m/s of x_dot
+	float poleFriction;  //N m per rad/s of angle_dot, at the pivot
+
+	float maxForce;      //N the actuator can deliver (0 = no limit)
+	float maxForceRate;  //N/s it can change by (0 = no limit)
+} PlantParameters;
+
+//The plant the controller was written for: mb 0.1, g 9.8, m 1.1, l 0.5,
+//legacy dynamics, no friction and no actuator limits
+PlantParameters defaultPlantParameters();
+
+//Yamakawa composite input gains
+extern float A, B, C, D;
+
+//---------------------------------------------------------------------------
+
+float calc_angular_acceleration(const WorldStateType& s, const PlantParameters& plant);
+float calc_horizontal_acceleration(const WorldStateType& s, const PlantParameters& plant);
+
+//Advances the state by one Euler step of length h under the force s.F
+void stepPendulum(WorldStateType& s, float h, const PlantParameters& plant);
+
+//What the actuator delivers for the controller's force F, given what it
+//delivered the tick before (s.F_actuator): F limited to plant.maxForce and
+//to a change of plant.maxForceRate * h
+float actuatorForce(float F, float previous, float h, const PlantParameters& plant);
+
+//Fills the Yamakawa controller inputs and the raw state vector
+void getControllerInputs(const WorldStateType& s, float inputs[]);
+void getStateVector(const WorldStateType& s, float state[]);
+
+//Controller inputs for one point of the angle vs angle_dot control surface:
+//the cart starts at rest and the pole takes one unforced step of length h
+//on plant
+void getSurfaceInputs(float angle, float angle_dot, float h, const PlantParameters& plant, float inputs[]);
+
+
+#endif
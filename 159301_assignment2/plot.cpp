@@ -0,0 +1,180 @@
+#include "plot.h"
+#include "graphics.h"
+
+//Label, range (values outside are drawn at the edge) and colour of each trace
+static const char* traceLabels[StripChart::NO_OF_TRACES] = { "angle (deg)", "x (m)", "F (N)" };
+static const float traceMin[StripChart::NO_OF_TRACES] = { -15.0f, -2.4f, -60.0f };
+static const float traceMax[StripChart::NO_OF_TRACES] = { 15.0f, 2.4f, 60.0f };
+static const int traceColours[StripChart::NO_OF_TRACES] = { YELLOW, LIGHTCYAN, LIGHTRED };
+
+//Pixels between the strips
+static const int STRIP_GAP = 8;
+
+////////////////////////////////////////////////////////////////////////////////
+
+SampleRing::SampleRing(int capacity){
+	size_t n = 1;
+	while (n < (size_t)capacity)
+		n *= 2;
+	slots.resize(n);
+	mask = n - 1;
+	head.store(0);
+	tail.store(0);
+	drops.store(0);
+}
+
+bool SampleRing::push(const PlotSample& s){
+	size_t h = head.load(memory_order_relaxed);
+	if (h - tail.load(memory_order_acquire) > mask) {
+		drops.fetch_add(1, memory_order_relaxed);
+		return false;
+	}
+	slots[h & mask] = s;
+	head.store(h + 1, memory_order_release);  //publishes the slot
+	return true;
+}
+
+int SampleRing::pop(PlotSample out[], int maxSamples){
+	size_t t = tail.load(memory_order_relaxed);
+	size_t available = head.load(memory_order_acquire) - t;
+	int n = available < (size_t)maxSamples ? (int)available : maxSamples;
+	for (int i = 0; i < n; i++)
+		out[i] = slots[(t + i) & mask];
+	tail.store(t + n, memory_order_release);  //hands the slots back
+	return n;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+StripChart::StripChart(double seconds){
+	windowSeconds = seconds;
+	DeviceRectType none = { 0, 0, -1, -1 };
+	panel = none;
+	for (int i = 0; i < NO_OF_TRACES; i++)
+		strip[i] = none;
+	width = 0;
+	columnSeconds = 0.0;
+	newest = -1;
+	taken = 0;
+	drained.resize(1024);
+}
+
+void StripChart::place(const DeviceRectType& r){
+	if (width > 0 && r.x1 == panel.x1 && r.y1 == panel.y1 && r.x2 == panel.x2 && r.y2 == panel.y2)
+		return;
+	panel = r;
+	settextstyle(SMALL_FONT, HORIZ_DIR, 5);
+	int labelHeight = textheight("H") + 2;
+
+	int w = (r.x2 - r.x1 + 1 - (NO_OF_TRACES - 1) * STRIP_GAP) / NO_OF_TRACES;
+	for (int i = 0; i < NO_OF_TRACES; i++) {
+		int x1 = r.x1 + i * (w + STRIP_GAP);
+		DeviceRectType inside = { x1 + 1, r.y1 + labelHeight + 1, x1 + w - 2, r.y2 - 1 };
+		strip[i] = inside;
+	}
+
+	width = w > 2 ? w - 2 : 0;
+	columnSeconds = width > 0 ? windowSeconds / width : 0.0;
+	columns.assign(width, Column());
+	newest = -1;
+}
+
+void StripChart::drawPanel(){
+	settextstyle(SMALL_FONT, HORIZ_DIR, 5);
+	settextjustify(LEFT_TEXT, BOTTOM_TEXT);
+	for (int i = 0; i < NO_OF_TRACES; i++) {
+		const DeviceRectType& s = strip[i];
+		if (s.x1 > s.x2 || s.y1 > s.y2)
+			continue;
+		setcolor(DARKGRAY);
+		rectangle(s.x1 - 1, s.y1 - 1, s.x2 + 1, s.y2 + 1);
+		if (traceMin[i] < 0.0f && traceMax[i] > 0.0f)
+			line(s.x1, traceY(i, 0.0f), s.x2, traceY(i, 0.0f));
+		setcolor(traceColours[i]);
+		outtextxy(s.x1 - 1, s.y1 - 2, traceLabels[i]);
+	}
+}
+
+int StripChart::traceY(int trace, float v) const{
+	const DeviceRectType& s = strip[trace];
+	float f = (v - traceMin[trace]) / (traceMax[trace] - traceMin[trace]);
+	if (f < 0.0f)
+		f = 0.0f;
+	else if (f > 1.0f)
+		f = 1.0f;
+	return s.y2 - (int)(f * (s.y2 - s.y1) + 0.5f);
+}
+
+void StripChart::add(const PlotSample& s){
+	long k = (long)(s.t / columnSeconds);
+
+	//time only goes backwards when a new run starts
+	if (k < newest)
+		newest = -1;
+	if (k > newest) {
+		long first = newest < 0 || k - newest > width ? k - width + 1 : newest + 1;
+		for (long j = first < 0 ? 0 : first; j <= k; j++)
+			columns[j % width].used = false;
+		newest = k;
+	}
+
+	float v[NO_OF_TRACES];
+	v[ANGLE_TRACE] = (float)(s.angle * 180.0 / M_PI);
+	v[X_TRACE] = s.x;
+	v[F_TRACE] = s.F;
+
+	Column& c = columns[k % width];
+	for (int i = 0; i < NO_OF_TRACES; i++) {
+		if (!c.used) {
+			c.lo[i] = c.hi[i] = v[i];
+		} else {
+			c.lo[i] = min(c.lo[i], v[i]);
+			c.hi[i] = max(c.hi[i], v[i]);
+		}
+		c.last[i] = v[i];
+	}
+	c.used = true;
+}
+
+void StripChart::update(){
+	int n;
+	while ((n = samples.pop(&drained[0], (int)drained.size())) > 0) {
+		taken += n;
+		if (width == 0)
+			continue;
+		for (int i = 0; i < n; i++)
+			if (drained[i].t >= 0.0f)
+				add(drained[i]);
+	}
+}
+
+DeviceRectType StripChart::traceArea(int trace) const{
+	return strip[trace];
+}
+
+void StripChart::draw(){
+	if (newest < 0)
+		return;
+
+	//the newest column is at the right edge of each strip
+	long first = newest - width + 1;
+	for (int i = 0; i < NO_OF_TRACES; i++) {
+		setcolor(traceColours[i]);
+		int previous = -1;  //where the last column ended
+		for (long k = first < 0 ? 0 : first; k <= newest; k++) {
+			const Column& c = columns[k % width];
+			if (!c.used) {
+				previous = -1;
+				continue;
+			}
+			int top = traceY(i, c.hi[i]), bottom = traceY(i, c.lo[i]);
+			if (previous >= 0) {
+				top = min(top, previous);
+				bottom = max(bottom, previous);
+			}
+			int x = strip[i].x1 + (int)(k - first);
+			line(x, top, x, bottom);
+			previous = traceY(i, c.last[i]);
+		}
+	}
+}
@@ -0,0 +1,109 @@
+#ifndef __PLOT_H__
+#define __PLOT_H__
+
+#include <vector>
+#include <atomic>
+
+#include "transform.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//Strip charts of the pendulum state against simulated time
+
+//One simulation step, as the strip chart sees it
+typedef struct {
+	float t;      //simulated seconds
+	float angle;  //radians
+	float x;
+	float F;
+} PlotSample;
+
+//Queue of samples from one producer (the simulation) to one consumer (the
+//display) without locks.  push() never waits: when the consumer is a whole
+//ring behind, the sample is dropped and counted instead.
+class SampleRing{
+
+public:
+	//capacity is rounded up to a power of two
+	SampleRing(int capacity = 4096);
+
+	//Producer side; false if the sample was dropped
+	bool push(const PlotSample& s);
+
+	//Consumer side: copies out up to maxSamples waiting samples, oldest first
+	int pop(PlotSample out[], int maxSamples);
+
+	long dropped() const { return drops.load(memory_order_relaxed); }
+
+private:
+	vector<PlotSample> slots;
+	size_t mask;
+
+	//each index is written by one side only; the padding keeps them off
+	//the same cache line
+	atomic<size_t> head;  //next slot to write
+	char padHead[64];
+	atomic<size_t> tail;  //next slot to read
+	char padTail[64];
+	atomic<long> drops;
+};
+
+//Angle (degrees), x and F over the last few simulated seconds, one strip
+//per trace side by side in a panel.  Samples are folded as they arrive into
+//the lowest, highest and last value of the pixel column they fall in, so a
+//column holds any number of samples and draw() is one vertical line per
+//column and trace: the cost follows the width of the panel, not the sample
+//rate or the length of the window.
+class StripChart{
+
+public:
+	enum { ANGLE_TRACE, X_TRACE, F_TRACE, NO_OF_TRACES };
+
+	StripChart(double seconds = 10.0);
+
+	//The simulation pushes every step here
+	SampleRing& ring() { return samples; }
+
+	//Lays the strips out in r.  A new size forgets the history (a column's
+	//length in time depends on the width).
+	void place(const DeviceRectType& r);
+	const DeviceRectType& bounds() const { return panel; }
+
+	//Frames, zero lines and labels, for the background layer
+	void drawPanel();
+
+	//Folds the samples waiting in the ring into the columns
+	void update();
+
+	//The traces, over the panel.  traceArea() is all they touch.
+	void draw();
+	DeviceRectType traceArea(int trace) const;
+
+	double seconds() const { return windowSeconds; }
+	long samplesTaken() const { return taken; }
+
+private:
+	struct Column {
+		float lo[NO_OF_TRACES], hi[NO_OF_TRACES], last[NO_OF_TRACES];
+		bool used;
+	};
+
+	void add(const PlotSample& s);
+	int traceY(int trace, float v) const;
+
+	SampleRing samples;
+	double windowSeconds;
+	DeviceRectType panel;
+	DeviceRectType strip[NO_OF_TRACES];  //inside of each frame
+
+	int width;  //columns in a strip
+	double columnSeconds;
+	vector<Column> columns;  //column k of time is columns[k % width]
+	long newest;  //newest column, -1 before the first sample
+	long taken;
+	vector<PlotSample> drained;
+};
+
+
+#endif
@@ -0,0 +1,148 @@
+#include <math.h>
+#include <string>
+#include <iomanip>
+#include <thread>
+
+#include "realtime.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+//Absolute sleep to t.  steady_clock is CLOCK_MONOTONIC under glibc.
+static void sleepUntil(chrono::steady_clock::time_point t){
+#ifdef __linux__
+	long long ns = chrono::duration_cast<chrono::nanoseconds>(t.time_since_epoch()).count();
+	if (ns <= 0)
+		return;
+	struct timespec ts;
+	ts.tv_sec = (time_t)(ns / 1000000000);
+	ts.tv_nsec = (long)(ns % 1000000000);
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+#else
+	this_thread::sleep_until(t);
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void TickStats::clear(){
+	for (int i = 0; i < NO_OF_BUCKETS; i++)
+		buckets[i] = 0;
+	count = missed = 0;
+	totalNs = 0.0;
+	worstNs = 0;
+}
+
+void TickStats::add(long long jitterNs, bool miss){
+	if (jitterNs < 0)
+		jitterNs = 0;
+	int i = 0;
+	for (long long us = jitterNs / 1000; us > 0 && i < NO_OF_BUCKETS - 1; us >>= 1)
+		i++;
+	buckets[i]++;
+	count++;
+	missed += miss;
+	totalNs += (double)jitterNs;
+	if (jitterNs > worstNs)
+		worstNs = jitterNs;
+}
+
+double TickStats::percentileUs(double p) const{
+	long target = (long)ceil(p * count), sum = 0;
+	for (int i = 0; i < NO_OF_BUCKETS - 1; i++) {
+		sum += buckets[i];
+		if (sum >= target)
+			return (double)(1L << i);
+	}
+	return worstUs();
+}
+
+void TickStats::print(ostream& out) const{
+	//the caller's format is put back at the end
+	ios::fmtflags flags = out.flags();
+	streamsize precision = out.precision();
+	out << fixed << setprecision(1) << "Tick jitter over " << count << " ticks: mean " << meanUs() << " us, 50% under "
+		<< percentileUs(0.5) << " us, 99% under " << percentileUs(0.99) << " us, worst " << worstUs() << " us; "
+		<< missed << " deadline miss(es)" << endl;
+	for (int i = 0; i < NO_OF_BUCKETS; i++) {
+		if (buckets[i] == 0)
+			continue;
+		out << "  " << setw(6) << (i == 0 ? 0L : 1L << (i - 1)) << " us";
+		if (i < NO_OF_BUCKETS - 1)
+			out << " - " << setw(6) << (1L << i) << " us";
+		else
+			out << " and up   ";
+		double percent = 100.0 * buckets[i] / count;
+		out << "  " << setw(8) << buckets[i] << "  " << setw(5) << percent << "% " << string((size_t)(percent / 2.0 + 0.5), '#') << endl;
+	}
+	out.flags(flags);
+	out.precision(precision);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+RealtimeTicker::RealtimeTicker(double periodSeconds, const RealtimeOptions& options_){
+	options = options_;
+	period = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(periodSeconds));
+	spin = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double, micro>(options.spinUs));
+	jitterNs = 0;
+}
+
+bool RealtimeTicker::setup(){
+	bool ok = true;
+
+	if (options.cpu >= 0) {
+#ifdef _WIN32
+		ok = SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << options.cpu) != 0;
+#elif defined(__linux__)
+		cpu_set_t cpus;
+		CPU_ZERO(&cpus);
+		CPU_SET(options.cpu, &cpus);
+		ok = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+#else
+		ok = false;
+#endif
+		if (!ok)
+			cout << "Cannot pin the control loop to CPU " << options.cpu << endl;
+	}
+
+	if (options.lockMemory) {
+#ifdef __linux__
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+			cout << "Cannot lock memory (needs CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK)" << endl;
+			ok = false;
+		}
+#else
+		cout << "Memory locking is not supported here" << endl;
+		ok = false;
+#endif
+	}
+	return ok;
+}
+
+void RealtimeTicker::start(){
+	tickStats.clear();
+	due = chrono::steady_clock::now();
+}
+
+void RealtimeTicker::wait(){
+	//a tick that is already due (after a late one) starts straight away
+	sleepUntil(due - spin);
+	chrono::steady_clock::time_point now = chrono::steady_clock::now();
+	while (now < due)
+		now = chrono::steady_clock::now();
+	jitterNs = chrono::duration_cast<chrono::nanoseconds>(now - due).count();
+}
+
+void RealtimeTicker::done(){
+	due += period;
+	tickStats.add(jitterNs, chrono::steady_clock::now() > due);
+}
@@ -0,0 +1,76 @@
+#ifndef __REALTIME_H__
+#define __REALTIME_H__
+
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//Fixed-rate ticking for the control loop
+
+//How hard RealtimeTicker tries to wake on time
+typedef struct {
+	double spinUs;    //wake this early and busy-wait the rest (0 = sleep only)
+	int cpu;          //pin the ticking thread to this CPU (-1 = any)
+	bool lockMemory;  //lock the process's pages in RAM (mlockall; not under Windows)
+} RealtimeOptions;
+
+//Per-tick jitter (wake-up time minus the tick's deadline) in power of two
+//buckets of microseconds, and deadline misses: ticks whose work was still
+//running when the next tick was due
+class TickStats{
+
+public:
+	enum { NO_OF_BUCKETS = 18 };  //[0,1) [1,2) [2,4) ... [65536 us, ...)
+
+	TickStats() { clear(); }
+	void clear();
+	void add(long long jitterNs, bool missed);
+
+	long ticks() const { return count; }
+	long misses() const { return missed; }
+	double meanUs() const { return count ? totalNs / count / 1e3 : 0.0; }
+	double worstUs() const { return worstNs / 1e3; }
+
+	//Upper edge of the bucket holding the p-th fraction of ticks
+	double percentileUs(double p) const;
+	long bucket(int i) const { return buckets[i]; }
+
+	void print(ostream& out) const;
+
+private:
+	long buckets[NO_OF_BUCKETS];
+	long count, missed;
+	double totalNs;
+	long long worstNs;
+};
+
+//Deadlines at start + k*period, absolute so that sleeping late on one tick
+//does not push the next back (clock_nanosleep(TIMER_ABSTIME) on Linux).
+//Call setup() and start() on the thread that ticks, then wait() before each
+//tick's work and done() after it.
+class RealtimeTicker{
+
+public:
+	RealtimeTicker(double periodSeconds, const RealtimeOptions& options);
+
+	//Pins and locks as the options ask; false (with a message) if either fails
+	bool setup();
+
+	void start();
+	void wait();
+	void done();
+
+	const TickStats& stats() const { return tickStats; }
+
+private:
+	chrono::steady_clock::duration period, spin;
+	chrono::steady_clock::time_point due;
+	RealtimeOptions options;
+	TickStats tickStats;
+	long long jitterNs;
+};
+
+
+#endif
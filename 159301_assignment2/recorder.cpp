@@ -0,0 +1,243 @@
+#include <string.h>
+#include <algorithm>
+#include <iostream>
+
+#include "recorder.h"
+#include "graphics.h"
+
+//Frames in flight between the simulation and the encoder
+static const int RECORDER_QUEUE = 3;
+
+bool frameFormatFromPath(const string &path, frame_format &format) {
+	size_t dot = path.rfind('.');
+	string ext = (dot == string::npos) ? "" : path.substr(dot);
+	if (ext == ".rgb")
+		format = frames_rgb;
+	else if (ext == ".ppm")
+		format = frames_ppm;
+	else if (ext == ".y4m")
+		format = frames_y4m;
+	else
+		return false;
+	return true;
+}
+
+//<path without extension>_000042.ppm
+static string ppmFileName(const string &path, int n) {
+	char number[16];
+	sprintf(number, "_%06d.ppm", n);
+	size_t dot = path.rfind('.');
+	return path.substr(0, dot) + number;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+FrameRecorder::FrameRecorder() {
+	width = height = 0;
+	interval = nextCapture = 0.0;
+	slots = 0;
+	recording = false;
+	stopping = false;
+	out = NULL;
+	written = 0;
+	image = NULL;
+}
+
+FrameRecorder::~FrameRecorder() {
+	close();
+}
+
+bool FrameRecorder::open(const string &path_, frame_format format_, int fps) {
+	close();
+
+	path = path_;
+	format = format_;
+	width = getmaxx() + 1;
+	height = getmaxy() + 1;
+	interval = 1.0 / (fps > 0 ? fps : 30);
+	nextCapture = 0.0;
+	slots = 0;
+	written = 0;
+
+	out = fopen(format == frames_ppm ? ppmFileName(path, 0).c_str() : path.c_str(), "wb");
+	if (out == NULL) {
+		cout << "FrameRecorder: cannot create " << path << endl;
+		return false;
+	}
+	if (format == frames_y4m)
+		fprintf(out, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, fps > 0 ? fps : 30);
+
+#ifndef BGI_SOFTWARE
+	image = bgiemu_newimage(width, height);
+#endif
+	frames.resize(RECORDER_QUEUE);
+	for (int i = 0; i < RECORDER_QUEUE; i++) {
+		frames[i].rgba.resize((size_t)width * height);
+		idle.push_back(&frames[i]);
+	}
+	stopping = false;
+	recording = true;
+	worker = thread(&FrameRecorder::encoder, this);
+	return true;
+}
+
+void FrameRecorder::frame(double t, int page) {
+	if (!due(t))
+		return;
+
+	//a frame longer than the capture interval is repeated in the output
+	int copies = 0;
+	while (nextCapture <= t) {
+		nextCapture = (++slots) * interval;
+		copies++;
+	}
+
+	CapturedFrame *f;
+	{
+		unique_lock<mutex> guard(lock);
+		while (idle.empty())
+			changed.wait(guard);
+		f = idle.front();
+		idle.pop_front();
+	}
+
+	capture(*f, page);
+	f->copies = copies;
+
+	{
+		lock_guard<mutex> guard(lock);
+		queued.push_back(f);
+	}
+	changed.notify_all();
+}
+
+void FrameRecorder::close() {
+	if (!recording)
+		return;
+
+	{
+		lock_guard<mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	worker.join();
+
+	if (out != NULL)
+		fclose(out);
+	out = NULL;
+	recording = false;
+	idle.clear();
+	queued.clear();
+	frames.clear();
+	bgiemu_freeimage(image);
+	image = NULL;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void FrameRecorder::capture(CapturedFrame &f, int page) {
+#ifdef BGI_SOFTWARE
+	const unsigned int *bits = bgiemu_framebuffer(page);
+	memcpy(&f.rgba[0], bits, (size_t)width * height * sizeof(unsigned int));
+#else
+	//a copy of the active page, 0x00RRGGBB with the top row first
+	(void)page;
+	bgiemu_getimage(0, 0, image);
+	const unsigned int *bits = bgiemu_imagebits(image);
+	size_t n = (size_t)width * height;
+	for (size_t i = 0; i < n; i++) {
+		unsigned int p = bits[i];
+		f.rgba[i] = 0xFF000000u | ((p & 0xFF) << 16) | (p & 0xFF00) | ((p >> 16) & 0xFF);
+	}
+#endif
+}
+
+void FrameRecorder::encoder() {
+	for (;;) {
+		CapturedFrame *f;
+		{
+			unique_lock<mutex> guard(lock);
+			while (queued.empty() && !stopping)
+				changed.wait(guard);
+			if (queued.empty())
+				return;  //stopping, and everything has been written
+			f = queued.front();
+			queued.pop_front();
+		}
+
+		writeFrame(*f);
+
+		{
+			lock_guard<mutex> guard(lock);
+			idle.push_back(f);
+		}
+		changed.notify_all();
+	}
+}
+
+//Pixels are packed 0xAABBGGRR
+void FrameRecorder::writeFrame(const CapturedFrame &f) {
+	size_t n = (size_t)width * height;
+
+	if (format == frames_y4m) {
+		int cw = (width + 1) / 2, ch = (height + 1) / 2;
+		pixels.resize(n + 2 * (size_t)cw * ch);
+		unsigned char *yp = &pixels[0];
+		unsigned char *up = yp + n;
+		unsigned char *vp = up + (size_t)cw * ch;
+
+		for (size_t i = 0; i < n; i++) {
+			unsigned int p = f.rgba[i];
+			int r = p & 0xFF, g = (p >> 8) & 0xFF, b = (p >> 16) & 0xFF;
+			yp[i] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+		}
+		//chroma from the mean colour of each 2x2 block
+		for (int cy = 0; cy < ch; cy++) {
+			for (int cx = 0; cx < cw; cx++) {
+				int r = 0, g = 0, b = 0, count = 0;
+				for (int y = 2 * cy; y < min(2 * cy + 2, height); y++) {
+					for (int x = 2 * cx; x < min(2 * cx + 2, width); x++) {
+						unsigned int p = f.rgba[(size_t)y * width + x];
+						r += p & 0xFF;
+						g += (p >> 8) & 0xFF;
+						b += (p >> 16) & 0xFF;
+						count++;
+					}
+				}
+				r /= count;
+				g /= count;
+				b /= count;
+				up[(size_t)cy * cw + cx] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+				vp[(size_t)cy * cw + cx] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+			}
+		}
+	} else {
+		pixels.resize(3 * n);
+		for (size_t i = 0; i < n; i++) {
+			unsigned int p = f.rgba[i];
+			pixels[3 * i] = (unsigned char)(p & 0xFF);
+			pixels[3 * i + 1] = (unsigned char)((p >> 8) & 0xFF);
+			pixels[3 * i + 2] = (unsigned char)((p >> 16) & 0xFF);
+		}
+	}
+
+	for (int c = 0; c < f.copies; c++) {
+		if (format == frames_ppm) {
+			if (out == NULL)
+				out = fopen(ppmFileName(path, written).c_str(), "wb");
+			if (out == NULL) {
+				cout << "FrameRecorder: cannot create " << ppmFileName(path, written) << endl;
+				return;
+			}
+			fprintf(out, "P6\n%d %d\n255\n", width, height);
+		} else if (format == frames_y4m) {
+			fputs("FRAME\n", out);
+		}
+		fwrite(&pixels[0], 1, pixels.size(), out);
+		if (format == frames_ppm) {
+			fclose(out);
+			out = NULL;
+		}
+		written++;
+	}
+}
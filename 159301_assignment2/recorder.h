@@ -0,0 +1,85 @@
+#ifndef __RECORDER_H__
+#define __RECORDER_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+struct bgiemu_image;
+
+/////////////////////////////////////////////////////
+//Offline export of an animation as a frame sequence.
+//
+//frame() copies the page that was just drawn whenever the next capture
+//time is due (the software framebuffer, or a bgiemu_image under WinBGI); the
+//conversion and the file output run on a background thread.  Output:
+//  frames_rgb  one file of packed 24-bit RGB frames, width*height*3 bytes each
+//  frames_ppm  one binary PPM per frame: <path>_000000.ppm, <path>_000001.ppm, ...
+//  frames_y4m  a YUV4MPEG2 stream, 4:2:0, BT.601 studio range
+
+enum frame_format { frames_rgb, frames_ppm, frames_y4m };
+
+//Picks the format from the file extension (.rgb, .ppm, .y4m); false if unknown
+bool frameFormatFromPath(const string &path, frame_format &format);
+
+class FrameRecorder{
+
+public:
+	FrameRecorder();
+	~FrameRecorder();
+
+	//Records the whole graphics window at fps frames per simulated second.
+	//False if the output cannot be created.
+	bool open(const string &path, frame_format format, int fps);
+
+	//True if a frame at simulated time t would be captured
+	bool due(double t) const { return recording && t >= nextCapture; }
+
+	//Call after page has been drawn for simulated time t.  Blocks only if
+	//the encoder is a full queue behind.
+	void frame(double t, int page);
+
+	//Writes out the queued frames and closes the output
+	void close();
+
+	bool isOpen() const { return recording; }
+	int framesWritten() const { return written; }
+
+private:
+	struct CapturedFrame {
+		vector<unsigned int> rgba;
+		int copies;  //the frame covers this many capture intervals
+	};
+
+	void capture(CapturedFrame &f, int page);
+	void encoder();
+	void writeFrame(const CapturedFrame &f);
+
+	string path;
+	frame_format format;
+	int width, height;
+	double interval, nextCapture;
+	long slots;  //capture intervals started so far
+	bool recording;
+	FILE *out;
+	int written;
+
+	vector<CapturedFrame> frames;
+	deque<CapturedFrame*> idle, queued;
+	bool stopping;
+	mutex lock;
+	condition_variable changed;
+	thread worker;
+
+	bgiemu_image *image;  //WinBGI capture buffer
+	vector<unsigned char> pixels;  //one converted frame
+};
+
+
+#endif
@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+
+#include "replay.h"
+#include "simulation.h"
+
+static unsigned int floatBits(float f){
+	unsigned int u;
+	memcpy(&u, &f, sizeof(u));
+	return u;
+}
+
+static float bitsFloat(unsigned int u){
+	float f;
+	memcpy(&f, &u, sizeof(f));
+	return f;
+}
+
+static void writeBits(ostream& out, const float values[], int n){
+	char word[16];
+	for (int i = 0; i < n; i++) {
+		sprintf(word, " %08x", floatBits(values[i]));
+		out << word;
+	}
+	out << endl;
+}
+
+static bool readBits(istream& in, float values[], int n){
+	for (int i = 0; i < n; i++) {
+		unsigned int u;
+		if (!(in >> hex >> u))
+			return false;
+		values[i] = bitsFloat(u);
+	}
+	return true;
+}
+
+//A ReplayStep goes through a float array rather than &step.x, since its
+//fields are separate members and not an array
+static void writeStep(ostream& out, const ReplayStep& step){
+	float values[5] = { step.x, step.x_dot, step.angle, step.angle_dot, step.F };
+	writeBits(out, values, 5);
+}
+
+static bool readStep(istream& in, ReplayStep& step){
+	float values[5];
+	if (!readBits(in, values, 5))
+		return false;
+	step.x = values[0];
+	step.x_dot = values[1];
+	step.angle = values[2];
+	step.angle_dot = values[3];
+	step.F = values[4];
+	return true;
+}
+
+//FNV-1a, one field at a time so that struct padding stays out of it
+static void hashBytes(unsigned int& h, const void* p, size_t n){
+	const unsigned char* bytes = (const unsigned char*)p;
+	for (size_t i = 0; i < n; i++)
+		h = (h ^ bytes[i]) * 16777619u;
+}
+
+template <class T>
+static void hashValue(unsigned int& h, const T& value){
+	hashBytes(h, &value, sizeof(value));
+}
+
+static void hashTrapezoid(unsigned int& h, const trapezoid& t){
+	hashValue(h, (int)t.tp);
+	float shape[6] = { t.a, t.b, t.c, t.d, t.l_slope, t.r_slope };
+	hashBytes(h, shape, sizeof(shape));
+	if (t.tp == piecewise_linear) {
+		hashValue(h, t.no_of_points);
+		hashBytes(h, t.px, t.no_of_points * sizeof(float));
+		hashBytes(h, t.py, t.no_of_points * sizeof(float));
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+unsigned int controllerHash(const fuzzy_system_rec& fz){
+	unsigned int h = 2166136261u;
+
+	int sizes[4] = { fz.no_of_inputs, fz.no_of_inp_regions, fz.no_of_rules, fz.no_of_outputs };
+	hashBytes(h, sizes, sizeof(sizes));
+	for (int i = 0; i < fz.no_of_inputs; i++)
+		for (int j = 0; j < fz.no_of_inp_regions; j++)
+			hashTrapezoid(h, fz.inp_mem_fns[i][j]);
+	for (int r = 0; r < fz.no_of_rules; r++) {
+		hashBytes(h, fz.rules[r].inp_index, fz.no_of_inputs * sizeof(short));
+		hashBytes(h, fz.rules[r].inp_fuzzy_set, fz.no_of_inputs * sizeof(short));
+		hashValue(h, fz.rules[r].out_fuzzy_set);
+	}
+	hashBytes(h, fz.output_values, fz.no_of_outputs * sizeof(float));
+
+	int operators[5] = { (int)fz.tnorm, (int)fz.defuzz, (int)fz.inference, (int)fz.implication, (int)fz.aggregation };
+	hashBytes(h, operators, sizeof(operators));
+	hashValue(h, fz.hamacher_gamma);
+	if (fz.inference == mamdani_consequents)
+		for (int i = 0; i < fz.no_of_outputs; i++)
+			hashTrapezoid(h, fz.out_mem_fns[i]);
+	if (fz.inference == tsk_consequents) {
+		hashValue(h, fz.no_of_state_vars);
+		hashBytes(h, fz.tsk_coeffs, fz.no_of_rules * TSK_ROW_SIZE * sizeof(float));
+	}
+
+	float gains[4] = { A, B, C, D };
+	hashBytes(h, gains, sizeof(gains));
+	return h;
+}
+
+ReplayStep replayStep(const WorldStateType& s){
+	ReplayStep step = { s.x, s.x_dot, s.angle, s.angle_dot, s.F };
+	return step;
+}
+
+bool sameStep(const ReplayStep& a, const ReplayStep& b){
+	return memcmp(&a, &b, sizeof(ReplayStep)) == 0;
+}
+
+void replayRun(const fuzzy_system_rec& fz, ReplayLog& log){
+	WorldStateType s(log.start);
+	float inputs[2];
+
+	log.controller = controllerHash(fz);
+	log.trace.resize(log.steps);
+	for (long step = 1; step <= log.steps; step++) {
+		controlStep(fz, s, log.h, log.disturbances.force((log.first + step - 1) * (double)log.h, log.h), inputs, log.plant);
+		log.trace[step - 1] = replayStep(s);
+	}
+	log.end = replayStep(s);
+}
+
+long firstDivergence(const vector<ReplayStep>& a, const vector<ReplayStep>& b){
+	size_t n = min(a.size(), b.size());
+	for (size_t i = 0; i < n; i++)
+		if (!sameStep(a[i], b[i]))
+			return (long)i + 1;
+	return 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+ReplayLog::ReplayLog(){
+	controller = 0;
+	plant = defaultPlantParameters();
+	h = 0.0f;
+	first = steps = 0;
+	start.init();
+	end = replayStep(start);
+}
+
+//File layout: a header of "key value" lines, the disturbance schedule
+//(ending with "end"), then optionally "trace <n>" and n ReplayStep lines.
+//Floats are 8 hex digits of their bits.  Version 1 logs have no plant
+//line and no F_actuator in the start state.
+bool ReplayLog::save(const string& path) const{
+	ofstream out(path.c_str());
+	if (!out) {
+		cout << "Cannot write replay log " << path << endl;
+		return false;
+	}
+
+	char word[16];
+	sprintf(word, "%08x", controller);
+	out << "pendulum-replay 2" << endl;
+	out << "controller " << word << endl;
+	float parameters[8] = { plant.mb, plant.g, plant.m, plant.l, plant.cartFriction, plant.poleFriction,
+		plant.maxForce, plant.maxForceRate };
+	out << "plant " << (plant.legacyDynamics ? "legacy" : "exact");
+	writeBits(out, parameters, 8);
+	out << "h";
+	writeBits(out, &h, 1);
+	out << "first " << first << endl;
+	out << "steps " << steps << endl;
+	float state[10] = { start.x, start.x_dot, start.x_double_dot, start.angle, start.angle_dot, start.angle_double_dot,
+		start.F, start.in_theta_and_theta_dot, start.in_x_and_x_dot, start.F_actuator };
+	out << "start";
+	writeBits(out, state, 10);
+	out << "final";
+	writeStep(out, end);
+	out << "disturbances" << endl;
+	disturbances.write(out);
+	out << "end" << endl;
+
+	if (!trace.empty()) {
+		out << "trace " << trace.size() << endl;
+		for (size_t i = 0; i < trace.size(); i++)
+			writeStep(out, trace[i]);
+	}
+	return true;
+}
+
+bool ReplayLog::load(const string& path){
+	ifstream in(path.c_str());
+	string text, key;
+	if (!in || !getline(in, text) || (text != "pendulum-replay 1" && text != "pendulum-replay 2")) {
+		cout << path << " is not a replay log" << endl;
+		return false;
+	}
+	int stateSize = text == "pendulum-replay 1" ? 9 : 10;
+	plant = defaultPlantParameters();
+
+	int lineNo = 1;
+	bool ok = true, haveH = false, haveSteps = false, haveStart = false;
+	while (ok && getline(in, text)) {
+		lineNo++;
+		istringstream line(text);
+		if (!(line >> key))
+			continue;
+		if (key == "disturbances")
+			break;
+		if (key == "controller") {
+			ok = !(line >> hex >> controller).fail();
+		} else if (key == "plant") {
+			string dynamics;
+			float parameters[8] = { 0.0f };
+			ok = (line >> dynamics) && (dynamics == "legacy" || dynamics == "exact") && readBits(line, parameters, 8);
+			plant.legacyDynamics = dynamics == "legacy";
+			plant.mb = parameters[0];
+			plant.g = parameters[1];
+			plant.m = parameters[2];
+			plant.l = parameters[3];
+			plant.cartFriction = parameters[4];
+			plant.poleFriction = parameters[5];
+			plant.maxForce = parameters[6];
+			plant.maxForceRate = parameters[7];
+		} else if (key == "h") {
+			ok = haveH = readBits(line, &h, 1);
+		} else if (key == "first") {
+			ok = !(line >> first).fail() && first >= 0;
+		} else if (key == "steps") {
+			ok = haveSteps = !(line >> steps).fail() && steps >= 0;
+		} else if (key == "start") {
+			float state[10] = { 0.0f };
+			ok = haveStart = readBits(line, state, stateSize);
+			start.x = state[0];
+			start.x_dot = state[1];
+			start.x_double_dot = state[2];
+			start.angle = state[3];
+			start.angle_dot = state[4];
+			start.angle_double_dot = state[5];
+			start.F = state[6];
+			start.in_theta_and_theta_dot = state[7];
+			start.in_x_and_x_dot = state[8];
+			start.F_actuator = state[9];
+		} else if (key == "final") {
+			ok = readStep(line, end);
+		}
+		if (!ok)
+			cout << path << ":" << lineNo << ": cannot read \"" << text << "\"" << endl;
+	}
+	if (!ok)
+		return false;
+	if (!haveH || !haveSteps || !haveStart) {
+		cout << path << ": the header has no " << (!haveH ? "h" : !haveSteps ? "steps" : "start") << " line" << endl;
+		return false;
+	}
+	if (!disturbances.read(in, path, lineNo + 1))
+		return false;
+
+	trace.clear();
+	long n = 0;
+	if (in >> key) {
+		if (key != "trace" || !(in >> dec >> n) || n < 0) {
+			cout << path << ": cannot read the trace" << endl;
+			return false;
+		}
+		trace.resize(n);
+		for (long i = 0; i < n; i++) {
+			if (!readStep(in, trace[i])) {
+				cout << path << ": the trace stops at tick " << i << " of " << n << endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
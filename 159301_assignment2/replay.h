@@ -0,0 +1,63 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "fuzzylogic.h"
+#include "pendulum.h"
+#include "disturbance.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//Closed-loop runs reduced to what decides them, to run again bit for bit
+
+//One tick's state in a replay trace
+typedef struct {
+	float x, x_dot;
+	float angle, angle_dot;
+	float F;
+} ReplayStep;
+
+//Everything a run of the control loop depends on: the start, the controller
+//(as a hash, to tell when it has changed), the plant, h, the number of ticks
+//and every force that was not the controller's, key presses included.  Floats are
+//saved as their bit patterns, so a loaded log runs exactly as recorded.
+class ReplayLog{
+
+public:
+	ReplayLog();
+
+	unsigned int controller;  //controllerHash() of the run
+	PlantParameters plant;    //the default plant for logs from before there was a choice
+	float h;
+	long first;               //ticks before start, for a run resumed from a checkpoint
+	long steps;
+	WorldStateType start;
+	ReplayStep end;           //state after the last tick
+	DisturbanceSchedule disturbances;
+	vector<ReplayStep> trace; //every tick's state, when the log was made by replayRun()
+
+	bool load(const string& path);
+	bool save(const string& path) const;
+};
+
+//FNV-1a over the controller's rules, membership functions, operators and
+//the Yamakawa gains
+unsigned int controllerHash(const fuzzy_system_rec& fz);
+
+ReplayStep replayStep(const WorldStateType& s);
+bool sameStep(const ReplayStep& a, const ReplayStep& b);  //bit for bit
+
+//Runs log headless with fz on its plant as fast as it computes, replacing its controller
+//hash, end and trace with those of the new run
+void replayRun(const fuzzy_system_rec& fz, ReplayLog& log);
+
+//First tick (from 1) at which the traces differ, or 0 if they agree for as
+//long as both go
+long firstDivergence(const vector<ReplayStep>& a, const vector<ReplayStep>& b);
+
+
+#endif
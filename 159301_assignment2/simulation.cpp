@@ -0,0 +1,109 @@
+#include "simulation.h"
+
+#ifndef BGI_SOFTWARE
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+void controlStep(const fuzzy_system_rec& fz, WorldStateType& s, float h, float disturbance, float inputs[],
+	const PlantParameters& plant){
+	float state[MAX_NO_OF_STATE_VARS];
+	float F;
+
+	getControllerInputs(s, inputs);
+	if (fz.inference == tsk_consequents) {
+		getStateVector(s, state);
+		F = fuzzy_system_tsk(inputs, state, fz);
+	} else {
+		F = fuzzy_system(inputs, fz);
+	}
+	s.F_actuator = actuatorForce(F, s.F_actuator, h, plant);
+	s.F = s.F_actuator + disturbance;
+	stepPendulum(s, h, plant);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+PendulumSimulation::PendulumSimulation(fuzzy_system_rec* fz_, float h_){
+	fz = fz_;
+	h = h_;
+	plant = defaultPlantParameters();
+	plot = NULL;
+	disturbances = &noDisturbances;
+	checkpoints = NULL;
+	checkpointEvery = 1;
+	RealtimeOptions none = { 0.0, -1, false };
+	realtime = none;
+	externalForce.store(0.0f);
+	stopping.store(false);
+	done.store(true);
+}
+
+PendulumSimulation::~PendulumSimulation(){
+	stop();
+}
+
+void PendulumSimulation::start(const WorldStateType& s, long maxSteps, long firstStep){
+	stop();
+	metrics.reset(s, firstStep * (double)h, h);
+	SimulationFrame first = { s, { 0.0f, 0.0f }, 0.0f, firstStep * (double)h, firstStep, metrics.summary() };
+	frames.publish(first);
+	if (checkpoints != NULL)
+		checkpoints->begin(*disturbances);
+	stopping.store(false);
+	done.store(false);
+	worker = thread(&PendulumSimulation::run, this, s, maxSteps, firstStep);
+}
+
+void PendulumSimulation::stop(){
+	stopping.store(true);
+	if (worker.joinable())
+		worker.join();
+}
+
+void PendulumSimulation::run(WorldStateType s, long maxSteps, long firstStep){
+#ifndef BGI_SOFTWARE
+	timeBeginPeriod(1);  //sleeps of a tick, not of the 15.6 ms default
+#endif
+	RealtimeTicker ticker(h, realtime);
+	ticker.setup();
+	ticker.start();
+	float inputs[2], key = 0.0f;
+	double end = firstStep * (double)h;
+	long nextCheckpoint = firstStep + checkpointEvery;
+
+	for (long step = firstStep + 1; !stopping.load() && (maxSteps == 0 || step <= maxSteps); step++) {
+		ticker.wait();
+		double t = (step - 1) * (double)h;  //when this tick's force starts
+		float pressed = externalForce.load(memory_order_relaxed);
+		if (pressed != key) {
+			disturbances->keyForce(t, pressed);
+			if (checkpoints != NULL)
+				checkpoints->keyForce(t, pressed);
+			key = pressed;
+		}
+		float disturbance = disturbances->force(t, h);
+		controlStep(*fz, s, h, disturbance, inputs, plant);
+
+		end = step * (double)h;
+		metrics.add(s, end);
+		SimulationFrame f = { s, { inputs[0], inputs[1] }, disturbance, end, step, metrics.summary() };
+		frames.publish(f);
+		if (plot != NULL) {
+			PlotSample sample = { (float)f.t, s.angle, s.x, s.F };
+			plot->push(sample);
+		}
+		//a busy writer only puts the checkpoint off to a later tick
+		if (checkpoints != NULL && step >= nextCheckpoint && checkpoints->offer(step, h, s))
+			nextCheckpoint = step + checkpointEvery;
+		ticker.done();
+	}
+	if (key != 0.0f)
+		disturbances->keyForce(end, 0.0f);  //a key still held ends with the run
+	stats = ticker.stats();
+
+#ifndef BGI_SOFTWARE
+	timeEndPeriod(1);
+#endif
+	done.store(true);
+}
@@ -0,0 +1,148 @@
+#ifndef __SIMULATION_H__
+#define __SIMULATION_H__
+
+#include <thread>
+#include <atomic>
+
+#include "fuzzylogic.h"
+#include "pendulum.h"
+#include "plot.h"
+#include "realtime.h"
+#include "disturbance.h"
+#include "checkpoint.h"
+#include "metrics.h"
+
+using namespace std;
+
+/////////////////////////////////////////////////////
+//The control loop of runInvertedPendulum on a thread of its own
+
+//Hands the newest value from one writer thread to one reader thread without
+//locks and without either side waiting: the writer fills a back slot and
+//swaps it with the middle one, and the reader swaps the middle slot for its
+//front one when the writer has put something new there.
+template <class T>
+class TripleBuffer{
+
+public:
+	TripleBuffer(){
+		back = 0;
+		middle.store(1);
+		front = 2;
+	}
+
+	//Writer side
+	void publish(const T& value){
+		slots[back] = value;
+		back = middle.exchange(back | FRESH) & INDEX;
+	}
+
+	//Reader side: takes the newest published value, if there is one since
+	//the last call, into current()
+	bool update(){
+		if ((middle.load(memory_order_relaxed) & FRESH) == 0)
+			return false;
+		front = middle.exchange(front) & INDEX;
+		return true;
+	}
+	const T& current() const { return slots[front]; }
+
+private:
+	enum { INDEX = 3, FRESH = 4 };
+
+	T slots[3];
+	int back;           //writer's slot
+	atomic<int> middle; //slot index, and FRESH until the reader takes it
+	int front;          //reader's slot
+};
+
+//One control tick: the controller's force through the plant's actuator,
+//plus disturbance (N), on s, then stepPendulum.  inputs gets the controller
+//inputs.
+void controlStep(const fuzzy_system_rec& fz, WorldStateType& s, float h, float disturbance, float inputs[],
+	const PlantParameters& plant = defaultPlantParameters());
+
+//One control tick, as the display sees it
+struct SimulationFrame{
+	WorldStateType state;  //after the tick, with the force that was applied
+	float inputs[2];       //controller inputs the force was worked out from
+	float disturbance;     //of state.F, the part that was not the controller's
+	double t;              //simulated seconds
+	long step;
+	MetricSummary metrics; //of the run so far
+};
+
+//Runs getControllerInputs, the fuzzy controller and stepPendulum every h
+//seconds of wall time, on a RealtimeTicker.  The display takes the newest
+//SimulationFrame with update() when it is ready to draw; a slow frame only
+//means frames are skipped, never that a tick waits.  Disturbances are added
+//to the controller's force by simulated time; a key force goes the other
+//way through setExternalForce() and is recorded in the schedule as a step.
+class PendulumSimulation{
+
+public:
+	PendulumSimulation(fuzzy_system_rec* fz, float h);
+	~PendulumSimulation();
+
+	//Starts ticking from s, as tick firstStep + 1 (a resumed run); stops by
+	//itself after tick maxSteps (0 = until stop())
+	void start(const WorldStateType& s, long maxSteps = 0, long firstStep = 0);
+	void stop();
+	bool running() const { return !done.load(); }
+
+	void setExternalForce(float F) { externalForce.store(F, memory_order_relaxed); }
+
+	//Schedule of disturbances (NULL for an empty one of its own); set before
+	//start().  The simulation thread adds key forces to it while running.
+	void useDisturbances(DisturbanceSchedule* schedule) { disturbances = schedule != NULL ? schedule : &noDisturbances; }
+
+	//Every tick's state is also pushed to ring (NULL for none)
+	void usePlot(SampleRing* ring) { plot = ring; }
+
+	//Offers writer a Checkpoint every everySteps ticks (NULL for none); set
+	//before start()
+	void useCheckpoints(CheckpointWriter* writer, long everySteps) { checkpoints = writer; checkpointEvery = max(1L, everySteps); }
+
+	//The cart, pole and actuator to simulate; set before start()
+	void setPlant(const PlantParameters& parameters) { plant = parameters; }
+
+	//What the run's metrics are judged against; set before start()
+	void setMetricLimits(const MetricLimits& limits) { metrics.setLimits(limits); }
+
+	//Pinning, memory locking and busy-waiting for the ticks; set before start()
+	void setRealtime(const RealtimeOptions& options) { realtime = options; }
+
+	//Display side: true if there is a newer frame in latest()
+	bool update() { return frames.update(); }
+	const SimulationFrame& latest() const { return frames.current(); }
+
+	//Jitter and deadline misses of the last run, once running() is false
+	const TickStats& tickStats() const { return stats; }
+
+	//Metrics of the run from start() (from the resumed tick, for a resumed
+	//run), once running() is false; latest() has them while it runs
+	const TrajectoryMetrics& runMetrics() const { return metrics; }
+
+private:
+	void run(WorldStateType s, long maxSteps, long firstStep);
+
+	fuzzy_system_rec* fz;
+	float h;
+	PlantParameters plant;
+	SampleRing* plot;
+	DisturbanceSchedule* disturbances;
+	DisturbanceSchedule noDisturbances;
+	CheckpointWriter* checkpoints;
+	long checkpointEvery;
+	RealtimeOptions realtime;
+	TickStats stats;
+	TrajectoryMetrics metrics;
+
+	TripleBuffer<SimulationFrame> frames;
+	atomic<float> externalForce;
+	atomic<bool> stopping, done;
+	thread worker;
+};
+
+
+#endif
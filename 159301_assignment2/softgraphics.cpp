@@ -0,0 +1,1396 @@
+////////////////////////////////////////////////////////////////////////
+//
+//   Program Name:  Graphics Engine (Software Rasterizer)
+//  	Description:  Headless implementation of the BGI calls in graphics.h.
+//                  Every page is a CPU framebuffer of 32-bit RGBA pixels
+//                  (bytes R, G, B, A in memory order).  Polygons are
+//                  scanline filled, ellipses use the midpoint algorithm and
+//                  text is drawn from an 8x8 bitmap font scaled to the
+//                  WinBGI font metrics.
+//
+//                  Build with BGI_SOFTWARE defined instead of graphics.cpp.
+//
+////////////////////////////////////////////////////////////////////////
+
+#ifdef BGI_SOFTWARE
+
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+#include "graphics.h"
+
+using namespace std;
+
+///////////////////////////////////////////////////////////////////////
+int bgiemu_handle_redraw = 1;
+int bgiemu_default_mode = VGAHI; //VGAMAX;
+///////////////////////////////////////////////////////////////////////
+
+#define MAX_PAGES 16
+#define ESC 0x1b
+
+static int window_width;
+static int window_height;
+static unsigned int* pages[MAX_PAGES];
+
+//One bit per 2^tile_shift columns of each row, set when a pixel there is
+//written; cleardevice only has to repaint the marked tiles
+static unsigned int* page_tiles[MAX_PAGES];
+static unsigned int page_clear_rgba[MAX_PAGES];
+static int tile_shift;
+
+static int active_page;
+static unsigned int* active_bits;
+static unsigned int* active_tiles;
+static int visual_page;
+
+static int color;
+static int bkcolor;
+static int write_mode;
+static linesettingstype line_settings;
+static fillsettingstype fill_settings;
+static textsettingstype text_settings;
+static viewporttype view_settings;
+static palettetype current_palette;
+static arccoordstype ac;
+static int aspect_ratio_x, aspect_ratio_y;
+static int font_mul_x, font_div_x, font_mul_y, font_div_y;
+static int cp_x, cp_y;
+static int graph_error = grOk;
+static unsigned int graph_buf_size = 4096;
+
+//Clip rectangle in screen coordinates (inclusive) and viewport origin
+static int clip_x1, clip_y1, clip_x2, clip_y2;
+static int origin_x, origin_y;
+
+static struct { unsigned char r, g, b; } BGIcolor[64] = {
+    { 0, 0, 0 },  // 0
+    { 0, 0, 255 },  // 1
+    { 0, 255, 0 },  // 2
+    { 0, 255, 255 },  // 3
+    { 255, 0, 0 },  // 4
+    { 255, 0, 255 },  // 5
+    { 165, 42, 42 },  // 6
+    { 211, 211, 211 },  // 7
+    { 47, 79, 79 },  // 8
+    { 173, 216, 230 },  // 9
+    { 32, 178, 170 },  // 10
+    { 224, 255, 255 },  // 11
+    { 240, 128, 128 },  // 12
+    { 219, 112, 147 },  // 13
+    { 255, 255, 0 },  // 14
+    { 255, 255, 255 },  // 15
+    { 0xF0, 0xF8, 0xFF },  // 16
+    { 0xFA, 0xEB, 0xD7 },  // 17
+    { 0x22, 0x85, 0xFF },  // 18
+    { 0x7F, 0xFF, 0xD4 },  // 19
+    { 0xF0, 0xFF, 0xFF },  // 20
+    { 0xF5, 0xF5, 0xDC },  // 21
+    { 0xFF, 0xE4, 0xC4 },  // 22
+    { 0xFF, 0x7B, 0xCD },  // 23
+    { 0x00, 0x00, 0xFF },  // 24
+    { 0x8A, 0x2B, 0xE2 },  // 25
+    { 0xA5, 0x2A, 0x2A },  // 26
+    { 0xDE, 0xB8, 0x87 },  // 27
+    { 0x5F, 0x9E, 0xA0 },  // 28
+    { 0x7F, 0xFF, 0x00 },  // 29
+    { 0xD2, 0x50, 0x1E },  // 30
+    { 0xFF, 0x7F, 0x50 },  // 31
+    { 0x64, 0x95, 0xED },  // 32
+    { 0xFF, 0xF8, 0xDC },  // 33
+    { 0xDC, 0x14, 0x3C },  // 34
+    { 0x68, 0xCF, 0xDF },  // 35
+    { 0x00, 0x00, 0x8B },  // 36
+    { 0x00, 0x8B, 0x8B },  // 37
+    { 0xB8, 0x86, 0x0B },  // 38
+    { 0xA9, 0xA9, 0xA9 },  // 39
+    { 0x00, 0x64, 0x00 },  // 40
+    { 0xBD, 0xB7, 0x6B },  // 41
+    { 0x8B, 0x00, 0x8B },  // 42
+    { 0x55, 0x6B, 0x2F },  // 43
+    { 0xFF, 0x8C, 0x00 },  // 44
+    { 0xB9, 0x82, 0xFC },  // 45
+    { 0x8B, 0x00, 0x00 },  // 46
+    { 0xE9, 0x96, 0x7A },  // 47
+    { 0x8F, 0xBC, 0x8F },  // 48
+    { 0x48, 0x3D, 0x8B },  // 49
+    { 0x2F, 0x4F, 0x4F },  // 50
+    { 0x00, 0xCE, 0xD1 },  // 51
+    { 0x94, 0x00, 0xD3 },  // 52
+    { 0xFF, 0x14, 0x93 },  // 53
+    { 0x00, 0xBF, 0xFF },  // 54
+    { 0x69, 0x69, 0x69 },  // 55
+    { 0x1E, 0x90, 0xFF },  // 56
+    { 0xB2, 0x22, 0x22 },  // 57
+    { 0xFF, 0xFA, 0xF0 },  // 58
+    { 0x22, 0x8B, 0x22 },  // 59
+    { 0xFF, 0x00, 0xFF },  // 60
+    { 0xDC, 0xDC, 0xDC },  // 61
+    { 0xF8, 0xF8, 0xBF },  // 62
+    { 0xFF, 0xD7, 0x00 },  // 63
+};
+
+static unsigned int palette_rgba[MAXCOLORS+1];
+
+static unsigned char fill_patterns[USER_FILL+1][8] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },  // EMPTY_FILL
+    { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF },  // SOLID_FILL
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF },  // LINE_FILL
+    { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80 },  // LTSLASH_FILL
+    { 0x81, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xC0 },  // SLASH_FILL
+    { 0xC0, 0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x81 },  // BKSLASH_FILL
+    { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 },  // LTBKSLASH_FILL
+    { 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0xFF },  // HATCH_FILL
+    { 0x81, 0x42, 0x24, 0x18, 0x18, 0x24, 0x42, 0x81 },  // XHATCH_FILL
+    { 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA, 0x55, 0xAA },  // INTERLEAVE_FILL
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01 },  // WIDE_DOT_FILL
+    { 0x44, 0x00, 0x11, 0x00, 0x44, 0x00, 0x11, 0x00 },  // CLOSE_DOT_FILL
+    { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF }   // USER_FILL
+};
+
+static unsigned short line_patterns[USERBIT_LINE] = {
+    0xFFFF,  // SOLID_LINE
+    0xCCCC,  // DOTTED_LINE
+    0xFC78,  // CENTER_LINE
+    0xF8F8   // DASHED_LINE
+};
+
+//Character cell of each font and size, as in the WinBGI backend
+static struct { int width; int height; } font_metrics[][11] = {
+{{0,0},{8,8},{16,16},{24,24},{32,32},{40,40},{48,48},{56,56},{64,64},{72,72},{80,80}}, // DefaultFont
+{{0,0},{13,18},{14,20},{16,23},{22,31},{29,41},{36,51},{44,62},{55,77},{66,93},{88,124}}, // TriplexFont
+{{0,0},{3,5},{4,6},{4,6},{6,9},{8,12},{10,15},{12,18},{15,22},{18,27},{24,36}}, // SmallFont
+{{0,0},{11,19},{12,21},{14,24},{19,32},{25,42},{31,53},{38,64},{47,80},{57,96},{76,128}}, // SansSerifFont
+{{0,0},{13,19},{14,21},{16,24},{22,32},{29,42},{36,53},{44,64},{55,80},{66,96},{88,128}}  // GothicFont
+};
+
+static int normal_font_size[] = { 1, 4, 4, 4, 4 };
+
+//8x8 glyphs for ' ' to '~'; bit 0 of each row is the leftmost pixel
+static const unsigned char font8x8[95][8] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },  // ' '
+    { 0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00 },  // '!'
+    { 0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },  // '"'
+    { 0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00 },  // '#'
+    { 0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00 },  // '$'
+    { 0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00 },  // '%'
+    { 0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00 },  // '&'
+    { 0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 },  // '''
+    { 0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00 },  // '('
+    { 0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00 },  // ')'
+    { 0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00 },  // '*'
+    { 0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00 },  // '+'
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06 },  // ','
+    { 0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00 },  // '-'
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00 },  // '.'
+    { 0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00 },  // '/'
+    { 0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00 },  // '0'
+    { 0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00 },  // '1'
+    { 0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00 },  // '2'
+    { 0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00 },  // '3'
+    { 0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00 },  // '4'
+    { 0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00 },  // '5'
+    { 0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00 },  // '6'
+    { 0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00 },  // '7'
+    { 0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00 },  // '8'
+    { 0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00 },  // '9'
+    { 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00 },  // ':'
+    { 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06 },  // ';'
+    { 0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00 },  // '<'
+    { 0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00 },  // '='
+    { 0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00 },  // '>'
+    { 0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00 },  // '?'
+    { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00 },  // '@'
+    { 0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00 },  // 'A'
+    { 0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00 },  // 'B'
+    { 0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00 },  // 'C'
+    { 0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00 },  // 'D'
+    { 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00 },  // 'E'
+    { 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00 },  // 'F'
+    { 0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00 },  // 'G'
+    { 0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00 },  // 'H'
+    { 0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 },  // 'I'
+    { 0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00 },  // 'J'
+    { 0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00 },  // 'K'
+    { 0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00 },  // 'L'
+    { 0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00 },  // 'M'
+    { 0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00 },  // 'N'
+    { 0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00 },  // 'O'
+    { 0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00 },  // 'P'
+    { 0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00 },  // 'Q'
+    { 0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00 },  // 'R'
+    { 0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00 },  // 'S'
+    { 0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 },  // 'T'
+    { 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00 },  // 'U'
+    { 0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 },  // 'V'
+    { 0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00 },  // 'W'
+    { 0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00 },  // 'X'
+    { 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00 },  // 'Y'
+    { 0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00 },  // 'Z'
+    { 0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00 },  // '['
+    { 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00 },  // '\'
+    { 0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00 },  // ']'
+    { 0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00 },  // '^'
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF },  // '_'
+    { 0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00 },  // '`'
+    { 0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00 },  // 'a'
+    { 0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00 },  // 'b'
+    { 0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00 },  // 'c'
+    { 0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00 },  // 'd'
+    { 0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00 },  // 'e'
+    { 0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00 },  // 'f'
+    { 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F },  // 'g'
+    { 0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00 },  // 'h'
+    { 0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 },  // 'i'
+    { 0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E },  // 'j'
+    { 0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00 },  // 'k'
+    { 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 },  // 'l'
+    { 0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00 },  // 'm'
+    { 0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00 },  // 'n'
+    { 0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00 },  // 'o'
+    { 0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F },  // 'p'
+    { 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78 },  // 'q'
+    { 0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00 },  // 'r'
+    { 0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00 },  // 's'
+    { 0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00 },  // 't'
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00 },  // 'u'
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 },  // 'v'
+    { 0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00 },  // 'w'
+    { 0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00 },  // 'x'
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F },  // 'y'
+    { 0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00 },  // 'z'
+    { 0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00 },  // '{'
+    { 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00 },  // '|'
+    { 0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00 },  // '}'
+    { 0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }   // '~'
+};
+
+struct BGIimage {
+    short width;
+    short height;
+    int   reserved; // let bits be aligned to DWORD boundary
+    unsigned int bits[1];
+};
+
+const double pi = 3.14159265358979323846;
+
+
+/////////////////////////////////////////////////////////////////////
+// Pixel level
+
+inline unsigned int pack_rgba(int r, int g, int b)
+{
+    return (unsigned int)r | ((unsigned int)g << 8) | ((unsigned int)b << 16) | 0xFF000000u;
+}
+
+inline unsigned int* page_bits(int page)
+{
+    if (pages[page] == NULL) {
+	pages[page] = new unsigned int[(size_t)window_width*window_height];
+	fill(pages[page], pages[page] + (size_t)window_width*window_height, palette_rgba[0]);
+	page_tiles[page] = new unsigned int[window_height];
+	fill(page_tiles[page], page_tiles[page] + window_height, 0u);
+	page_clear_rgba[page] = palette_rgba[0];
+    }
+    return pages[page];
+}
+
+static void select_active_page(int page)
+{
+    active_page = page & (MAX_PAGES-1);
+    active_bits = page_bits(active_page);
+    active_tiles = page_tiles[active_page];
+}
+
+//Tile bits covering columns x1..x2
+inline unsigned int tile_mask(int x1, int x2)
+{
+    return (2u << (x2 >> tile_shift)) - (1u << (x1 >> tile_shift));
+}
+
+static void update_clip()
+{
+    origin_x = view_settings.left;
+    origin_y = view_settings.top;
+    if (view_settings.clip) {
+	clip_x1 = max(0, view_settings.left);
+	clip_y1 = max(0, view_settings.top);
+	clip_x2 = min(window_width-1, view_settings.right);
+	clip_y2 = min(window_height-1, view_settings.bottom);
+    } else {
+	clip_x1 = 0;
+	clip_y1 = 0;
+	clip_x2 = window_width-1;
+	clip_y2 = window_height-1;
+    }
+}
+
+//Screen coordinates; applies the write mode of lines and putpixel
+inline void plot(int x, int y, unsigned int rgba)
+{
+    if (x < clip_x1 || x > clip_x2 || y < clip_y1 || y > clip_y2) {
+	return;
+    }
+    unsigned int* p = active_bits + (size_t)y*window_width + x;
+    active_tiles[y] |= 1u << (x >> tile_shift);
+    switch (write_mode) {
+      case XOR_PUT: *p ^= rgba & 0x00FFFFFF; break;
+      case OR_PUT:  *p |= rgba; break;
+      case AND_PUT: *p &= rgba; break;
+      case NOT_PUT: *p = ~rgba | 0xFF000000u; break;
+      default:      *p = rgba; break;
+    }
+}
+
+//Horizontal run in screen coordinates with the current fill pattern
+static void fill_span(int y, int x1, int x2)
+{
+    if (y < clip_y1 || y > clip_y2) {
+	return;
+    }
+    if (x1 < clip_x1) x1 = clip_x1;
+    if (x2 > clip_x2) x2 = clip_x2;
+    if (x1 > x2 || fill_settings.pattern == EMPTY_FILL) {
+	return;
+    }
+    unsigned int* row = active_bits + (size_t)y*window_width;
+    active_tiles[y] |= tile_mask(x1, x2);
+    unsigned int fg = palette_rgba[fill_settings.color];
+    unsigned char bits = fill_patterns[fill_settings.pattern][y & 7];
+    if (bits == 0xFF) {
+	fill(row + x1, row + x2 + 1, fg);
+	return;
+    }
+    unsigned int bg = palette_rgba[0];
+    for (int x = x1; x <= x2; x++) {
+	row[x] = (bits & (0x80 >> (x & 7))) ? fg : bg;
+    }
+}
+
+//Bresenham line in screen coordinates with the current style and thickness
+static void draw_line(int x0, int y0, int x1, int y1)
+{
+    unsigned int rgba = palette_rgba[color];
+    unsigned short pattern = (line_settings.linestyle == USERBIT_LINE)
+	? (unsigned short)line_settings.upattern : line_patterns[line_settings.linestyle];
+    int dx = abs(x1-x0), dy = abs(y1-y0);
+    int sx = x0 < x1 ? 1 : -1, sy = y0 < y1 ? 1 : -1;
+    int err = dx - dy;
+    int half = line_settings.thickness / 2;
+    int bit = 0;
+
+    while (true) {
+	if (pattern & (0x8000 >> (bit++ & 15))) {
+	    if (half == 0) {
+		plot(x0, y0, rgba);
+	    } else if (dx >= dy) {
+		for (int t = -half; t <= half; t++) plot(x0, y0+t, rgba);
+	    } else {
+		for (int t = -half; t <= half; t++) plot(x0+t, y0, rgba);
+	    }
+	}
+	if (x0 == x1 && y0 == y1) {
+	    break;
+	}
+	int e2 = 2*err;
+	if (e2 > -dy) { err -= dy; x0 += sx; }
+	if (e2 < dx) { err += dx; y0 += sy; }
+    }
+}
+
+//Even-odd scanline fill sampled at pixel centres; points in screen coordinates
+static void fill_polygon(int n_points, const int* points)
+{
+    if (n_points < 3) {
+	return;
+    }
+    //non-horizontal edges, top to bottom, with x per unit of y
+    struct edge { float y_top, y_bottom, x_top, slope; };
+    static vector<edge> edges;
+    static vector<float> xs;
+    edges.clear();
+    int ymin = points[1], ymax = points[1];
+    for (int i = 0, j = n_points-1; i < n_points; j = i++) {
+	ymin = min(ymin, points[2*i+1]);
+	ymax = max(ymax, points[2*i+1]);
+	float xi = (float)points[2*i], yi = (float)points[2*i+1];
+	float xj = (float)points[2*j], yj = (float)points[2*j+1];
+	if (yi == yj) {
+	    continue;
+	}
+	edge e;
+	e.slope = (xj - xi) / (yj - yi);
+	if (yi < yj) {
+	    e.y_top = yi; e.y_bottom = yj; e.x_top = xi;
+	} else {
+	    e.y_top = yj; e.y_bottom = yi; e.x_top = xj;
+	}
+	edges.push_back(e);
+    }
+    ymin = max(ymin, clip_y1);
+    ymax = min(ymax, clip_y2);
+    xs.resize(edges.size());
+
+    for (int y = ymin; y <= ymax; y++) {
+	float yc = y + 0.5f;
+	size_t n = 0;
+	for (size_t k = 0; k < edges.size(); k++) {
+	    const edge& e = edges[k];
+	    if (yc >= e.y_top && yc < e.y_bottom) {
+		//insertion sort; a row crosses only a few edges
+		float x = e.x_top + (yc - e.y_top) * e.slope;
+		size_t m = n++;
+		for (; m > 0 && xs[m-1] > x; m--) {
+		    xs[m] = xs[m-1];
+		}
+		xs[m] = x;
+	    }
+	}
+	for (size_t k = 0; k + 1 < n; k += 2) {
+	    fill_span(y, (int)ceil(xs[k] - 0.5f), (int)ceil(xs[k+1] - 0.5f) - 1);
+	}
+    }
+}
+
+//First quadrant of an ellipse by the midpoint algorithm: extent[dy] is the
+//largest |dx| on row dy, outline gets every boundary point
+static void midpoint_ellipse(int rx, int ry, vector<int>& extent, vector<int>* outline)
+{
+    extent.assign(ry+1, -1);
+    if (outline) outline->clear();
+    if (rx == 0 || ry == 0) {
+	for (int y = 0; y <= ry; y++) {
+	    extent[y] = rx;
+	    if (outline) { outline->push_back(rx); outline->push_back(y); }
+	}
+	return;
+    }
+    long long rx2 = (long long)rx*rx, ry2 = (long long)ry*ry;
+    long long x = 0, y = ry;
+    long long px = 0, py = 2*rx2*y;
+    long long p = ry2 - rx2*ry + rx2/4;
+
+    //region 1: slope above -1
+    while (px < py) {
+	extent[y] = max(extent[y], (int)x);
+	if (outline) { outline->push_back((int)x); outline->push_back((int)y); }
+	x++;
+	px += 2*ry2;
+	if (p < 0) {
+	    p += ry2 + px;
+	} else {
+	    y--;
+	    py -= 2*rx2;
+	    p += ry2 + px - py;
+	}
+    }
+    //region 2
+    p = (long long)(ry2*(x+0.5)*(x+0.5) + rx2*(y-1)*(y-1) - rx2*ry2);
+    while (y >= 0) {
+	extent[y] = max(extent[y], (int)x);
+	if (outline) { outline->push_back((int)x); outline->push_back((int)y); }
+	y--;
+	py -= 2*rx2;
+	if (p > 0) {
+	    p += rx2 - py;
+	} else {
+	    x++;
+	    px += 2*ry2;
+	    p += rx2 - py + px;
+	}
+    }
+}
+
+static void draw_ellipse_outline(int cx, int cy, int rx, int ry)
+{
+    static vector<int> extent, outline;
+    unsigned int rgba = palette_rgba[color];
+    midpoint_ellipse(rx, ry, extent, &outline);
+    for (size_t k = 0; k < outline.size(); k += 2) {
+	int x = outline[k], y = outline[k+1];
+	plot(cx+x, cy+y, rgba);
+	plot(cx-x, cy+y, rgba);
+	plot(cx+x, cy-y, rgba);
+	plot(cx-x, cy-y, rgba);
+    }
+}
+
+static void fill_ellipse_area(int cx, int cy, int rx, int ry)
+{
+    static vector<int> extent;
+    midpoint_ellipse(rx, ry, extent, NULL);
+    for (int y = 0; y <= ry; y++) {
+	fill_span(cy+y, cx-extent[y], cx+extent[y]);
+	if (y != 0) {
+	    fill_span(cy-y, cx-extent[y], cx+extent[y]);
+	}
+    }
+}
+
+//Arc from start_angle to end_angle (degrees, counter-clockwise) as a polyline
+static int arc_points(int cx, int cy, int start_angle, int end_angle, int rx, int ry, vector<int>& pts)
+{
+    while (end_angle < start_angle) end_angle += 360;
+    int steps = max(4, (int)((end_angle - start_angle) * max(rx, ry) * pi / 180.0 / 4.0));
+    pts.clear();
+    for (int i = 0; i <= steps; i++) {
+	double a = (start_angle + (end_angle - start_angle) * double(i) / steps) * pi / 180.0;
+	pts.push_back(cx + int(floor(rx*cos(a) + 0.5)));
+	pts.push_back(cy - int(floor(ry*sin(a) + 0.5)));
+    }
+    return steps + 1;
+}
+
+static void draw_polyline_screen(int n_points, const int* pts)
+{
+    for (int i = 0; i + 1 < n_points; i++) {
+	draw_line(pts[2*i], pts[2*i+1], pts[2*i+2], pts[2*i+3]);
+    }
+}
+
+/////////////////////////////////////////////////////////////////////
+// Text
+
+static void char_size(int& w, int& h)
+{
+    int font = (text_settings.font >= 0 && text_settings.font <= GOTHIC_FONT) ? text_settings.font : DEFAULT_FONT;
+    if (text_settings.charsize == 0) {
+	w = font_metrics[font][normal_font_size[font]].width*font_mul_x/font_div_x;
+	h = font_metrics[font][normal_font_size[font]].height*font_mul_y/font_div_y;
+    } else {
+	w = font_metrics[font][text_settings.charsize].width;
+	h = font_metrics[font][text_settings.charsize].height;
+    }
+}
+
+//Text drawn transparently at the top left corner (x, y) of its box
+static void draw_text(int x, int y, const char* str)
+{
+    int w, h;
+    char_size(w, h);
+    unsigned int rgba = palette_rgba[color];
+    bool vertical = text_settings.direction == VERT_DIR;
+
+    for (const char* s = str; *s; s++) {
+	unsigned char ch = (unsigned char)*s;
+	if (ch >= 32 && ch < 127) {
+	    const unsigned char* glyph = font8x8[ch - 32];
+	    for (int dy = 0; dy < h; dy++) {
+		unsigned char bits = glyph[dy*8/h];
+		if (bits == 0) continue;
+		for (int dx = 0; dx < w; dx++) {
+		    if (bits & (1 << (dx*8/w))) {
+			if (vertical) plot(x + dy, y - dx, rgba);
+			else plot(x + dx, y + dy, rgba);
+		    }
+		}
+	    }
+	}
+	if (vertical) y -= w;
+	else x += w;
+    }
+}
+
+static void justified_text(int x, int y, const char* str)
+{
+    int w, h;
+    char_size(w, h);
+    int len = (int)strlen(str)*w;
+    int horiz = text_settings.horiz, vert = text_settings.vert;
+
+    if (text_settings.direction == VERT_DIR) {
+	//the string runs upwards from (x, y); justification is rotated with it
+	y += (horiz == CENTER_TEXT) ? len/2 : (horiz == RIGHT_TEXT) ? len : 0;
+	x -= (vert == CENTER_TEXT) ? h/2 : (vert == BOTTOM_TEXT) ? h : 0;
+    } else {
+	x -= (horiz == CENTER_TEXT) ? len/2 : (horiz == RIGHT_TEXT) ? len : 0;
+	y -= (vert == CENTER_TEXT) ? h/2 : (vert == BOTTOM_TEXT) ? h : 0;
+    }
+    draw_text(x + origin_x, y + origin_y, str);
+}
+
+
+/////////////////////////////////////////////////////////////////////
+// BGI interface
+
+static void set_defaults()
+{
+    color = WHITE;
+    bkcolor = 0;
+    line_settings.thickness = 1;
+    line_settings.linestyle = SOLID_LINE;
+    line_settings.upattern = ~0;
+    fill_settings.pattern = SOLID_FILL;
+    fill_settings.color = WHITE;
+    write_mode = COPY_PUT;
+
+    text_settings.direction = HORIZ_DIR;
+    text_settings.font = DEFAULT_FONT;
+    text_settings.charsize = 1;
+    text_settings.horiz = LEFT_TEXT;
+    text_settings.vert = TOP_TEXT;
+    font_mul_x = font_div_x = font_mul_y = font_div_y = 1;
+
+    select_active_page(0);
+    visual_page = 0;
+
+    view_settings.left = 0;
+    view_settings.top = 0;
+    view_settings.right = window_width-1;
+    view_settings.bottom = window_height-1;
+    view_settings.clip = 1;
+    update_clip();
+    cp_x = cp_y = 0;
+
+    aspect_ratio_x = aspect_ratio_y = 10000;
+
+    current_palette.size = MAXCOLORS+1;
+    for (int i = 0; i <= MAXCOLORS; i++) {
+	current_palette.colors[i] = i;
+	palette_rgba[i] = pack_rgba(BGIcolor[i].r, BGIcolor[i].g, BGIcolor[i].b);
+    }
+}
+
+void initgraph(int* device, int* mode, char const* /*pathtodriver*/,
+			   int size_width, int size_height)
+{
+    int width = 640, height = 480;
+    if (*device == VGA && *mode == VGALO) height = 200;
+    if (*device == VGA && *mode == VGAMED) height = 350;
+    if (size_width) width = size_width;
+    if (size_height) height = size_height;
+
+    if (width != window_width || height != window_height) {
+	closegraph();
+    }
+    window_width = width;
+    window_height = height;
+    for (tile_shift = 0; ((width-1) >> tile_shift) >= 32; tile_shift++) {}
+    graph_error = grOk;
+    set_defaults();
+    cleardevice();
+}
+
+void closegraph()
+{
+    for (int i = 0; i < MAX_PAGES; i++) {
+	delete[] pages[i];
+	delete[] page_tiles[i];
+	pages[i] = NULL;
+	page_tiles[i] = NULL;
+    }
+    active_bits = NULL;
+    active_tiles = NULL;
+}
+
+void graphdefaults()
+{
+    set_defaults();
+}
+
+void restorecrtmode() {}
+void setgraphmode(int) {}
+
+void detectgraph(int *graphdriver, int *graphmode)
+{
+    *graphdriver = VGA;
+    *graphmode = bgiemu_default_mode;
+}
+
+int getgraphmode()
+{
+    return bgiemu_default_mode;
+}
+
+int getmaxmode()
+{
+    return VGAMAX;
+}
+
+void getmoderange(int /*graphdriver*/, int* lomode, int* himode)
+{
+    *lomode = VGALO;
+    *himode = VGAMAX;
+}
+
+char* getmodename(int mode)
+{
+    static char mode_str[32];
+    sprintf(mode_str, "%d x %d %s", window_width, window_height,
+	    mode < 2 ? "EGA" : "VGA");
+    return mode_str;
+}
+
+char* getdrivername()
+{
+    return (char*)"SOFTWARE";
+}
+
+char* grapherrormsg(int code)
+{
+    static char buf[64];
+    sprintf(buf, code == grOk ? "No error" : "Graphics error %d", code);
+    return buf;
+}
+
+int graphresult()
+{
+    int code = graph_error;
+    graph_error = grOk;
+    return code;
+}
+
+int installuserdriver(char const*, int*) { return grError; }
+int installuserfont(char const*) { return grError; }
+int registerbgidriver(void*) { return grError; }
+int registerbgifont(void*) { return grError; }
+
+unsigned int setgraphbufsize(unsigned int size)
+{
+    unsigned int old = graph_buf_size;
+    graph_buf_size = size;
+    return old;
+}
+
+void* _graphgetmem(unsigned int size) { return malloc(size); }
+void _graphfreemem(void* ptr, unsigned int) { free(ptr); }
+
+int getmaxx()
+{
+    return window_width-1;
+}
+
+int getmaxy()
+{
+    return window_height-1;
+}
+
+int getmaxcolor()
+{
+    return WHITE;
+}
+
+void setcolor(int c)
+{
+    color = c & MAXCOLORS;
+}
+
+int getcolor()
+{
+    return color;
+}
+
+void setbkcolor(int c)
+{
+    c &= MAXCOLORS;
+    palette_rgba[0] = pack_rgba(BGIcolor[c].r, BGIcolor[c].g, BGIcolor[c].b);
+    bkcolor = c;
+}
+
+int getbkcolor()
+{
+    return bkcolor;
+}
+
+//Palette changes affect later drawing only; pixels already drawn keep their RGBA value
+void setpalette(int index, int c)
+{
+    c &= MAXCOLORS;
+    current_palette.colors[index & MAXCOLORS] = c;
+    palette_rgba[index & MAXCOLORS] = pack_rgba(BGIcolor[c].r, BGIcolor[c].g, BGIcolor[c].b);
+    if (index == 0) {
+	bkcolor = 0;
+    }
+}
+
+void setrgbpalette(int index, int red, int green, int blue)
+{
+    palette_rgba[index & MAXCOLORS] = pack_rgba(red & 0xFC, green & 0xFC, blue & 0xFC);
+    if (index == 0) {
+	bkcolor = 0;
+    }
+}
+
+void setallpalette(palettetype* pal)
+{
+    for (int i = 0; i < pal->size; i++) {
+	setpalette(i, pal->colors[i]);
+    }
+    bkcolor = 0;
+}
+
+palettetype* getdefaultpalette()
+{
+    static palettetype default_palette;
+    default_palette.size = MAXCOLORS+1;
+    for (int i = 0; i <= MAXCOLORS; i++) {
+	default_palette.colors[i] = i;
+    }
+    return &default_palette;
+}
+
+void getpalette(palettetype* pal)
+{
+    *pal = current_palette;
+}
+
+int getpalettesize()
+{
+    return MAXCOLORS+1;
+}
+
+void setlinestyle(int style, unsigned int pattern, int thickness)
+{
+    line_settings.linestyle = style;
+    line_settings.thickness = thickness;
+    line_settings.upattern  = pattern;
+}
+
+void getlinesettings(linesettingstype* ls)
+{
+    *ls = line_settings;
+}
+
+void setwritemode(int mode)
+{
+    write_mode = mode;
+}
+
+void setfillstyle(int style, int c)
+{
+    fill_settings.pattern = style;
+    fill_settings.color = c & MAXCOLORS;
+}
+
+void getfillsettings(fillsettingstype* fs)
+{
+    *fs = fill_settings;
+}
+
+void setfillpattern(char const* upattern, int c)
+{
+    memcpy(fill_patterns[USER_FILL], upattern, 8);
+    fill_settings.color = c & MAXCOLORS;
+    fill_settings.pattern = USER_FILL;
+}
+
+void getfillpattern(fillpatterntype fp)
+{
+    memcpy(fp, fill_patterns[USER_FILL], 8);
+}
+
+void setaspectratio(int ax, int ay)
+{
+    aspect_ratio_x = ax;
+    aspect_ratio_y = ay;
+}
+
+void getaspectratio(int* ax, int* ay)
+{
+    *ax = aspect_ratio_x;
+    *ay = aspect_ratio_y;
+}
+
+void setviewport(int x1, int y1, int x2, int y2, int clip)
+{
+    view_settings.left = x1;
+    view_settings.top = y1;
+    view_settings.right = x2;
+    view_settings.bottom = y2;
+    view_settings.clip = clip;
+    update_clip();
+    moveto(0,0);
+}
+
+void getviewsettings(viewporttype *viewport)
+{
+     *viewport = view_settings;
+}
+
+void setactivepage(int page)
+{
+    select_active_page(page);
+}
+
+//Headless: the visual page is only recorded (see bgiemu_framebuffer)
+void setvisualpage(int page)
+{
+    visual_page = page & (MAX_PAGES-1);
+    page_bits(visual_page);
+}
+
+void cleardevice()
+{
+    unsigned int bg = palette_rgba[0];
+    if (page_clear_rgba[active_page] != bg) {
+	fill(active_bits, active_bits + (size_t)window_width*window_height, bg);
+	fill(active_tiles, active_tiles + window_height, 0u);
+	page_clear_rgba[active_page] = bg;
+	moveto(0,0);
+	return;
+    }
+    int tile = 1 << tile_shift;
+    for (int y = 0; y < window_height; y++) {
+	unsigned int tiles = active_tiles[y];
+	unsigned int* row = active_bits + (size_t)y*window_width;
+	for (int t = 0; tiles != 0; t++, tiles >>= 1) {
+	    if (tiles & 1) {
+		fill(row + t*tile, row + min(window_width, (t+1)*tile), bg);
+	    }
+	}
+	active_tiles[y] = 0;
+    }
+    moveto(0,0);
+}
+
+void clearviewport()
+{
+    unsigned int bg = palette_rgba[0];
+    unsigned int* bits = active_bits;
+    for (int y = clip_y1; y <= clip_y2; y++) {
+	fill(bits + (size_t)y*window_width + clip_x1, bits + (size_t)y*window_width + clip_x2 + 1, bg);
+    }
+    moveto(0,0);
+}
+
+void moveto(int x, int y)
+{
+    cp_x = x;
+    cp_y = y;
+}
+
+void moverel(int dx, int dy)
+{
+    moveto(cp_x + dx, cp_y + dy);
+}
+
+int getx()
+{
+    return cp_x;
+}
+
+int gety()
+{
+    return cp_y;
+}
+
+void putpixel(int x, int y, int c)
+{
+    int mode = write_mode;
+    write_mode = COPY_PUT;
+    plot(x + origin_x, y + origin_y, palette_rgba[c & MAXCOLORS]);
+    write_mode = mode;
+}
+
+int getpixel(int x, int y)
+{
+    x += origin_x;
+    y += origin_y;
+    if (x < 0 || x >= window_width || y < 0 || y >= window_height) {
+	return -1;
+    }
+    unsigned int rgba = active_bits[(size_t)y*window_width + x];
+    for (int c = 0; c <= MAXCOLORS; c++) {
+	if (palette_rgba[c] == rgba) {
+	    return c;
+	}
+    }
+    return -1;
+}
+
+void line(int x0, int y0, int x1, int y1)
+{
+    draw_line(x0 + origin_x, y0 + origin_y, x1 + origin_x, y1 + origin_y);
+}
+
+void lineto(int x, int y)
+{
+    line(cp_x, cp_y, x, y);
+    moveto(x, y);
+}
+
+void linerel(int dx, int dy)
+{
+    lineto(cp_x + dx, cp_y + dy);
+}
+
+void drawpoly(int n_points, int* points)
+{
+    for (int i = 0; i + 1 < n_points; i++) {
+	line(points[2*i], points[2*i+1], points[2*i+2], points[2*i+3]);
+    }
+}
+
+void rectangle(int left, int top, int right, int bottom)
+{
+    int rect[10] = { left, top, right, top, right, bottom, left, bottom, left, top };
+    drawpoly(5, rect);
+}
+
+void fillpoly(int n_points, int* points)
+{
+    static vector<int> pts;
+    pts.resize(2*n_points + 2);
+    for (int i = 0; i < n_points; i++) {
+	pts[2*i] = points[2*i] + origin_x;
+	pts[2*i+1] = points[2*i+1] + origin_y;
+    }
+    fill_polygon(n_points, &pts[0]);
+
+    //outline in the current colour, as GDI's Polygon does
+    pts[2*n_points] = pts[0];
+    pts[2*n_points+1] = pts[1];
+    draw_polyline_screen(n_points + 1, &pts[0]);
+}
+
+void bar(int left, int top, int right, int bottom)
+{
+    if (left > right) swap(left, right);  /* Turbo C corrects for badly ordered corners */
+    if (bottom < top) swap(top, bottom);
+    //right and bottom edges excluded, as with the WinBGI FillRect
+    for (int y = top; y < bottom; y++) {
+	fill_span(y + origin_y, left + origin_x, right - 1 + origin_x);
+    }
+}
+
+void bar3d(int left, int top, int right, int bottom, int depth, int topflag)
+{
+    const double tan30 = 1.0/1.73205080756887729352;
+    if (left > right) swap(left, right);
+    if (bottom < top) swap(top, bottom);
+    bar(left+line_settings.thickness, top+line_settings.thickness,
+	right-line_settings.thickness+1, bottom-line_settings.thickness+1);
+
+    int dy = int(depth*tan30);
+    int p[22] = {
+	right, bottom, right, top, left, top, left, bottom, right, bottom,
+	right+depth, bottom-dy, right+depth, top-dy, right, top,
+	right+depth, top-dy, left+depth, top-dy, left, top
+    };
+    drawpoly(topflag ? 11 : 8, p);
+}
+
+void circle(int x, int y, int radius)
+{
+    int ry = (unsigned)radius*aspect_ratio_x/aspect_ratio_y;
+    draw_ellipse_outline(x + origin_x, y + origin_y, radius, ry);
+}
+
+void fillellipse(int x, int y, int rx, int ry)
+{
+    fill_ellipse_area(x + origin_x, y + origin_y, rx, ry);
+    draw_ellipse_outline(x + origin_x, y + origin_y, rx, ry);
+}
+
+void ellipse(int x, int y, int start_angle, int end_angle, int rx, int ry)
+{
+    static vector<int> pts;
+    ac.x = x;
+    ac.y = y;
+    if (start_angle == 0 && end_angle == 360) {
+	draw_ellipse_outline(x + origin_x, y + origin_y, rx, ry);
+	ac.xstart = ac.xend = x + rx;
+	ac.ystart = ac.yend = y;
+	return;
+    }
+    int n = arc_points(x + origin_x, y + origin_y, start_angle, end_angle, rx, ry, pts);
+    draw_polyline_screen(n, &pts[0]);
+    ac.xstart = pts[0] - origin_x; ac.ystart = pts[1] - origin_y;
+    ac.xend = pts[2*n-2] - origin_x; ac.yend = pts[2*n-1] - origin_y;
+}
+
+void arc(int x, int y, int start_angle, int end_angle, int radius)
+{
+    ellipse(x, y, start_angle, end_angle, radius, radius);
+}
+
+void getarccoords(arccoordstype *arccoords)
+{
+    *arccoords = ac;
+}
+
+void sector(int x, int y, int start_angle, int end_angle, int rx, int ry)
+{
+    static vector<int> pts;
+    int n = arc_points(x + origin_x, y + origin_y, start_angle, end_angle, rx, ry, pts);
+    pts.push_back(x + origin_x);
+    pts.push_back(y + origin_y);
+    fill_polygon(n + 1, &pts[0]);
+    pts.push_back(pts[0]);
+    pts.push_back(pts[1]);
+    draw_polyline_screen(n + 2, &pts[0]);
+
+    ac.x = x;
+    ac.y = y;
+    ac.xstart = pts[0] - origin_x; ac.ystart = pts[1] - origin_y;
+    ac.xend = pts[2*n-2] - origin_x; ac.yend = pts[2*n-1] - origin_y;
+}
+
+void pieslice(int x, int y, int start_angle, int end_angle, int radius)
+{
+    sector(x, y, start_angle, end_angle, radius, radius);
+}
+
+//Scanline seed fill up to the border colour, with the current fill pattern
+void floodfill(int x, int y, int border)
+{
+    x += origin_x;
+    y += origin_y;
+    if (x < clip_x1 || x > clip_x2 || y < clip_y1 || y > clip_y2) {
+	return;
+    }
+    unsigned int* bits = active_bits;
+    unsigned int edge = palette_rgba[border & MAXCOLORS];
+    vector<unsigned char> done((size_t)window_width*window_height, 0);
+    vector<int> seeds;
+    seeds.push_back(x);
+    seeds.push_back(y);
+
+    while (!seeds.empty()) {
+	int sy = seeds.back(); seeds.pop_back();
+	int sx = seeds.back(); seeds.pop_back();
+	size_t row = (size_t)sy*window_width;
+	if (done[row + sx] || bits[row + sx] == edge) continue;
+
+	int x1 = sx, x2 = sx;
+	while (x1 > clip_x1 && !done[row + x1 - 1] && bits[row + x1 - 1] != edge) x1--;
+	while (x2 < clip_x2 && !done[row + x2 + 1] && bits[row + x2 + 1] != edge) x2++;
+	fill(done.begin() + row + x1, done.begin() + row + x2 + 1, 1);
+	fill_span(sy, x1, x2);
+
+	for (int ny = sy - 1; ny <= sy + 1; ny += 2) {
+	    if (ny < clip_y1 || ny > clip_y2) continue;
+	    size_t nrow = (size_t)ny*window_width;
+	    for (int nx = x1; nx <= x2; nx++) {
+		if (!done[nrow + nx] && bits[nrow + nx] != edge &&
+		    (nx == x1 || done[nrow + nx - 1] || bits[nrow + nx - 1] == edge)) {
+		    seeds.push_back(nx);
+		    seeds.push_back(ny);
+		}
+	    }
+	}
+    }
+}
+
+unsigned int imagesize(int x1, int y1, int x2, int y2)
+{
+    return 8 + 4*(x2-x1+1)*(y2-y1+1);
+}
+
+//
+// Copies the width x height block at viewport (x1, y1) of the active page to
+// dst, stride pixels per row; the part outside the page is background.
+//
+static void read_block(int x1, int y1, int width, int height, unsigned int* dst, int stride)
+{
+    int sx1 = x1 + origin_x, sx2 = sx1 + width - 1;
+    int cx1 = max(sx1, 0), cx2 = min(sx2, window_width-1);
+    for (int y = 0; y < height; y++, dst += stride) {
+	int sy = y1 + y + origin_y;
+	if (sy < 0 || sy >= window_height || cx1 > cx2) {
+	    fill(dst, dst + width, palette_rgba[0]);
+	    continue;
+	}
+	//the part of the row inside the page is copied, the rest is background
+	fill(dst, dst + (cx1 - sx1), palette_rgba[0]);
+	memcpy(dst + (cx1 - sx1), active_bits + (size_t)sy*window_width + cx1, (cx2 - cx1 + 1)*sizeof(unsigned int));
+	fill(dst + (cx2 - sx1 + 1), dst + width, palette_rgba[0]);
+    }
+}
+
+//
+// Puts the width x height block src (stride pixels per row) at viewport
+// (x, y) of the active page with a putimage() op, clipped to the viewport
+// and combined as plot() does
+//
+static void write_block(int x, int y, const unsigned int* src, int width, int height, int stride, int bitblt)
+{
+    int sx1 = x + origin_x;
+    int cx1 = max(sx1, clip_x1), cx2 = min(sx1 + width - 1, clip_x2);
+    if (cx1 > cx2) {
+	return;
+    }
+    int n = cx2 - cx1 + 1;
+    for (int row = 0; row < height; row++) {
+	int sy = y + row + origin_y;
+	if (sy < clip_y1 || sy > clip_y2) continue;
+	unsigned int* p = active_bits + (size_t)sy*window_width + cx1;
+	const unsigned int* s = src + row*stride + (cx1 - sx1);
+	switch (bitblt) {
+	  case XOR_PUT: for (int i = 0; i < n; i++) p[i] ^= s[i] & 0x00FFFFFF; break;
+	  case OR_PUT:  for (int i = 0; i < n; i++) p[i] |= s[i]; break;
+	  case AND_PUT: for (int i = 0; i < n; i++) p[i] &= s[i]; break;
+	  case NOT_PUT: for (int i = 0; i < n; i++) p[i] = ~s[i] | 0xFF000000u; break;
+	  default:      memcpy(p, s, n*sizeof(unsigned int)); break;
+	}
+	active_tiles[sy] |= tile_mask(cx1, cx2);
+    }
+}
+
+void getimage(int x1, int y1, int x2, int y2, void* image)
+{
+    BGIimage* bi = (BGIimage*)image;
+    bi->width = x2-x1+1;
+    bi->height = y2-y1+1;
+    read_block(x1, y1, bi->width, bi->height, bi->bits, bi->width);
+}
+
+void putimage(int x, int y, void* image, int bitblt)
+{
+    BGIimage* bi = (BGIimage*)image;
+    write_block(x, y, bi->bits, bi->width, bi->height, bi->width, bitblt);
+}
+
+struct bgiemu_image {
+    int width;
+    int height;
+    vector<unsigned int> bits;
+};
+
+bgiemu_image* bgiemu_newimage(int width, int height)
+{
+    bgiemu_image* img = new bgiemu_image;
+    img->width = width;
+    img->height = height;
+    img->bits.resize((size_t)width*height);
+    return img;
+}
+
+void bgiemu_freeimage(bgiemu_image* img)
+{
+    delete img;
+}
+
+void bgiemu_getimage(int x, int y, bgiemu_image* img)
+{
+    read_block(x, y, img->width, img->height, &img->bits[0], img->width);
+}
+
+void bgiemu_putimage(int x, int y, bgiemu_image* img, int sx, int sy, int w, int h, int op)
+{
+    write_block(x, y, &img->bits[0] + (size_t)sy*img->width + sx, w, h, img->width, op);
+}
+
+unsigned int* bgiemu_imagebits(bgiemu_image* img)
+{
+    return &img->bits[0];
+}
+
+void settextstyle(int font, int direction, int char_size)
+{
+    if (char_size > 10) {
+	char_size = 10;
+    }
+    text_settings.direction = direction;
+    text_settings.font = font;
+    text_settings.charsize = char_size;
+}
+
+void settextjustify(int horiz, int vert)
+{
+    text_settings.horiz = horiz;
+    text_settings.vert = vert;
+}
+
+void gettextsettings(textsettingstype* ts)
+{
+    *ts = text_settings;
+}
+
+void setusercharsize(int multx, int divx, int multy, int divy)
+{
+    font_mul_x = multx;
+    font_div_x = divx;
+    font_mul_y = multy;
+    font_div_y = divy;
+    text_settings.charsize = 0;
+}
+
+int textheight(const char* /*str*/)
+{
+    int w, h;
+    char_size(w, h);
+    return h;
+}
+
+int textwidth(const char* str)
+{
+    int w, h;
+    char_size(w, h);
+    return (int)strlen(str)*w;
+}
+
+void outtextxy(int x, int y, const char* str)
+{
+    justified_text(x, y, str);
+}
+
+void outtext(const char* str)
+{
+    justified_text(cp_x, cp_y, str);
+    if (text_settings.direction == HORIZ_DIR && text_settings.horiz == LEFT_TEXT) {
+	cp_x += textwidth(str);
+    }
+}
+
+//Headless: there is no keyboard, so getch() reports ESC instead of blocking
+int kbhit()
+{
+    return 0;
+}
+
+int getch()
+{
+    return ESC;
+}
+
+void delay(unsigned msec)
+{
+    this_thread::sleep_for(chrono::milliseconds(msec));
+}
+
+bool mouseup() { return false; }
+bool mousedown() { return false; }
+void clearmouse() {}
+int mouseclickx() { return 0; }
+int mouseclicky() { return 0; }
+int mousecurrentx() { return 0; }
+int mousecurrenty() { return 0; }
+int whichmousebutton() { return LEFT_BUTTON; }
+
+unsigned int bgiemu_color_rgba(int color)
+{
+    return palette_rgba[color & MAXCOLORS];
+}
+
+unsigned int const* bgiemu_framebuffer(int page)
+{
+    return page_bits(page & (MAX_PAGES-1));
+}
+
+int bgiemu_save_ppm(int page, char const* file_name)
+{
+    FILE* f = fopen(file_name, "wb");
+    if (f == NULL) {
+	return grIOerror;
+    }
+    const unsigned int* bits = bgiemu_framebuffer(page);
+    vector<unsigned char> rgb((size_t)window_width*3);
+    fprintf(f, "P6\n%d %d\n255\n", window_width, window_height);
+    for (int y = 0; y < window_height; y++) {
+	for (int x = 0; x < window_width; x++) {
+	    unsigned int p = bits[(size_t)y*window_width + x];
+	    rgb[3*x] = (unsigned char)(p & 0xFF);
+	    rgb[3*x+1] = (unsigned char)((p >> 8) & 0xFF);
+	    rgb[3*x+2] = (unsigned char)((p >> 16) & 0xFF);
+	}
+	fwrite(&rgb[0], 1, rgb.size(), f);
+    }
+    fclose(f);
+    return grOk;
+}
+
+#endif
@@ -1,2 +1,169 @@
+#include <string.h>
+#include <chrono>
+
 #include "sprites.h"
 
+//Width of the atlas image; poses are packed into shelves across it
+static const int ATLAS_WIDTH = 2048;
+
+//Slack around the sprite bounds for outlines
+static const int CELL_MARGIN = 2;
+
+SpriteAtlas::SpriteAtlas(float maxAngle_, float angleStep_, long maxPixels_){
+	maxAngle = maxAngle_;
+	angleStep = angleStep_;
+	maxPixels = maxPixels_;
+	builtSx = builtSy = 0.0f;
+	atlas = NULL;
+	atlasPixels = 0;
+	ms = 0.0;
+}
+
+SpriteAtlas::~SpriteAtlas(){
+	bgiemu_freeimage(atlas);
+}
+
+int SpriteAtlas::rodCell(float angle) const{
+	if (atlas == NULL || angle < -maxAngle || angle > maxAngle)
+		return -1;
+	int i = (int)floor((angle + maxAngle) / angleStep + 0.5f);
+	return i < (int)rodCells.size() ? i : -1;
+}
+
+void SpriteAtlas::put(const Cell& c, int x, int y){
+	bgiemu_putimage(x + c.dx, y + c.dy, atlas, c.sx, c.sy, c.w, c.h, AND_PUT);
+	bgiemu_putimage(x + c.dx, y + c.dy, atlas, c.sx + c.w, c.sy, c.w, c.h, OR_PUT);
+}
+
+void SpriteAtlas::drawCart(Cart& cart){
+	if (atlas == NULL)
+		cart.draw();
+	else
+		put(cartCell, worldView.x(cart.getX()), worldView.y(0.0f));
+}
+
+void SpriteAtlas::drawRod(Rod& rod){
+	int i = rodCell(rod.getAngle());
+	if (i < 0)
+		rod.draw();
+	else
+		put(rodCells[i], worldView.x(rod.getX()), worldView.y(0.0f));
+}
+
+static DeviceRectType placed(int dx, int dy, int w, int h, int x, int y){
+	DeviceRectType r = { x + dx, y + dy, x + dx + w - 1, y + dy + h - 1 };
+	return r;
+}
+
+DeviceRectType SpriteAtlas::cartBounds(Cart& cart){
+	if (atlas == NULL)
+		return cart.bounds();
+	return placed(cartCell.dx, cartCell.dy, cartCell.w, cartCell.h, worldView.x(cart.getX()), worldView.y(0.0f));
+}
+
+DeviceRectType SpriteAtlas::rodBounds(Rod& rod){
+	int i = rodCell(rod.getAngle());
+	if (i < 0)
+		return rod.bounds();
+	const Cell& c = rodCells[i];
+	return placed(c.dx, c.dy, c.w, c.h, worldView.x(rod.getX()), worldView.y(0.0f));
+}
+
+bool SpriteAtlas::build(const Cart& cart_, const Rod& rod_, int scratchPage){
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	Cart cart = cart_;
+	Rod rod = rod_;
+	int n = (int)floor(2.0f * maxAngle / angleStep + 0.5f) + 1;
+
+	bgiemu_freeimage(atlas);
+	atlas = NULL;
+	atlasPixels = 0;
+	ms = 0.0;
+	builtSx = worldView.xScale();
+	builtSy = worldView.yScale();
+
+	//every pose is drawn with the cart and the pivot at world x = 0
+	int refX = worldView.x(0.0f), refY = worldView.y(0.0f);
+	vector<DeviceRectType> bounds(n + 1);
+	cart.setX(0.0f);
+	rod.setX(0.0f);
+	bounds[0] = cart.bounds();
+	for (int i = 0; i < n; i++) {
+		rod.setAngle(-maxAngle + i * angleStep);
+		bounds[i + 1] = rod.bounds();
+	}
+
+	//shelf packing, mask and colours side by side
+	vector<Cell> cells(n + 1);
+	int shelfX = 0, shelfY = 0, shelfH = 0, maxW = 0, maxH = 0;
+	for (int i = 0; i <= n; i++) {
+		Cell& c = cells[i];
+		c.dx = bounds[i].x1 - CELL_MARGIN - refX;
+		c.dy = bounds[i].y1 - CELL_MARGIN - refY;
+		c.w = bounds[i].x2 - bounds[i].x1 + 1 + 2 * CELL_MARGIN;
+		c.h = bounds[i].y2 - bounds[i].y1 + 1 + 2 * CELL_MARGIN;
+		//a pose must fit across the atlas, and be drawn whole on the page
+		if (2 * c.w > ATLAS_WIDTH || refX + c.dx < 0 || refY + c.dy < 0
+			|| refX + c.dx + c.w - 1 > getmaxx() || refY + c.dy + c.h - 1 > getmaxy())
+			return false;
+		if (shelfX + 2 * c.w > ATLAS_WIDTH) {
+			shelfY += shelfH;
+			shelfX = shelfH = 0;
+		}
+		c.sx = shelfX;
+		c.sy = shelfY;
+		shelfX += 2 * c.w;
+		shelfH = max(shelfH, c.h);
+		maxW = max(maxW, c.w);
+		maxH = max(maxH, c.h);
+	}
+	int atlasHeight = shelfY + shelfH;
+	if ((long)ATLAS_WIDTH * atlasHeight > maxPixels)
+		return false;
+
+	//each pose is drawn over black and over white: pixels that differ are
+	//background (mask all ones, colour 0), the rest are the sprite (mask 0)
+	bgiemu_image* overBlack = bgiemu_newimage(maxW, maxH);
+	bgiemu_image* overWhite = bgiemu_newimage(maxW, maxH);
+	atlas = bgiemu_newimage(ATLAS_WIDTH, atlasHeight);
+	unsigned int* dst = bgiemu_imagebits(atlas);
+	memset(dst, 0, (size_t)ATLAS_WIDTH * atlasHeight * sizeof(unsigned int));
+
+	setactivepage(scratchPage);
+	for (int i = 0; i <= n; i++) {
+		const Cell& c = cells[i];
+		int x = refX + c.dx, y = refY + c.dy;
+		if (i > 0)
+			rod.setAngle(-maxAngle + (i - 1) * angleStep);
+		for (int pass = 0; pass < 2; pass++) {
+			setfillstyle(SOLID_FILL, pass == 0 ? BLACK : WHITE);
+			bar(x, y, x + c.w, y + c.h);  //bar() leaves out the right and bottom edges
+			if (i == 0)
+				cart.draw();
+			else
+				rod.draw();
+			bgiemu_getimage(x, y, pass == 0 ? overBlack : overWhite);
+		}
+
+		const unsigned int* a = bgiemu_imagebits(overBlack);
+		const unsigned int* b = bgiemu_imagebits(overWhite);
+		for (int row = 0; row < c.h; row++) {
+			unsigned int* mask = dst + (size_t)(c.sy + row) * ATLAS_WIDTH + c.sx;
+			unsigned int* colour = mask + c.w;
+			for (int col = 0; col < c.w; col++) {
+				unsigned int p = a[row * maxW + col];
+				bool sprite = p == b[row * maxW + col];
+				mask[col] = sprite ? 0 : 0xFFFFFFFFu;
+				colour[col] = sprite ? p : 0;
+			}
+		}
+	}
+	bgiemu_freeimage(overBlack);
+	bgiemu_freeimage(overWhite);
+
+	cartCell = cells[0];
+	rodCells.assign(cells.begin() + 1, cells.end());
+	atlasPixels = (long)ATLAS_WIDTH * atlasHeight;
+	ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+	return true;
+}
@@ -9,10 +9,13 @@
 #include <iostream>
 #include <math.h>
 
+#include <vector>
+
 #include "graphics.h"
 #include "transform.h"
 
 extern BoundaryType worldBoundary,deviceBoundary;
+extern ViewportTransform worldView;
 extern char keyPressed[5];
 
 enum Position {LEFT_SIDE, RIGHT_SIDE};
@@ -47,7 +50,6 @@ public:
 	  Rod(float sx = 0.0f, float sy = 0.0f, float a=0.0f){
 		  x = sx;
 		  y = sy;
-		  angle = a;
 		  length=2.0f;
 		  halfWidth=0.078125f;
 		  halfAngle=0.04f; //not used
@@ -55,110 +57,43 @@ public:
 		  axleHeight=0.16f;
         theta_b = 0.03904265f; //0.04
 		  
+		  //outline at angle 0, relative to the pivot: the top corners lie r
+		  //from the pivot at +-theta_b, the bottom corners halfWidth either side
+		  float r = sqrt(halfWidth*halfWidth + length*length);
+		  local[0] = -r*sin(theta_b);  local[1] = r*cos(theta_b);  //top left
+		  local[2] = r*sin(theta_b);   local[3] = r*cos(theta_b);  //top right
+		  local[4] = halfWidth;        local[5] = 0.0f;            //bottom right
+		  local[6] = -halfWidth;       local[7] = 0.0f;            //bottom left
+
+		  setAngle(a);
 	  } 
     
 	  void setAngle(float a){
 		  angle = a;
+		  sinAngle = sin(a);
+		  cosAngle = cos(a);
 	  }
 	  void setX(const float& _x){
 		 x = _x;
 	  }
+	  float getX() const { return x; }
+	  float getAngle() const { return angle; }
 	  
+	  //Device coordinates of the rod outline: the local outline rotated
+	  //clockwise by angle, with the one sin/cos pair from setAngle
+	  void devicePolygon(int poly[8]){
+		  float points[8];
+		  for (int i = 0; i < 8; i += 2) {
+			  points[i] = x + local[i]*cosAngle + local[i+1]*sinAngle;
+			  points[i+1] = local[i+1]*cosAngle - local[i]*sinAngle;
+		  }
+		  worldView.map(points, poly, 4);
+	  }
+
 	  void draw(){
 		  
 		  int poly[8];
-		  float points[8];
-		  	   
-//Vertices of a polynomial
-		  
-		  float r=0.0; //r=x/cos(theta) 
-		  
-		  r = float(sqrt(pow(halfWidth,2) + pow(length,2)));
-		  
-		  //top left
-		  points[0] = x + ((sin(angle - theta_b)*r));
-		  points[1] = (cos(angle - theta_b)*r);
-		  
-		  //top right
-		  points[2] = x + (sin(angle + theta_b)*r); //WORKS fine
-		  //points[2] = sin(angle + theta_b);  //WORKS fine
-		  points[3] = cos(angle + theta_b)*r; //* original
-		 
-////////////
-		  
-		  float theta_p = 90.0f*3.14f/180.0f;
-		  
-		  //bottom right
-		  points[4] = x + ((sin(angle + theta_p)*halfWidth));
-		  points[5] = (cos(angle + theta_p)*halfWidth);
-		  		  		  
-		  //bottom left				  
-		  points[6] = x + ((sin(angle - theta_p)*halfWidth));
-		  points[7] = (cos(angle - theta_p)*halfWidth);
-		  
-		  //~ fillellipse(xDev(worldBoundary,deviceBoundary,points[6]),
-		              //~ yDev(worldBoundary,deviceBoundary,points[7]),10,10);
-		  
-	/*	
-	//this works, too!
-	
-	if(angle < 0.0){	 		  
-		  //bottom right
-		  //points[4] = x + (cos(angle) * theta_b);
-		  points[4] = x + ( halfWidth *   cos(angle + (90.0*3.14/180.0) ));
-		  //points[5] = -sin(angle) * theta_b; //* original
-		  points[5] = ( halfWidth *   sin(angle + (90.0*3.14/180.0) ));
-		  		  
-		  //bottom left
-		  //points[6] = x - (cos(angle) * theta_b);
-		  points[6] = x + ( halfWidth *   cos(angle - (90.0*3.14/180.0) ));
-		  //points[7] = (sin(angle) * theta_b);
-		  points[7] = ( halfWidth *   sin(angle - (90.0*3.14/180.0) ));
-	} else if(angle > 0.0) {
-		
-		 //bottom right
-		 points[4] = x + ( halfWidth *   cos(angle-(90.0*3.14/180.0) ));
-		 points[5] = ( halfWidth *   sin(angle - (90.0*3.14/180.0) ));
-		  		  
-		 //bottom left
-		 points[6] = x + ( halfWidth *   cos(angle + (90.0*3.14/180.0) ));
-		 points[7] = ( halfWidth *   sin(angle + (90.0*3.14/180.0) ));
-	} else {
-		
-		 //bottom right
-		 points[4] = x + ( halfWidth);
-		 points[5] = halfWidth *   sin(angle);
-		  		  
-		 //bottom left
-		 points[6] = x - ( halfWidth);
-		 points[7] = halfWidth *   sin(angle);
-	}
-		  
-		*/  
-		  //~ //top left
-		  //~ points[0] = x + sin(angle - theta_b);
-		  //~ points[1] = cos(angle - theta_b);
-		  
-		  //~ //top right
-		  //~ points[2] = x + sin(angle + theta_b); //WORKS fine
-		  //~ //points[2] = sin(angle + theta_b);  //WORKS fine
-		  //~ points[3] = cos(angle + theta_b); //* original
-		 
-		
-		 		  
-		  //~ //bottom right
-		  //~ points[4] = x + (cos(angle) * theta_b);
-		  //~ points[5] = -sin(angle) * theta_b; //* original
-		  		  
-		  //~ //bottom left
-		  //~ points[6] = x - (cos(angle) * theta_b);
-		  //~ points[7] = (sin(angle) * theta_b);
-		  
-//~ //Vertices of a polynomial		  
-		  for(int i=0; i < 8; i = i + 2){
-	        poly[i] = xDev(worldBoundary,deviceBoundary,points[i]);
-	        poly[i+1] = yDev(worldBoundary,deviceBoundary,points[i+1]);
-	     }     
+		  devicePolygon(poly);
         setcolor(WHITE);
 		  setfillstyle(SOLID_FILL, LIGHTBLUE);     
 		  fillpoly(4,poly);   
@@ -166,22 +101,36 @@ public:
 		  
 		  setfillstyle(SOLID_FILL, DARKGRAY);    		
 		  		  
-		  int radius = (int)((halfWidth/2.0f) * ((deviceBoundary.x2-deviceBoundary.x1)/(worldBoundary.x2-worldBoundary.x1)));
-		  //draw wheels
-		  fillellipse(xDev(worldBoundary,deviceBoundary,x),
-		              yDev(worldBoundary,deviceBoundary,pivotHeight/3),radius,radius);
-  		  
-		  
+		  int cx, cy, radius;
+		  pivot(cx, cy, radius);
+		  fillellipse(cx, cy, radius, radius);
+	  }
+
+	  //Device rectangle covering everything draw() paints
+	  DeviceRectType bounds(){
+		  int poly[8], cx, cy, radius;
+		  devicePolygon(poly);
+		  pivot(cx, cy, radius);
+		  return unionRect(polygonBounds(4, poly), circleBounds(cx, cy, radius));
 	  }
 private:
+	  //Device centre and radius of the pivot disc
+	  void pivot(int& cx, int& cy, int& radius){
+		  cx = worldView.x(x);
+		  cy = worldView.y(pivotHeight/3);
+		  radius = (int)((halfWidth/2.0f) * worldView.xScale());
+	  }
+
     float x, y;
     float angle;
+    float sinAngle, cosAngle;
     float length;
     float halfWidth;
     float halfAngle;
     float pivotHeight;
     float axleHeight;
     float theta_b;
+    float local[8];  //outline at angle 0, (x, y) pairs
     
 
 };
@@ -202,34 +151,26 @@ public:
 		  halfWheelBase=0.265625;
 		  cartHalfWidth= 0.25;
 		  
+		  //body corners relative to (x, y)
+		  local[0] = -cartHalfWidth;  local[1] = height;  //top left
+		  local[2] = cartHalfWidth;   local[3] = height;  //top right
+		  local[4] = cartHalfWidth;   local[5] = 0.0f;    //bottom right
+		  local[6] = -cartHalfWidth;  local[7] = 0.0f;    //bottom left
 	  }   
+	  //Device coordinates of the cart body
+	  void devicePolygon(int poly[8]){
+		  float points[8];
+		  for (int i = 0; i < 8; i += 2) {
+			  points[i] = x + local[i];
+			  points[i+1] = y + local[i+1];
+		  }
+		  worldView.map(points, poly, 4);
+	  }
+
 	  void draw(){
 		  
 		  int poly[8];
-		  float points[8];
-		  
-//Vertices of a polynomial
-		  //top left
-		  points[0] = x - cartHalfWidth;
-		  points[1] = y + height;
-		  
-		  //top right
-		  points[2] = x + cartHalfWidth;
-		  points[3] = y + height;
-		  
-		  //bottom right
-		  points[4] = x + cartHalfWidth;
-		  points[5] = y;
-		  
-		  //bottom left
-		  points[6] = x - cartHalfWidth;
-		  points[7] = y;
-		  
-//Vertices of a polynomial		  
-		  for(int i=0; i < 8; i = i + 2){
-	        poly[i] = xDev(worldBoundary,deviceBoundary,points[i]);
-	        poly[i+1] = yDev(worldBoundary,deviceBoundary,points[i+1]);
-	     }     
+		  devicePolygon(poly);
         setcolor(WHITE);
 		  setfillstyle(SOLID_FILL, RED);     
 		  fillpoly(4,poly);   
@@ -239,30 +180,34 @@ public:
 		  
 		  setfillstyle(SOLID_FILL, DARKGRAY);    		
 		  		  
-		  int radius = int(wheelRadius * ((deviceBoundary.x2-deviceBoundary.x1)/(worldBoundary.x2-worldBoundary.x1)));
-		  //cout << "radius = " << radius << endl;
+		  int leftX, rightX, wheelY, radius;
+		  wheels(leftX, rightX, wheelY, radius);
 		  //draw wheels
-		  fillellipse(xDev(worldBoundary,deviceBoundary,x + (cartHalfWidth/2)),
-		              yDev(worldBoundary,deviceBoundary,y),radius,radius);
-		  fillellipse(xDev(worldBoundary,deviceBoundary,x - (cartHalfWidth/2)),
-		              yDev(worldBoundary,deviceBoundary,y),radius,radius);	
+		  fillellipse(rightX, wheelY, radius, radius);
+		  fillellipse(leftX, wheelY, radius, radius);
 		  setcolor(BLACK);
-		  circle(xDev(worldBoundary,deviceBoundary,x + (cartHalfWidth/2)),
-		              yDev(worldBoundary,deviceBoundary,y),radius);
-		  circle(xDev(worldBoundary,deviceBoundary,x - (cartHalfWidth/2)),
-		              yDev(worldBoundary,deviceBoundary,y),radius);	
+		  circle(rightX, wheelY, radius);
+		  circle(leftX, wheelY, radius);
 		  
 		  //draw spindle
         setfillstyle(SOLID_FILL, LIGHTGRAY);
-        fillellipse(xDev(worldBoundary,deviceBoundary,x + (cartHalfWidth/2)),
-		              yDev(worldBoundary,deviceBoundary,y),radius/4,radius/4);
-		  fillellipse(xDev(worldBoundary,deviceBoundary,x - (cartHalfWidth/2)),
-		              yDev(worldBoundary,deviceBoundary,y),radius/4,radius/4);	
+        fillellipse(rightX, wheelY, radius/4, radius/4);
+		  fillellipse(leftX, wheelY, radius/4, radius/4);
+	  }
+
+	  //Device rectangle covering everything draw() paints
+	  DeviceRectType bounds(){
+		  int poly[8], leftX, rightX, wheelY, radius;
+		  devicePolygon(poly);
+		  wheels(leftX, rightX, wheelY, radius);
+		  DeviceRectType r = unionRect(polygonBounds(4, poly), circleBounds(rightX, wheelY, radius));
+		  return unionRect(r, circleBounds(leftX, wheelY, radius));
 	  }
 
     void setX(const float& _x){
 		 x = _x;
 	 }		 
+	 float getX() const { return x; }
 	
 private:
     float x, y;
@@ -272,9 +217,70 @@ private:
     float wheelRadius;
     float halfWheelBase;
     float cartHalfWidth;
+    float local[8];  //body corners relative to (x, y)
+
+	  //Device centres of the two wheels and their radius
+	  void wheels(int& leftX, int& rightX, int& wheelY, int& radius){
+		  leftX = worldView.x(x - (cartHalfWidth/2));
+		  rightX = worldView.x(x + (cartHalfWidth/2));
+		  wheelY = worldView.y(y);
+		  radius = int(wheelRadius * worldView.xScale());
+	  }
 
 };
 
 
 
+//Pre-rasterized cart and rod for the current worldView scale: the cart
+//once, and the rod (with its pivot disc) at every angleStep out to
+//+-maxAngle, packed into one bgiemu_image.  A sprite is put as a mask
+//(AND_PUT) and then its colours (OR_PUT) at the device position of the
+//cart or pivot, so it lands within a pixel of the vector drawing.  Rod
+//angles outside the range are drawn as vectors, and so is everything at a
+//scale where the atlas would not fit in maxPixels (high zoom).
+class SpriteAtlas{
+
+public:
+	SpriteAtlas(float maxAngle = 12.0f * (M_PI / 180.0f), float angleStep = 0.5f * (M_PI / 180.0f),
+		long maxPixels = 8L * 1024 * 1024);
+	~SpriteAtlas();
+
+	//Draws every pose on scratchPage, which is left active.  False if the
+	//atlas would be too big, in which case the draws stay vector.
+	bool build(const Cart& cart, const Rod& rod, int scratchPage);
+
+	//False when worldView has been rescaled since build()
+	bool current() const { return builtSx == worldView.xScale() && builtSy == worldView.yScale(); }
+
+	void drawCart(Cart& cart);
+	void drawRod(Rod& rod);
+
+	//Device rectangle covering what drawCart()/drawRod() paint
+	DeviceRectType cartBounds(Cart& cart);
+	DeviceRectType rodBounds(Rod& rod);
+
+	bool ready() const { return atlas != NULL; }
+	int poses() const { return (int)rodCells.size() + 1; }
+	long pixels() const { return atlasPixels; }
+	double buildMs() const { return ms; }
+
+private:
+	//A pose: its rectangle relative to the device reference point, and
+	//where it is in the atlas (mask at sx, colours at sx + w)
+	struct Cell { int dx, dy, sx, sy, w, h; };
+
+	int rodCell(float angle) const;  //-1 if the rod is drawn as vectors
+	void put(const Cell& c, int x, int y);
+
+	float maxAngle, angleStep;
+	long maxPixels;
+	float builtSx, builtSy;
+	bgiemu_image* atlas;
+	long atlasPixels;
+	Cell cartCell;
+	vector<Cell> rodCells;
+	double ms;
+};
+
+
 #endif
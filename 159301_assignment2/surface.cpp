@@ -0,0 +1,258 @@
+#include "surface.h"
+#include "graphics.h"
+
+//Oldest points are let go of in blocks once the trajectory is this long
+static const int TRAJECTORY_POINTS = 2000;
+static const int TRAJECTORY_DROP = 500;
+
+//Mesh segments are coloured by height in these bands, low to high
+static const int meshColours[] = { BLUE, LIGHTBLUE, CYAN, LIGHTGREEN, YELLOW, LIGHTRED, RED };
+static const int MESH_BANDS = sizeof(meshColours) / sizeof(meshColours[0]);
+
+//A pixel for bgiemu_imagebits()
+static unsigned int imagePixel(int r, int g, int b){
+#ifdef BGI_SOFTWARE
+	return 0xFF000000u | (b << 16) | (g << 8) | r;
+#else
+	return (r << 16) | (g << 8) | b;
+#endif
+}
+
+//0 <= t <= 1 from blue through cyan, green and yellow to red
+static unsigned int heatColour(float t){
+	float c[3];
+	for (int i = 0; i < 3; i++) {
+		c[i] = 1.5f - fabs(4.0f * t - 3.0f + i);
+		c[i] = c[i] < 0.0f ? 0.0f : c[i] > 1.0f ? 1.0f : c[i];
+	}
+	return imagePixel((int)(c[0] * 255.0f), (int)(c[1] * 255.0f), (int)(c[2] * 255.0f));
+}
+
+static float clampUnit(float t){
+	return t < 0.0f ? 0.0f : t > 1.0f ? 1.0f : t;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+SurfaceViewer::SurfaceViewer(int meshLines_){
+	meshLines = meshLines_ < 2 ? 2 : meshLines_;
+	x0 = y0 = zMin = 0.0f;
+	x1 = y1 = zMax = 1.0f;
+	heatmap = NULL;
+	heatLevel = 0;
+	heatmapReady = false;
+	setView(0.6f, 0.5f);
+}
+
+SurfaceViewer::~SurfaceViewer(){
+	bgiemu_freeimage(heatmap);
+}
+
+void SurfaceViewer::setGrid(const vector<float>& x, const vector<float>& y, const vector<vector<float> >& z){
+	levels.clear();
+	heatmapReady = false;
+	trajectory.clear();
+	if (x.size() < 2 || y.size() < 2 || z.size() < y.size())
+		return;
+
+	x0 = x.front();
+	x1 = x.back();
+	y0 = y.front();
+	y1 = y.back();
+
+	Level base;
+	base.cols = (int)x.size();
+	base.rows = (int)y.size();
+	base.z.resize((size_t)base.cols * base.rows);
+	zMin = zMax = z[0][0];
+	for (int row = 0; row < base.rows; row++) {
+		for (int col = 0; col < base.cols; col++) {
+			float v = z[row][col];
+			base.z[(size_t)row * base.cols + col] = v;
+			zMin = min(zMin, v);
+			zMax = max(zMax, v);
+		}
+	}
+	if (zMax <= zMin)
+		zMax = zMin + 1.0f;
+	levels.push_back(base);
+
+	//each level averages 2x2 cells of the one below; odd edges average fewer
+	while (levels.back().cols > 2 || levels.back().rows > 2) {
+		const Level& fine = levels.back();
+		Level coarse;
+		coarse.cols = (fine.cols + 1) / 2;
+		coarse.rows = (fine.rows + 1) / 2;
+		coarse.z.resize((size_t)coarse.cols * coarse.rows);
+		for (int row = 0; row < coarse.rows; row++) {
+			for (int col = 0; col < coarse.cols; col++) {
+				float sum = 0.0f;
+				int n = 0;
+				for (int r = 2 * row; r < 2 * row + 2 && r < fine.rows; r++)
+					for (int c = 2 * col; c < 2 * col + 2 && c < fine.cols; c++, n++)
+						sum += fine.z[(size_t)r * fine.cols + c];
+				coarse.z[(size_t)row * coarse.cols + col] = sum / n;
+			}
+		}
+		levels.push_back(coarse);
+	}
+}
+
+void SurfaceViewer::setView(float yaw, float pitch){
+	yawAngle = yaw;
+	pitchAngle = pitch;
+	sinYaw = sin(yaw);
+	cosYaw = cos(yaw);
+	sinPitch = sin(pitch);
+	cosPitch = cos(pitch);
+}
+
+int SurfaceViewer::meshLevel() const{
+	int level = 0;
+	while (level + 1 < (int)levels.size() && (levels[level].cols > meshLines || levels[level].rows > meshLines))
+		level++;
+	return level;
+}
+
+//u, v in [-1, 1] across the grid and w in [-0.5, 0.5] up the z range
+void SurfaceViewer::project(float u, float v, float w, const DeviceRectType& r, int& px, int& py) const{
+	float across = u * cosYaw - v * sinYaw;
+	float depth = u * sinYaw + v * cosYaw;
+	float up = w * cosPitch + depth * sinPitch;
+
+	//a turned grid reaches sqrt(2) from the centre, and the height adds 0.5
+	float scale = min(r.x2 - r.x1, r.y2 - r.y1) / 3.8f;
+	px = (r.x1 + r.x2) / 2 + (int)floor(across * scale + 0.5f);
+	py = (r.y1 + r.y2) / 2 - (int)floor(up * scale + 0.5f);
+}
+
+void SurfaceViewer::heatmapPoint(float x, float y, const DeviceRectType& r, int& px, int& py) const{
+	float u = clampUnit((x - x0) / (x1 - x0)), v = clampUnit((y - y0) / (y1 - y0));
+	px = r.x1 + (int)(u * (r.x2 - r.x1) + 0.5f);
+	py = r.y2 - (int)(v * (r.y2 - r.y1) + 0.5f);
+}
+
+void SurfaceViewer::drawHeatmap(const DeviceRectType& r){
+	int w = r.x2 - r.x1 + 1, h = r.y2 - r.y1 + 1;
+	if (!ready() || w <= 0 || h <= 0)
+		return;
+
+	if (!heatmapReady || r.x1 != heatRect.x1 || r.y1 != heatRect.y1 || r.x2 != heatRect.x2 || r.y2 != heatRect.y2) {
+		if (!heatmapReady || w != heatRect.x2 - heatRect.x1 + 1 || h != heatRect.y2 - heatRect.y1 + 1) {
+			bgiemu_freeimage(heatmap);
+			heatmap = bgiemu_newimage(w, h);
+		}
+		heatRect = r;
+
+		heatLevel = 0;
+		while (heatLevel + 1 < (int)levels.size() && (levels[heatLevel].cols > w || levels[heatLevel].rows > h))
+			heatLevel++;
+		const Level& grid = levels[heatLevel];
+
+		unsigned int colours[256];
+		for (int i = 0; i < 256; i++)
+			colours[i] = heatColour(i / 255.0f);
+		vector<int> col(w);
+		for (int px = 0; px < w; px++)
+			col[px] = px * grid.cols / w;
+
+		//the top row of the image is the highest y
+		unsigned int* bits = bgiemu_imagebits(heatmap);
+		float toIndex = 255.0f / (zMax - zMin);
+		for (int py = 0; py < h; py++) {
+			const float* z = &grid.z[(size_t)((h - 1 - py) * grid.rows / h) * grid.cols];
+			for (int px = 0; px < w; px++)
+				bits[(size_t)py * w + px] = colours[(int)((z[col[px]] - zMin) * toIndex + 0.5f)];
+		}
+		heatmapReady = true;
+	}
+	bgiemu_putimage(r.x1, r.y1, heatmap, 0, 0, w, h, COPY_PUT);
+}
+
+void SurfaceViewer::drawMesh(const DeviceRectType& r){
+	if (!ready())
+		return;
+
+	const Level& grid = levels[meshLevel()];
+	vector<int> px((size_t)grid.cols * grid.rows), py(px.size());
+	vector<int> band(px.size());
+	for (int row = 0; row < grid.rows; row++) {
+		for (int col = 0; col < grid.cols; col++) {
+			size_t i = (size_t)row * grid.cols + col;
+			float w = (grid.z[i] - zMin) / (zMax - zMin);
+			project(2.0f * col / (grid.cols - 1) - 1.0f, 2.0f * row / (grid.rows - 1) - 1.0f, w - 0.5f, r, px[i], py[i]);
+			band[i] = min((int)(w * MESH_BANDS), MESH_BANDS - 1);
+		}
+	}
+
+	//a segment takes the colour of its higher end
+	int colour = -1;
+	for (int row = 0; row < grid.rows; row++) {
+		for (int col = 0; col < grid.cols; col++) {
+			size_t i = (size_t)row * grid.cols + col;
+			if (col + 1 < grid.cols) {
+				int c = meshColours[max(band[i], band[i + 1])];
+				if (c != colour)
+					setcolor(colour = c);
+				line(px[i], py[i], px[i + 1], py[i + 1]);
+			}
+			if (row + 1 < grid.rows) {
+				size_t j = i + grid.cols;
+				int c = meshColours[max(band[i], band[j])];
+				if (c != colour)
+					setcolor(colour = c);
+				line(px[i], py[i], px[j], py[j]);
+			}
+		}
+	}
+}
+
+void SurfaceViewer::addState(float x, float y, float z){
+	if (!ready())
+		return;
+
+	const Level& grid = levels[heatLevel];
+	State s = { x, y, z };
+	if (!trajectory.empty()) {
+		const State& last = trajectory.back();
+		int col = (int)(clampUnit((x - x0) / (x1 - x0)) * (grid.cols - 1) + 0.5f);
+		int row = (int)(clampUnit((y - y0) / (y1 - y0)) * (grid.rows - 1) + 0.5f);
+		int lastCol = (int)(clampUnit((last.x - x0) / (x1 - x0)) * (grid.cols - 1) + 0.5f);
+		int lastRow = (int)(clampUnit((last.y - y0) / (y1 - y0)) * (grid.rows - 1) + 0.5f);
+		if (col == lastCol && row == lastRow) {
+			trajectory.back() = s;
+			return;
+		}
+	}
+	if ((int)trajectory.size() >= TRAJECTORY_POINTS)
+		trajectory.erase(trajectory.begin(), trajectory.begin() + TRAJECTORY_DROP);
+	trajectory.push_back(s);
+}
+
+void SurfaceViewer::drawTrajectory(const DeviceRectType& heat, const DeviceRectType& mesh){
+	if (!ready() || trajectory.empty())
+		return;
+
+	setcolor(WHITE);
+	int hx = 0, hy = 0, mx = 0, my = 0;
+	for (size_t i = 0; i < trajectory.size(); i++) {
+		const State& s = trajectory[i];
+		int x, y;
+		heatmapPoint(s.x, s.y, heat, x, y);
+		if (i > 0)
+			line(hx, hy, x, y);
+		hx = x;
+		hy = y;
+
+		float u = 2.0f * clampUnit((s.x - x0) / (x1 - x0)) - 1.0f, v = 2.0f * clampUnit((s.y - y0) / (y1 - y0)) - 1.0f;
+		project(u, v, clampUnit((s.z - zMin) / (zMax - zMin)) - 0.5f, mesh, x, y);
+		if (i > 0)
+			line(mx, my, x, y);
+		mx = x;
+		my = y;
+	}
+
+	//the current state
+	circle(hx, hy, 3);
+	circle(mx, my, 3);
+}
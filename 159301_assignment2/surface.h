@@ -0,0 +1,82 @@
+#ifndef __SURFACE_H__
+#define __SURFACE_H__
+
+#include <vector>
+
+#include "transform.h"
+
+using namespace std;
+
+struct bgiemu_image;
+
+/////////////////////////////////////////////////////
+//Viewer for a control surface z(x, y) sampled on a regular grid, such as
+//the one generateControlSurface_Angle_vs_Angle_Dot() leaves in dataSet:
+//  heatmap  the grid colour-mapped from blue (lowest z) to red (highest)
+//  mesh     a wireframe turned by yaw and tilted by pitch
+//and a trajectory of states (x, y, z) over both.
+//
+//setGrid() keeps a pyramid of the grid, each level the 2x2 means of the one
+//below.  The heatmap samples the finest level no bigger than its rectangle
+//and the mesh the finest level with at most meshLines lines each way, so
+//the cost of drawing follows the size on screen, not the size of the grid.
+class SurfaceViewer{
+
+public:
+	SurfaceViewer(int meshLines = 64);
+	~SurfaceViewer();
+
+	//z[row][col] is the surface at (x[col], y[row]); x and y evenly spaced
+	void setGrid(const vector<float>& x, const vector<float>& y, const vector<vector<float> >& z);
+	bool ready() const { return !levels.empty(); }
+
+	//Mesh rotation in radians: yaw about the z axis, pitch of the view above the x-y plane
+	void setView(float yaw, float pitch);
+	float yaw() const { return yawAngle; }
+	float pitch() const { return pitchAngle; }
+
+	//Drawn on the active page, filling r.  The heatmap is rasterized into
+	//an image once and put from it while r and the grid stay the same.
+	void drawHeatmap(const DeviceRectType& r);
+	void drawMesh(const DeviceRectType& r);
+
+	//The trajectory: points that fall on the last point's heatmap cell
+	//replace it, so it grows only as fast as the state moves across the grid
+	void addState(float x, float y, float z);
+	void clearTrajectory() { trajectory.clear(); }
+	void drawTrajectory(const DeviceRectType& heatmap, const DeviceRectType& mesh);
+
+	int columns(int level = 0) const { return levels[level].cols; }
+	int rows(int level = 0) const { return levels[level].rows; }
+	int noOfLevels() const { return (int)levels.size(); }
+	int heatmapLevel() const { return heatLevel; }
+	int meshLevel() const;
+
+private:
+	struct Level {
+		int cols, rows;
+		vector<float> z;  //row major
+	};
+	struct State {
+		float x, y, z;
+	};
+
+	void project(float u, float v, float w, const DeviceRectType& r, int& px, int& py) const;
+	void heatmapPoint(float x, float y, const DeviceRectType& r, int& px, int& py) const;
+
+	int meshLines;
+	vector<Level> levels;
+	float x0, x1, y0, y1, zMin, zMax;
+	float yawAngle, pitchAngle;
+	float sinYaw, cosYaw, sinPitch, cosPitch;
+
+	bgiemu_image* heatmap;  //the last heatmap drawn
+	DeviceRectType heatRect;
+	int heatLevel;
+	bool heatmapReady;
+
+	vector<State> trajectory;
+};
+
+
+#endif
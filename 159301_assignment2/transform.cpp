@@ -1,4 +1,9 @@
 #include "transform.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define TRANSFORM_SSE2
+#endif
  
 
 using namespace std;
@@ -33,8 +38,123 @@ int yDev(BoundaryType WorldBound,BoundaryType DevBound,float yworld)
 }
 
 
+/////////////////////////////////////////////////////////////////////////////////
+// ViewportTransform
+
+ViewportTransform::ViewportTransform()
+{
+    BoundaryType unit = { 0.0f, 0.0f, 1.0f, 1.0f };
+    set(unit, unit);
+}
+
+ViewportTransform::ViewportTransform(const BoundaryType& world, const BoundaryType& dev)
+{
+    set(world, dev);
+}
+
+void ViewportTransform::set(const BoundaryType& world, const BoundaryType& dev)
+{
+    //same arithmetic as xDev/yDev, so the pixels do not move
+    if((world.x2-world.x1) == 0)
+      baseSx = (dev.x2-dev.x1)/(world.x2-world.x1+.001);
+    else
+      baseSx = (dev.x2-dev.x1)/(world.x2-world.x1);
+    baseTx = dev.x1-baseSx*world.x1;
+
+    if((world.y2-world.y1) == 0.0)
+       baseSy = (dev.y2-dev.y1)/(world.y2-world.y1+.001);
+    else
+       baseSy = (dev.y2-dev.y1)/(world.y2-world.y1);
+    baseTy = dev.y1-baseSy*world.y1;
+
+    centreX = (dev.x1+dev.x2)/2;
+    centreY = (dev.y1+dev.y2)/2;
+    zoom = 1.0f;
+    panX = panY = 0.0f;
+    update();
+}
+
+void ViewportTransform::setView(float zoom_, float panX_, float panY_)
+{
+    zoom = zoom_;
+    panX = panX_;
+    panY = panY_;
+    update();
+}
+
+void ViewportTransform::update()
+{
+    if (zoom == 1.0f && panX == 0.0f && panY == 0.0f) {
+       sx = baseSx; tx = baseTx;
+       sy = baseSy; ty = baseTy;
+       return;
+    }
+    sx = baseSx*zoom;
+    tx = centreX + (baseTx-centreX)*zoom + panX;
+    sy = baseSy*zoom;
+    ty = centreY + (baseTy-centreY)*zoom + panY;
+}
+
+void ViewportTransform::map(const float world[], int dev[], int n_points) const
+{
+    int i = 0;
+#ifdef TRANSFORM_SSE2
+    //two interleaved points per register; ceil from truncation, which
+    //rounds towards zero, plus one where that landed below the value
+    __m128 scale = _mm_setr_ps(sx, sy, sx, sy);
+    __m128 offset = _mm_setr_ps(tx, ty, tx, ty);
+    __m128i one = _mm_set1_epi32(1);
+    for (; i + 2 <= n_points; i += 2) {
+       __m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(world + 2*i), scale), offset);
+       __m128i t = _mm_cvttps_epi32(v);
+       __m128i below = _mm_castps_si128(_mm_cmplt_ps(_mm_cvtepi32_ps(t), v));
+       t = _mm_add_epi32(t, _mm_and_si128(below, one));
+       _mm_storeu_si128((__m128i*)(dev + 2*i), t);
+    }
+#endif
+    for (; i < n_points; i++) {
+       dev[2*i] = x(world[2*i]);
+       dev[2*i+1] = y(world[2*i+1]);
+    }
+}
+
+
 float degToRad(float deg) {
 	return(deg * M_PI / 180.0);
 }
 
 
+
+/////////////////////////////////////////////////////////////////////////////////
+// Device Rectangles
+
+DeviceRectType polygonBounds(int n_points, const int poly[])
+{
+    DeviceRectType r = { poly[0], poly[1], poly[0], poly[1] };
+    for (int i = 1; i < n_points; i++) {
+       r.x1 = min(r.x1, poly[2*i]);
+       r.x2 = max(r.x2, poly[2*i]);
+       r.y1 = min(r.y1, poly[2*i+1]);
+       r.y2 = max(r.y2, poly[2*i+1]);
+    }
+    return r;
+}
+
+DeviceRectType circleBounds(int x, int y, int radius)
+{
+    DeviceRectType r = { x - radius, y - radius, x + radius, y + radius };
+    return r;
+}
+
+DeviceRectType unionRect(const DeviceRectType& a, const DeviceRectType& b)
+{
+    if (a.x1 > a.x2 || a.y1 > a.y2) return b;
+    if (b.x1 > b.x2 || b.y1 > b.y2) return a;
+    DeviceRectType r = { min(a.x1, b.x1), min(a.y1, b.y1), max(a.x2, b.x2), max(a.y2, b.y2) };
+    return r;
+}
+
+bool rectsOverlap(const DeviceRectType& a, const DeviceRectType& b)
+{
+    return a.x1 <= b.x2 && b.x1 <= a.x2 && a.y1 <= b.y2 && b.y1 <= a.y2;
+}
@@ -3,18 +3,58 @@
 
 
 #include <math.h>
+#include <algorithm>
  
 
 using namespace std;
 
+#ifndef M_PI
 const float M_PI = 3.14159265358979323846f;  //use M_PI from math.h instead
+#endif
 
 typedef struct
 {
   float x1,y1,x2,y2;
 } BoundaryType; 
 
+//Inclusive pixel rectangle; empty when x1 > x2 or y1 > y2
+typedef struct
+{
+  int x1,y1,x2,y2;
+} DeviceRectType;
+
+
+
+//World-to-device mapping with the slope and intercept worked out once:
+//  xdev = ceil(sx*xworld + tx),  ydev = ceil(sy*yworld + ty)
+//which gives the same pixels as xDev/yDev.  A zoom about the centre of the
+//device boundary and a pan in pixels can be layered on top.
+class ViewportTransform
+{
+public:
+    ViewportTransform();
+    ViewportTransform(const BoundaryType& world, const BoundaryType& dev);
 
+    void set(const BoundaryType& world, const BoundaryType& dev);
+    void setView(float zoom, float panX, float panY);
+
+    int x(float xworld) const { return (int)ceil(sx*xworld + tx); }
+    int y(float yworld) const { return (int)ceil(sy*yworld + ty); }
+
+    //Device pixels per world unit along x (for radii)
+    float xScale() const { return sx; }
+    float yScale() const { return sy; }
+
+    //n_points (x, y) pairs; SSE2 does two points per step where available
+    void map(const float world[], int dev[], int n_points) const;
+
+private:
+    void update();
+
+    float baseSx, baseTx, baseSy, baseTy;  //from the boundaries
+    float centreX, centreY, zoom, panX, panY;
+    float sx, tx, sy, ty;  //with the view applied
+};
 
 /// Function Prototypes ////////////////////////////////////////////////////////////////////
 
@@ -22,6 +62,11 @@ float degToRad(float deg);
 int xDev(BoundaryType WorldBound,BoundaryType DevBound,float xworld);
 int yDev(BoundaryType WorldBound,BoundaryType DevBound,float yworld);
 
+DeviceRectType polygonBounds(int n_points, const int poly[]);
+DeviceRectType circleBounds(int x, int y, int radius);
+DeviceRectType unionRect(const DeviceRectType& a, const DeviceRectType& b);
+bool rectsOverlap(const DeviceRectType& a, const DeviceRectType& b);
+
 
 #endif
 